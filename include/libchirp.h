@@ -10,6 +10,12 @@
 #include "libchirp/message.h"
 #include "libchirp/chirp.h"
 #include "libchirp/encryption.h"
+#include "libchirp/histogram.h"
+#include "libchirp/ring.h"
+#include "libchirp/router.h"
+#include "libchirp/schedule.h"
+#include "libchirp/state.h"
+#include "libchirp/stats.h"
 
 // .. c:var:: extern char* ch_version
 //
@@ -59,9 +59,23 @@ typedef void (*ch_log_cb_t)(char msg[], char error);
 //
 //    Called by chirp when message is sent and can be freed.
 //
+//    .. c:member:: ch_chirp_t* chirp
+//
+//       Pointer to the chirp object.
+//
+//    .. c:member:: ch_message_t* msg
+//
+//       The message that has been sent.
+//
 //    .. c:member:: int status
 //
-//       Is CH_SUCCESS, CH_TIMEOUT, TODO list errors
+//       CH_SUCCESS if the remote acknowledged the message (or it was written
+//       if ACKNOWLEDGE is off). CH_TIMEOUT, CH_PROTOCOL_ERROR if the
+//       connection broke, CH_CANNOT_CONNECT or CH_OVERLOADED otherwise.
+//       Errors of the connection are reported after the retries, see
+//       :c:member:`ch_config_t.RETRIES`. CH_UV_ERROR if the spool could
+//       not be written, see :c:member:`ch_config_t.SPOOL_DIR`. CH_UNINIT if
+//       chirp is closing.
 //
 //    .. c:member:: float load
 //
@@ -72,7 +86,14 @@ typedef void (*ch_log_cb_t)(char msg[], char error);
 //
 // .. code-block:: cpp
 //
-typedef void (*ch_send_cb_t)(int status, float load);
+struct ch_chirp_s;
+struct ch_message_s;
+typedef void (*ch_send_cb_t)(
+        struct ch_chirp_s* chirp,
+        struct ch_message_s* msg,
+        int status,
+        float load
+);
 
 // .. c:type:: ch_realloc_cb_t
 //
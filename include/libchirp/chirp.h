@@ -33,7 +33,22 @@
 //
 //    .. c:member:: float TIMEOUT
 //
-//       General IO related timeout.
+//       General IO related timeout in seconds. Connecting times out after
+//       TIMEOUT. The send timeout adapts to the round trip time and the
+//       throughput of the connection, TIMEOUT is its upper bound.
+//
+//    .. c:member:: float WATCH_INTERVAL
+//
+//       Interval in seconds the watcher checks if peers are alive. Peers that
+//       sent nothing during an interval get a ping. 0 disables the watcher,
+//       by default 5.
+//
+//    .. c:member:: float MAX_LAG
+//
+//       Admission control: if the loop lags more than MAX_LAG seconds, new
+//       connections are not accepted and new messages fail with
+//       :c:member:`ch_error_t.CH_OVERLOADED`, until the lag dropped below
+//       half of MAX_LAG. 0 disables admission control, by default 0.
 //
 //    .. c:member:: uint16_t PORT
 //
@@ -45,7 +60,15 @@
 //
 //    .. c:member:: uint8_t RETRIES
 //
-//       Count of retries till error is reported, by default 1.
+//       Count of retries till error is reported, by default 1. A message
+//       whose connection failed is sent again after an exponential backoff
+//       with jitter. Peers that failed repeatedly are considered down for a
+//       while, sends to them fail at once with CH_CANNOT_CONNECT.
+//
+//    .. c:member:: uint8_t WATCH_MISSES
+//
+//       Count of intervals a peer may be silent until it is considered dead,
+//       by default 3.
 //
 //    .. c:member:: uint8_t MAX_HANDLERS
 //
@@ -54,20 +77,39 @@
 //
 //    .. c:member:: char ACKNOWLEDGE
 //
-//       Acknowledge messages. Is needed for retry and flow-control. Disabling
-//       acknowledge can improve performance on long delay connections, but at
-//       the risk of overloading the remote and the local machine. You have to
-//       set RETRIES and FLOW_CONTROL to 0 or chirp won't accept the config.
+//       Acknowledge messages. Is needed for retry. Disabling acknowledge can
+//       improve performance on long delay connections, but at the risk of
+//       overloading the remote and the local machine. You have to set RETRIES
+//       to 0 or chirp won't accept the config.
 //
 //    .. c:member:: char FLOW_CONTROL
 //
 //       Flow control prevents overloading of a node in a chain for workers.
-//       Default: 1.
+//       The remote grants credits for its free handler buffers in the
+//       handshake and every ack returns one. The writer sends as many
+//       messages as it has credits without waiting for acks, further
+//       messages stay queued, see :c:func:`ch_chirp_get_credits`. Without
+//       flow control the writer waits for the ack of every message. When all
+//       handler buffers of a connection are used, chirp stops reading from
+//       it until a message is released. The data stays in the kernel buffer
+//       and TCP pushes back on the sender. Without flow control the
+//       connection is shut down. Default: 1.
 //
 //    .. c:member:: char CLOSE_ON_SIGINT
 //
 //       By default chirp closes on SIGINT (Ctrl-C).
 //
+//    .. c:member:: char DISABLE_ENCRYPTION
+//
+//       Don't use TLS, for trusted networks and benchmarks. All nodes must
+//       use the same setting. Default: 0.
+//
+//    .. c:member:: char COMPACT_WIRE
+//
+//       Use the compact frame encoding (varint lengths, identities sent
+//       recently are referred to by index) on connections to nodes that
+//       support it. It is negotiated in the handshake. Default: 1.
+//
 //    .. c:member:: uint32_t BUFFER_SIZE
 //
 //       Size of the buffer used for a connection. Defaults to 0, which means
@@ -94,24 +136,38 @@
 //
 //       Holds the path to the file containing DH parameters.
 //
+//    .. c:member:: char* SPOOL_DIR
+//
+//       Directory of the write-ahead spool. If set, messages sent are synced
+//       to the spool before they are sent, and messages not acknowledged are
+//       sent again when chirp is started the next time (at-least-once
+//       delivery). Their send callbacks are gone then: failures are logged.
+//       Default: NULL, no spool.
+//
 // .. code-block:: cpp
 //
 typedef struct ch_config_s {
     float           REUSE_TIME;
     float           TIMEOUT;
+    float           WATCH_INTERVAL;
+    float           MAX_LAG;
     uint16_t        PORT;
     uint8_t         BACKLOG;
     uint8_t         RETRIES;
+    uint8_t         WATCH_MISSES;
     uint8_t         MAX_HANDLERS;
     char            ACKNOWLEDGE;
     char            FLOW_CONTROL;
     char            CLOSE_ON_SIGINT;
+    char            DISABLE_ENCRYPTION;
+    char            COMPACT_WIRE;
     uint32_t        BUFFER_SIZE;
     uint8_t         BIND_V6[16];
     uint8_t         BIND_V4[4];
     uint8_t         IDENTITY[16];
     char*           CERT_CHAIN_PEM;
     char*           DH_PARAMS_PEM;
+    char*           SPOOL_DIR;
 } ch_config_t;
 
 // .. c:type:: ch_chirp_int_t
@@ -156,6 +212,93 @@ typedef struct ch_identity_s {
     unsigned char data[16];
 } ch_identity_t;
 
+// .. c:type:: ch_peer_dead_cb_t
+//
+//    Called by chirp when the watcher considers a peer dead. The connection
+//    to the peer has been shut down. Use this to remove the peer from routers
+//    and rings.
+//
+//    .. c:member:: ch_chirp_t* chirp
+//
+//       Pointer to the chirp object.
+//
+//    .. c:member:: ch_ip_protocol_t ip_protocol
+//
+//       IP protocol of the address.
+//
+//    .. c:member:: const uint8_t* address
+//
+//       IPv4/6 address of the peer (4 or 16 bytes).
+//
+//    .. c:member:: int32_t port
+//
+//       The public port of the peer.
+//
+// .. code-block:: cpp
+//
+typedef void (*ch_peer_dead_cb_t)(
+        ch_chirp_t* chirp,
+        ch_ip_protocol_t ip_protocol,
+        const uint8_t* address,
+        int32_t port
+);
+
+// .. c:type:: ch_recv_cb_t
+//
+//    Called by chirp when a message has been received. The message and its
+//    buffers belong to chirp: call :c:func:`ch_chirp_release_message` when
+//    done with it. Until then the handler buffer stays used, see
+//    :c:member:`ch_config_t.MAX_HANDLERS`.
+//
+//    .. c:member:: ch_chirp_t* chirp
+//
+//       Pointer to the chirp object.
+//
+//    .. c:member:: ch_message_t* msg
+//
+//       The message received.
+//
+// .. code-block:: cpp
+//
+typedef void (*ch_recv_cb_t)(ch_chirp_t* chirp, ch_message_t* msg);
+
+// .. c:type:: ch_recv_stream_cb_t
+//
+//    Called by chirp with a chunk of the data of a streamed message, see
+//    :c:func:`ch_chirp_set_recv_stream_cb`. The chunk points into the read
+//    buffer of the connection and is only valid during the callback. Header
+//    and actor of the message are complete.
+//
+//    .. c:member:: ch_chirp_t* chirp
+//
+//       Pointer to the chirp object.
+//
+//    .. c:member:: ch_message_t* msg
+//
+//       The message being received.
+//
+//    .. c:member:: const ch_buf* data
+//
+//       The chunk of data.
+//
+//    .. c:member:: uint32_t len
+//
+//       Length of the chunk.
+//
+//    .. c:member:: uint32_t offset
+//
+//       Offset of the chunk in the data of the message.
+//
+// .. code-block:: cpp
+//
+typedef void (*ch_recv_stream_cb_t)(
+        ch_chirp_t* chirp,
+        ch_message_t* msg,
+        const ch_buf* data,
+        uint32_t len,
+        uint32_t offset
+);
+
 // .. c:function::
 extern
 void
@@ -180,6 +323,30 @@ ch_chirp_close_ts(ch_chirp_t* chirp);
 //    :return: A chirp error. See: :c:type:`ch_error_t`.
 //    :rtype: ch_error_t
 
+// .. c:function::
+extern
+int
+ch_chirp_get_credits(
+        ch_chirp_t* chirp,
+        ch_ip_protocol_t ip_protocol,
+        const uint8_t* address,
+        int32_t port
+);
+//
+//    Get the credits left on the connection to a node: the count of messages
+//    that are written right away, before chirp has to wait for an ack of the
+//    node. A node without credits has all its handler buffers in use, so
+//    the application can route to another node. Must be called on the loop
+//    thread.
+//
+//    :param ch_chirp_t* chirp:            Pointer to a chirp object.
+//    :param ch_ip_protocol_t ip_protocol: IP protocol of the address.
+//    :param uint8_t* address:             IPv4/6 address of the node.
+//    :param int32_t port:                 The public port of the node.
+//
+//    :return: the credits or -1 if chirp is not connected to the node.
+//    :rtype:  int
+
 // .. c:function::
 extern
 ch_identity_t
@@ -204,6 +371,20 @@ ch_chirp_get_loop(ch_chirp_t* chirp);
 //    :return: a pointer to a libuv event loop object.
 //    :rtype:  uv_loop_t*
 
+// .. c:function::
+extern
+float
+ch_chirp_get_loop_lag(ch_chirp_t* chirp);
+//
+//    Get the lag of the loop, the time timers fire late. The lag is smoothed
+//    over a few measurements. Chirp adds it to the load passed to
+//    :c:type:`ch_send_cb_t`.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//
+//    :return: the lag in seconds
+//    :rtype:  float
+
 // .. c:function::
 extern
 ch_error_t
@@ -260,6 +441,17 @@ ch_chirp_register_log_cb(ch_chirp_t* chirp, ch_log_cb_t log_cb)
     chirp->_log = log_cb;
 }
 
+// .. c:function::
+extern
+void
+ch_chirp_release_message(ch_message_t* msg);
+//
+//    Release a message passed to :c:type:`ch_recv_cb_t`. This frees the
+//    handler buffer of the message and acknowledges the message to the
+//    sender. Must be called on the loop thread.
+//
+//    :param ch_message_t* msg: The message received.
+
 // .. c:function::
 extern
 ch_error_t
@@ -294,7 +486,12 @@ void
 ch_chirp_send(ch_chirp_t* chirp, ch_message_t* msg, ch_send_cb_t send_cb);
 //
 //    Send a message. Messages can be sent in parallel to different nodes.
-//    Messages to the same node will block if you don't wait for the callback.
+//    Messages to the same node are queued and sent one after the other. With
+//    :c:member:`ch_config_t.FLOW_CONTROL` the next message is written while
+//    the previous ones wait for their acks, as long as the remote has credits
+//    left, otherwise when the remote acknowledged the previous one.
+//    If there is no connection to the node, chirp connects. Must be called
+//    on the loop thread.
 //
 //    If you don't want to allocate messages on sending, we recommend to use a
 //    pool of messages.
@@ -319,6 +516,49 @@ ch_chirp_set_auto_stop_loop(ch_chirp_t* chirp);
 //    This function is thread-safe.
 //
 //    :param ch_chirp_t* chirp: Pointer to a chirp object.
+
+// .. c:function::
+extern
+void
+ch_chirp_set_peer_dead_cb(ch_chirp_t* chirp, ch_peer_dead_cb_t dead_cb);
+//
+//    Set the callback called when the watcher considers a peer dead.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    :param ch_peer_dead_cb_t dead_cb: The callback, can be NULL.
+
+// .. c:function::
+extern
+void
+ch_chirp_set_recv_cb(ch_chirp_t* chirp, ch_recv_cb_t recv_cb);
+//
+//    Set the callback called when a message has been received. Without
+//    callback received messages are released right away.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    :param ch_recv_cb_t recv_cb: The callback, can be NULL.
+
+// .. c:function::
+extern
+void
+ch_chirp_set_recv_stream_cb(
+        ch_chirp_t* chirp,
+        ch_recv_stream_cb_t stream_cb,
+        uint32_t min_data_len
+);
+//
+//    Stream the data of received messages with at least **min_data_len**
+//    bytes of data. The data is not buffered, it is passed to **stream_cb**
+//    in chunks as it arrives. When all data has arrived the message is passed
+//    to :c:type:`ch_recv_cb_t` as usual, with
+//    :c:member:`ch_message_t.streamed` set and no data. The message is
+//    acknowledged when it is released, so a slow consumer slows down the
+//    sender.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    :param ch_recv_stream_cb_t stream_cb: The callback, NULL disables
+//                                          streaming.
+//    :param uint32_t min_data_len: Minimum length of data to stream.
 //
 // .. code-block:: cpp
 
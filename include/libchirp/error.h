@@ -62,6 +62,15 @@
 //       the user, but often it might only be logged. In debug mode it is
 //       asserted.
 //
+//    .. c:member:: CH_CANNOT_CONNECT
+//
+//       Connecting to the remote failed.
+//
+//    .. c:member:: CH_OVERLOADED
+//
+//       The loop lags more than :c:member:`ch_config_t.MAX_LAG`, chirp sheds
+//       load instead of timing out.
+//
 // .. code-block:: cpp
 //
 typedef enum {
@@ -76,6 +85,8 @@ typedef enum {
     CH_IN_PRORESS     = 8,
     CH_TIMEOUT        = 9,
     CH_ENOMEM         = 10,
+    CH_CANNOT_CONNECT = 11,
+    CH_OVERLOADED     = 12,
 } ch_error_t;
 
 #endif //ch_libchirp_error_h
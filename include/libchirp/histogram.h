@@ -0,0 +1,185 @@
+// ==========
+// Histograms
+// ==========
+//
+// Latency histograms of the stages of sending and receiving messages. Chirp
+// always records them, so p99 latencies can be broken down by stage.
+//
+// The histograms are log-bucketed like HDR histograms: every power of two is
+// split into 2^CH_HG_SUB_BITS buckets, so a recorded value is off by at most
+// 1/2^CH_HG_SUB_BITS (12.5%). Values are nanoseconds and buckets cover the
+// whole uint64_t range, so no value gets lost.
+//
+// Histograms of different chirp instances (or processes) can be merged,
+// because all histograms have the same buckets.
+//
+// .. code-block:: cpp
+//
+#ifndef ch_libchirp_histogram_h
+#define ch_libchirp_histogram_h
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "common.h"
+#include "chirp.h"
+
+// Declarations
+// ============
+
+// .. c:macro:: CH_HG_SUB_BITS
+//
+//    Every power of two is split into 2^CH_HG_SUB_BITS buckets.
+//
+// .. c:macro:: CH_HG_BUCKETS
+//
+//    Count of buckets of a histogram.
+//
+// .. code-block:: cpp
+//
+#define CH_HG_SUB_BITS 3
+#define CH_HG_BUCKETS ((64 - CH_HG_SUB_BITS + 1) << CH_HG_SUB_BITS)
+
+// .. c:type:: ch_hg_stage_t
+//
+//    Stages timed by chirp.
+//
+//    .. c:member:: CH_HG_QUEUE
+//
+//       Waiting for the writer of the connection.
+//
+//    .. c:member:: CH_HG_WIRE_HEADER
+//
+//       Writing the wire header (:c:type:`ch_msg_message_t`).
+//
+//    .. c:member:: CH_HG_HEADER
+//
+//       Writing the header of the message.
+//
+//    .. c:member:: CH_HG_ACTOR
+//
+//       Writing the actor of the message.
+//
+//    .. c:member:: CH_HG_DATA
+//
+//       Writing the data of the message.
+//
+//    .. c:member:: CH_HG_ACK
+//
+//       Round trip of the acknowledge, from the last write until the ack
+//       arrived.
+//
+//    .. c:member:: CH_HG_RECEIVE
+//
+//       Receiving a message, from its first byte until it is complete.
+//
+//    .. c:member:: CH_HG_STAGES
+//
+//       Count of stages.
+//
+// .. code-block:: cpp
+//
+typedef enum {
+    CH_HG_QUEUE       = 0,
+    CH_HG_WIRE_HEADER = 1,
+    CH_HG_HEADER      = 2,
+    CH_HG_ACTOR       = 3,
+    CH_HG_DATA        = 4,
+    CH_HG_ACK         = 5,
+    CH_HG_RECEIVE     = 6,
+    CH_HG_STAGES      = 7,
+} ch_hg_stage_t;
+
+// .. c:type:: ch_histogram_t
+//
+//    A log-bucketed histogram.
+//
+//    .. c:member:: uint64_t count
+//
+//       Count of recorded values.
+//
+//    .. c:member:: uint64_t sum
+//
+//       Sum of the recorded values, for the mean.
+//
+//    .. c:member:: uint64_t max
+//
+//       Largest recorded value.
+//
+//    .. c:member:: uint64_t buckets[CH_HG_BUCKETS]
+//
+//       Count of values per bucket.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_histogram_s {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[CH_HG_BUCKETS];
+} ch_histogram_t;
+
+// .. c:function::
+extern
+void
+ch_chirp_get_histograms(
+        ch_chirp_t* chirp,
+        ch_histogram_t histograms[CH_HG_STAGES],
+        int reset
+);
+//
+//    Copy the histograms of a chirp instance. Must be called on the loop
+//    thread, like :c:func:`ch_chirp_get_stats`.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    :param ch_histogram_t histograms[CH_HG_STAGES]: Out: The histograms,
+//                                  indexed by :c:type:`ch_hg_stage_t`.
+//    :param int reset: If 1 the histograms of chirp are cleared, so the
+//                      next snapshot covers the next interval only.
+
+// .. c:function::
+extern
+void
+ch_hg_merge(ch_histogram_t* dest, const ch_histogram_t* src);
+//
+//    Add the values of **src** to **dest**.
+//
+//    :param ch_histogram_t* dest: The histogram to add to.
+//    :param ch_histogram_t* src: The histogram to add.
+
+// .. c:function::
+extern
+uint64_t
+ch_hg_percentile(const ch_histogram_t* histogram, double percentile);
+//
+//    Get the value at or below which **percentile** percent of the values
+//    are. Like HDR histograms, the upper bound of the bucket is returned.
+//
+//    :param ch_histogram_t* histogram: The histogram.
+//    :param double percentile: The percentile (0 - 100), for example 99.
+//
+//    :return: the value, 0 if the histogram is empty
+//    :rtype:  uint64_t
+
+// .. c:function::
+extern
+void
+ch_hg_record(ch_histogram_t* histogram, uint64_t value);
+//
+//    Record a value.
+//
+//    :param ch_histogram_t* histogram: The histogram.
+//    :param uint64_t value: The value, chirp records nanoseconds.
+
+// .. c:function::
+extern
+void
+ch_hg_reset(ch_histogram_t* histogram);
+//
+//    Clear a histogram. Use it to initialize histograms too.
+//
+//    :param ch_histogram_t* histogram: The histogram.
+
+#endif //ch_libchirp_histogram_h
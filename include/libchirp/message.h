@@ -15,6 +15,7 @@
 // .. code-block:: cpp
 //
 #include "common.h"
+#include "callbacks.h"
 
 // System includes
 // ===============
@@ -31,6 +32,37 @@
 // Declarations
 // ============
 
+// .. c:type:: ch_msg_types_t
+//
+//    Flags for :c:member:`ch_message_t.message_type`.
+//
+//    .. c:member:: CH_MSG_REQ_ACK
+//
+//       The sender expects an ack for the message.
+//
+//    .. c:member:: CH_MSG_ACK
+//
+//       The message is an ack.
+//
+//    .. c:member:: CH_MSG_PING
+//
+//       The message is a ping of the watcher, it has no payload and is not
+//       delivered to the user.
+//
+//    .. c:member:: CH_MSG_PONG
+//
+//       The message answers a ping, it has no payload and is not delivered to
+//       the user.
+//
+// .. code-block:: cpp
+//
+typedef enum {
+    CH_MSG_REQ_ACK = 1 << 0,
+    CH_MSG_ACK     = 1 << 1,
+    CH_MSG_PING    = 1 << 2,
+    CH_MSG_PONG    = 1 << 3,
+} ch_msg_types_t;
+
 // .. c:macro:: CH_WIRE_MESSAGE
 //
 //    Defines a chirp-wire message.
@@ -111,18 +143,56 @@
 //
 //    .. c:member:: int8_t free_header
 //
-//       Unused.
-//       .. todo:: Unused.
+//       Set if the header of a received message did not fit into the
+//       preallocated buffer. It gets freed by
+//       :c:func:`ch_chirp_release_message`.
 //
 //    .. c:member:: int8_t free_actor
 //
-//       Unused.
-//       .. todo:: Unused.
+//       Set if the actor of a received message did not fit into the
+//       preallocated buffer. It gets freed by
+//       :c:func:`ch_chirp_release_message`.
 //
 //    .. c:member:: int8_t free_data
 //
-//       Unused.
-//       .. todo:: Unused.
+//       Set if the data of a received message did not fit into the
+//       preallocated buffer. It gets freed by
+//       :c:func:`ch_chirp_release_message`.
+//
+//    .. c:member:: int8_t streamed
+//
+//       Set if the data of a received message has been passed to
+//       :c:type:`ch_recv_stream_cb_t` as it arrived. :c:member:`data` is NULL
+//       then, :c:member:`data_len` is the total length.
+//
+//    .. c:member:: ch_send_cb_t _send_cb
+//
+//       Private: Callback of the message while it is sent.
+//
+//    .. c:member:: struct ch_message_s* _next
+//
+//       Private: Next message in the queue of a writer.
+//
+//    .. c:member:: void* _handler
+//
+//       Private: Handler buffer of a received message, see
+//       :c:func:`ch_chirp_release_message`.
+//
+//    .. c:member:: uint64_t _stamp
+//
+//       Private: Time (uv_hrtime) the message was queued. Once written, the
+//       start of the acknowledge round trip. While waiting for a retry, the
+//       loop time (ms) the retry is due.
+//
+//    .. c:member:: uint8_t _retries
+//
+//       Private: Count of retries of the message, see
+//       :c:member:`ch_config_t.RETRIES`.
+//
+//    .. c:member:: void* _spool
+//
+//       Private: Spool segment of the message until it is done, see
+//       :c:member:`ch_config_t.SPOOL_DIR`.
 //
 // .. code-block:: cpp
 //
@@ -140,6 +210,14 @@ typedef struct ch_message_s {
     int8_t   free_header;
     int8_t   free_actor;
     int8_t   free_data;
+    int8_t   streamed;
+    // Private
+    ch_send_cb_t         _send_cb;
+    struct ch_message_s* _next;
+    void*                _handler;
+    uint64_t             _stamp;
+    uint8_t              _retries;
+    void*                _spool;
 } ch_message_t;
 
 // .. c:type:: ch_msg_message_t
@@ -152,6 +230,30 @@ typedef struct ch_msg_message_s {
     CH_WIRE_MESSAGE;
 } ch_msg_message_t;
 
+// .. c:type:: ch_msg_pool_item_t
+//    :noindex:
+//
+//    Opaque pointer to a message of a pool with its buffers.
+//
+//    see: :c:type:`ch_msg_pool_item_t`
+//
+// .. code-block:: cpp
+//
+typedef struct ch_msg_pool_item_s ch_msg_pool_item_t;
+
+// .. c:type:: ch_msg_pool_t
+//
+//    Pool of messages, see :c:func:`ch_msg_pool_acquire`. A pool is not
+//    thread-safe, use one pool per thread. It has no public members.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_msg_pool_s {
+    ch_msg_pool_item_t* _free;
+    uint32_t            _count;
+    uint32_t            _max;
+} ch_msg_pool_t;
+
 // .. c:type:: ch_text_address_t
 //
 //    Type to be used with :c:func:`ch_msg_get_address`. Used for the textual
@@ -215,13 +317,81 @@ extern
 ch_error_t
 ch_msg_init(ch_message_t* message);
 //
-//    Initialize a message. Memory provided by caller (for performance).
+//    Initialize a message. Memory provided by caller (for performance). To
+//    recycle messages and their buffers, see :c:func:`ch_msg_pool_acquire`.
 //
 //    :param ch_message_t* message: Pointer to the message
 //
 //    :return: A chirp error. see: :c:type:`ch_error_t`
 //    :rtype:  ch_error_t
 
+// .. c:function::
+extern
+ch_error_t
+ch_msg_pool_acquire(
+    ch_msg_pool_t* pool,
+    ch_message_t** message,
+    uint16_t header_len,
+    uint16_t actor_len,
+    uint32_t data_len
+);
+//
+//    Get a message from the pool, or allocate one if the pool is empty. The
+//    message is initialized like by :c:func:`ch_msg_init`, but header, actor
+//    and data point to buffers of the given lengths, owned by the message,
+//    and their lengths are set. A buffer is NULL if its length is 0. The
+//    buffers are reused, so a recycled message only allocates when a buffer
+//    has to grow.
+//
+//    The buffers may be replaced by buffers of the user. Set
+//    :c:member:`ch_message_t.free_header` (free_actor, free_data) if the
+//    buffer was allocated by the alloc function of chirp (see
+//    :c:func:`ch_set_alloc_funcs`) and shall be freed on release.
+//
+//    :param ch_msg_pool_t* pool: Pointer to the pool.
+//    :param ch_message_t** message: Out: The message.
+//    :param uint16_t header_len: Length of the header buffer.
+//    :param uint16_t actor_len: Length of the actor buffer.
+//    :param uint32_t data_len: Length of the data buffer.
+//
+//    :return: A chirp error. see: :c:type:`ch_error_t`
+//    :rtype:  ch_error_t
+
+// .. c:function::
+extern
+void
+ch_msg_pool_free(ch_msg_pool_t* pool);
+//
+//    Free the pool and the messages in it. Messages acquired and not
+//    released are not freed.
+//
+//    :param ch_msg_pool_t* pool: Pointer to the pool.
+
+// .. c:function::
+extern
+void
+ch_msg_pool_init(ch_msg_pool_t* pool, uint32_t max);
+//
+//    Initialize a pool. Memory provided by caller. You must call
+//    :c:func:`ch_msg_pool_free` to cleanup the pool.
+//
+//    :param ch_msg_pool_t* pool: Pointer to the pool.
+//    :param uint32_t max: Maximum count of messages kept in the pool, more
+//                         messages released are freed.
+
+// .. c:function::
+extern
+void
+ch_msg_pool_release(ch_msg_pool_t* pool, ch_message_t* message);
+//
+//    Return a message acquired from the pool, usually in the send callback.
+//    The message must not be used anymore, it must not be sent or waiting
+//    for a retry. Buffers of the user that are flagged by
+//    :c:member:`ch_message_t.free_header` (free_actor, free_data) are freed.
+//
+//    :param ch_msg_pool_t* pool: Pointer to the pool.
+//    :param ch_message_t* message: The message to return.
+
 // .. c:function::
 extern
 ch_error_t
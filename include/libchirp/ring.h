@@ -0,0 +1,195 @@
+// ====
+// Ring
+// ====
+//
+// Binds messages to nodes using a key. Implements BoundMessage of RFC 01: all
+// messages with the same key go to the same node, as long as the node is on
+// the ring. So the caches of the actor on that node stay warm.
+//
+// The ring uses consistent hashing: every node is placed on the ring
+// :c:macro:`CH_RG_VNODES` times (virtual nodes) and a key belongs to the first
+// virtual node following the hash of the key. If a node fails it is removed
+// from the ring and only the keys of that node move to other nodes; all other
+// keys stay bound.
+//
+// Lookups read an immutable snapshot of the ring and never wait for a lock,
+// they may be called from any thread. Adding and removing nodes builds a new
+// snapshot and publishes it atomically. Replaced snapshots are freed as soon
+// as no lookup is running.
+//
+// The ring doesn't watch its nodes. Remove failed nodes yourself, for
+// example in the callback set by :c:func:`ch_chirp_set_peer_dead_cb`:
+//
+// .. code-block:: cpp
+//
+//    static void
+//    peer_dead_cb(
+//            ch_chirp_t* chirp,
+//            ch_ip_protocol_t ip_protocol,
+//            const uint8_t* address,
+//            int32_t port
+//    ) {
+//        char text[INET6_ADDRSTRLEN];
+//        uv_inet_ntop(
+//            ip_protocol == CH_IPV6 ? AF_INET6 : AF_INET,
+//            address,
+//            text,
+//            sizeof(text)
+//        );
+//        ch_rg_remove_node_ts(&ring, ip_protocol, text, port);
+//    }
+//
+//
+// .. code-block:: cpp
+//
+#ifndef ch_libchirp_ring_h
+#define ch_libchirp_ring_h
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "common.h"
+#include "callbacks.h"
+#include "chirp.h"
+#include "message.h"
+
+// Declarations
+// ============
+
+// .. c:type:: ch_ring_int_t
+//    :noindex:
+//
+//    Opaque pointer to internals.
+//
+//    see: :c:type:`ch_ring_int_t`
+//
+// .. code-block:: cpp
+//
+typedef struct ch_ring_int_s ch_ring_int_t;
+
+// .. c:type:: ch_ring_t
+//
+//    Ring object. It has no public members and uses an opaque pointer to its
+//    internal data structures.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_ring_s {
+    ch_ring_int_t* _;
+} ch_ring_t;
+
+// .. c:function::
+extern
+ch_error_t
+ch_rg_add_node_ts(
+        ch_ring_t* ring,
+        ch_ip_protocol_t ip_protocol,
+        const char* address,
+        int32_t port
+);
+//
+//    Add a node to the ring. Adding a node twice has no effect. Thread-safe.
+//
+//    :param ch_ring_t* ring: Pointer to a ring object.
+//    :param ch_ip_protocol_t ip_protocol: IP-protocol of the address
+//    :param char* address: Textual representation of IP
+//    :param int32_t port: Port of the node
+//
+//    :return: A chirp error. See: :c:type:`ch_error_t`.
+//    :rtype: ch_error_t
+
+// .. c:function::
+extern
+void
+ch_rg_free(ch_ring_t* ring);
+//
+//    Free the ring and its snapshots. No lookup may be running.
+//
+//    :param ch_ring_t* ring: Pointer to a ring object.
+
+// .. c:function::
+extern
+ch_error_t
+ch_rg_init(ch_ring_t* ring, ch_chirp_t* chirp);
+//
+//    Initialize a ring object. Memory is provided by the caller. You must
+//    call :c:func:`ch_rg_free` to cleanup the ring object.
+//
+//    :param ch_ring_t* ring: Out: Pointer to a ring object.
+//    :param ch_chirp_t* chirp: Pointer to the chirp object used for sending.
+//
+//    :return: A chirp error. See: :c:type:`ch_error_t`.
+//    :rtype: ch_error_t
+
+// .. c:function::
+extern
+ch_error_t
+ch_rg_remove_node_ts(
+        ch_ring_t* ring,
+        ch_ip_protocol_t ip_protocol,
+        const char* address,
+        int32_t port
+);
+//
+//    Remove a node from the ring, for example because it failed. Only the
+//    keys bound to this node are remapped. Thread-safe.
+//
+//    :param ch_ring_t* ring: Pointer to a ring object.
+//    :param ch_ip_protocol_t ip_protocol: IP-protocol of the address
+//    :param char* address: Textual representation of IP
+//    :param int32_t port: Port of the node
+//
+//    :return: A chirp error. CH_VALUE_ERROR if the node is not on the ring.
+//             See: :c:type:`ch_error_t`.
+//    :rtype: ch_error_t
+
+// .. c:function::
+extern
+ch_error_t
+ch_rg_route_ts(
+        ch_ring_t* ring,
+        ch_message_t* msg,
+        const ch_buf* key,
+        size_t key_len
+);
+//
+//    Select the node the key is bound to and set the address and port of the
+//    message. Lock-free and thread-safe.
+//
+//    :param ch_ring_t* ring: Pointer to a ring object.
+//    :param ch_message_t* msg: The message to route.
+//    :param ch_buf* key: The key the message is bound by.
+//    :param size_t key_len: Length of the key.
+//
+//    :return: A chirp error. CH_VALUE_ERROR if the ring is empty.
+//             See: :c:type:`ch_error_t`.
+//    :rtype: ch_error_t
+
+// .. c:function::
+extern
+ch_error_t
+ch_rg_send(
+        ch_ring_t* ring,
+        ch_message_t* msg,
+        const ch_buf* key,
+        size_t key_len,
+        ch_send_cb_t send_cb
+);
+//
+//    Route the message using :c:func:`ch_rg_route_ts` and send it using
+//    :c:func:`ch_chirp_send`.
+//
+//    :param ch_ring_t* ring: Pointer to a ring object.
+//    :param ch_message_t msg: The message to send. The memory of the message
+//                             must stay valid until the callback is called.
+//    :param ch_buf* key: The key the message is bound by.
+//    :param size_t key_len: Length of the key.
+//    :param ch_send_cb_t send_cb: The callback, that will be called after
+//                                 sending.
+//
+//    :return: A chirp error. See: :c:type:`ch_error_t`.
+//    :rtype: ch_error_t
+
+#endif //ch_libchirp_ring_h
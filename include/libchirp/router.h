@@ -0,0 +1,158 @@
+// ======
+// Router
+// ======
+//
+// Routes a message to one of the nodes that registered an actor. Implements
+// RoutedMessage of RFC 01: the message goes to the node with the lowest load.
+//
+// The router uses the power-of-two-choices strategy: it samples two
+// candidates of the actor and sends to the one with the lower load. This
+// balances the cluster without a central coordinator and without scanning all
+// candidates for every message.
+//
+// The load of a candidate is the load its peer reported last, plus an
+// estimate for the messages the router dispatched since. The estimate decays
+// over time, so a stale value doesn't keep a node busy (or idle) forever.
+//
+// .. code-block:: cpp
+//
+#ifndef ch_libchirp_router_h
+#define ch_libchirp_router_h
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "common.h"
+#include "callbacks.h"
+#include "chirp.h"
+#include "message.h"
+
+// Declarations
+// ============
+
+// .. c:type:: ch_router_int_t
+//    :noindex:
+//
+//    Opaque pointer to internals.
+//
+//    see: :c:type:`ch_router_int_t`
+//
+// .. code-block:: cpp
+//
+typedef struct ch_router_int_s ch_router_int_t;
+
+// .. c:type:: ch_router_t
+//
+//    Router object. It has no public members and uses an opaque pointer to
+//    its internal data structures.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_router_s {
+    ch_router_int_t* _;
+} ch_router_t;
+
+// .. c:function::
+extern
+ch_error_t
+ch_rt_add_node(
+        ch_router_t* router,
+        const char* actor,
+        ch_ip_protocol_t ip_protocol,
+        const char* address,
+        int32_t port
+);
+//
+//    Add a node to the candidates of an actor. Adding a node twice has no
+//    effect.
+//
+//    :param ch_router_t* router: Pointer to a router object.
+//    :param char* actor: The actor (c-string) provided by the node.
+//    :param ch_ip_protocol_t ip_protocol: IP-protocol of the address
+//    :param char* address: Textual representation of IP
+//    :param int32_t port: Port of the node
+//
+//    :return: A chirp error. See: :c:type:`ch_error_t`.
+//    :rtype: ch_error_t
+
+// .. c:function::
+extern
+void
+ch_rt_free(ch_router_t* router);
+//
+//    Free the router and all its candidates.
+//
+//    :param ch_router_t* router: Pointer to a router object.
+
+// .. c:function::
+extern
+ch_error_t
+ch_rt_init(ch_router_t* router, ch_chirp_t* chirp);
+//
+//    Initialize a router object. Memory is provided by the caller. You must
+//    call :c:func:`ch_rt_free` to cleanup the router object.
+//
+//    :param ch_router_t* router: Out: Pointer to a router object.
+//    :param ch_chirp_t* chirp: Pointer to the chirp object used for sending.
+//
+//    :return: A chirp error. See: :c:type:`ch_error_t`.
+//    :rtype: ch_error_t
+
+// .. c:function::
+extern
+ch_error_t
+ch_rt_remove_node(
+        ch_router_t* router,
+        const char* actor,
+        ch_ip_protocol_t ip_protocol,
+        const char* address,
+        int32_t port
+);
+//
+//    Remove a node from the candidates of an actor.
+//
+//    :param ch_router_t* router: Pointer to a router object.
+//    :param char* actor: The actor (c-string) the node is removed from.
+//    :param ch_ip_protocol_t ip_protocol: IP-protocol of the address
+//    :param char* address: Textual representation of IP
+//    :param int32_t port: Port of the node
+//
+//    :return: A chirp error. CH_VALUE_ERROR if the node is not a candidate
+//             of the actor. See: :c:type:`ch_error_t`.
+//    :rtype: ch_error_t
+
+// .. c:function::
+extern
+ch_error_t
+ch_rt_route(ch_router_t* router, ch_message_t* msg);
+//
+//    Select the node for the message and set its address and port. The
+//    candidates are the nodes registered for :c:member:`ch_message_t.actor`.
+//
+//    :param ch_router_t* router: Pointer to a router object.
+//    :param ch_message_t* msg: The message to route.
+//
+//    :return: A chirp error. CH_VALUE_ERROR if the actor has no candidates.
+//             See: :c:type:`ch_error_t`.
+//    :rtype: ch_error_t
+
+// .. c:function::
+extern
+ch_error_t
+ch_rt_send(ch_router_t* router, ch_message_t* msg, ch_send_cb_t send_cb);
+//
+//    Route the message using :c:func:`ch_rt_route` and send it using
+//    :c:func:`ch_chirp_send`.
+//
+//    :param ch_router_t* router: Pointer to a router object.
+//    :param ch_message_t msg: The message to send. The memory of the message
+//                             must stay valid until the callback is called.
+//    :param ch_send_cb_t send_cb: The callback, that will be called after
+//                                 sending.
+//
+//    :return: A chirp error. See: :c:type:`ch_error_t`.
+//    :rtype: ch_error_t
+
+#endif //ch_libchirp_router_h
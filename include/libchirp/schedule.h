@@ -0,0 +1,180 @@
+// ========
+// Schedule
+// ========
+//
+// Run a callback or send a message after a delay. Implements
+// :code:`chirp.schedule(timeout, fn, state)` of RFC 01, which is used for
+// cache expiry and alert plans.
+//
+// Entries are provided by the caller, so scheduling doesn't allocate. They
+// are kept in a hierarchical timing wheel, inserting, cancelling and firing
+// an entry takes constant time, independent of the count of pending entries.
+// The resolution is :c:macro:`CH_SC_TICK` milliseconds.
+//
+// Scheduling and cancelling are not thread-safe, call them on the loop of
+// chirp.
+//
+// .. code-block:: cpp
+//
+#ifndef ch_libchirp_schedule_h
+#define ch_libchirp_schedule_h
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "common.h"
+#include "callbacks.h"
+#include "chirp.h"
+#include "message.h"
+
+// Declarations
+// ============
+
+struct ch_schedule_s;
+
+// .. c:type:: ch_schedule_cb_t
+//
+//    Called by chirp when a scheduled entry is due. The entry is not pending
+//    anymore and may be scheduled again or freed.
+//
+//    .. c:member:: ch_chirp_t* chirp
+//
+//       Pointer to the chirp object.
+//
+//    .. c:member:: ch_schedule_t* entry
+//
+//       The entry that is due.
+//
+// .. code-block:: cpp
+//
+typedef void (*ch_schedule_cb_t)(
+        ch_chirp_t* chirp,
+        struct ch_schedule_s* entry
+);
+
+// .. c:type:: ch_schedule_t
+//
+//    A scheduled entry. Memory is provided by the caller and must stay valid
+//    until the entry is due or cancelled. Initialize it with
+//    :c:func:`ch_schedule_init` before its first use.
+//
+//    .. c:member:: void* state
+//
+//       User data, chirp doesn't touch it.
+//
+//    .. c:member:: ch_schedule_cb_t _cb
+//
+//       Callback called when the entry is due.
+//
+//    .. c:member:: ch_message_t* _msg
+//
+//       Message to send, see :c:func:`ch_chirp_schedule_send`.
+//
+//    .. c:member:: ch_send_cb_t _send_cb
+//
+//       Send callback of the message.
+//
+//    .. c:member:: uint64_t _due
+//
+//       Tick the entry is due.
+//
+//    .. c:member:: struct ch_schedule_s* _next
+//
+//       Next entry in the same slot of the wheel.
+//
+//    .. c:member:: struct ch_schedule_s** _pprev
+//
+//       Pointer to the pointer pointing to this entry, NULL if the entry is
+//       not pending.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_schedule_s {
+    void*                  state;
+    ch_schedule_cb_t       _cb;
+    ch_message_t*          _msg;
+    ch_send_cb_t           _send_cb;
+    uint64_t               _due;
+    struct ch_schedule_s*  _next;
+    struct ch_schedule_s** _pprev;
+} ch_schedule_t;
+
+// .. c:function::
+extern
+ch_error_t
+ch_chirp_cancel(ch_chirp_t* chirp, ch_schedule_t* entry);
+//
+//    Cancel a pending entry. Its callback will not be called.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    :param ch_schedule_t* entry: The entry to cancel.
+//
+//    :return: A chirp error. CH_VALUE_ERROR if the entry is not pending.
+//             See: :c:type:`ch_error_t`.
+//    :rtype: ch_error_t
+
+// .. c:function::
+extern
+ch_error_t
+ch_chirp_schedule(
+        ch_chirp_t* chirp,
+        ch_schedule_t* entry,
+        uint64_t timeout,
+        ch_schedule_cb_t cb,
+        void* state
+);
+//
+//    Call **cb** after **timeout** milliseconds.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    :param ch_schedule_t* entry: The entry, used as handle to cancel.
+//    :param uint64_t timeout: Delay in milliseconds.
+//    :param ch_schedule_cb_t cb: Callback called after the delay.
+//    :param void* state: User data stored in :c:member:`ch_schedule_t.state`.
+//
+//    :return: A chirp error. CH_VALUE_ERROR if the entry is already pending,
+//             CH_UNINIT if chirp is closing. See: :c:type:`ch_error_t`.
+//    :rtype: ch_error_t
+
+// .. c:function::
+extern
+ch_error_t
+ch_chirp_schedule_send(
+        ch_chirp_t* chirp,
+        ch_schedule_t* entry,
+        uint64_t timeout,
+        ch_message_t* msg,
+        ch_send_cb_t send_cb
+);
+//
+//    Send **msg** using :c:func:`ch_chirp_send` after **timeout**
+//    milliseconds. To deliver to a local actor, address the message to the
+//    own node.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    :param ch_schedule_t* entry: The entry, used as handle to cancel.
+//    :param uint64_t timeout: Delay in milliseconds.
+//    :param ch_message_t msg: The message to send. The memory of the message
+//                             must stay valid until the callback is called.
+//    :param ch_send_cb_t send_cb: The callback, that will be called after
+//                                 sending. If chirp is closed before the
+//                                 message is due, it is called with
+//                                 CH_UNINIT.
+//
+//    :return: A chirp error. CH_VALUE_ERROR if the entry is already pending,
+//             CH_UNINIT if chirp is closing. See: :c:type:`ch_error_t`.
+//    :rtype: ch_error_t
+
+// .. c:function::
+extern
+void
+ch_schedule_init(ch_schedule_t* entry);
+//
+//    Initialize an entry, so it is not pending. Cancelling an initialized
+//    entry that is not pending returns CH_VALUE_ERROR.
+//
+//    :param ch_schedule_t* entry: The entry to initialize.
+
+#endif //ch_libchirp_schedule_h
@@ -0,0 +1,183 @@
+// ===========
+// Local state
+// ===========
+//
+// Local state of actors, see the level-two model of RFC 01. Actors gathering
+// results (for example by batch_id) keep the partial results in a state
+// entry identified by a key taken from the message.
+//
+// The entries are striped by the hash of the key. Every stripe has its own
+// lock, so workers gathering different keys don't serialize behind one lock
+// per actor. Memory of an entry comes from an arena that is freed in bulk,
+// when the entry expires.
+//
+// All functions with the suffix _ts are thread-safe.
+//
+// .. code-block:: cpp
+//
+#ifndef ch_libchirp_state_h
+#define ch_libchirp_state_h
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "common.h"
+#include "chirp.h"
+
+// Declarations
+// ============
+
+// .. c:type:: ch_st_chunk_t
+//    :noindex:
+//
+//    Opaque pointer to the arena of an entry.
+//
+//    see: :c:type:`ch_st_chunk_t`
+//
+// .. code-block:: cpp
+//
+typedef struct ch_st_chunk_s ch_st_chunk_t;
+
+// .. c:type:: ch_state_int_t
+//    :noindex:
+//
+//    Opaque pointer to internals.
+//
+//    see: :c:type:`ch_state_int_t`
+//
+// .. code-block:: cpp
+//
+typedef struct ch_state_int_s ch_state_int_t;
+
+// .. c:type:: ch_state_t
+//
+//    Local state object. It has no public members and uses an opaque pointer
+//    to its internal data structures.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_state_s {
+    ch_state_int_t* _;
+} ch_state_t;
+
+// .. c:type:: ch_st_entry_t
+//
+//    A state entry. Only valid while its stripe is locked, see
+//    :c:func:`ch_st_lock_ts`.
+//
+//    .. c:member:: void* data
+//
+//       User data, NULL for a new entry. Usually allocated with
+//       :c:func:`ch_st_alloc`.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_st_entry_s {
+    void*                 data;
+    ch_buf*               _key;
+    size_t                _key_len;
+    uint64_t              _stamp;
+    ch_st_chunk_t*        _arena;
+    uint32_t              _stripe;
+    struct ch_st_entry_s* _expired;
+    char                  _color_field;
+    struct ch_st_entry_s* _left;
+    struct ch_st_entry_s* _right;
+} ch_st_entry_t;
+
+// .. c:function::
+extern
+void*
+ch_st_alloc(ch_st_entry_t* entry, size_t size);
+//
+//    Allocate memory from the arena of an entry. The memory is freed when the
+//    entry expires. The stripe of the entry must be locked.
+//
+//    :param ch_st_entry_t* entry: The entry.
+//    :param size_t size: The amount of memory in bytes to allocate.
+//
+//    :return: the memory, NULL if the allocation failed.
+//    :rtype:  void*
+
+// .. c:function::
+extern
+ch_error_t
+ch_st_expire_ts(ch_state_t* state, const ch_buf* key, size_t key_len);
+//
+//    Remove an entry and free its arena.
+//
+//    :param ch_state_t* state: Pointer to a state object.
+//    :param ch_buf* key: The key of the entry.
+//    :param size_t key_len: Length of the key.
+//
+//    :return: A chirp error. CH_VALUE_ERROR if there is no such entry.
+//             See: :c:type:`ch_error_t`.
+//    :rtype: ch_error_t
+
+// .. c:function::
+extern
+uint32_t
+ch_st_expire_idle_ts(ch_state_t* state, uint64_t idle);
+//
+//    Remove all entries not locked for **idle** milliseconds and free their
+//    arenas. Locks one stripe at a time.
+//
+//    :param ch_state_t* state: Pointer to a state object.
+//    :param uint64_t idle: Idle time in milliseconds.
+//
+//    :return: the count of removed entries
+//    :rtype:  uint32_t
+
+// .. c:function::
+extern
+void
+ch_st_free(ch_state_t* state);
+//
+//    Free the state object and all entries. No stripe may be locked.
+//
+//    :param ch_state_t* state: Pointer to a state object.
+
+// .. c:function::
+extern
+ch_error_t
+ch_st_init(ch_state_t* state, ch_chirp_t* chirp, uint32_t stripes);
+//
+//    Initialize a state object. Memory is provided by the caller. You must
+//    call :c:func:`ch_st_free` to cleanup the state object.
+//
+//    :param ch_state_t* state: Out: Pointer to a state object.
+//    :param ch_chirp_t* chirp: Pointer to the chirp object used for logging.
+//    :param uint32_t stripes: Count of stripes, must be a power of two. Use
+//                             a few times the count of workers.
+//
+//    :return: A chirp error. See: :c:type:`ch_error_t`.
+//    :rtype: ch_error_t
+
+// .. c:function::
+extern
+ch_st_entry_t*
+ch_st_lock_ts(ch_state_t* state, const ch_buf* key, size_t key_len);
+//
+//    Lock the stripe of **key** and return its entry. The entry is created if
+//    it doesn't exist. Unlock using :c:func:`ch_st_unlock_ts`.
+//
+//    :param ch_state_t* state: Pointer to a state object.
+//    :param ch_buf* key: The key of the entry, for example the batch_id.
+//    :param size_t key_len: Length of the key.
+//
+//    :return: the locked entry, NULL if it could not be allocated.
+//    :rtype:  ch_st_entry_t*
+
+// .. c:function::
+extern
+void
+ch_st_unlock_ts(ch_state_t* state, ch_st_entry_t* entry);
+//
+//    Unlock the stripe of an entry locked by :c:func:`ch_st_lock_ts`.
+//
+//    :param ch_state_t* state: Pointer to a state object.
+//    :param ch_st_entry_t* entry: The locked entry.
+
+#endif //ch_libchirp_state_h
@@ -0,0 +1,247 @@
+// ==========
+// Statistics
+// ==========
+//
+// Counters of a chirp instance and of its connections. Use them to size
+// :c:member:`ch_config_t.MAX_HANDLERS` and :c:member:`ch_config_t.BUFFER_SIZE`
+// from real numbers: if the buffer pool is often exhausted, increase
+// MAX_HANDLERS, if many writes are partial, increase BUFFER_SIZE.
+//
+// The counters are updated on the loop thread without locks or atomics, so
+// the functions below must be called on the loop thread too, for example from
+// a uv_timer_t or a scheduled callback.
+//
+// .. code-block:: cpp
+//
+#ifndef ch_libchirp_stats_h
+#define ch_libchirp_stats_h
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "common.h"
+#include "chirp.h"
+
+// Declarations
+// ============
+
+// .. c:type:: ch_shutdown_reason_t
+//
+//    Reason a connection has been shut down.
+//
+//    .. c:member:: CH_SHUTDOWN_CLOSE
+//
+//       Chirp has been closed.
+//
+//    .. c:member:: CH_SHUTDOWN_EOF
+//
+//       The remote closed the connection.
+//
+//    .. c:member:: CH_SHUTDOWN_IO_ERROR
+//
+//       Reading or writing failed.
+//
+//    .. c:member:: CH_SHUTDOWN_TLS_ERROR
+//
+//       TLS error, including failed TLS handshakes.
+//
+//    .. c:member:: CH_SHUTDOWN_PROTOCOL_ERROR
+//
+//       The remote violated the chirp protocol.
+//
+//    .. c:member:: CH_SHUTDOWN_TIMEOUT
+//
+//       Sending a message timed out.
+//
+//    .. c:member:: CH_SHUTDOWN_DEAD
+//
+//       The watcher considered the remote dead.
+//
+//    .. c:member:: CH_SHUTDOWN_REASONS
+//
+//       Count of reasons.
+//
+// .. code-block:: cpp
+//
+typedef enum {
+    CH_SHUTDOWN_CLOSE          = 0,
+    CH_SHUTDOWN_EOF            = 1,
+    CH_SHUTDOWN_IO_ERROR       = 2,
+    CH_SHUTDOWN_TLS_ERROR      = 3,
+    CH_SHUTDOWN_PROTOCOL_ERROR = 4,
+    CH_SHUTDOWN_TIMEOUT        = 5,
+    CH_SHUTDOWN_DEAD           = 6,
+    CH_SHUTDOWN_REASONS        = 7,
+} ch_shutdown_reason_t;
+
+// .. c:type:: ch_stats_t
+//
+//    Counters of a chirp instance or a connection. The counters of an
+//    instance include the connections that have been closed.
+//
+//    .. c:member:: uint64_t messages_sent
+//
+//       Messages written completely.
+//
+//    .. c:member:: uint64_t messages_received
+//
+//       Messages received.
+//
+//    .. c:member:: uint64_t bytes_sent
+//
+//       Bytes of messages passed to the connection (before encryption).
+//
+//    .. c:member:: uint64_t bytes_received
+//
+//       Bytes read from the socket (before decryption).
+//
+//    .. c:member:: uint64_t handshakes
+//
+//       Successful TLS handshakes.
+//
+//    .. c:member:: uint64_t partial_writes
+//
+//       Writes that didn't fit into the TLS buffer and needed another round.
+//
+//    .. c:member:: uint64_t send_timeouts
+//
+//       Messages that could not be sent within
+//       :c:member:`ch_config_t.TIMEOUT`.
+//
+//    .. c:member:: uint64_t pool_exhausted
+//
+//       Times a handler buffer was requested while all
+//       :c:member:`ch_config_t.MAX_HANDLERS` buffers were used.
+//
+//    .. c:member:: uint64_t duplicates
+//
+//       Messages received again, acknowledged but not passed to the receive
+//       callback.
+//
+//    .. c:member:: uint64_t shutdowns[CH_SHUTDOWN_REASONS]
+//
+//       Connections shut down, by :c:type:`ch_shutdown_reason_t`.
+//
+//    .. c:member:: uint32_t connections
+//
+//       Current count of connections (1 for a connection).
+//
+//    .. c:member:: uint32_t handlers_used
+//
+//       Current count of handler buffers used.
+//
+//    .. c:member:: uint32_t sends_pending
+//
+//       Current count of messages being sent.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_stats_s {
+    uint64_t messages_sent;
+    uint64_t messages_received;
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    uint64_t handshakes;
+    uint64_t partial_writes;
+    uint64_t send_timeouts;
+    uint64_t pool_exhausted;
+    uint64_t duplicates;
+    uint64_t shutdowns[CH_SHUTDOWN_REASONS];
+    uint32_t connections;
+    uint32_t handlers_used;
+    uint32_t sends_pending;
+} ch_stats_t;
+
+// .. c:type:: ch_conn_stats_t
+//
+//    Counters of a connection and its remote.
+//
+//    .. c:member:: ch_ip_protocol_t ip_protocol
+//
+//       IP protocol of the address.
+//
+//    .. c:member:: uint8_t address[16]
+//
+//       IPv4/6 address of the remote.
+//
+//    .. c:member:: int32_t port
+//
+//       The public port of the remote.
+//
+//    .. c:member:: uint8_t identity[16]
+//
+//       The identity of the remote.
+//
+//    .. c:member:: int credits
+//
+//       The credits left, see :c:func:`ch_chirp_get_credits`.
+//
+//    .. c:member:: ch_stats_t stats
+//
+//       The counters of the connection.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_conn_stats_s {
+    ch_ip_protocol_t ip_protocol;
+    uint8_t          address[16];
+    int32_t          port;
+    uint8_t          identity[16];
+    int              credits;
+    ch_stats_t       stats;
+} ch_conn_stats_t;
+
+// .. c:type:: ch_conn_stats_cb_t
+//
+//    Called by :c:func:`ch_chirp_iter_conn_stats` for every connection.
+//
+//    .. c:member:: ch_chirp_t* chirp
+//
+//       Pointer to the chirp object.
+//
+//    .. c:member:: const ch_conn_stats_t* stats
+//
+//       Counters of the connection, only valid during the call.
+//
+//    .. c:member:: void* arg
+//
+//       The argument passed to :c:func:`ch_chirp_iter_conn_stats`.
+//
+// .. code-block:: cpp
+//
+typedef void (*ch_conn_stats_cb_t)(
+        ch_chirp_t* chirp,
+        const ch_conn_stats_t* stats,
+        void* arg
+);
+
+// .. c:function::
+extern
+void
+ch_chirp_get_stats(ch_chirp_t* chirp, ch_stats_t* stats);
+//
+//    Get the counters of a chirp instance. Must be called on the loop thread.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    :param ch_stats_t* stats: Out: The counters.
+
+// .. c:function::
+extern
+void
+ch_chirp_iter_conn_stats(
+        ch_chirp_t* chirp,
+        ch_conn_stats_cb_t cb,
+        void* arg
+);
+//
+//    Call **cb** with the counters of every connection that finished its
+//    handshake. Must be called on the loop thread. **cb** may not send
+//    messages or close chirp, since that changes the connections.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    :param ch_conn_stats_cb_t cb: Called for every connection.
+//    :param void* arg: Passed to **cb**.
+
+#endif //ch_libchirp_stats_h
@@ -46,4 +46,66 @@
 
 ////#define CH_CN_PRINT_CIPHERS
 
+// Half-life (ms) of the load estimate the router keeps per node. After a node
+// has not reported its load for this time, half of the estimated load is
+// forgotten.
+//
+// .. code-block:: cpp
+
+#define CH_RT_LOAD_HALF_LIFE 1000
+
+// Count of virtual nodes per node on the consistent-hash ring. More virtual
+// nodes spread the keys more evenly, but make changing the ring slower.
+//
+// .. code-block:: cpp
+
+#define CH_RG_VNODES 160
+
+// Resolution (ms) of the scheduler. Scheduled entries fire at most one tick
+// late.
+//
+// .. code-block:: cpp
+
+#define CH_SC_TICK 10
+
+// Size of the chunks of the arena of a local state entry. Larger allocations
+// get a chunk of their own.
+//
+// .. code-block:: cpp
+
+#define CH_ST_CHUNK_SIZE 4096
+
+// Interval (ms) in which the loop monitor measures the lag of the loop.
+//
+// .. code-block:: cpp
+//
+#define CH_MO_INTERVAL 50
+
+// Record E and L into per-thread binary event rings instead of formatting
+// them in place. A drainer thread formats the events and calls the log
+// callback, so the log callback must be thread-safe. See src/trace.h.
+//
+// .. code-block:: cpp
+//
+////#define CH_ENABLE_TRACE
+
+// Build SystemTap/USDT probes, requires sys/sdt.h. See src/probes.h.
+//
+// .. code-block:: cpp
+//
+////#define CH_ENABLE_USDT
+
+// Count of events per trace ring, must be a power of two. If the drainer
+// can't keep up, further events are dropped.
+//
+// .. code-block:: cpp
+//
+#define CH_TR_EVENTS 1024
+
+// Interval (ms) in which the drainer formats the recorded events.
+//
+// .. code-block:: cpp
+//
+#define CH_TR_DRAIN_INTERVAL 100
+
 #endif //ch_global_config_h
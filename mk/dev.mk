@@ -47,6 +47,16 @@ etests: all
 	sleep 1; \
 	kill -2 $$PID
 	$(BUILD)/src/quickcheck_etest
+	$(BUILD)/src/dedup_etest
+	$(BUILD)/src/reader_etest
+	$(BUILD)/src/ring_etest
+	$(BUILD)/src/router_etest
+	$(BUILD)/src/schedule_etest
+	$(BUILD)/src/retry_etest
+	$(BUILD)/src/receipt_etest
+	$(BUILD)/src/spool_etest
+	$(BUILD)/src/state_etest
+	$(BUILD)/src/microbench_etest
 
 cppcheck:  ## Static analysis
 	cppcheck -v \
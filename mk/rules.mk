@@ -1,4 +1,4 @@
-.PHONY += doc
+.PHONY += doc bench microbench
 UNAME_S := $(shell uname -s)
 
 libchirp.a: $(BUILD)/libchirp.a
@@ -17,6 +17,24 @@ check: all
 	sleep 1; \
 	kill -2 $$PID
 	$(BUILD)/src/quickcheck_etest
+	$(BUILD)/src/dedup_etest
+	$(BUILD)/src/reader_etest
+	$(BUILD)/src/ring_etest
+	$(BUILD)/src/router_etest
+	$(BUILD)/src/schedule_etest
+	$(BUILD)/src/retry_etest
+	$(BUILD)/src/receipt_etest
+	$(BUILD)/src/spool_etest
+	$(BUILD)/src/state_etest
+	$(BUILD)/src/microbench_etest
+
+bench: all  ## Loopback benchmark, prints JSON lines (BENCH_SECONDS=1)
+	$(BUILD)/src/message_etest $(BENCH_SECONDS)
+
+MICROBENCH_BASELINE ?= $(BUILD)/microbench.baseline
+
+microbench: all  ## Microbenchmarks compared with MICROBENCH_BASELINE
+	$(BUILD)/src/microbench_etest -b $(MICROBENCH_BASELINE)
 
 ifeq ($(DOC),True)
 doc: doc_files
@@ -17,26 +17,46 @@
 //
 #include "util.h"
 #include "config.h"
+#include "probes.h"
+#include "libchirp/message.h"
+#include "libchirp/stats.h"
 
 // Declarations
 // ============
 
+// Forward declarations
+// --------------------
+
+struct ch_buffer_pool_s;
+struct ch_connection_s;
+
+// Direct declarations
+// -------------------
+
 // .. c:type:: ch_bf_handler_t
 //
 //    Preallocated buffer for a chirp handler.
 //
-//    .. c:member:: ch_buf* header
+//    .. c:member:: ch_message_t msg
+//
+//       The message received into the handler.
+//
+//    .. c:member:: ch_buf header[CH_BF_PREALLOC_HEADER]
 //
 //       Preallocated buffer for the chirp header.
 //
-//    .. c:member:: char* actor
+//    .. c:member:: char actor[CH_BF_PREALLOC_ACTOR]
 //
 //       Preallocated buffer for the actor.
 //
-//    .. c:member:: ch_buf* data
+//    .. c:member:: ch_buf data[CH_BF_PREALLOC_DATA]
 //
 //       Preallocated buffer for the data.
 //
+//    .. c:member:: struct ch_buffer_pool_s* pool
+//
+//       The pool the handler belongs to.
+//
 //    .. c:member:: uint8_t id
 //
 //       Identifier of the buffer.
@@ -48,11 +68,13 @@
 // .. code-block:: cpp
 //
 typedef struct ch_bf_handler_s {
-    ch_buf* header[CH_BF_PREALLOC_HEADER];
-    char*   actor[CH_BF_PREALLOC_ACTOR];
-    ch_buf* data[CH_BF_PREALLOC_DATA];
-    uint8_t id;
-    uint8_t used;
+    ch_message_t             msg;
+    ch_buf                   header[CH_BF_PREALLOC_HEADER];
+    char                     actor[CH_BF_PREALLOC_ACTOR];
+    ch_buf                   data[CH_BF_PREALLOC_DATA];
+    struct ch_buffer_pool_s* pool;
+    uint8_t                  id;
+    uint8_t                  used;
 } ch_bf_handler_t;
 
 // .. c:type:: ch_buffer_pool_t
@@ -77,6 +99,25 @@ typedef struct ch_bf_handler_s {
 //       Pointer of type ch_bf_handler_t to the actual handlers. See
 //       :c:type:`ch_bf_handler_t`.
 //
+//    .. c:member:: ch_stats_t* stats
+//
+//       Counters of the connection owning the pool, can be NULL.
+//
+//    .. c:member:: ch_stats_t* total
+//
+//       Counters of the chirp instance owning the pool, can be NULL.
+//
+//    .. c:member:: struct ch_connection_s* conn
+//
+//       The connection owning the pool, NULL after the connection has been
+//       closed.
+//
+//    .. c:member:: int refcnt
+//
+//       References to the pool: one by the connection and one per used
+//       handler. Messages can be released after their connection has been
+//       closed, so the last reference frees the pool.
+//
 // .. code-block:: cpp
 //
 typedef struct ch_buffer_pool_s {
@@ -84,8 +125,30 @@ typedef struct ch_buffer_pool_s {
     uint8_t  used_buffers;
     uint32_t free_buffers;
     ch_bf_handler_t* handlers;
+    ch_stats_t* stats;
+    ch_stats_t* total;
+    struct ch_connection_s* conn;
+    int refcnt;
 } ch_buffer_pool_t;
 
+// .. c:macro:: CH_BF_STATS_ADD
+//
+//    Add **value** to a counter of the connection and the chirp instance
+//    owning the pool, see :c:macro:`CH_STATS_ADD`.
+//
+//    :param pool: Pointer to a buffer pool.
+//    :param member: The member of :c:type:`ch_stats_t`.
+//    :param value: The value to add.
+//
+// .. code-block:: cpp
+//
+#define CH_BF_STATS_ADD(pool, member, value) do { \
+    if((pool)->stats != NULL) \
+        (pool)->stats->member += (value); \
+    if((pool)->total != NULL) \
+        (pool)->total->member += (value); \
+} while(0)
+
 // Definitions
 // ===========
 
@@ -95,14 +158,21 @@ ch_inline
 void
 ch_bf_free(ch_buffer_pool_t* pool)
 //
-//    Free the given buffer structure.
+//    Drop the reference of the connection to the pool. The pool is freed,
+//    when no handler is used anymore.
 //
 //    :param ch_buffer_pool_t* pool: The buffer pool structure to free
 //
 // .. code-block:: cpp
 //
 {
-    ch_free(pool->handlers);
+    pool->conn   = NULL;
+    pool->stats  = NULL;
+    pool->refcnt -= 1;
+    if(pool->refcnt == 0) {
+        ch_free(pool->handlers);
+        ch_free(pool);
+    }
 }
 
 // .. c:function::
@@ -112,6 +182,7 @@ ch_error_t
 ch_bf_init(ch_buffer_pool_t* pool, uint8_t max_buffers)
 //
 //    Initialize the given buffer pool structure using given max. buffers.
+//    The pool has to be allocated with ch_alloc, see :c:func:`ch_bf_free`.
 //
 //    :param ch_buffer_pool_t* pool: The buffer pool object
 //    :param max_buffers: Buffers to allocate
@@ -123,6 +194,10 @@ ch_bf_init(ch_buffer_pool_t* pool, uint8_t max_buffers)
     A(max_buffers <= 32, "buffer.c can't handle more than 32 handlers");
     pool->used_buffers = 0;
     pool->max_buffers  = max_buffers;
+    pool->stats        = NULL;
+    pool->total        = NULL;
+    pool->conn         = NULL;
+    pool->refcnt       = 1;
     pool->handlers     = ch_alloc(max_buffers * sizeof(ch_bf_handler_t));
     if(!pool->handlers) {
         fprintf(
@@ -174,8 +249,14 @@ ch_bf_acquire(ch_buffer_pool_t* pool)
         handler_buf = &pool->handlers[32 - free];
         A(handler_buf->used == 0, "Handler buffer already used.");
         handler_buf->used = 1;
+        handler_buf->pool = pool;
+        pool->refcnt += 1;
+        CH_BF_STATS_ADD(pool, handlers_used, 1);
+        CH_PROBE2(bf_acquire, pool, handler_buf->id);
         return handler_buf;
     }
+    CH_BF_STATS_ADD(pool, pool_exhausted, 1);
+    CH_PROBE2(bf_acquire, pool, -1);
     return NULL;
 }
 
@@ -186,7 +267,8 @@ void
 ch_bf_release(ch_buffer_pool_t* pool, ch_bf_handler_t* handler_buf)
 //
 //    Set given handler buffer as unused in the buffer pool structure and
-//    (re-)add it to the list of free buffers.
+//    (re-)add it to the list of free buffers. Frees the pool if the
+//    connection has already been closed and this was the last handler.
 //
 //    .. todo:: Maybe use another name for this method as it does not seem to
 //              return something?
@@ -205,9 +287,16 @@ ch_bf_release(ch_buffer_pool_t* pool, ch_bf_handler_t* handler_buf)
     A(handler_buf->used == 1, "Double return of buffer.");
     handler_buf->used = 0;
     A(handler_buf->used == 0, "Buffer pool inconsistent.");
+    CH_PROBE2(bf_release, pool, handler_buf->id);
     pool->used_buffers -= 1;
+    CH_BF_STATS_ADD(pool, handlers_used, -1);
     // Return the buffer
     pool->free_buffers |= (1 << (31 - handler_buf->id));
+    pool->refcnt -= 1;
+    if(pool->refcnt == 0) {
+        ch_free(pool->handlers);
+        ch_free(pool);
+    }
 }
 
 #endif //ch_buffer_h
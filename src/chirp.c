@@ -54,19 +54,25 @@ SGLIB_DEFINE_RBTREE_FUNCTIONS( // NOCOV
 static ch_config_t _ch_config_defaults = {
     .REUSE_TIME      = 30,
     .TIMEOUT         = 5,
+    .WATCH_INTERVAL  = 5,
+    .MAX_LAG         = 0,
     .PORT            = 2998,
     .BACKLOG         = 100,
     .RETRIES         = 1,
+    .WATCH_MISSES    = 3,
     .MAX_HANDLERS    = 16,
     .FLOW_CONTROL    = 1,
     .ACKNOWLEDGE     = 1,
     .CLOSE_ON_SIGINT = 1,
+    .DISABLE_ENCRYPTION = 0,
+    .COMPACT_WIRE    = 1,
     .BUFFER_SIZE     = 0,
     .BIND_V6         = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
     .BIND_V4         = {0, 0, 0, 0},
     .IDENTITY        = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
     .CERT_CHAIN_PEM  = NULL,
     .DH_PARAMS_PEM   = NULL,
+    .SPOOL_DIR       = NULL,
 };
 
 // .. c:var:: int _ch_chirp_ref_count
@@ -193,9 +199,10 @@ _ch_chirp_check_closing_cb(uv_prepare_t* handle)
         (void*) chirp
     );
     /* In production we allow the semaphore to drop below zero but log it as
-     * an error.
+     * an error. Connections aren't part of the semaphore, chirp waits until
+     * the last one is freed, see ch_cn_close_cb.
      */
-    if(ichirp->closing_tasks < 1) {
+    if(ichirp->closing_tasks < 1 && ichirp->stats.connections == 0) {
         assert(uv_prepare_stop(handle) == CH_SUCCESS);
         assert(ch_en_stop(&ichirp->encryption) == CH_SUCCESS);
         uv_close((uv_handle_t*) handle, _ch_chirp_closing_down_cb);
@@ -257,6 +264,11 @@ _ch_chirp_close_async_cb(uv_async_t* handle)
         (void*) chirp
     );
     assert(ch_pr_stop(&ichirp->protocol) == CH_SUCCESS);
+    ch_wa_stop(&ichirp->watcher);
+    ch_sc_stop(&ichirp->scheduler);
+    ch_ry_stop(&ichirp->retry);
+    ch_mo_stop(&ichirp->monitor);
+    ch_sp_stop(&ichirp->spool);
     uv_close((uv_handle_t*) &ichirp->close, ch_chirp_close_cb);
     ichirp->closing_tasks += 1;
     assert(uv_prepare_init(ichirp->loop, &ichirp->close_check) == CH_SUCCESS);
@@ -473,6 +485,29 @@ _ch_chirp_verify_cfg(const ch_chirp_t* chirp)
         conf->TIMEOUT,
         conf->REUSE_TIME
     );
+    V(
+        chirp,
+        conf->WATCH_INTERVAL == 0 || conf->WATCH_INTERVAL >= 0.1,
+        "Config: watch interval must be 0 or >= 0.1. (%f)",
+        conf->WATCH_INTERVAL
+    );
+    V(
+        chirp,
+        conf->WATCH_INTERVAL <= 3600,
+        "Config: watch interval must be <= 3600. (%f)",
+        conf->WATCH_INTERVAL
+    );
+    V(
+        chirp,
+        conf->MAX_LAG >= 0,
+        "Config: max lag must be >= 0. (%f)",
+        conf->MAX_LAG
+    );
+    VE(
+        chirp,
+        conf->WATCH_MISSES >= 1,
+        "Config: watch misses must be >= 1."
+    );
     if(conf->FLOW_CONTROL) {
         VE(
             chirp,
@@ -489,14 +524,9 @@ _ch_chirp_verify_cfg(const ch_chirp_t* chirp)
     if(conf->ACKNOWLEDGE == 0) {
         VE(
             chirp,
-            conf->RETRIES != 0,
+            conf->RETRIES == 0,
             "Config: if acknowledge is disabled retries has to be 0."
         );
-        VE(
-            chirp,
-            conf->FLOW_CONTROL != 0,
-            "Config: if acknowledge is disabled flow-control has to be 0."
-        );
     }
     VE(
         chirp,
@@ -608,8 +638,6 @@ ch_chirp_init(
         return tmp_err;
     }
 
-    // rand
-    srand((unsigned int) time(NULL));
     unsigned int i = 0;
     while(
             i < (sizeof(tmp_conf->IDENTITY) - 1) &&
@@ -675,6 +703,76 @@ ch_chirp_init(
         uv_mutex_unlock(&_ch_libchirp_mutex);
         return tmp_err;
     }
+    ch_wa_init(chirp, &ichirp->watcher);
+    tmp_err = ch_wa_start(&ichirp->watcher);
+    if(tmp_err != CH_SUCCESS) {
+        E(
+            chirp,
+            "Could not start watcher: %d. ch_chirp_t:%p",
+            tmp_err,
+            (void*) chirp
+        );
+        ch_free(ichirp);
+        chirp->_init = 0;
+        uv_mutex_unlock(&_ch_libchirp_mutex);
+        return tmp_err;
+    }
+    ch_sc_init(chirp, &ichirp->scheduler);
+    tmp_err = ch_sc_start(&ichirp->scheduler);
+    if(tmp_err != CH_SUCCESS) {
+        E(
+            chirp,
+            "Could not start scheduler: %d. ch_chirp_t:%p",
+            tmp_err,
+            (void*) chirp
+        );
+        ch_free(ichirp);
+        chirp->_init = 0;
+        uv_mutex_unlock(&_ch_libchirp_mutex);
+        return tmp_err;
+    }
+    ch_ry_init(chirp, &ichirp->retry);
+    tmp_err = ch_ry_start(&ichirp->retry);
+    if(tmp_err != CH_SUCCESS) {
+        E(
+            chirp,
+            "Could not start retry engine: %d. ch_chirp_t:%p",
+            tmp_err,
+            (void*) chirp
+        );
+        ch_free(ichirp);
+        chirp->_init = 0;
+        uv_mutex_unlock(&_ch_libchirp_mutex);
+        return tmp_err;
+    }
+    ch_mo_init(chirp, &ichirp->monitor);
+    tmp_err = ch_mo_start(&ichirp->monitor);
+    if(tmp_err != CH_SUCCESS) {
+        E(
+            chirp,
+            "Could not start loop monitor: %d. ch_chirp_t:%p",
+            tmp_err,
+            (void*) chirp
+        );
+        ch_free(ichirp);
+        chirp->_init = 0;
+        uv_mutex_unlock(&_ch_libchirp_mutex);
+        return tmp_err;
+    }
+    ch_sp_init(chirp, &ichirp->spool);
+    tmp_err = ch_sp_start(&ichirp->spool);
+    if(tmp_err != CH_SUCCESS) {
+        E(
+            chirp,
+            "Could not start spool: %d. ch_chirp_t:%p",
+            tmp_err,
+            (void*) chirp
+        );
+        ch_free(ichirp);
+        chirp->_init = 0;
+        uv_mutex_unlock(&_ch_libchirp_mutex);
+        return tmp_err;
+    }
 #   ifndef NDEBUG
     char id_str[33];
     ch_bytes_to_hex(
@@ -844,6 +942,9 @@ ch_libchirp_cleanup(void)
 // .. code-block:: cpp
 //
 {
+#ifdef CH_ENABLE_TRACE
+    ch_tr_stop();
+#endif
     uv_mutex_destroy(&_ch_libchirp_mutex);
 }
 
@@ -858,4 +959,8 @@ ch_libchirp_init(void)
 //
 {
     uv_mutex_init(&_ch_libchirp_mutex);
+    ch_random_init();
+#ifdef CH_ENABLE_TRACE
+    ch_tr_start();
+#endif
 }
@@ -17,6 +17,11 @@
 #include "libchirp.h"
 #include "protocol.h"
 #include "encryption.h"
+#include "monitor.h"
+#include "retry.h"
+#include "spool.h"
+#include "schedule.h"
+#include "watcher.h"
 
 // System includes
 // ===============
@@ -104,6 +109,49 @@ typedef enum {
 //       Reference to encryption object. Is used when a encrypted connection is
 //       used.
 //
+//    .. c:member:: ch_watcher_t watcher
+//
+//       Watcher object, checks if peers are alive.
+//
+//    .. c:member:: ch_scheduler_t scheduler
+//
+//       Scheduler object, runs callbacks after a delay.
+//
+//    .. c:member:: ch_monitor_t monitor
+//
+//       Loop monitor, measures the lag of the loop.
+//
+//    .. c:member:: ch_retry_t retry
+//
+//       Retry engine, requeues failed sends.
+//
+//    .. c:member:: ch_spool_t spool
+//
+//       Write-ahead spool of messages sent, see
+//       :c:member:`ch_config_t.SPOOL_DIR`.
+//
+//    .. c:member:: ch_stats_t stats
+//
+//       Counters of the instance, see :c:macro:`CH_STATS_ADD`.
+//
+//    .. c:member:: ch_histogram_t histograms[CH_HG_STAGES]
+//
+//       Latency histograms of the stages, see :c:type:`ch_hg_stage_t`.
+//
+//    .. c:member:: ch_recv_cb_t recv_cb
+//
+//       Called when a message has been received, see
+//       :c:func:`ch_chirp_set_recv_cb`.
+//
+//    .. c:member:: ch_recv_stream_cb_t recv_stream_cb
+//
+//       Called with chunks of the data of streamed messages, see
+//       :c:func:`ch_chirp_set_recv_stream_cb`.
+//
+//    .. c:member:: uint32_t stream_min_data_len
+//
+//       Minimum length of data to stream.
+//
 //    .. c:member:: uv_loop_t* loop
 //
 //       Pointer to the libuv (main) event loop. The event loop is the central
@@ -128,6 +176,16 @@ struct ch_chirp_int_s {
     uv_prepare_t    close_check;
     ch_protocol_t   protocol;
     ch_encryption_t encryption;
+    ch_watcher_t    watcher;
+    ch_scheduler_t  scheduler;
+    ch_monitor_t    monitor;
+    ch_retry_t      retry;
+    ch_spool_t      spool;
+    ch_stats_t      stats;
+    ch_histogram_t  histograms[CH_HG_STAGES];
+    ch_recv_cb_t    recv_cb;
+    ch_recv_stream_cb_t recv_stream_cb;
+    uint32_t        stream_min_data_len;
     uv_loop_t*      loop;
     uint8_t         identity[16];
     uint16_t        public_port;
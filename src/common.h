@@ -16,6 +16,7 @@
 // .. code-block:: cpp
 //
 #include "libchirp/common.h"
+#include "config.h"
 
 // System includes
 // ===============
@@ -396,6 +397,24 @@
 #   error Validate macro not defined
 #endif
 
+// .. c:macro:: CH_ENABLE_TRACE
+//
+//    Replaces :c:macro:`E` and :c:macro:`L` by :c:macro:`T`, which records
+//    the raw arguments into a per-thread ring instead of formatting them. See
+//    :c:func:`ch_tr_record`.
+//
+// .. code-block:: cpp
+//
+#ifdef CH_ENABLE_TRACE
+#   include "trace.h"
+#   undef E
+#   define E(chirp, message, ...) T(chirp, 1, message, __VA_ARGS__)
+#   ifndef NDEBUG
+#       undef L
+#       define L(chirp, message, ...) T(chirp, 0, message, __VA_ARGS__)
+#   endif
+#endif
+
 #define CH_CHIRP_MAGIC 42429
 
 #define CH_GET_CHIRP(handle) \
@@ -454,6 +473,18 @@ A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*")
 #   define ch_inline inline
 #endif // _WIN32
 
+// .. c:macro:: ch_thread_local
+//
+//    Storage class of thread-local variables.
+//
+// .. code-block:: cpp
+//
+#ifdef _MSC_VER
+#   define ch_thread_local __declspec(thread)
+#else
+#   define ch_thread_local __thread
+#endif
+
 // Generic functions
 // =================
 //
@@ -14,6 +14,8 @@
 //
 #include "connection.h"
 #include "chirp.h"
+#include "probes.h"
+#include "stats.h"
 #include "util.h"
 
 // System includes
@@ -205,7 +207,7 @@ _ch_cn_partial_write(ch_connection_t* conn)
                 (void*) conn,
                 (void*) chirp
             );
-            ch_cn_shutdown(conn);
+            ch_cn_shutdown(conn, CH_SHUTDOWN_TLS_ERROR);
             return;
         }
         int read = BIO_read(
@@ -220,6 +222,8 @@ _ch_cn_partial_write(ch_connection_t* conn)
         (bytes_read < conn->buffer_size)
     );
     conn->buffer_wtls_uv.len = bytes_read;
+    if(bytes_encrypted + conn->write_written < conn->write_size)
+        CH_STATS_ADD(conn, partial_writes, 1);
     uv_write(
         &conn->write_req,
         (uv_stream_t*) &conn->client,
@@ -256,6 +260,7 @@ _ch_cn_send_pending_cb(uv_write_t* req, int status)
         conn->flags &= ~CH_CN_WRITE_PENDING;
         conn->flags &= ~CH_CN_BUF_WTLS_USED;
 #   endif
+    conn->writer.flags &= ~CH_WR_WRITING;
     if(status < 0) {
         L(
             chirp,
@@ -263,9 +268,11 @@ _ch_cn_send_pending_cb(uv_write_t* req, int status)
             (void*) chirp,
             (void*) conn
         );
-        ch_cn_shutdown(conn);
+        ch_cn_shutdown(conn, CH_SHUTDOWN_IO_ERROR);
         return;
     }
+    if(conn->flags & CH_CN_SHUTTING_DOWN)
+        return;
     L(
         chirp,
         "Write handshake bytes to connection successful. "
@@ -314,7 +321,6 @@ _ch_cn_shutdown_gen_cb(
     int tmp_err;
     ch_connection_t* conn = req->handle->data;
     ch_chirp_t* chirp = conn->chirp;
-    ch_chirp_int_t* ichirp = chirp->_;
     L(
         chirp,
         "Shutdown callback called. ch_connection_t:%p, ch_chirp_t:%p",
@@ -334,8 +340,6 @@ _ch_cn_shutdown_gen_cb(
     }
     uv_handle_t* handle = (uv_handle_t*) req->handle;
     if(uv_is_closing(handle)) {
-        if(ichirp->flags & CH_CHIRP_CLOSING)
-            chirp->_->closing_tasks -= 1;
         E(
             chirp,
             "Connection already closed after shutdown. "
@@ -346,9 +350,8 @@ _ch_cn_shutdown_gen_cb(
     } else {
         uv_close((uv_handle_t*) req->handle, close_cb);
         uv_close((uv_handle_t*) &conn->shutdown_timeout, close_cb);
-        if(ichirp->flags & CH_CHIRP_CLOSING)
-            chirp->_->closing_tasks += 1;
-        conn->shutdown_tasks += 2;
+        uv_close((uv_handle_t*) &conn->writer.send_timeout, close_cb);
+        conn->shutdown_tasks += 3;
         L(
             chirp,
             "Closing connection after shutdown. "
@@ -390,11 +393,18 @@ _ch_cn_shutdown_gen(
         return CH_IN_PRORESS;
     }
     /* There are many reasons the connection is not in this data-structure,
-     * therefore we do a blind delete.
+     * therefore we do a blind delete. Another connection to the same remote
+     * compares equal, so we only delete if it is actually this connection.
      */
     ch_connection_t* out_conn;
-    sglib_ch_connection_t_delete_if_member(
-        &protocol->connections,
+    out_conn = sglib_ch_connection_t_find_member(
+        protocol->connections,
+        conn
+    );
+    if(out_conn == conn)
+        sglib_ch_connection_t_delete(&protocol->connections, conn);
+    sglib_ch_connection_set_t_delete_if_member(
+        &protocol->old_connections,
         conn,
         &out_conn
     );
@@ -431,18 +441,23 @@ _ch_cn_shutdown_gen(
         shutdown_cb
     );
     if(tmp_err != CH_SUCCESS) {
-        E(
+        /* For example the connection isn't connected yet, so we close it
+         * right away.
+         */
+        L(
             chirp,
-            "uv_shutdown returned error: %d. ch_connection_t:%p, "
+            "uv_shutdown returned error: %d, closing. ch_connection_t:%p, "
             "ch_chirp_t:%p",
             tmp_err,
             (void*) conn,
             (void*) chirp
         );
+        uv_close((uv_handle_t*) &conn->client, ch_cn_close_cb);
+        uv_close((uv_handle_t*) &conn->shutdown_timeout, ch_cn_close_cb);
+        uv_close((uv_handle_t*) &conn->writer.send_timeout, ch_cn_close_cb);
+        conn->shutdown_tasks += 3;
         return ch_uv_error_map(tmp_err);
     }
-    if(ichirp->flags & CH_CHIRP_CLOSING)
-        chirp->_->closing_tasks += 1;
     tmp_err = uv_timer_start(
         &conn->shutdown_timeout,
         timer_cb,
@@ -504,9 +519,6 @@ _ch_cn_shutdown_timeout_gen_cb(
     int tmp_err;
     ch_chirp_t* chirp = conn->chirp;
     A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
-    ch_chirp_int_t* ichirp = chirp->_;
-    if(ichirp->flags & CH_CHIRP_CLOSING)
-        chirp->_->closing_tasks -= 1;
     shutdown_cb(&conn->shutdown_req, 1);
     tmp_err = uv_cancel((uv_req_t*) &conn->shutdown_req);
     if(tmp_err != CH_SUCCESS) {
@@ -552,11 +564,53 @@ _ch_cn_write_cb(uv_write_t* req, int status)
             (void*) chirp,
             (void*) conn
         );
-        conn->write_callback(req, status);
-        ch_cn_shutdown(conn);
+        conn->write_size = 0;
+        if(conn->write_callback != NULL)
+            conn->write_callback(req, status);
+        ch_cn_shutdown(conn, CH_SHUTDOWN_IO_ERROR);
         return;
     }
-    if(conn->write_size < conn->write_written) {
+    int pending = 0;
+    if(conn->flags & CH_CN_ENCRYPTED)
+        pending = BIO_pending(conn->bio_app);
+    /* Encrypted data that didn't fit into the wtls buffer has to be sent
+     * before we encrypt more.
+     */
+    if(pending > 0) {
+#       ifndef NDEBUG
+            conn->flags |= CH_CN_WRITE_PENDING;
+            conn->flags |= CH_CN_BUF_WTLS_USED;
+#       endif
+        L(
+            chirp,
+            "Partially sent %d bytes. "
+            "ch_chirp_t:%p, ch_connection_t:%p",
+            (int) conn->buffer_size,
+            (void*) chirp,
+            (void*) conn
+        );
+        int read = BIO_read(
+            conn->bio_app,
+            conn->buffer_wtls,
+            conn->buffer_size
+        );
+        conn->buffer_wtls_uv.len = read;
+        uv_write(
+            &conn->write_req,
+            (uv_stream_t*) &conn->client,
+            &conn->buffer_wtls_uv,
+            1,
+            _ch_cn_write_cb
+        );
+        L(
+            chirp,
+            "Called uv_write with %d bytes. ch_chirp_t:%p, "
+            "ch_connection_t:%p",
+            (int) read,
+            (void*) chirp,
+            (void*) conn
+        );
+    } else if(conn->write_written < conn->write_size) {
         _ch_cn_partial_write(conn);
         L(
             chirp,
@@ -568,53 +622,16 @@ _ch_cn_write_cb(uv_write_t* req, int status)
             (void*) conn
         );
     } else {
-        int pending = BIO_pending(conn->bio_app);
-        if(pending < 1) {
-            L(
-                chirp,
-                "Completely sent %d bytes. ch_chirp_t:%p, ch_connection_t:%p",
-                (int) conn->write_written,
-                (void*) chirp,
-                (void*) conn
-            );
-            conn->write_size = 0;
-            if(conn->write_callback != NULL)
-                conn->write_callback(req, status);
-        } else {
-#           ifndef NDEBUG
-                conn->flags |= CH_CN_WRITE_PENDING;
-                conn->flags |= CH_CN_BUF_WTLS_USED;
-#           endif
-            L(
-                chirp,
-                "Partially sent %d bytes. "
-                "ch_chirp_t:%p, ch_connection_t:%p",
-                (int) conn->buffer_size,
-                (void*) chirp,
-                (void*) conn
-            );
-            int read = BIO_read(
-                conn->bio_app,
-                conn->buffer_wtls,
-                conn->buffer_size
-            );
-            conn->buffer_wtls_uv.len = read;
-            uv_write(
-                &conn->write_req,
-                (uv_stream_t*) &conn->client,
-                &conn->buffer_wtls_uv,
-                1,
-                _ch_cn_write_cb
-            );
-            L(
-                chirp,
-                "Called uv_write with %d bytes. ch_chirp_t:%p, "
-                "ch_connection_t:%p",
-                (int) read,
-                (void*) chirp,
-                (void*) conn
-            );
-        }
+        L(
+            chirp,
+            "Completely sent %d bytes. ch_chirp_t:%p, ch_connection_t:%p",
+            (int) conn->write_written,
+            (void*) chirp,
+            (void*) conn
+        );
+        conn->write_size = 0;
+        if(conn->write_callback != NULL)
+            conn->write_callback(req, status);
     }
 }
 
@@ -632,8 +649,6 @@ ch_cn_close_cb(uv_handle_t* handle)
     ch_chirp_t* chirp = conn->chirp;
     A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
     ch_chirp_int_t* ichirp = chirp->_;
-    if(ichirp->flags & CH_CHIRP_CLOSING)
-        chirp->_->closing_tasks -= 1;
     conn->shutdown_tasks -= 1;
     A(conn->shutdown_tasks > -1, "Shutdown semaphore dropped below zero");
     L(
@@ -669,13 +684,13 @@ ch_cn_close_cb(uv_handle_t* handle)
         if(conn->bio_app != NULL)
             BIO_free(conn->bio_app);
         ch_rd_free(&conn->reader);
-        ch_wr_free(&conn->writer);
+        ichirp->stats.connections -= 1;
         ch_free(conn);
         L(
             chirp,
-            "Closed connection, closing semaphore (%d). ch_connection_t:%p, "
+            "Closed connection, %d connections left. ch_connection_t:%p, "
             "ch_chirp_t:%p",
-            chirp->_->closing_tasks,
+            (int) ichirp->stats.connections,
             (void*) conn,
             (void*) chirp
         );
@@ -698,6 +713,7 @@ ch_cn_init(ch_chirp_t* chirp, ch_connection_t* conn, uint8_t flags)
     ch_chirp_int_t* ichirp  = chirp->_;
     memset(conn, 0, sizeof(ch_connection_t));
     conn->load            = 0;
+    conn->last_activity   = uv_now(ichirp->loop);
     conn->chirp           = chirp;
     conn->flags          |= flags;
     conn->write_req.data  = conn;
@@ -714,6 +730,36 @@ ch_cn_init(ch_chirp_t* chirp, ch_connection_t* conn, uint8_t flags)
         return tmp_err;
     }
     ch_wr_init(&conn->writer, conn);
+    conn->buffer_size = ichirp->config.BUFFER_SIZE;
+    if(conn->buffer_size == 0)
+        conn->buffer_size = CH_CN_BUFFER_SIZE;
+    conn->buffer_uv = ch_alloc(conn->buffer_size);
+    if(conn->flags & CH_CN_ENCRYPTED) {
+        /* The TLS buffers have to be of the same size */
+        conn->buffer_wtls = ch_alloc(conn->buffer_size);
+        conn->buffer_rtls = ch_alloc(conn->buffer_size);
+    }
+    if(!conn->buffer_uv || (
+            conn->flags & CH_CN_ENCRYPTED &&
+            !(conn->buffer_wtls && conn->buffer_rtls)
+    )) {
+        E(
+            chirp,
+            "Could not allocate memory for libuv and tls. "
+            "ch_chirp_t:%p, ch_connection_t:%p",
+            (void*) chirp,
+            (void*) conn
+        );
+        return CH_ENOMEM;
+    }
+    conn->buffer_uv_uv = uv_buf_init(
+        conn->buffer_uv,
+        conn->buffer_size
+    );
+    conn->buffer_wtls_uv = uv_buf_init(
+        conn->buffer_wtls,
+        conn->buffer_size
+    );
     tmp_err = uv_timer_init(ichirp->loop, &conn->shutdown_timeout);
     if(tmp_err != CH_SUCCESS) {
         E(
@@ -727,8 +773,17 @@ ch_cn_init(ch_chirp_t* chirp, ch_connection_t* conn, uint8_t flags)
         return tmp_err;
     }
     conn->shutdown_timeout.data = conn;
-    if(conn->flags & CH_CN_ENCRYPTED)
-        return ch_cn_init_enc(chirp, conn);
+    conn->reader.pool->stats    = &conn->stats;
+    conn->reader.pool->total    = &ichirp->stats;
+    conn->reader.pool->conn     = conn;
+    if(conn->flags & CH_CN_ENCRYPTED) {
+        tmp_err = ch_cn_init_enc(chirp, conn);
+        if(tmp_err != CH_SUCCESS)
+            return tmp_err;
+    }
+    /* Closing chirp waits until all connections are freed. */
+    conn->stats.connections     = 1;
+    ichirp->stats.connections  += 1;
     return CH_SUCCESS;
 }
 
@@ -800,56 +855,14 @@ ch_cn_read_alloc_cb(
 // .. code-block:: cpp
 //
 {
+    (void)(suggested_size);
     ch_connection_t* conn = handle->data;
     ch_chirp_t* chirp = conn->chirp;
     A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
-    ch_chirp_int_t* ichirp = chirp->_;
-    // ichirp->config.BUFFER_SIZE = 40; // TODO remove
     A(!(conn->flags & CH_CN_BUF_UV_USED), "UV buffer still used");
 #   ifndef NDEBUG
         conn->flags |= CH_CN_BUF_UV_USED;
 #   endif
-    if(!conn->buffer_uv) {
-        /* We also allocate the TLS buffer, because they have to be of the same
-         * size
-         */
-        if(ichirp->config.BUFFER_SIZE == 0) {
-            conn->buffer_uv   = ch_alloc(suggested_size);
-            if(conn->flags & CH_CN_ENCRYPTED) {
-                conn->buffer_wtls  = ch_alloc(suggested_size);
-                conn->buffer_rtls  = ch_alloc(suggested_size);
-            }
-            conn->buffer_size = suggested_size;
-        } else {
-            conn->buffer_uv   = ch_alloc(ichirp->config.BUFFER_SIZE);
-            if(conn->flags & CH_CN_ENCRYPTED) {
-                conn->buffer_wtls  = ch_alloc(ichirp->config.BUFFER_SIZE);
-                conn->buffer_rtls  = ch_alloc(ichirp->config.BUFFER_SIZE);
-            }
-            conn->buffer_size = ichirp->config.BUFFER_SIZE;
-        }
-        if(!(conn->buffer_uv && conn->buffer_wtls && conn->buffer_rtls)) {
-            E(
-                chirp,
-                "Could not allocate memory for libuv and tls. "
-                "ch_chirp_t:%p, ch_connection_t:%p",
-                (void*) chirp,
-                (void*) conn
-            );
-            // Tell libuv about the error
-            buf->base = 0;
-            buf->len = 0;
-            return;
-        }
-        conn->buffer_uv_uv = uv_buf_init(
-            conn->buffer_uv,
-            conn->buffer_size
-        );
-        conn->buffer_wtls_uv = uv_buf_init(
-            conn->buffer_wtls,
-            conn->buffer_size
-        );
-    }
     buf->base = conn->buffer_uv;
     buf->len = conn->buffer_size;
 }
@@ -864,13 +877,22 @@ ch_cn_send_if_pending(ch_connection_t* conn)
 // .. code-block:: cpp
 //
 {
-    A(!(conn->flags & CH_CN_WRITE_PENDING), "Another write is still pending");
     ch_chirp_t* chirp = conn->chirp;
     A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
-    int pending = BIO_pending(conn->bio_app);
+    /* A running write sends the pending data, see _ch_cn_write_cb. */
+    if(conn->writer.flags & CH_WR_WRITING)
+        return;
+    A(!(conn->flags & CH_CN_WRITE_PENDING), "Another write is still pending");
+    int pending = 0;
+    if(conn->flags & CH_CN_ENCRYPTED)
+        pending = BIO_pending(conn->bio_app);
     if(pending < 1) {
-        if(!(conn->flags & CH_CN_TLS_HANDSHAKE))
+        if(conn->flags & (CH_CN_TLS_HANDSHAKE | CH_CN_SHUTTING_DOWN))
+            return;
+        if(conn->reader.state == CH_RD_START)
             ch_rd_read(conn, NULL, 0); // Start reader
+        else
+            ch_wr_process_queues(conn);
         return;
     }
     A(!(conn->flags & CH_CN_BUF_WTLS_USED), "The wtls buffer is still used");
@@ -878,6 +900,7 @@ ch_cn_send_if_pending(ch_connection_t* conn)
         conn->flags |= CH_CN_BUF_WTLS_USED;
         conn->flags |= CH_CN_WRITE_PENDING;
 #   endif
+    conn->writer.flags |= CH_WR_WRITING;
     int read = BIO_read(conn->bio_app, conn->buffer_wtls, conn->buffer_size);
     conn->buffer_wtls_uv.len = read;
     uv_write(
@@ -899,7 +922,7 @@ ch_cn_send_if_pending(ch_connection_t* conn)
 
 // .. c:function::
 ch_error_t
-ch_cn_shutdown(ch_connection_t* conn)
+ch_cn_shutdown(ch_connection_t* conn, ch_shutdown_reason_t reason)
 //    :noindex:
 //
 //    see: :c:func:`ch_cn_shutdown`
@@ -907,11 +930,30 @@ ch_cn_shutdown(ch_connection_t* conn)
 // .. code-block:: cpp
 //
 {
-    return _ch_cn_shutdown_gen(
+    ch_error_t tmp_err;
+    int status = CH_PROTOCOL_ERROR;
+    if(conn->flags & CH_CN_SHUTTING_DOWN)
+        return _ch_cn_shutdown_gen(
+            conn,
+            _ch_cn_shutdown_cb,
+            _ch_cn_shutdown_timeout_cb
+        );
+    CH_STATS_ADD(conn, shutdowns[reason], 1);
+    CH_PROBE2(cn_shutdown, conn, reason);
+    if(reason == CH_SHUTDOWN_TIMEOUT)
+        status = CH_TIMEOUT;
+    else if(!(conn->flags & CH_CN_CONNECTED))
+        status = CH_CANNOT_CONNECT;
+    tmp_err = _ch_cn_shutdown_gen(
         conn,
         _ch_cn_shutdown_cb,
         _ch_cn_shutdown_timeout_cb
     );
+    /* The connection has been removed from the protocol, so the send
+     * callbacks can retry on a new connection.
+     */
+    ch_wr_abort(conn, status);
+    return tmp_err;
 }
 
 // .. c:function::
@@ -932,6 +974,7 @@ ch_cn_write(
     ch_chirp_t* chirp = conn->chirp;
     A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
     A(conn->write_size == 0, "Another connection write is pending");
+    CH_STATS_ADD(conn, bytes_sent, size);
     if(conn->flags & CH_CN_ENCRYPTED) {
         conn->write_callback  = callback;
         conn->write_buffer    = buf;
@@ -943,7 +986,10 @@ ch_cn_write(
 #       endif
         _ch_cn_partial_write(conn);
     } else {
-        conn->buffer_any_uv = uv_buf_init(buf, size);
+        conn->write_callback  = callback;
+        conn->write_size      = size;
+        conn->write_written   = size;
+        conn->buffer_any_uv   = uv_buf_init(buf, size);
         uv_write(
             &conn->write_req,
             (uv_stream_t*) &conn->client,
@@ -15,6 +15,7 @@
 // .. code-block:: cpp
 //
 #include "libchirp/chirp.h"
+#include "libchirp/stats.h"
 #include "message.h"
 #include "reader.h"
 #include "writer.h"
@@ -63,6 +64,20 @@
 //
 //       Indicates that the connection buffer is currently used by libuv.
 //
+//    .. c:member:: CH_CN_CONNECTED
+//
+//       The chirp handshake is done, messages can be sent.
+//
+//    .. c:member:: CH_CN_READ_STOPPED
+//
+//       Reading is stopped, since all handler buffers are used (flow
+//       control), see :c:func:`ch_pr_resume_read`.
+//
+//    .. c:member:: CH_CN_COMPACT
+//
+//       Both nodes use the compact frame encoding, see
+//       :c:type:`ch_wi_table_t`.
+//
 // .. code-block:: cpp
 //
 typedef enum {
@@ -73,8 +88,20 @@ typedef enum {
     CH_CN_BUF_WTLS_USED  = 1 << 4,
     CH_CN_BUF_RTLS_USED  = 1 << 5,
     CH_CN_BUF_UV_USED    = 1 << 6,
+    CH_CN_CONNECTED      = 1 << 7,
+    CH_CN_READ_STOPPED   = 1 << 8,
+    CH_CN_COMPACT        = 1 << 9,
 } ch_cn_flags_t;
 
+// .. c:macro:: CH_CN_BUFFER_SIZE
+//
+//    Size of the buffers of a connection, if
+//    :c:member:`ch_config_t.BUFFER_SIZE` is 0. It is the size libuv suggests.
+//
+// .. code-block:: cpp
+//
+#define CH_CN_BUFFER_SIZE (64 * 1024)
+
 // .. c:type:: ch_connection_t
 //
 //    Connection dictionary implemented as red-black tree.
@@ -169,6 +196,10 @@ typedef enum {
 //
 //       Write request objet, which is used to write data on a handle.
 //
+//    .. c:member:: uv_connect_t connect_req
+//
+//       Connect request of connections created by the writer.
+//
 //    .. c:member:: uv_timer_t shutdown_timeout
 //
 //       Timer handle used when shutting down a connection. This is used to set
@@ -182,12 +213,31 @@ typedef enum {
 //       Tasks may be calling closing-callbacks for example, on a request handle
 //       or the shutdown timer handle. This acts as semaphore.
 //
-//    .. c:member:: uint8_t flags
+//    .. c:member:: uint16_t flags
 //
 //       Flags indicating the state of a connection, e.g. shutting down, write
 //       pending, TLS handshake, whether the connection is encrypted or not and
 //       so on, see :c:type:`ch_cn_flags_t`.
 //
+//    .. c:member:: ch_buf* read_rest
+//
+//       Data read (and decrypted) but not consumed by the reader, while
+//       reading is stopped. Points into :c:member:`buffer_uv` or
+//       :c:member:`buffer_rtls`.
+//
+//    .. c:member:: size_t read_rest_len
+//
+//       Length of :c:member:`read_rest`.
+//
+//    .. c:member:: ch_buf* read_tls_rest
+//
+//       Encrypted data read but not passed to SSL, while reading is stopped.
+//       Points into :c:member:`buffer_uv`.
+//
+//    .. c:member:: size_t read_tls_rest_len
+//
+//       Length of :c:member:`read_tls_rest`.
+//
 //    .. c:member:: SSL* ssl
 //
 //       Pointer to a SSL (data-) structure. This is used when using an
@@ -214,7 +264,22 @@ typedef enum {
 //    .. c:member:: float load
 //
 //       The load of the remote peer. This is used when a protocol error or an
-//       timeout happens when writing. See :c:member:`ch_send_cb_t.load`.
+//       timeout happens when writing. See :c:member:`ch_send_cb_t.load`. The
+//       router uses it as load report of the peer, see :c:type:`ch_router_t`.
+//
+//    .. c:member:: uint64_t load_stamp
+//
+//       Loop time (ms) the remote peer last reported its load. Zero if the
+//       peer has not reported a load yet.
+//
+//    .. c:member:: uint64_t last_activity
+//
+//       Loop time (ms) data was last received from the remote peer. Used by
+//       the watcher, see :c:type:`ch_watcher_t`.
+//
+//    .. c:member:: ch_stats_t stats
+//
+//       Counters of the connection, see :c:macro:`CH_STATS_ADD`.
 //
 //    .. c:member:: ch_reader_t reader
 //
@@ -263,14 +328,22 @@ typedef struct ch_connection_s {
     ch_chirp_t*             chirp;
     uv_shutdown_t           shutdown_req;
     uv_write_t              write_req;
+    uv_connect_t            connect_req;
     uv_timer_t              shutdown_timeout;
     int8_t                  shutdown_tasks;
-    uint8_t                 flags;
+    uint16_t                flags;
+    ch_buf*                 read_rest;
+    size_t                  read_rest_len;
+    ch_buf*                 read_tls_rest;
+    size_t                  read_tls_rest_len;
     SSL*                    ssl;
     BIO*                    bio_ssl;
     BIO*                    bio_app;
     int                     tls_handshake_state;
     float                   load;
+    uint64_t                load_stamp;
+    uint64_t                last_activity;
+    ch_stats_t              stats;
     ch_reader_t             reader;
     ch_writer_t             writer;
     char                    color_field;
@@ -320,9 +393,8 @@ ch_cn_close_cb(uv_handle_t* handle);
 void
 ch_cn_read_alloc_cb(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf);
 //
-//    Allocates buffers on the connection and reuses it for each subsequent
-//    reads. Also allocates the buffer for TLS since it has to be the same
-//    size.
+//    Passes the read buffer of the connection to libuv, it is reused for
+//    each read. The buffers are allocated by :c:func:`ch_cn_init`.
 //
 //    :param uv_handle_t* handle: The libuv handle holding the
 //                                connection
@@ -333,12 +405,17 @@ ch_cn_read_alloc_cb(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf);
 
 // .. c:function::
 ch_error_t
-ch_cn_shutdown(ch_connection_t* conn);
+ch_cn_shutdown(ch_connection_t* conn, ch_shutdown_reason_t reason);
 //
-//    Shutdown this connection.
+//    Shutdown this connection. The messages queued on the writer are aborted,
+//    see :c:func:`ch_wr_abort`: with CH_TIMEOUT after a timeout, with
+//    CH_CANNOT_CONNECT if the handshake wasn't done yet and with
+//    CH_PROTOCOL_ERROR otherwise.
 //
 //    :param ch_connection_t* conn: Connection dictionary holding a
 //                                  chirp instance.
+//    :param ch_shutdown_reason_t reason: Reason of the shutdown, counted
+//                                        in :c:type:`ch_stats_t`.
 //    :return: A chirp error. see: :c:type:`ch_error_t`
 //    :rtype: ch_error_t
 
@@ -368,7 +445,9 @@ ch_cn_init_enc(ch_chirp_t* chirp, ch_connection_t* conn);
 void
 ch_cn_send_if_pending(ch_connection_t* conn);
 //
-//    Send all pending handshake data from SSL
+//    Send all pending handshake data from SSL. If nothing is pending the
+//    chirp handshake is started or the writer continues, see
+//    :c:func:`ch_wr_process_queues`.
 //
 //    :param ch_connection_t* conn: Connection
 //
@@ -0,0 +1,237 @@
+// =====
+// Dedup
+// =====
+//
+// Duplicate suppression, see :c:type:`ch_dedup_t`.
+//
+// .. code-block:: cpp
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "dedup.h"
+#include "util.h"
+
+// Sglib Prototypes
+// ================
+
+// .. code-block:: cpp
+//
+SGLIB_DEFINE_RBTREE_FUNCTIONS( // NOCOV
+    ch_dd_peer_t,
+    left,
+    right,
+    color_field,
+    CH_DD_PEER_CMP
+)
+
+// Declarations
+// ============
+
+// .. c:function::
+static
+ch_dd_peer_t*
+_ch_dd_get_peer(ch_dedup_t* dedup, const uint8_t* identity, uint64_t now);
+//
+//    Find the filter of a peer or create it.
+//
+//    :param ch_dedup_t* dedup:       Duplicate suppression object.
+//    :param const uint8_t* identity: Identity of the peer (16 bytes).
+//    :param uint64_t now:            Current time in ms.
+//
+//    :return: the filter, NULL if out of memory.
+//    :rtype:  ch_dd_peer_t*
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_dd_hash(const uint8_t* serial, uint32_t* index);
+//
+//    Get the bits of a serial (double hashing of both halves).
+//
+//    :param const uint8_t* serial: The serial (16 bytes).
+//    :param uint32_t* index:       Out: :c:macro:`CH_DD_HASHES` bit indexes.
+
+// .. c:function::
+static
+void
+_ch_dd_sweep(ch_dedup_t* dedup, uint64_t now);
+//
+//    Remove the filters of peers that sent nothing for two horizons.
+//
+//    :param ch_dedup_t* dedup: Duplicate suppression object.
+//    :param uint64_t now:      Current time in ms.
+
+// Definitions
+// ===========
+
+// .. c:function::
+static
+ch_dd_peer_t*
+_ch_dd_get_peer(ch_dedup_t* dedup, const uint8_t* identity, uint64_t now)
+//    :noindex:
+//
+//    see: :c:func:`_ch_dd_get_peer`
+//
+// .. code-block:: cpp
+//
+{
+    ch_dd_peer_t key;
+    ch_dd_peer_t* peer;
+    memcpy(key.identity, identity, 16);
+    peer = sglib_ch_dd_peer_t_find_member(dedup->peers, &key);
+    if(peer != NULL)
+        return peer;
+    peer = ch_alloc(sizeof(*peer));
+    if(!peer)
+        return NULL;
+    memset(peer, 0, sizeof(*peer));
+    memcpy(peer->identity, identity, 16);
+    peer->rotate_at = now + dedup->horizon;
+    sglib_ch_dd_peer_t_add(&dedup->peers, peer);
+    return peer;
+}
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_dd_hash(const uint8_t* serial, uint32_t* index)
+//    :noindex:
+//
+//    see: :c:func:`_ch_dd_hash`
+//
+// .. code-block:: cpp
+//
+{
+    int i;
+    uint64_t low;
+    uint64_t high;
+    uint32_t h1;
+    uint32_t h2;
+    memcpy(&low, serial, 8);
+    memcpy(&high, serial + 8, 8);
+    h1 = (uint32_t) ((low * 0x9E3779B97F4A7C15ULL) >> 32);
+    /* An odd step visits all bits of the filter. */
+    h2 = (uint32_t) ((high * 0xC2B2AE3D27D4EB4FULL) >> 32) | 1;
+    for(i = 0; i < CH_DD_HASHES; i++)
+        index[i] = (h1 + (uint32_t) i * h2) & (CH_DD_BITS - 1);
+}
+
+// .. c:function::
+static
+void
+_ch_dd_sweep(ch_dedup_t* dedup, uint64_t now)
+//    :noindex:
+//
+//    see: :c:func:`_ch_dd_sweep`
+//
+// .. code-block:: cpp
+//
+{
+    ch_dd_peer_t* peer;
+    ch_dd_peer_t* idle = NULL;
+    struct sglib_ch_dd_peer_t_iterator it;
+    for(
+            peer = sglib_ch_dd_peer_t_it_init(&it, dedup->peers);
+            peer != NULL;
+            peer = sglib_ch_dd_peer_t_it_next(&it)
+    ) {
+        if(peer->last_seen + 2 * dedup->horizon <= now) {
+            peer->next = idle;
+            idle = peer;
+        }
+    }
+    while(idle != NULL) {
+        peer = idle;
+        idle = peer->next;
+        sglib_ch_dd_peer_t_delete(&dedup->peers, peer);
+        ch_free(peer);
+    }
+    dedup->sweep_at = now + dedup->horizon;
+}
+
+// .. c:function::
+void
+ch_dd_free(ch_dedup_t* dedup)
+//    :noindex:
+//
+//    see: :c:func:`ch_dd_free`
+//
+// .. code-block:: cpp
+//
+{
+    ch_dd_peer_t* peer;
+    struct sglib_ch_dd_peer_t_iterator it;
+    for(
+            peer = sglib_ch_dd_peer_t_it_init_postorder(&it, dedup->peers);
+            peer != NULL;
+            peer = sglib_ch_dd_peer_t_it_next(&it)
+    ) {
+        ch_free(peer);
+    }
+    dedup->peers = NULL;
+}
+
+// .. c:function::
+int
+ch_dd_seen(
+        ch_dedup_t* dedup,
+        ch_receipts_t* receipts,
+        const uint8_t* identity,
+        const uint8_t* serial,
+        uint64_t now
+)
+//    :noindex:
+//
+//    see: :c:func:`ch_dd_seen`
+//
+// .. code-block:: cpp
+//
+{
+    int i;
+    int gen;
+    uint64_t* bits;
+    uint32_t index[CH_DD_HASHES];
+    ch_dd_peer_t* peer;
+    if(dedup->horizon == 0)
+        return 0;
+    if(now >= dedup->sweep_at) {
+        if(dedup->sweep_at != 0)
+            _ch_dd_sweep(dedup, now);
+        else
+            dedup->sweep_at = now + dedup->horizon;
+    }
+    peer = _ch_dd_get_peer(dedup, identity, now);
+    if(peer == NULL)
+        return 0;
+    peer->last_seen = now;
+    if(now >= peer->rotate_at || peer->count >= CH_DD_CAPACITY) {
+        peer->current = !peer->current;
+        memset(peer->bits[peer->current], 0, sizeof(peer->bits[0]));
+        peer->count     = 0;
+        peer->rotate_at = now + dedup->horizon;
+    }
+    _ch_dd_hash(serial, index);
+    /* Likely a duplicate if all bits are set in either generation. */
+    for(gen = 0; gen < 2; gen++) {
+        bits = peer->bits[gen];
+        for(i = 0; i < CH_DD_HASHES; i++) {
+            if(!(bits[index[i] >> 6] & (1ULL << (index[i] & 63))))
+                break;
+        }
+        if(i == CH_DD_HASHES)
+            break;
+    }
+    if(gen < 2 && ch_rc_contains(receipts, serial, now))
+        return 1;
+    bits = peer->bits[peer->current];
+    for(i = 0; i < CH_DD_HASHES; i++)
+        bits[index[i] >> 6] |= 1ULL << (index[i] & 63);
+    peer->count += 1;
+    ch_rc_add(receipts, serial, now);
+    return 0;
+}
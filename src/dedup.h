@@ -0,0 +1,217 @@
+// ============
+// Dedup header
+// ============
+//
+// Suppression of duplicate messages. Retries and the spool (see
+// :c:member:`ch_config_t.SPOOL_DIR`) send a message again with its serial,
+// if the first send was not acknowledged, so the receiver may get it twice.
+//
+// Every peer (by remote identity) has a Bloom filter of the serials it sent
+// recently. Only if the filter reports a likely duplicate, the serial is
+// looked up in the receipts of the protocol (see :c:type:`ch_receipts_t`),
+// which confirm it. The filter has two generations, the older one is
+// cleared when the current one is older than
+// :c:member:`ch_config_t.REUSE_TIME` or full. So the memory is fixed per
+// peer, at higher message rates the horizon gets shorter. The receipts are
+// bounded too, a likely duplicate that is not confirmed is delivered.
+//
+// Duplicates are detected when the reader has decoded the wire message, so
+// before the payload arrives. The payload of a duplicate is skipped: nothing
+// is allocated or copied and it is not passed to the stream callback. It is
+// acknowledged but not passed to the receive callback. A message whose
+// connection is shut down before it is complete is removed from the
+// receipts, so a retry is delivered.
+//
+// .. code-block:: cpp
+//
+#ifndef ch_dedup_h
+#define ch_dedup_h
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "common.h"
+#include "receipt.h"
+#include "sglib.h"
+
+// Declarations
+// ============
+
+// .. c:macro:: CH_DD_BITS
+//
+//    Bits of a filter generation, a power of two.
+//
+// .. c:macro:: CH_DD_HASHES
+//
+//    Bits set per serial.
+//
+// .. c:macro:: CH_DD_CAPACITY
+//
+//    Serials per generation, about 1% false positives when it is full.
+//
+// .. c:macro:: CH_DD_RECEIPTS
+//
+//    Limit of a generation of the receipts, see
+//    :c:member:`ch_receipts_t.limit`.
+//
+// .. code-block:: cpp
+//
+#define CH_DD_BITS (1 << 17)
+#define CH_DD_HASHES 4
+#define CH_DD_CAPACITY (CH_DD_BITS / 10)
+#define CH_DD_RECEIPTS 16384
+
+// .. c:type:: ch_dd_peer_t
+//
+//    Filter of a peer, implemented as red-black tree.
+//
+//    .. c:member:: uint8_t identity[16]
+//
+//       Identity of the peer.
+//
+//    .. c:member:: uint64_t bits[2][CH_DD_BITS / 64]
+//
+//       The filter generations.
+//
+//    .. c:member:: int current
+//
+//       Index of the generation serials are added to.
+//
+//    .. c:member:: uint32_t count
+//
+//       Count of serials added to the current generation.
+//
+//    .. c:member:: uint64_t rotate_at
+//
+//       Time (ms) the current generation ends.
+//
+//    .. c:member:: uint64_t last_seen
+//
+//       Time (ms) of the last message of the peer.
+//
+//    .. c:member:: struct ch_dd_peer_s* next
+//
+//       Next idle peer, while they are removed.
+//
+//    .. c:member:: char color_field
+//
+//       The color of the current node. This may either be red or black.
+//
+//    .. c:member:: struct ch_dd_peer_s* left
+//
+//       Left child in the red-black tree.
+//
+//    .. c:member:: struct ch_dd_peer_s* right
+//
+//       Right child in the red-black tree.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_dd_peer_s {
+    uint8_t              identity[16];
+    uint64_t             bits[2][CH_DD_BITS / 64];
+    int                  current;
+    uint32_t             count;
+    uint64_t             rotate_at;
+    uint64_t             last_seen;
+    struct ch_dd_peer_s* next;
+    char                 color_field;
+    struct ch_dd_peer_s* left;
+    struct ch_dd_peer_s* right;
+} ch_dd_peer_t;
+
+// .. c:type:: ch_dedup_t
+//
+//    Duplicate suppression object.
+//
+//    .. c:member:: ch_dd_peer_t* peers
+//
+//       The filters of the peers.
+//
+//    .. c:member:: uint64_t horizon
+//
+//       Lifetime (ms) of a filter generation, 0 if suppression is disabled.
+//
+//    .. c:member:: uint64_t sweep_at
+//
+//       Time (ms) idle peers are removed next.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_dedup_s {
+    ch_dd_peer_t* peers;
+    uint64_t      horizon;
+    uint64_t      sweep_at;
+} ch_dedup_t;
+
+// .. c:function::
+void
+ch_dd_free(ch_dedup_t* dedup);
+//
+//    Free the filters of the peers.
+//
+//    :param ch_dedup_t* dedup: Duplicate suppression object.
+
+// .. c:function::
+int
+ch_dd_seen(
+        ch_dedup_t* dedup,
+        ch_receipts_t* receipts,
+        const uint8_t* identity,
+        const uint8_t* serial,
+        uint64_t now
+);
+//
+//    Check if a message is a duplicate. If it is not, it is recorded.
+//
+//    :param ch_dedup_t* dedup:       Duplicate suppression object.
+//    :param ch_receipts_t* receipts: Receipts confirming duplicates.
+//    :param const uint8_t* identity: Identity of the peer (16 bytes).
+//    :param const uint8_t* serial:   Serial of the message (16 bytes).
+//    :param uint64_t now:            Current time in ms (loop time).
+//
+//    :return: 1 if the message is a duplicate, 0 otherwise.
+//    :rtype:  int
+
+// .. c:macro:: CH_DD_PEER_CMP
+//
+//    Compare the identities of peers.
+//
+// .. code-block:: cpp
+//
+#define CH_DD_PEER_CMP(x,y) memcmp(x->identity, y->identity, 16)
+
+// .. code-block:: cpp
+//
+SGLIB_DEFINE_RBTREE_PROTOTYPES( // NOCOV
+    ch_dd_peer_t,
+    left,
+    right,
+    color_field,
+    CH_DD_PEER_CMP
+)
+
+// Definitions
+// ===========
+
+// .. c:function::
+static
+ch_inline
+void
+ch_dd_init(ch_dedup_t* dedup, uint64_t horizon)
+//
+//    Initialize the duplicate suppression object.
+//
+//    :param ch_dedup_t* dedup: Duplicate suppression object.
+//    :param uint64_t horizon:  Lifetime (ms) of a filter generation.
+//
+// .. code-block:: cpp
+//
+{
+    memset(dedup, 0, sizeof(ch_dedup_t));
+    dedup->horizon = horizon;
+}
+
+#endif //ch_dedup_h
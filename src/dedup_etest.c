@@ -0,0 +1,224 @@
+// ===========
+// Dedup etest
+// ===========
+//
+// Behavior of the duplicate suppression (see :c:type:`ch_dedup_t`): the
+// Bloom filter of a peer reports likely duplicates, the receipts confirm
+// them. The filter generations rotate by time and when they are full, idle
+// peers are removed.
+//
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "libchirp.h"
+#include "fixture_test.h"
+#include "dedup.h"
+
+// Test functions
+// ==============
+//
+// Not documented on purpose.
+//
+// .. code-block:: cpp
+
+#define CH_DD_TEST_HORIZON 100
+#define CH_DD_TEST_RECEIPTS 100000
+
+typedef struct ch_dd_test_s {
+    ch_dedup_t    dedup;
+    ch_receipts_t receipts;
+    uint8_t       peer_a[16];
+    uint8_t       peer_b[16];
+    int           errors;
+} ch_dd_test_t;
+
+static ch_dd_test_t _ch_dd_test;
+
+static
+void
+_ch_dd_test_serial(uint8_t* serial, uint64_t i)
+{
+    uint64_t high = i * 0x2545F4914F6CDD1DULL;
+    memcpy(serial, &i, 8);
+    memcpy(serial + 8, &high, 8);
+}
+
+static
+void
+_ch_dd_test_init(ch_dd_test_t* test, uint64_t horizon)
+{
+    ch_dd_init(&test->dedup, horizon);
+    ch_rc_init(&test->receipts, CH_DD_TEST_RECEIPTS, 0);
+    memset(test->peer_a, 'a', 16);
+    memset(test->peer_b, 'b', 16);
+}
+
+static
+void
+_ch_dd_test_free(ch_dd_test_t* test)
+{
+    ch_dd_free(&test->dedup);
+    ch_rc_free(&test->receipts);
+}
+
+static
+ch_dd_peer_t*
+_ch_dd_test_peer(ch_dd_test_t* test, const uint8_t* identity)
+{
+    ch_dd_peer_t key;
+    memcpy(key.identity, identity, 16);
+    return sglib_ch_dd_peer_t_find_member(test->dedup.peers, &key);
+}
+
+static
+void
+_ch_dd_test_seen(
+        ch_dd_test_t* test,
+        const uint8_t* peer,
+        uint64_t i,
+        uint64_t now,
+        int expected,
+        const char* what
+)
+{
+    uint8_t serial[16];
+    _ch_dd_test_serial(serial, i);
+    test->errors += ch_test_expect(
+        ch_dd_seen(&test->dedup, &test->receipts, peer, serial, now),
+        expected,
+        what
+    );
+}
+
+static
+void
+_ch_dd_test_confirm(ch_dd_test_t* test)
+{
+    ch_dd_peer_t* peer;
+    _ch_dd_test_init(test, CH_DD_TEST_HORIZON);
+    _ch_dd_test_seen(test, test->peer_a, 1, 0, 0, "Confirm");
+    _ch_dd_test_seen(test, test->peer_a, 1, 0, 1, "Confirm");
+    _ch_dd_test_seen(test, test->peer_a, 2, 0, 0, "Confirm");
+    /* Filters are per peer */
+    _ch_dd_test_seen(test, test->peer_b, 1, 0, 0, "Confirm");
+    _ch_dd_test_seen(test, test->peer_b, 1, 0, 1, "Confirm");
+    /* A likely duplicate the receipts don't know is delivered */
+    peer = _ch_dd_test_peer(test, test->peer_a);
+    if(peer == NULL) {
+        fprintf(stderr, "Confirm: peer not found\n");
+        test->errors += 1;
+    } else {
+        memset(peer->bits[peer->current], 0xff, sizeof(peer->bits[0]));
+        _ch_dd_test_seen(test, test->peer_a, 3, 0, 0, "Confirm");
+        _ch_dd_test_seen(test, test->peer_a, 3, 0, 1, "Confirm");
+    }
+    _ch_dd_test_free(test);
+    /* Disabled */
+    _ch_dd_test_init(test, 0);
+    _ch_dd_test_seen(test, test->peer_a, 1, 0, 0, "Disabled");
+    _ch_dd_test_seen(test, test->peer_a, 1, 0, 0, "Disabled");
+    _ch_dd_test_free(test);
+}
+
+static
+void
+_ch_dd_test_rotate_time(ch_dd_test_t* test)
+{
+    uint64_t h = CH_DD_TEST_HORIZON;
+    _ch_dd_test_init(test, h);
+    _ch_dd_test_seen(test, test->peer_a, 1, 0, 0, "Rotate time");
+    /* The older generation is still checked */
+    _ch_dd_test_seen(test, test->peer_a, 1, h + h / 2, 1, "Rotate time");
+    /* The generation of the serial is cleared */
+    _ch_dd_test_seen(
+        test,
+        test->peer_a,
+        1,
+        2 * h + h / 2 + 10,
+        0,
+        "Rotate time"
+    );
+    _ch_dd_test_free(test);
+}
+
+static
+void
+_ch_dd_test_rotate_full(ch_dd_test_t* test)
+{
+    uint64_t i;
+    _ch_dd_test_init(test, CH_DD_TEST_HORIZON);
+    for(i = 0; i < CH_DD_CAPACITY; i++)
+        _ch_dd_test_seen(test, test->peer_a, i, 0, 0, "Rotate full");
+    for(i = CH_DD_CAPACITY; i < CH_DD_CAPACITY + 10; i++)
+        _ch_dd_test_seen(test, test->peer_a, i, 0, 0, "Rotate full");
+    /* The full generation is the older one now */
+    _ch_dd_test_seen(test, test->peer_a, 0, 0, 1, "Rotate full");
+    for(i = CH_DD_CAPACITY + 10; i < 2 * CH_DD_CAPACITY; i++)
+        _ch_dd_test_seen(test, test->peer_a, i, 0, 0, "Rotate full");
+    _ch_dd_test_seen(
+        test,
+        test->peer_a,
+        2 * CH_DD_CAPACITY,
+        0,
+        0,
+        "Rotate full"
+    );
+    if(test->dedup.peers == NULL || test->dedup.peers->count != 1) {
+        fprintf(stderr, "Rotate full: generation not rotated\n");
+        test->errors += 1;
+    }
+    /* The generation of the serial is cleared */
+    _ch_dd_test_seen(test, test->peer_a, 0, 0, 0, "Rotate full");
+    _ch_dd_test_free(test);
+}
+
+static
+void
+_ch_dd_test_sweep(ch_dd_test_t* test)
+{
+    ch_dd_peer_t* peer;
+    uint64_t h = CH_DD_TEST_HORIZON;
+    _ch_dd_test_init(test, h);
+    _ch_dd_test_seen(test, test->peer_a, 1, 0, 0, "Sweep");
+    _ch_dd_test_seen(test, test->peer_b, 2, h, 0, "Sweep");
+    peer = _ch_dd_test_peer(test, test->peer_b);
+    /* Peer a is idle for two horizons, peer b is not */
+    _ch_dd_test_seen(test, test->peer_b, 3, 2 * h, 0, "Sweep");
+    if(_ch_dd_test_peer(test, test->peer_a) != NULL) {
+        fprintf(stderr, "Sweep: idle peer not removed\n");
+        test->errors += 1;
+    }
+    if(peer == NULL || _ch_dd_test_peer(test, test->peer_b) != peer) {
+        fprintf(stderr, "Sweep: active peer removed\n");
+        test->errors += 1;
+    }
+    _ch_dd_test_free(test);
+}
+
+// Runner
+// ======
+
+// .. c:function::
+int
+main(void)
+//    :noindex:
+//
+//    Run the test.
+//
+// .. code-block:: cpp
+//
+{
+    ch_dd_test_t* test = &_ch_dd_test;
+    ch_libchirp_init();
+    memset(test, 0, sizeof(*test));
+    _ch_dd_test_confirm(test);
+    _ch_dd_test_rotate_time(test);
+    _ch_dd_test_rotate_full(test);
+    _ch_dd_test_sweep(test);
+    ch_libchirp_cleanup();
+    if(test->errors == 0)
+        printf("OK\n");
+    return test->errors > 0;
+}
@@ -0,0 +1,77 @@
+// ============
+// Fixture test
+// ============
+//
+// .. code-block:: cpp
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+
+#include "fixture_test.h"
+
+// Definitions
+// ===========
+//
+
+// .. c:function::
+void
+ch_test_close_cb(uv_handle_t* handle)
+//    :noindex:
+//
+//    see: :c:func:`ch_test_close_cb`
+//
+// .. code-block:: cpp
+//
+{
+    (void)(handle);
+}
+
+// .. c:function::
+int
+ch_test_expect(int got, int expected, const char* what)
+//    :noindex:
+//
+//    see: :c:func:`ch_test_expect`
+//
+// .. code-block:: cpp
+//
+{
+    if(got == expected)
+        return 0;
+    fprintf(stderr, "%s: expected %d, got %d\n", what, expected, got);
+    return 1;
+}
+
+// .. c:function::
+void
+ch_test_fake_chirp(ch_chirp_t* chirp, ch_chirp_int_t* ichirp)
+//    :noindex:
+//
+//    see: :c:func:`ch_test_fake_chirp`
+//
+// .. code-block:: cpp
+//
+{
+    memset(chirp, 0, sizeof(*chirp));
+    memset(ichirp, 0, sizeof(*ichirp));
+    ch_chirp_config_init(&ichirp->config);
+    chirp->_init = CH_CHIRP_MAGIC;
+    chirp->_     = ichirp;
+    chirp->_log  = ch_test_log_cb;
+}
+
+// .. c:function::
+void
+ch_test_log_cb(char msg[], char error)
+//    :noindex:
+//
+//    see: :c:func:`ch_test_log_cb`
+//
+// .. code-block:: cpp
+//
+{
+    if(error)
+        fprintf(stderr, "%s\n", msg);
+}
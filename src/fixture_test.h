@@ -0,0 +1,63 @@
+// ===================
+// Fixture test Header
+// ===================
+//
+// Helpers shared by the etests: logging, a chirp that is only used for
+// logging and checking results.
+//
+// .. code-block:: cpp
+//
+#ifndef ch_fixture_test_h
+#define ch_fixture_test_h
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "chirp.h"
+
+// Declarations
+// ============
+
+// .. c:function::
+void
+ch_test_close_cb(uv_handle_t* handle);
+//
+//    Close callback that does nothing, for handles embedded in the test.
+//
+//    :param uv_handle_t* handle: The closed handle.
+
+// .. c:function::
+int
+ch_test_expect(int got, int expected, const char* what);
+//
+//    Check a result, print **what** if it is not the expected one.
+//
+//    :param int got:          The result.
+//    :param int expected:     The expected result.
+//    :param const char* what: What was checked.
+//
+//    :return: 0 if the result is the expected one, 1 otherwise.
+//    :rtype:  int
+
+// .. c:function::
+void
+ch_test_fake_chirp(ch_chirp_t* chirp, ch_chirp_int_t* ichirp);
+//
+//    Initialize a chirp object that has no loop and no connections, for
+//    testing components that only use chirp for logging and its config.
+//
+//    :param ch_chirp_t* chirp:      Out: The chirp object.
+//    :param ch_chirp_int_t* ichirp: Out: Its internals.
+
+// .. c:function::
+void
+ch_test_log_cb(char msg[], char error);
+//
+//    Log callback printing errors only.
+//
+//    :param char[] msg: The message.
+//    :param char error: Non-zero if it is an error.
+
+#endif //ch_fixture_test_h
@@ -0,0 +1,219 @@
+// ==========
+// Histograms
+// ==========
+//
+// Log-bucketed histograms, see :c:type:`ch_histogram_t`.
+//
+// A value below 2^CH_HG_SUB_BITS has its own bucket. For larger values the
+// bucket is chosen by the most significant bit and the CH_HG_SUB_BITS bits
+// following it.
+//
+// .. code-block:: cpp
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "histogram.h"
+#include "chirp.h"
+
+// Declarations
+// ============
+
+// .. c:macro:: CH_HG_SUB_COUNT
+//
+//    Count of buckets per power of two.
+//
+// .. code-block:: cpp
+//
+#define CH_HG_SUB_COUNT (1 << CH_HG_SUB_BITS)
+
+// .. c:function::
+static
+ch_inline
+int
+_ch_hg_msb64(uint64_t value);
+//
+//    Get the index of the most significant bit set.
+//
+//    :param uint64_t value: The value, must not be zero.
+//
+//    :return: the index (0 - 63)
+//    :rtype:  int
+
+// .. c:function::
+static
+ch_inline
+uint64_t
+_ch_hg_upper(int index);
+//
+//    Get the largest value of a bucket.
+//
+//    :param int index: Index of the bucket.
+//
+//    :return: the largest value
+//    :rtype:  uint64_t
+
+// Definitions
+// ===========
+
+// .. c:function::
+static
+ch_inline
+int
+_ch_hg_msb64(uint64_t value)
+//    :noindex:
+//
+//    see: :c:func:`_ch_hg_msb64`
+//
+// .. code-block:: cpp
+//
+{
+#ifdef __GNUC__
+    return 63 - __builtin_clzll(value);
+#else // __GNUC__
+    int msb = 0;
+    while(value >>= 1)
+        msb += 1;
+    return msb;
+#endif // __GNUC__
+}
+
+// .. c:function::
+static
+ch_inline
+uint64_t
+_ch_hg_upper(int index)
+//    :noindex:
+//
+//    see: :c:func:`_ch_hg_upper`
+//
+// .. code-block:: cpp
+//
+{
+    int shift;
+    if(index < CH_HG_SUB_COUNT)
+        return index;
+    shift = (index >> CH_HG_SUB_BITS) - 1;
+    return (
+        (uint64_t) (CH_HG_SUB_COUNT + (index & (CH_HG_SUB_COUNT - 1)) + 1)
+        << shift
+    ) - 1;
+}
+
+// .. c:function::
+void
+ch_chirp_get_histograms(
+        ch_chirp_t* chirp,
+        ch_histogram_t histograms[CH_HG_STAGES],
+        int reset
+)
+//    :noindex:
+//
+//    see: :c:func:`ch_chirp_get_histograms`
+//
+// .. code-block:: cpp
+//
+{
+    int i;
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    ch_chirp_int_t* ichirp = chirp->_;
+    memcpy(
+        histograms,
+        ichirp->histograms,
+        sizeof(ch_histogram_t) * CH_HG_STAGES
+    );
+    if(reset) {
+        for(i = 0; i < CH_HG_STAGES; i++)
+            ch_hg_reset(&ichirp->histograms[i]);
+    }
+}
+
+// .. c:function::
+void
+ch_hg_merge(ch_histogram_t* dest, const ch_histogram_t* src)
+//    :noindex:
+//
+//    see: :c:func:`ch_hg_merge`
+//
+// .. code-block:: cpp
+//
+{
+    int i;
+    dest->count += src->count;
+    dest->sum   += src->sum;
+    if(src->max > dest->max)
+        dest->max = src->max;
+    for(i = 0; i < CH_HG_BUCKETS; i++)
+        dest->buckets[i] += src->buckets[i];
+}
+
+// .. c:function::
+uint64_t
+ch_hg_percentile(const ch_histogram_t* histogram, double percentile)
+//    :noindex:
+//
+//    see: :c:func:`ch_hg_percentile`
+//
+// .. code-block:: cpp
+//
+{
+    int i;
+    uint64_t seen = 0;
+    uint64_t target;
+    if(histogram->count == 0)
+        return 0;
+    if(percentile > 100)
+        percentile = 100;
+    target = (uint64_t) (histogram->count * (percentile / 100));
+    if(target == 0)
+        target = 1;
+    for(i = 0; i < CH_HG_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if(seen >= target) {
+            uint64_t upper = _ch_hg_upper(i);
+            return upper < histogram->max ? upper : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+// .. c:function::
+void
+ch_hg_record(ch_histogram_t* histogram, uint64_t value)
+//    :noindex:
+//
+//    see: :c:func:`ch_hg_record`
+//
+// .. code-block:: cpp
+//
+{
+    int index;
+    if(value < CH_HG_SUB_COUNT) {
+        index = (int) value;
+    } else {
+        int msb = _ch_hg_msb64(value);
+        index = ((msb - CH_HG_SUB_BITS + 1) << CH_HG_SUB_BITS) + (int) (
+            (value >> (msb - CH_HG_SUB_BITS)) & (CH_HG_SUB_COUNT - 1)
+        );
+    }
+    histogram->buckets[index] += 1;
+    histogram->count          += 1;
+    histogram->sum            += value;
+    if(value > histogram->max)
+        histogram->max = value;
+}
+
+// .. c:function::
+void
+ch_hg_reset(ch_histogram_t* histogram)
+//    :noindex:
+//
+//    see: :c:func:`ch_hg_reset`
+//
+// .. code-block:: cpp
+//
+{
+    memset(histogram, 0, sizeof(ch_histogram_t));
+}
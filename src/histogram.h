@@ -0,0 +1,45 @@
+// ================
+// Histogram header
+// ================
+//
+// Timing of the stages, see :c:type:`ch_hg_stage_t`.
+//
+// .. code-block:: cpp
+//
+#ifndef ch_histogram_h
+#define ch_histogram_h
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "libchirp/histogram.h"
+
+// Definitions
+// ===========
+
+// .. c:function::
+static
+ch_inline
+uint64_t
+ch_hg_stage(ch_histogram_t* histogram, uint64_t start)
+//
+//    Record the time since **start** and return the current time, which is
+//    the start of the next stage.
+//
+//    :param ch_histogram_t* histogram: The histogram of the stage.
+//    :param uint64_t start: Start of the stage (uv_hrtime).
+//
+//    :return: the current time (uv_hrtime)
+//    :rtype:  uint64_t
+//
+// .. code-block:: cpp
+//
+{
+    uint64_t now = uv_hrtime();
+    ch_hg_record(histogram, now - start);
+    return now;
+}
+
+#endif //ch_histogram_h
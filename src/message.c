@@ -14,6 +14,79 @@
 #include "message.h"
 #include "util.h"
 
+// Declarations
+// ============
+
+// .. c:function::
+static
+ch_error_t
+_ch_msg_pool_buffer(void** buf, uint32_t* size, uint32_t len);
+//
+//    Make sure a buffer owned by a pooled message has at least the given
+//    length. Its content is not kept.
+//
+//    :param void** buf:     In/out: The buffer.
+//    :param uint32_t* size: In/out: Size of the buffer.
+//    :param uint32_t len:   Length needed.
+//
+//    :return: A chirp error. see: :c:type:`ch_error_t`
+//    :rtype:  ch_error_t
+
+// .. c:function::
+static
+void
+_ch_msg_pool_drop(ch_msg_pool_item_t* item);
+//
+//    Free a pooled message and its buffers.
+//
+//    :param ch_msg_pool_item_t* item: The pooled message.
+
+// Definitions
+// ===========
+
+// .. c:function::
+static
+ch_error_t
+_ch_msg_pool_buffer(void** buf, uint32_t* size, uint32_t len)
+//    :noindex:
+//
+//    see: :c:func:`_ch_msg_pool_buffer`
+//
+// .. code-block:: cpp
+//
+{
+    if(*size >= len)
+        return CH_SUCCESS;
+    if(*buf != NULL)
+        ch_free(*buf);
+    *size = 0;
+    *buf  = ch_alloc(len);
+    if(*buf == NULL)
+        return CH_ENOMEM;
+    *size = len;
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+static
+void
+_ch_msg_pool_drop(ch_msg_pool_item_t* item)
+//    :noindex:
+//
+//    see: :c:func:`_ch_msg_pool_drop`
+//
+// .. code-block:: cpp
+//
+{
+    if(item->header != NULL)
+        ch_free(item->header);
+    if(item->actor != NULL)
+        ch_free(item->actor);
+    if(item->data != NULL)
+        ch_free(item->data);
+    ch_free(item);
+}
+
 // .. c:function::
 ch_error_t
 ch_msg_get_address(
@@ -64,6 +137,146 @@ ch_msg_init(ch_message_t* message)
     return CH_SUCCESS;
 }
 
+// .. c:function::
+ch_error_t
+ch_msg_pool_acquire(
+    ch_msg_pool_t* pool,
+    ch_message_t** message,
+    uint16_t header_len,
+    uint16_t actor_len,
+    uint32_t data_len
+)
+//    :noindex:
+//
+//    see: :c:func:`ch_msg_pool_acquire`
+//
+// .. code-block:: cpp
+//
+{
+    ch_message_t* msg;
+    ch_msg_pool_item_t* item = pool->_free;
+    if(item != NULL) {
+        pool->_free   = item->next;
+        pool->_count -= 1;
+    } else {
+        item = ch_alloc(sizeof(*item));
+        if(!item)
+            return CH_ENOMEM;
+        memset(item, 0, sizeof(*item));
+    }
+    if(
+            _ch_msg_pool_buffer(
+                (void**) &item->header,
+                &item->header_size,
+                header_len
+            ) != CH_SUCCESS ||
+            _ch_msg_pool_buffer(
+                (void**) &item->actor,
+                &item->actor_size,
+                actor_len
+            ) != CH_SUCCESS ||
+            _ch_msg_pool_buffer(
+                (void**) &item->data,
+                &item->data_size,
+                data_len
+            ) != CH_SUCCESS
+    ) {
+        _ch_msg_pool_drop(item);
+        return CH_ENOMEM;
+    }
+    msg = &item->msg;
+    /* Only reset what is not overwritten: the serial is set by
+     * ch_chirp_send, the address by ch_msg_set_address.
+     */
+    ch_random_ints_as_bytes(msg->identity, sizeof(msg->identity));
+    msg->message_type = 0;
+    msg->header_len   = header_len;
+    msg->actor_len    = actor_len;
+    msg->data_len     = data_len;
+    msg->header       = header_len > 0 ? item->header : NULL;
+    msg->actor        = actor_len > 0 ? item->actor : NULL;
+    msg->data         = data_len > 0 ? item->data : NULL;
+    msg->ip_protocol  = 0;
+    msg->port         = 0;
+    msg->free_header  = 0;
+    msg->free_actor   = 0;
+    msg->free_data    = 0;
+    msg->streamed     = 0;
+    msg->_send_cb     = NULL;
+    msg->_next        = NULL;
+    msg->_handler     = NULL;
+    msg->_stamp       = 0;
+    msg->_retries     = 0;
+    msg->_spool       = NULL;
+    *message = msg;
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+void
+ch_msg_pool_free(ch_msg_pool_t* pool)
+//    :noindex:
+//
+//    see: :c:func:`ch_msg_pool_free`
+//
+// .. code-block:: cpp
+//
+{
+    ch_msg_pool_item_t* item;
+    while(pool->_free != NULL) {
+        item = pool->_free;
+        pool->_free = item->next;
+        _ch_msg_pool_drop(item);
+    }
+    pool->_count = 0;
+}
+
+// .. c:function::
+void
+ch_msg_pool_init(ch_msg_pool_t* pool, uint32_t max)
+//    :noindex:
+//
+//    see: :c:func:`ch_msg_pool_init`
+//
+// .. code-block:: cpp
+//
+{
+    pool->_free  = NULL;
+    pool->_count = 0;
+    pool->_max   = max;
+}
+
+// .. c:function::
+void
+ch_msg_pool_release(ch_msg_pool_t* pool, ch_message_t* message)
+//    :noindex:
+//
+//    see: :c:func:`ch_msg_pool_release`
+//
+// .. code-block:: cpp
+//
+{
+    ch_msg_pool_item_t* item = (ch_msg_pool_item_t*) message;
+    if(message->free_header && message->header != item->header)
+        ch_free(message->header);
+    if(message->free_actor && message->actor != item->actor)
+        ch_free(message->actor);
+    if(message->free_data && message->data != item->data)
+        ch_free(message->data);
+    if(pool->_count >= pool->_max) {
+        _ch_msg_pool_drop(item);
+        return;
+    }
+    if(item->data_size > CH_MSG_POOL_KEEP) {
+        ch_free(item->data);
+        item->data      = NULL;
+        item->data_size = 0;
+    }
+    item->next   = pool->_free;
+    pool->_free  = item;
+    pool->_count += 1;
+}
+
 // .. c:function::
 ch_error_t
 ch_msg_set_address(
@@ -11,6 +11,70 @@
 
 // Project includes
 // ================
+//
+// .. code-block:: cpp
+//
 #include "libchirp/message.h"
 
+// Declarations
+// ============
+
+// .. c:macro:: CH_MSG_POOL_KEEP
+//
+//    Buffers of a pooled message larger than this are freed on release, so
+//    a few large messages don't keep their memory in the pool.
+//
+// .. code-block:: cpp
+//
+#define CH_MSG_POOL_KEEP (64 * 1024)
+
+// .. c:type:: ch_msg_pool_item_t
+//
+//    A message of a pool with its buffers.
+//
+//    .. c:member:: ch_message_t msg
+//
+//       The message, has to be the first member.
+//
+//    .. c:member:: ch_buf* header
+//
+//       The header buffer owned by the message.
+//
+//    .. c:member:: char* actor
+//
+//       The actor buffer owned by the message.
+//
+//    .. c:member:: ch_buf* data
+//
+//       The data buffer owned by the message.
+//
+//    .. c:member:: uint32_t header_size
+//
+//       Size of :c:member:`header`.
+//
+//    .. c:member:: uint32_t actor_size
+//
+//       Size of :c:member:`actor`.
+//
+//    .. c:member:: uint32_t data_size
+//
+//       Size of :c:member:`data`.
+//
+//    .. c:member:: struct ch_msg_pool_item_s* next
+//
+//       Next message in the pool.
+//
+// .. code-block:: cpp
+//
+struct ch_msg_pool_item_s {
+    ch_message_t               msg;
+    ch_buf*                    header;
+    char*                      actor;
+    ch_buf*                    data;
+    uint32_t                   header_size;
+    uint32_t                   actor_size;
+    uint32_t                   data_size;
+    struct ch_msg_pool_item_s* next;
+};
+
 #endif //ch_msg_message_h
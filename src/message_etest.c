@@ -2,7 +2,18 @@
 // Message etest
 // =============
 //
-// Testing sending/receiving messages
+// Loopback benchmark of sending/receiving messages. An echo chirp sends every
+// message it receives back, sender chirps (one per thread) send a message and
+// wait for the echo before sending the next one. Every combination of message
+// size, encryption, acknowledge and sender count runs for the given seconds
+// (default 1) and prints one JSON line with throughput and round trip
+// percentiles (microseconds).
+//
+// .. code-block:: bash
+//
+//    make bench
+//
+// Configure without --dev for meaningful numbers.
 //
 // Project includes
 // ================
@@ -17,7 +28,7 @@
 //
 // .. code-block:: cpp
 //
-#include <unistd.h>
+#include <stdlib.h>
 
 // Test functions
 // ==============
@@ -26,58 +37,313 @@
 //
 // .. code-block:: cpp
 
-typedef struct ch_test_chirp_thread_s {
-    ch_chirp_t* chirp;
-    int port;
-    uv_async_cb init;
-} ch_test_chirp_thread_t;
+#define CH_BENCH_ECHO_PORT 59732
+#define CH_BENCH_SENDER_PORT 59733
+#define CH_BENCH_MAX_SENDERS 4
+
+#define CH_BENCH_SENT 1
+#define CH_BENCH_ECHOED 2
+
+typedef struct ch_bench_run_s {
+    size_t size;
+    int    tls;
+    int    ack;
+    int    senders;
+    double seconds;
+} ch_bench_run_t;
 
+typedef struct ch_bench_echo_msg_s {
+    ch_message_t  msg;
+    ch_message_t* orig;
+} ch_bench_echo_msg_t;
+
+typedef struct ch_bench_chirp_s {
+    ch_chirp_t      chirp; // First member, callbacks cast the chirp
+    ch_config_t     config;
+    uv_loop_t       loop;
+    uv_async_t      start;
+    uv_sem_t*       started;
+    ch_bench_run_t* run;
+    ch_message_t    msg;
+    ch_histogram_t  rtt;
+    uint64_t        sent_at;
+    uint64_t        end;
+    uint64_t        messages;
+    int             errors;
+    uint8_t         flags;
+} ch_bench_chirp_t;
+
+static
 void
-sender_init_handler(uv_async_t* handle)
+_ch_bench_log_cb(char msg[], char error)
 {
-    ch_chirp_t* chirp = handle->data;
-    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
-    //ch_chirp_close_ts(chirp);
+    if(error)
+        fprintf(stderr, "%s\n", msg);
 }
 
+static
 void
-echo_init_handler(uv_async_t* handle)
+_ch_bench_echo_send_cb(
+        ch_chirp_t* chirp,
+        ch_message_t* msg,
+        int status,
+        float load
+)
 {
-    ch_chirp_t* chirp = handle->data;
-    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
-    //ch_chirp_close_ts(chirp);
+    (void)(chirp);
+    (void)(status);
+    (void)(load);
+    ch_bench_echo_msg_t* echo_msg = (ch_bench_echo_msg_t*) msg;
+    ch_chirp_release_message(echo_msg->orig);
+    free(echo_msg);
 }
 
 static
 void
-_ch_test_run_chirp(void* arg)
+_ch_bench_echo_recv_cb(ch_chirp_t* chirp, ch_message_t* msg)
 {
-    ch_test_chirp_thread_t* args = (ch_test_chirp_thread_t*) arg;
-    uv_async_t init_call;
-    ch_chirp_t chirp;
-    uv_loop_t loop;
-    ch_config_t config;
-    ch_chirp_config_init(&config);
-    config.PORT = args->port;
-    args->chirp = &chirp;
-    config.CERT_CHAIN_PEM = "./cert.pem";
-    config.DH_PARAMS_PEM = "./dh.pem";
-    ch_loop_init(&loop);
-    if(uv_async_init(&loop, &init_call, args->init) < 0) {
-        printf("uv_async_init error\n");
+    ch_bench_echo_msg_t* echo_msg = malloc(sizeof(ch_bench_echo_msg_t));
+    if(echo_msg == NULL) {
+        ch_chirp_release_message(msg);
         return;
     }
-    init_call.data = &chirp;
-    if(ch_chirp_init(&chirp, &config, &loop, NULL, NULL) != CH_SUCCESS) {
-        printf("ch_chirp_init error\n");
+    ch_msg_init(&echo_msg->msg);
+    echo_msg->orig            = msg;
+    echo_msg->msg.header_len  = msg->header_len;
+    echo_msg->msg.actor_len   = msg->actor_len;
+    echo_msg->msg.data_len    = msg->data_len;
+    echo_msg->msg.header      = msg->header;
+    echo_msg->msg.actor       = msg->actor;
+    echo_msg->msg.data        = msg->data;
+    echo_msg->msg.ip_protocol = msg->ip_protocol;
+    echo_msg->msg.port        = msg->port;
+    memcpy(echo_msg->msg.address, msg->address, sizeof(msg->address));
+    ch_chirp_send(chirp, &echo_msg->msg, _ch_bench_echo_send_cb);
+}
+
+static
+void
+_ch_bench_send_cb(
+        ch_chirp_t* chirp,
+        ch_message_t* msg,
+        int status,
+        float load
+);
+
+static
+void
+_ch_bench_send_next(ch_bench_chirp_t* bchirp)
+{
+    bchirp->sent_at = uv_hrtime();
+    if(bchirp->errors > 0 || bchirp->sent_at >= bchirp->end) {
+        ch_chirp_close_ts(&bchirp->chirp);
+        return;
+    }
+    bchirp->flags = 0;
+    ch_chirp_send(&bchirp->chirp, &bchirp->msg, _ch_bench_send_cb);
+}
+
+static
+void
+_ch_bench_send_cb(
+        ch_chirp_t* chirp,
+        ch_message_t* msg,
+        int status,
+        float load
+)
+{
+    (void)(msg);
+    (void)(load);
+    ch_bench_chirp_t* bchirp = (ch_bench_chirp_t*) chirp;
+    if(status != CH_SUCCESS) {
+        fprintf(stderr, "Sending failed: %d\n", status);
+        bchirp->errors += 1;
+        ch_chirp_close_ts(chirp);
+        return;
+    }
+    bchirp->flags |= CH_BENCH_SENT;
+    if(bchirp->flags & CH_BENCH_ECHOED)
+        _ch_bench_send_next(bchirp);
+}
+
+static
+void
+_ch_bench_recv_cb(ch_chirp_t* chirp, ch_message_t* msg)
+{
+    ch_bench_chirp_t* bchirp = (ch_bench_chirp_t*) chirp;
+    ch_hg_record(&bchirp->rtt, uv_hrtime() - bchirp->sent_at);
+    bchirp->messages += 1;
+    ch_chirp_release_message(msg);
+    bchirp->flags |= CH_BENCH_ECHOED;
+    if(bchirp->flags & CH_BENCH_SENT)
+        _ch_bench_send_next(bchirp);
+}
+
+static
+void
+_ch_bench_echo_start_cb(uv_async_t* handle)
+{
+    ch_bench_chirp_t* bchirp = handle->data;
+    uv_close((uv_handle_t*) handle, NULL);
+    uv_sem_post(bchirp->started);
+}
+
+static
+void
+_ch_bench_sender_start_cb(uv_async_t* handle)
+{
+    ch_bench_chirp_t* bchirp = handle->data;
+    uv_close((uv_handle_t*) handle, NULL);
+    bchirp->end = uv_hrtime() + (uint64_t) (bchirp->run->seconds * 1e9);
+    _ch_bench_send_next(bchirp);
+}
+
+static
+void
+_ch_bench_thread(void* arg)
+{
+    ch_bench_chirp_t* bchirp = arg;
+    ch_loop_init(&bchirp->loop);
+    bchirp->start.data = bchirp;
+    uv_async_init(
+        &bchirp->loop,
+        &bchirp->start,
+        bchirp->started != NULL ?
+            _ch_bench_echo_start_cb :
+            _ch_bench_sender_start_cb
+    );
+    if(ch_chirp_init(
+            &bchirp->chirp,
+            &bchirp->config,
+            &bchirp->loop,
+            NULL,
+            _ch_bench_log_cb
+    ) != CH_SUCCESS) {
+        fprintf(stderr, "ch_chirp_init error\n");
+        bchirp->errors += 1;
+        uv_close((uv_handle_t*) &bchirp->start, NULL);
+        uv_run(&bchirp->loop, UV_RUN_DEFAULT);
+        ch_loop_close(&bchirp->loop);
+        if(bchirp->started != NULL)
+            uv_sem_post(bchirp->started);
         return;
     }
-    ch_chirp_set_auto_stop_loop(&chirp);
-    uv_async_send(&init_call);
-    ch_run(&loop); // Will block till loop stops
-    ch_loop_close(&loop);
+    ch_chirp_set_auto_stop_loop(&bchirp->chirp);
+    ch_chirp_set_recv_cb(
+        &bchirp->chirp,
+        bchirp->started != NULL ? _ch_bench_echo_recv_cb : _ch_bench_recv_cb
+    );
+    uv_async_send(&bchirp->start);
+    ch_run(&bchirp->loop); // Will block till loop stops
+    ch_loop_close(&bchirp->loop);
 }
 
+static
+void
+_ch_bench_config(ch_bench_chirp_t* bchirp, ch_bench_run_t* run, int port)
+{
+    memset(bchirp, 0, sizeof(*bchirp));
+    bchirp->run = run;
+    ch_chirp_config_init(&bchirp->config);
+    bchirp->config.PORT               = port;
+    bchirp->config.CLOSE_ON_SIGINT    = 0;
+    bchirp->config.DISABLE_ENCRYPTION = !run->tls;
+    bchirp->config.CERT_CHAIN_PEM     = "./cert.pem";
+    bchirp->config.DH_PARAMS_PEM      = "./dh.pem";
+    if(!run->ack) {
+        bchirp->config.ACKNOWLEDGE = 0;
+        bchirp->config.RETRIES     = 0;
+    }
+    ch_hg_reset(&bchirp->rtt);
+}
+
+static
+int
+_ch_bench_run(ch_bench_run_t* run)
+{
+    int i;
+    int errors = 0;
+    uint64_t messages = 0;
+    uv_sem_t started;
+    uv_thread_t echo_thread;
+    uv_thread_t sender_threads[CH_BENCH_MAX_SENDERS];
+    ch_histogram_t rtt;
+    ch_bench_chirp_t* echo = malloc(sizeof(ch_bench_chirp_t));
+    ch_bench_chirp_t* senders = malloc(
+        sizeof(ch_bench_chirp_t) * run->senders
+    );
+    ch_buf* data = malloc(run->size + 1);
+    if(echo == NULL || senders == NULL || data == NULL) {
+        fprintf(stderr, "Could not allocate benchmark\n");
+        free(echo);
+        free(senders);
+        free(data);
+        return 1;
+    }
+    memset(data, 'x', run->size);
+    uv_sem_init(&started, 0);
+
+    _ch_bench_config(echo, run, CH_BENCH_ECHO_PORT);
+    echo->started = &started;
+    uv_thread_create(&echo_thread, _ch_bench_thread, echo);
+    for(i = 0; i < run->senders; i++)
+        _ch_bench_config(&senders[i], run, CH_BENCH_SENDER_PORT + i);
+    uv_sem_wait(&started);
+    if(echo->errors) {
+        uv_thread_join(&echo_thread);
+        errors = 1;
+        goto cleanup;
+    }
+    for(i = 0; i < run->senders; i++) {
+        ch_bench_chirp_t* bchirp = &senders[i];
+        ch_msg_init(&bchirp->msg);
+        ch_msg_set_address(
+            &bchirp->msg,
+            CH_IPV4,
+            "127.0.0.1",
+            CH_BENCH_ECHO_PORT
+        );
+        bchirp->msg.data     = data;
+        bchirp->msg.data_len = run->size;
+        uv_thread_create(&sender_threads[i], _ch_bench_thread, bchirp);
+    }
+    for(i = 0; i < run->senders; i++)
+        uv_thread_join(&sender_threads[i]);
+    ch_chirp_close_ts(&echo->chirp);
+    uv_thread_join(&echo_thread);
+
+    ch_hg_reset(&rtt);
+    for(i = 0; i < run->senders; i++) {
+        ch_hg_merge(&rtt, &senders[i].rtt);
+        messages += senders[i].messages;
+        errors   += senders[i].errors;
+    }
+    printf(
+        "{\"size\": %lu, \"tls\": %d, \"ack\": %d, \"senders\": %d, "
+        "\"messages\": %lu, \"seconds\": %.3f, \"msg_per_s\": %.1f, "
+        "\"mb_per_s\": %.3f, \"p50_us\": %.1f, \"p90_us\": %.1f, "
+        "\"p99_us\": %.1f, \"max_us\": %.1f}\n",
+        (unsigned long) run->size,
+        run->tls,
+        run->ack,
+        run->senders,
+        (unsigned long) messages,
+        run->seconds,
+        messages / run->seconds,
+        messages * run->size / run->seconds / (1024 * 1024),
+        ch_hg_percentile(&rtt, 50) / 1e3,
+        ch_hg_percentile(&rtt, 90) / 1e3,
+        ch_hg_percentile(&rtt, 99) / 1e3,
+        rtt.max / 1e3
+    );
+    fflush(stdout);
+cleanup:
+    uv_sem_destroy(&started);
+    free(echo);
+    free(senders);
+    free(data);
+    return errors > 0;
+}
 
 // Runner
 // ======
@@ -90,30 +356,44 @@ main(
 )
 //    :noindex:
 //
-//    Test quickcheck.
+//    Run the benchmark.
 //
 // .. code-block:: cpp
 //
 {
-    (void)(argc); // I hate incomplete main signatures
-    (void)(argv); // I hate incomplete main signatures
-    ch_test_chirp_thread_t sender_thread;
-    ch_test_chirp_thread_t echo_thread;
-    sender_thread.port = 59731;
-    sender_thread.init = sender_init_handler;
-    echo_thread.port   = 59732;
-    echo_thread.init = echo_init_handler;
-    uv_thread_t echo;
-    uv_thread_t sender;
+    static const size_t sizes[] = {0, 100, 4096, 1024 * 1024};
+    static const int senders[] = {1, CH_BENCH_MAX_SENDERS};
+    size_t s;
+    int tls;
+    int ack;
+    int n;
+    int errors = 0;
+    ch_bench_run_t run;
+    run.seconds = 1;
+    if(argc > 1)
+        run.seconds = atof(argv[1]);
+    if(run.seconds <= 0) {
+        fprintf(stderr, "Usage: %s [seconds]\n", argv[0]);
+        return 1;
+    }
     ch_libchirp_init();
     ch_en_set_manual_openssl_init(); // OpenSSL doesn't like to be initialized
                                      // from threads
     ch_en_openssl_init();
-    uv_thread_create(&echo, _ch_test_run_chirp, &echo_thread);
-    sleep(1);
-    uv_thread_create(&sender, _ch_test_run_chirp, &sender_thread);
-    uv_thread_join(&echo);
-    uv_thread_join(&sender);
+    for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for(tls = 1; tls >= 0; tls--) {
+            for(ack = 1; ack >= 0; ack--) {
+                for(n = 0; n < 2; n++) {
+                    run.size    = sizes[s];
+                    run.tls     = tls;
+                    run.ack     = ack;
+                    run.senders = senders[n];
+                    errors += _ch_bench_run(&run);
+                }
+            }
+        }
+    }
     ch_en_openssl_cleanup();
     ch_libchirp_cleanup();
+    return errors > 0;
 }
@@ -11,6 +11,7 @@
 
 #include "quickcheck.h"
 #include "message.h"
+#include "util.h"
 
 // Definitions
 // ===========
@@ -26,12 +27,12 @@ int _ch_test_gen_data_field(
 )
 //
 //   Allocates memory for one of the data field in a chirp message: header,
-//   actor, data.
+//   actor, data. The field is filled with random bytes.
 //
 //    :param zero_probability: Probability of the len being zero
 //    :param max_probability: Probability of the len being max
 //    :param int max_size: Max size of that field
-//    :param ch_buf*: Buffer for the data
+//    :param ch_buf*: Out: Buffer for the data, NULL if the len is zero
 //
 // .. code-block:: cpp
 //
@@ -40,16 +41,19 @@ int _ch_test_gen_data_field(
     double draw = ch_qc_tgen_double();
     int size = 0;
     if(draw > zero_probability) {
-        if(draw < max_probability)
+        if(draw < zero_probability + max_probability)
             size = max_size;
         else {
             size = ch_qc_tgen_double() * max_size;
         }
     }
-    track = ch_qc_tgen_bytes();
-
-    data = &track->data;
-    (void)(data);
+    *data = NULL;
+    if(size > 0) {
+        // ch_random_ints_as_bytes fills multiples of four
+        track = ch_qc_track_alloc((size + 3) & ~3);
+        ch_random_ints_as_bytes((uint8_t*) track->data, (size + 3) & ~3);
+        *data = track->data;
+    }
     return size;
 }
 
@@ -79,7 +83,7 @@ ch_test_gen_message(ch_buf* data)
         0.1,
         0.1,
         2048,
-        &message->actor
+        (ch_buf**) &message->actor
     );
     message->data_len = _ch_test_gen_data_field(
         0.1,
@@ -0,0 +1,351 @@
+// ===============
+// Microbenchmarks
+// ===============
+//
+// Microbenchmarks of hot helpers, see :c:func:`ch_mb_run`. No network is
+// needed, so they can run on every build.
+//
+// .. code-block:: bash
+//
+//    microbench_etest [-b baseline] [-s] [-t tolerance]
+//
+// With **-b** the results are compared with the baseline file, if it doesn't
+// exist it is created. **-s** overwrites the baseline with the results.
+// Benchmarks slower than the baseline by more than **tolerance** percent
+// (default 10) count as regression and make the exit status 1.
+//
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "libchirp.h"
+#include "buffer.h"
+#include "connection.h"
+#include "microbench_test.h"
+#include "protocol.h"
+#include "receipt.h"
+#include "util.h"
+
+// System includes
+// ===============
+//
+// .. code-block:: cpp
+//
+#include <stdlib.h>
+
+// Test functions
+// ==============
+//
+// Not documented on purpose.
+//
+// .. code-block:: cpp
+
+#define CH_MB_TREE_SIZE 1024
+
+typedef struct ch_mb_receipts_s {
+    ch_receipts_t set;
+    uint8_t       serials[CH_MB_TREE_SIZE][16];
+} ch_mb_receipts_t;
+
+static
+void
+_ch_mb_bf_acquire_release(void* arg, uint64_t iterations)
+{
+    uint64_t i;
+    uint64_t sum = 0;
+    ch_buffer_pool_t* pool = arg;
+    for(i = 0; i < iterations; i++) {
+        ch_bf_handler_t* handler = ch_bf_acquire(pool);
+        sum += handler->id;
+        ch_bf_release(pool, handler);
+    }
+    ch_mb_sink += sum;
+}
+
+static
+void
+_ch_mb_bytes_to_hex(void* arg, uint64_t iterations)
+{
+    uint64_t i;
+    uint64_t sum = 0;
+    uint8_t* bytes = arg;
+    char str[33];
+    for(i = 0; i < iterations; i++) {
+        bytes[0] = (uint8_t) i;
+        ch_bytes_to_hex(bytes, 16, str, sizeof(str));
+        sum += str[1];
+    }
+    ch_mb_sink += sum;
+}
+
+static
+void
+_ch_mb_cn_find(void* arg, uint64_t iterations)
+{
+    uint64_t i;
+    uint64_t sum = 0;
+    ch_connection_t* conns = arg;
+    ch_connection_t* tree = conns[CH_MB_TREE_SIZE].left;
+    for(i = 0; i < iterations; i++) {
+        ch_connection_t* conn = sglib_ch_connection_t_find_member(
+            tree,
+            &conns[(i * 7919) % CH_MB_TREE_SIZE]
+        );
+        sum += conn->port;
+    }
+    ch_mb_sink += sum;
+}
+
+static
+void
+_ch_mb_cn_add_delete(void* arg, uint64_t iterations)
+{
+    uint64_t i;
+    ch_connection_t* conns = arg;
+    ch_connection_t* tree = conns[CH_MB_TREE_SIZE].left;
+    for(i = 0; i < iterations; i++) {
+        ch_connection_t* conn = &conns[(i * 7919) % CH_MB_TREE_SIZE];
+        sglib_ch_connection_t_delete(&tree, conn);
+        sglib_ch_connection_t_add(&tree, conn);
+    }
+    conns[CH_MB_TREE_SIZE].left = tree;
+    ch_mb_sink += (uintptr_t) tree;
+}
+
+static
+void
+_ch_mb_msb32(void* arg, uint64_t iterations)
+{
+    uint64_t i;
+    uint64_t sum = 0;
+    (void)(arg);
+    for(i = 0; i < iterations; i++)
+        sum += ch_msb32((uint32_t) (i * 2654435761U) | 1);
+    ch_mb_sink += sum;
+}
+
+static
+void
+_ch_mb_msg_init(void* arg, uint64_t iterations)
+{
+    uint64_t i;
+    uint64_t sum = 0;
+    ch_message_t* msg = arg;
+    for(i = 0; i < iterations; i++) {
+        ch_msg_init(msg);
+        sum += msg->identity[0];
+    }
+    ch_mb_sink += sum;
+}
+
+static
+void
+_ch_mb_msg_pool(void* arg, uint64_t iterations)
+{
+    uint64_t i;
+    uint64_t sum = 0;
+    ch_message_t* msg;
+    ch_msg_pool_t* msg_pool = arg;
+    for(i = 0; i < iterations; i++) {
+        if(ch_msg_pool_acquire(msg_pool, &msg, 16, 8, 512) != CH_SUCCESS)
+            return;
+        sum += msg->identity[0];
+        ch_msg_pool_release(msg_pool, msg);
+    }
+    ch_mb_sink += sum;
+}
+
+static
+void
+_ch_mb_random_ints_as_bytes(void* arg, uint64_t iterations)
+{
+    uint64_t i;
+    uint64_t sum = 0;
+    uint8_t* bytes = arg;
+    for(i = 0; i < iterations; i++) {
+        ch_random_ints_as_bytes(bytes, 16);
+        sum += bytes[0];
+    }
+    ch_mb_sink += sum;
+}
+
+static
+void
+_ch_mb_receipt_find(void* arg, uint64_t iterations)
+{
+    uint64_t i;
+    uint64_t sum = 0;
+    ch_mb_receipts_t* receipts = arg;
+    for(i = 0; i < iterations; i++) {
+        sum += ch_rc_contains(
+            &receipts->set,
+            receipts->serials[(i * 7919) % CH_MB_TREE_SIZE],
+            1
+        );
+    }
+    ch_mb_sink += sum;
+}
+
+static
+void
+_ch_mb_receipt_miss(void* arg, uint64_t iterations)
+{
+    uint64_t i;
+    uint64_t sum = 0;
+    uint8_t serial[16];
+    ch_mb_receipts_t* receipts = arg;
+    memset(serial, 0, sizeof(serial));
+    for(i = 0; i < iterations; i++) {
+        memcpy(serial, &i, sizeof(i));
+        sum += ch_rc_contains(&receipts->set, serial, 1);
+    }
+    ch_mb_sink += sum;
+}
+
+// Runner
+// ======
+
+// .. c:function::
+int
+main(
+    int argc,
+    char *argv[]
+)
+//    :noindex:
+//
+//    Run the microbenchmarks.
+//
+// .. code-block:: cpp
+//
+{
+    int i;
+    int count = 0;
+    int regressions = 0;
+    int save = 0;
+    double tolerance = 10;
+    const char* baseline = NULL;
+    ch_mb_result_t results[16];
+    uint8_t bytes[16];
+    ch_message_t msg;
+    ch_msg_pool_t msg_pool;
+    ch_buffer_pool_t* pool;
+    ch_connection_t* conns;
+    ch_mb_receipts_t* receipts;
+    for(i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+            baseline = argv[++i];
+        else if(strcmp(argv[i], "-s") == 0)
+            save = 1;
+        else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            tolerance = atof(argv[++i]);
+        else {
+            fprintf(
+                stderr,
+                "Usage: %s [-b baseline] [-s] [-t tolerance]\n",
+                argv[0]
+            );
+            return 1;
+        }
+    }
+    if(save && baseline == NULL) {
+        fprintf(stderr, "-s needs a baseline (-b)\n");
+        return 1;
+    }
+    ch_libchirp_init();
+    memset(bytes, 0xA5, sizeof(bytes));
+    ch_msg_pool_init(&msg_pool, 16);
+
+    pool = ch_alloc(sizeof(ch_buffer_pool_t));
+    /* The last member holds the root of the tree. */
+    conns = calloc(CH_MB_TREE_SIZE + 1, sizeof(ch_connection_t));
+    receipts = calloc(1, sizeof(ch_mb_receipts_t));
+    if(
+            pool == NULL ||
+            conns == NULL ||
+            receipts == NULL ||
+            ch_bf_init(pool, 16) != CH_SUCCESS
+    ) {
+        fprintf(stderr, "Could not allocate benchmarks\n");
+        return 1;
+    }
+    for(i = 0; i < CH_MB_TREE_SIZE; i++) {
+        ch_connection_t* conn = &conns[i];
+        conn->ip_protocol = CH_IPV4;
+        conn->address[0]  = 127;
+        conn->address[3]  = (uint8_t) (i >> 8);
+        conn->port        = 2998 + (i & 0xFF);
+        sglib_ch_connection_t_add(&conns[CH_MB_TREE_SIZE].left, conn);
+    }
+    /* The horizon is never reached, the benchmarks pass now = 1. */
+    ch_rc_init(&receipts->set, 60000, 0);
+    for(i = 0; i < CH_MB_TREE_SIZE; i++) {
+        ch_random_ints_as_bytes(receipts->serials[i], 16);
+        ch_rc_add(&receipts->set, receipts->serials[i], 1);
+    }
+
+    ch_mb_run(
+        "bf_acquire_release",
+        _ch_mb_bf_acquire_release,
+        pool,
+        &results[count++]
+    );
+    ch_mb_run(
+        "bytes_to_hex_16",
+        _ch_mb_bytes_to_hex,
+        bytes,
+        &results[count++]
+    );
+    ch_mb_run("cn_tree_find_1k", _ch_mb_cn_find, conns, &results[count++]);
+    ch_mb_run(
+        "cn_tree_delete_add_1k",
+        _ch_mb_cn_add_delete,
+        conns,
+        &results[count++]
+    );
+    ch_mb_run("msb32", _ch_mb_msb32, NULL, &results[count++]);
+    ch_mb_run("msg_init", _ch_mb_msg_init, &msg, &results[count++]);
+    ch_mb_run(
+        "msg_pool_acquire_release",
+        _ch_mb_msg_pool,
+        &msg_pool,
+        &results[count++]
+    );
+    ch_mb_run(
+        "random_ints_as_bytes_16",
+        _ch_mb_random_ints_as_bytes,
+        bytes,
+        &results[count++]
+    );
+    ch_mb_run(
+        "receipt_set_find_1k",
+        _ch_mb_receipt_find,
+        receipts,
+        &results[count++]
+    );
+    ch_mb_run(
+        "receipt_set_miss_1k",
+        _ch_mb_receipt_miss,
+        receipts,
+        &results[count++]
+    );
+
+    if(baseline != NULL && !save) {
+        if(ch_mb_load_baseline(baseline, results, count) != 0) {
+            printf("No baseline %s, creating it\n", baseline);
+            save = 1;
+        }
+    }
+    regressions = ch_mb_print(results, count, tolerance);
+    if(save && ch_mb_save_baseline(baseline, results, count) != 0) {
+        fprintf(stderr, "Could not save baseline %s\n", baseline);
+        regressions += 1;
+    }
+    ch_bf_free(pool);
+    ch_msg_pool_free(&msg_pool);
+    free(conns);
+    ch_rc_free(&receipts->set);
+    free(receipts);
+    ch_libchirp_cleanup();
+    return regressions > 0;
+}
@@ -0,0 +1,193 @@
+// ==============
+// Microbenchmark
+// ==============
+//
+// .. code-block:: cpp
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "microbench_test.h"
+
+// System includes
+// ===============
+//
+// .. code-block:: cpp
+//
+#include <stdlib.h>
+#if defined(__x86_64__) || defined(__i386__)
+#   include <x86intrin.h>
+#   define CH_MB_CYCLES() __rdtsc()
+#else
+#   define CH_MB_CYCLES() 0
+#endif
+
+// Definitions
+// ===========
+
+// .. c:var:: ch_mb_sink
+//
+//    see: :c:data:`ch_mb_sink`
+//
+// .. code-block:: cpp
+//
+volatile uint64_t ch_mb_sink = 0;
+
+// .. c:function::
+static
+int
+_ch_mb_cmp_double(const void* a, const void* b)
+//
+//    Compare doubles for qsort.
+//
+// .. code-block:: cpp
+//
+{
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+// .. c:function::
+int
+ch_mb_load_baseline(
+        const char* path,
+        ch_mb_result_t* results,
+        int count
+)
+//    :noindex:
+//
+//    see: :c:func:`ch_mb_load_baseline`
+//
+// .. code-block:: cpp
+//
+{
+    int i;
+    char name[64];
+    double ns;
+    FILE* file = fopen(path, "r");
+    if(file == NULL)
+        return -1;
+    while(fscanf(file, "%63s %lf", name, &ns) == 2) {
+        for(i = 0; i < count; i++) {
+            if(strcmp(results[i].name, name) == 0)
+                results[i].baseline = ns;
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+// .. c:function::
+int
+ch_mb_print(ch_mb_result_t* results, int count, double tolerance)
+//    :noindex:
+//
+//    see: :c:func:`ch_mb_print`
+//
+// .. code-block:: cpp
+//
+{
+    int i;
+    int regressions = 0;
+    printf(
+        "%-28s %12s %10s %10s %10s %9s\n",
+        "benchmark",
+        "iterations",
+        "ns/op",
+        "min ns/op",
+        "cycles/op",
+        "baseline"
+    );
+    for(i = 0; i < count; i++) {
+        ch_mb_result_t* r = &results[i];
+        printf(
+            "%-28s %12lu %10.2f %10.2f %10.1f",
+            r->name,
+            (unsigned long) r->iterations,
+            r->ns,
+            r->ns_min,
+            r->cycles
+        );
+        if(r->baseline > 0) {
+            double diff = (r->ns - r->baseline) / r->baseline * 100;
+            printf(" %+8.1f%%", diff);
+            if(diff > tolerance) {
+                printf(" REGRESSION");
+                regressions += 1;
+            }
+        }
+        printf("\n");
+    }
+    return regressions;
+}
+
+// .. c:function::
+void
+ch_mb_run(
+        const char* name,
+        ch_mb_fn_t fn,
+        void* arg,
+        ch_mb_result_t* result
+)
+//    :noindex:
+//
+//    see: :c:func:`ch_mb_run`
+//
+// .. code-block:: cpp
+//
+{
+    int i;
+    uint64_t start;
+    uint64_t iterations = 1;
+    double ns[CH_MB_REPETITIONS];
+    double cycles[CH_MB_REPETITIONS];
+    memset(result, 0, sizeof(*result));
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    /* Calibration doubles as warmup. */
+    for(;;) {
+        start = uv_hrtime();
+        fn(arg, iterations);
+        if(uv_hrtime() - start >= CH_MB_MIN_NS)
+            break;
+        iterations *= 2;
+    }
+    for(i = 0; i < CH_MB_REPETITIONS; i++) {
+        uint64_t start_cycles = CH_MB_CYCLES();
+        start = uv_hrtime();
+        fn(arg, iterations);
+        ns[i] = (double) (uv_hrtime() - start) / iterations;
+        cycles[i] = (double) (CH_MB_CYCLES() - start_cycles) / iterations;
+    }
+    qsort(ns, CH_MB_REPETITIONS, sizeof(double), _ch_mb_cmp_double);
+    qsort(cycles, CH_MB_REPETITIONS, sizeof(double), _ch_mb_cmp_double);
+    result->iterations = iterations;
+    result->ns         = ns[CH_MB_REPETITIONS / 2];
+    result->ns_min     = ns[0];
+    result->cycles     = cycles[CH_MB_REPETITIONS / 2];
+}
+
+// .. c:function::
+int
+ch_mb_save_baseline(
+        const char* path,
+        ch_mb_result_t* results,
+        int count
+)
+//    :noindex:
+//
+//    see: :c:func:`ch_mb_save_baseline`
+//
+// .. code-block:: cpp
+//
+{
+    int i;
+    FILE* file = fopen(path, "w");
+    if(file == NULL)
+        return -1;
+    for(i = 0; i < count; i++)
+        fprintf(file, "%s %.3f\n", results[i].name, results[i].ns);
+    return fclose(file) == 0 ? 0 : -1;
+}
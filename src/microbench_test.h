@@ -0,0 +1,175 @@
+// =====================
+// Microbenchmark Header
+// =====================
+//
+// Harness for microbenchmarks of hot helpers. A benchmark is a function
+// running its operation a given number of iterations. The harness calibrates
+// the iterations until a repetition takes :c:macro:`CH_MB_MIN_NS` (this
+// warms up caches and branch predictors), then runs
+// :c:macro:`CH_MB_REPETITIONS` repetitions and reports the median and the
+// minimum time per operation. On x86 it also reports TSC cycles per
+// operation.
+//
+// Results can be saved to a baseline file and compared with it later, see
+// :c:func:`ch_mb_load_baseline` and :c:func:`ch_mb_save_baseline`.
+//
+// .. code-block:: cpp
+//
+#ifndef ch_microbench_test_h
+#define ch_microbench_test_h
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "common.h"
+
+// Declarations
+// ============
+
+// .. c:macro:: CH_MB_MIN_NS
+//
+//    Minimal time of a repetition in nanoseconds.
+//
+// .. c:macro:: CH_MB_REPETITIONS
+//
+//    Count of measured repetitions.
+//
+// .. code-block:: cpp
+//
+#define CH_MB_MIN_NS (5 * 1000 * 1000)
+#define CH_MB_REPETITIONS 7
+
+// .. c:type:: ch_mb_fn_t
+//
+//    A benchmark. It runs its operation **iterations** times.
+//
+//    .. c:member:: void* arg
+//
+//       The argument passed to :c:func:`ch_mb_run`.
+//
+//    .. c:member:: uint64_t iterations
+//
+//       Count of operations to run.
+//
+// .. code-block:: cpp
+//
+typedef void (*ch_mb_fn_t)(void* arg, uint64_t iterations);
+
+// .. c:type:: ch_mb_result_t
+//
+//    Result of a benchmark.
+//
+//    .. c:member:: char name[64]
+//
+//       Name of the benchmark.
+//
+//    .. c:member:: uint64_t iterations
+//
+//       Operations per repetition.
+//
+//    .. c:member:: double ns
+//
+//       Median nanoseconds per operation.
+//
+//    .. c:member:: double ns_min
+//
+//       Minimum nanoseconds per operation.
+//
+//    .. c:member:: double cycles
+//
+//       Median TSC cycles per operation, 0 if not available.
+//
+//    .. c:member:: double baseline
+//
+//       Median nanoseconds per operation of the baseline, 0 if the baseline
+//       doesn't contain the benchmark.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_mb_result_s {
+    char     name[64];
+    uint64_t iterations;
+    double   ns;
+    double   ns_min;
+    double   cycles;
+    double   baseline;
+} ch_mb_result_t;
+
+// .. c:var:: ch_mb_sink
+//
+//    Benchmarks store results here, so the compiler can't remove the
+//    operation.
+//
+// .. code-block:: cpp
+//
+extern volatile uint64_t ch_mb_sink;
+
+// .. c:function::
+int
+ch_mb_load_baseline(
+        const char* path,
+        ch_mb_result_t* results,
+        int count
+);
+//
+//    Set :c:member:`ch_mb_result_t.baseline` of the results from a baseline
+//    file.
+//
+//    :param char* path:              The baseline file.
+//    :param ch_mb_result_t* results: The results.
+//    :param int count:               Count of results.
+//
+//    :return: 0 on success, -1 if the file could not be read.
+//    :rtype:  int
+
+// .. c:function::
+int
+ch_mb_print(ch_mb_result_t* results, int count, double tolerance);
+//
+//    Print the results and the difference to the baseline.
+//
+//    :param ch_mb_result_t* results: The results.
+//    :param int count:               Count of results.
+//    :param double tolerance:        Slowdown in percent compared to the
+//                                    baseline that counts as regression.
+//
+//    :return: count of regressions
+//    :rtype:  int
+
+// .. c:function::
+void
+ch_mb_run(
+        const char* name,
+        ch_mb_fn_t fn,
+        void* arg,
+        ch_mb_result_t* result
+);
+//
+//    Calibrate and run a benchmark.
+//
+//    :param char* name:             Name of the benchmark, at most 63
+//                                   characters, no whitespace.
+//    :param ch_mb_fn_t fn:          The benchmark.
+//    :param void* arg:              Passed to the benchmark.
+//    :param ch_mb_result_t* result: Out: The result.
+
+// .. c:function::
+int
+ch_mb_save_baseline(
+        const char* path,
+        ch_mb_result_t* results,
+        int count
+);
+//
+//    Save the results as baseline file, one line **name ns** per result.
+//
+//    :param char* path:              The baseline file.
+//    :param ch_mb_result_t* results: The results.
+//    :param int count:               Count of results.
+//
+//    :return: 0 on success, -1 if the file could not be written.
+//    :rtype:  int
+
+#endif //ch_microbench_test_h
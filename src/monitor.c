@@ -0,0 +1,154 @@
+// ============
+// Loop monitor
+// ============
+//
+// Measures the lag of the loop, see :c:type:`ch_monitor_t`.
+//
+// .. code-block:: cpp
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "monitor.h"
+#include "chirp.h"
+
+// Declarations
+// ============
+
+// .. c:function::
+static
+void
+_ch_mo_timer_cb(uv_timer_t* handle);
+//
+//    Measure the lag, update the load and start or stop shedding load.
+//
+//    :param uv_timer_t* handle: The timer of the monitor, contains chirp (as
+//                               data).
+
+// Definitions
+// ===========
+
+// .. c:function::
+static
+void
+_ch_mo_timer_cb(uv_timer_t* handle)
+//    :noindex:
+//
+//    see: :c:func:`_ch_mo_timer_cb`
+//
+// .. code-block:: cpp
+//
+{
+    float sample = 0;
+    CH_GET_CHIRP(handle);
+    ch_chirp_int_t* ichirp = chirp->_;
+    ch_config_t* config = &ichirp->config;
+    ch_monitor_t* monitor = &ichirp->monitor;
+    uint64_t now = uv_hrtime();
+    if(now > monitor->due)
+        sample = (now - monitor->due) / 1e9f;
+    monitor->due  = now + (uint64_t) CH_MO_INTERVAL * 1000000;
+    monitor->lag += (sample - monitor->lag) / 4;
+    monitor->load = monitor->lag / config->TIMEOUT;
+    if(monitor->load > 1)
+        monitor->load = 1;
+    if(config->MAX_LAG > 0) {
+        /* Stop shedding at half of MAX_LAG, so we don't flap. */
+        if(!monitor->overloaded && monitor->lag > config->MAX_LAG) {
+            monitor->overloaded = 1;
+            E(
+                chirp,
+                "Loop lags %.3fs, shedding load. ch_chirp_t:%p",
+                monitor->lag,
+                (void*) chirp
+            );
+        } else if(
+                monitor->overloaded &&
+                monitor->lag < config->MAX_LAG / 2
+        ) {
+            monitor->overloaded = 0;
+            L(
+                chirp,
+                "Loop lags %.3fs, accepting load. ch_chirp_t:%p",
+                monitor->lag,
+                (void*) chirp
+            );
+            ch_pr_resume_accept(&ichirp->protocol);
+        }
+    }
+}
+
+// .. c:function::
+float
+ch_chirp_get_loop_lag(ch_chirp_t* chirp)
+//    :noindex:
+//
+//    see: :c:func:`ch_chirp_get_loop_lag`
+//
+// .. code-block:: cpp
+//
+{
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    return chirp->_->monitor.lag;
+}
+
+// .. c:function::
+ch_error_t
+ch_mo_start(ch_monitor_t* monitor)
+//    :noindex:
+//
+//    see: :c:func:`ch_mo_start`
+//
+// .. code-block:: cpp
+//
+{
+    int tmp_err;
+    ch_chirp_t* chirp = monitor->chirp;
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    tmp_err = uv_timer_init(chirp->_->loop, &monitor->timer);
+    if(tmp_err != CH_SUCCESS) {
+        E(
+            chirp,
+            "Initializing monitor timer failed: %d. ch_chirp_t:%p",
+            tmp_err,
+            (void*) chirp
+        );
+        return CH_UV_ERROR;
+    }
+    monitor->timer.data = chirp;
+    monitor->due = uv_hrtime() + (uint64_t) CH_MO_INTERVAL * 1000000;
+    tmp_err = uv_timer_start(
+        &monitor->timer,
+        _ch_mo_timer_cb,
+        CH_MO_INTERVAL,
+        CH_MO_INTERVAL
+    );
+    if(tmp_err != CH_SUCCESS) {
+        E(
+            chirp,
+            "Starting monitor timer failed: %d. ch_chirp_t:%p",
+            tmp_err,
+            (void*) chirp
+        );
+        return CH_UV_ERROR;
+    }
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+void
+ch_mo_stop(ch_monitor_t* monitor)
+//    :noindex:
+//
+//    see: :c:func:`ch_mo_stop`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t* chirp = monitor->chirp;
+    uv_timer_stop(&monitor->timer);
+    uv_close((uv_handle_t*) &monitor->timer, ch_chirp_close_cb);
+    chirp->_->closing_tasks += 1;
+}
@@ -0,0 +1,131 @@
+// ==============
+// Monitor header
+// ==============
+//
+// The loop monitor measures the lag of the loop: a timer expects to fire
+// every :c:macro:`CH_MO_INTERVAL` ms, the time it fires late is the lag. If
+// callbacks block the loop, every connection gets slower and send timeouts
+// fire in large numbers.
+//
+// The lag is added to the load passed to :c:type:`ch_send_cb_t`, so routers
+// avoid a lagging node. If :c:member:`ch_config_t.MAX_LAG` is set, chirp
+// sheds load while the loop lags: it defers accepting connections and
+// rejects new messages with :c:member:`ch_error_t.CH_OVERLOADED`.
+//
+// .. code-block:: cpp
+//
+#ifndef ch_monitor_h
+#define ch_monitor_h
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "common.h"
+#include "libchirp/chirp.h"
+
+// Declarations
+// ============
+
+// .. c:type:: ch_monitor_t
+//
+//    Loop monitor object.
+//
+//    .. c:member:: uv_timer_t timer
+//
+//       The timer measuring the lag.
+//
+//    .. c:member:: uint64_t due
+//
+//       Time (uv_hrtime) the timer should fire.
+//
+//    .. c:member:: float lag
+//
+//       Smoothed lag in seconds.
+//
+//    .. c:member:: float load
+//
+//       The lag as load (0.0 - 1.0), relative to
+//       :c:member:`ch_config_t.TIMEOUT`.
+//
+//    .. c:member:: char overloaded
+//
+//       1 while chirp sheds load.
+//
+//    .. c:member:: ch_chirp_t* chirp
+//
+//       Pointer to the chirp object. See: :c:type:`ch_chirp_t`.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_monitor_s {
+    uv_timer_t  timer;
+    uint64_t    due;
+    float       lag;
+    float       load;
+    char        overloaded;
+    ch_chirp_t* chirp;
+} ch_monitor_t;
+
+// .. c:function::
+ch_error_t
+ch_mo_start(ch_monitor_t* monitor);
+//
+//    Start the loop monitor.
+//
+//    :param ch_monitor_t* monitor: Monitor which shall be started.
+//
+//    :return: A chirp error. see: :c:type:`ch_error_t`
+//    :rtype:  ch_error_t
+
+// .. c:function::
+void
+ch_mo_stop(ch_monitor_t* monitor);
+//
+//    Stop the loop monitor and close its timer.
+//
+//    :param ch_monitor_t* monitor: Monitor which shall be stopped.
+
+// Definitions
+// ===========
+
+// .. c:function::
+static
+ch_inline
+void
+ch_mo_init(ch_chirp_t* chirp, ch_monitor_t* monitor)
+//
+//    Initialize the monitor structure.
+//
+//    :param ch_chirp_t* chirp: Chirp instance.
+//    :param ch_monitor_t* monitor: Monitor to initialize.
+//
+// .. code-block:: cpp
+//
+{
+    memset(monitor, 0, sizeof(ch_monitor_t));
+    monitor->chirp = chirp;
+}
+
+// .. c:function::
+static
+ch_inline
+float
+ch_mo_load(ch_monitor_t* monitor, float load)
+//
+//    Fold the lag into the load of a remote.
+//
+//    :param ch_monitor_t* monitor: The monitor.
+//    :param float load: The load of the remote.
+//
+//    :return: the larger of the remote load and the local lag as load
+//    :rtype:  float
+//
+// .. code-block:: cpp
+//
+{
+    return monitor->load > load ? monitor->load : load;
+}
+
+#endif //ch_monitor_h
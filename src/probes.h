@@ -0,0 +1,87 @@
+// ===========
+// USDT probes
+// ===========
+//
+// Static tracepoints (SystemTap/USDT) at the transitions of the reader, the
+// writer, TLS and the buffer pool. Define :c:macro:`CH_ENABLE_USDT` in
+// config.h to build them, this requires sys/sdt.h (systemtap-sdt-dev). A
+// probe that isn't attached costs a nop, if CH_ENABLE_USDT isn't defined the
+// probes aren't compiled at all.
+//
+// All probes belong to the provider **libchirp**:
+//
+// ============ ======================================================
+// Probe        Arguments
+// ============ ======================================================
+// rd_state     conn, old state, new state (:c:type:`ch_rd_state_t`)
+// wr_enqueue   conn, msg, the message waits for the writer
+// wr_start     conn, msg
+// wr_stage     conn, finished stage (:c:type:`ch_hg_stage_t`)
+// wr_done      conn, msg
+// tls_done     conn, 1 if the handshake succeeded
+// cn_shutdown  conn, reason (:c:type:`ch_shutdown_reason_t`)
+// bf_acquire   pool, handler id (-1 if the pool is exhausted)
+// bf_release   pool, handler id
+// ============ ======================================================
+//
+// mk/bpftrace contains scripts building latency distributions from the
+// probes, for example:
+//
+// .. code-block:: bash
+//
+//    bpftrace -p $(pidof myservice) mk/bpftrace/writer.bt
+//
+// .. code-block:: cpp
+//
+#ifndef ch_probes_h
+#define ch_probes_h
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "config.h"
+
+// System includes
+// ===============
+//
+// .. code-block:: cpp
+//
+#ifdef CH_ENABLE_USDT
+#   include <sys/sdt.h>
+#endif
+
+// Declarations
+// ============
+
+// .. c:macro:: CH_PROBE2
+//
+//    Fires the probe **name** of the provider libchirp with two arguments.
+//
+//    :param name: Name of the probe.
+//    :param a: First argument.
+//    :param b: Second argument.
+//
+// .. c:macro:: CH_PROBE3
+//
+//    Fires the probe **name** of the provider libchirp with three arguments.
+//
+//    :param name: Name of the probe.
+//    :param a: First argument.
+//    :param b: Second argument.
+//    :param c: Third argument.
+//
+// .. code-block:: cpp
+//
+#ifdef CH_ENABLE_USDT
+#   define CH_PROBE2(name, a, b) DTRACE_PROBE2(libchirp, name, a, b)
+#   define CH_PROBE3(name, a, b, c) DTRACE_PROBE3(libchirp, name, a, b, c)
+#else
+#   define CH_PROBE2(name, a, b) do { (void)(a); (void)(b); } while(0)
+#   define CH_PROBE3(name, a, b, c) do { \
+        (void)(a); (void)(b); (void)(c); \
+    } while(0)
+#endif
+
+#endif //ch_probes_h
@@ -13,6 +13,8 @@
 //
 #include "protocol.h"
 #include "chirp.h"
+#include "probes.h"
+#include "stats.h"
 #include "util.h"
 
 // System includes
@@ -22,20 +24,6 @@
 //
 #include <openssl/err.h>
 
-// Sglib Prototypes
-// ================
-
-// .. code-block:: cpp
-//
-SGLIB_DEFINE_RBTREE_FUNCTIONS( // NOCOV
-    ch_receipt_t,
-    left,
-    right,
-    color_field,
-    CH_RECEIPT_CMP
-)
-
-
 // Declarations
 // ============
 
@@ -59,17 +47,6 @@ _ch_pr_do_handshake(ch_connection_t* conn);
 //
 //    :param ch_connection_t* conn: Pointer to a connection handle.
 
-// .. c:function::
-static
-ch_inline
-void
-_ch_pr_free_receipts(ch_receipt_t* receipts);
-//
-//    Free all remaining items in a receipts set.
-//
-//    :param ch_receipt_t* receipts: Pointer to a set of receipts which shall
-//                                   have its items freed.
-
 // .. c:function::
 static
 void
@@ -92,6 +69,17 @@ _ch_pr_read(ch_connection_t* conn);
 //
 //    :param ch_connection_t* conn: Pointer to a connection handle.
 
+// .. c:function::
+static
+void
+_ch_pr_read_encrypted(ch_connection_t* conn, ch_buf* buf, size_t len);
+//
+//    Pass encrypted data to SSL and read the decrypted data.
+//
+//    :param ch_connection_t* conn: Pointer to a connection handle.
+//    :param ch_buf* buf:           The encrypted data.
+//    :param size_t len:            Length of the encrypted data.
+
 // .. c:function::
 static
 void
@@ -108,6 +96,25 @@ _ch_pr_read_data_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf);
 //                          buffer; in that case buf.len and buf.base are both
 //                          set to 0.
 
+// .. c:function::
+static
+ch_inline
+int
+_ch_pr_read_plain(ch_connection_t* conn, ch_buf* buf, size_t len);
+//
+//    Pass (decrypted) data to the reader. If the reader ran out of handler
+//    buffers, reading is stopped and the rest of the data is kept, the kernel
+//    buffer fills and TCP pushes back on the remote. See
+//    :c:func:`ch_pr_resume_read`.
+//
+//    :param ch_connection_t* conn: Pointer to a connection handle.
+//    :param ch_buf* buf:           The data.
+//    :param size_t len:            Length of the data.
+//
+//    :return: 1 if reading can continue, 0 if the connection has been shut
+//             down or reading has been stopped
+//    :rtype:  int
+
 // Definitions
 // ===========
 
@@ -125,31 +132,13 @@ _ch_pr_close_free_connections(ch_chirp_t* chirp)
 {
     ch_chirp_int_t* ichirp = chirp->_;
     ch_protocol_t* protocol = &ichirp->protocol;
-    ch_connection_t* t;
-    struct sglib_ch_connection_t_iterator itt;
-    struct sglib_ch_connection_set_t_iterator its;
-    for(
-            t = sglib_ch_connection_t_it_init(
-                &itt,
-                protocol->connections
-            );
-            t != NULL;
-            t = sglib_ch_connection_t_it_next(&itt) // NOCOV TODO remove
-    ) {
-        ch_cn_shutdown(t);
-    } // NOCOV TODO remove
-    for(
-            t = sglib_ch_connection_set_t_it_init(
-                &its,
-                protocol->old_connections
-            );
-            t != NULL;
-            t = sglib_ch_connection_set_t_it_next(&its) // NOCOV TODO remove
-    ) {
-        ch_cn_shutdown(t);
-    } // NOCOV TODO remove
-    // Effectively we have cleared the list
-    protocol->old_connections = NULL;
+    /* ch_cn_shutdown removes the connection from the data-structures, so we
+     * can't iterate, but always shut down the root.
+     */
+    while(protocol->connections != NULL)
+        ch_cn_shutdown(protocol->connections, CH_SHUTDOWN_CLOSE);
+    while(protocol->old_connections != NULL)
+        ch_cn_shutdown(protocol->old_connections, CH_SHUTDOWN_CLOSE);
 }
 
 // .. c:function::
@@ -167,12 +156,30 @@ _ch_pr_do_handshake(ch_connection_t* conn)
     ch_chirp_t* chirp = conn->chirp;
     A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
     conn->tls_handshake_state = SSL_do_handshake(conn->ssl);
-    if(SSL_is_init_finished(conn->ssl)) {
+    if(!SSL_is_init_finished(conn->ssl)) {
+        int ssl_err = SSL_get_error(conn->ssl, conn->tls_handshake_state);
+        if(ssl_err != SSL_ERROR_WANT_READ && ssl_err != SSL_ERROR_WANT_WRITE) {
+            CH_PROBE2(tls_done, conn, 0);
+#           ifndef NDEBUG
+                ERR_print_errors_fp(stderr);
+#           endif
+            E(
+                chirp,
+                "SSL handshake failed. ch_chirp_t:%p, ch_connection_t:%p",
+                (void*) chirp,
+                (void*) conn
+            );
+            ch_cn_shutdown(conn, CH_SHUTDOWN_TLS_ERROR);
+            return;
+        }
+    } else {
         conn->flags &= ~CH_CN_TLS_HANDSHAKE;
         /* Last handshake state, since we got that on the last read and have to
          * use it on this read.
          */
+        CH_PROBE2(tls_done, conn, conn->tls_handshake_state != 0);
         if(conn->tls_handshake_state) {
+            CH_STATS_ADD(conn, handshakes, 1);
             L(
                 chirp,
                 "SSL handshake successful. ch_chirp_t:%p, ch_connection_t:%p",
@@ -189,39 +196,13 @@ _ch_pr_do_handshake(ch_connection_t* conn)
                 (void*) chirp,
                 (void*) conn
             );
-            ch_cn_shutdown(conn);
+            ch_cn_shutdown(conn, CH_SHUTDOWN_TLS_ERROR);
             return;
         }
     }
     ch_cn_send_if_pending(conn);
 }
 
-// .. c:function::
-static
-ch_inline
-void
-_ch_pr_free_receipts(ch_receipt_t* receipts)
-//    :noindex:
-//
-//    see: :c:func:`_ch_pr_free_receipts`
-//
-// .. code-block:: cpp
-//
-{
-    ch_receipt_t* t;
-    struct sglib_ch_receipt_t_iterator it;
-    for(
-            t = sglib_ch_receipt_t_it_init(
-                &it,
-                receipts
-            );
-            t != NULL;
-            t = sglib_ch_receipt_t_it_next(&it) // NOCOV TODO remove
-    ) {
-        ch_free(t); // NOCOV TODO remove
-    } // NOCOV TODO remove
-}
-
 // .. c:function::
 static
 void
@@ -243,6 +224,17 @@ _ch_pr_new_connection_cb(uv_stream_t* server, int status)
         ); // NOCOV TODO
         return; // NOCOV TODO
     }
+    ch_protocol_t* protocol = &chirp->_->protocol;
+    if(chirp->_->monitor.overloaded) {
+        /* libuv stops polling the server until we accept, so the remote
+         * waits in the backlog. See ch_pr_resume_accept.
+         */
+        if(server == (uv_stream_t*) &protocol->serverv4)
+            protocol->deferred |= CH_PR_DEFERRED_V4;
+        else
+            protocol->deferred |= CH_PR_DEFERRED_V6;
+        return;
+    }
 
     ch_connection_t* conn = (ch_connection_t*) ch_alloc(
         sizeof(ch_connection_t)
@@ -255,7 +247,10 @@ _ch_pr_new_connection_cb(uv_stream_t* server, int status)
         );
         return;
     }
-    if(ch_cn_init(chirp, conn, CH_CN_ENCRYPTED) != CH_SUCCESS) {
+    uint8_t flags = 0;
+    if(!chirp->_->config.DISABLE_ENCRYPTION)
+        flags |= CH_CN_ENCRYPTED;
+    if(ch_cn_init(chirp, conn, flags) != CH_SUCCESS) {
         E(
             chirp,
             "Could not initialize connection. ch_chirp_t:%p",
@@ -274,20 +269,13 @@ _ch_pr_new_connection_cb(uv_stream_t* server, int status)
             (void*) chirp,
             (void*) conn
         );
-        if(conn->flags & CH_CN_ENCRYPTED) {
-            SSL_set_accept_state(conn->ssl);
-            conn->flags |= CH_CN_TLS_HANDSHAKE;
-        } else
-            ch_rd_read(conn, NULL, 0); // Start reader
-        uv_read_start(
-            (uv_stream_t*) client,
-            ch_cn_read_alloc_cb,
-            _ch_pr_read_data_cb
-        );
+        ch_pr_conn_start(conn, 1);
     }
     else {
-        conn->shutdown_tasks = 1;
+        conn->shutdown_tasks = 3;
         uv_close((uv_handle_t*) client, ch_cn_close_cb);
+        uv_close((uv_handle_t*) &conn->shutdown_timeout, ch_cn_close_cb);
+        uv_close((uv_handle_t*) &conn->writer.send_timeout, ch_cn_close_cb);
     }
 }
 
@@ -306,45 +294,55 @@ _ch_pr_read(ch_connection_t* conn)
     ch_chirp_t* chirp = conn->chirp;
     A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
     int tmp_err;
-    // Handshake done, normal operation
-    tmp_err = SSL_read(
-        conn->ssl,
-        conn->buffer_rtls,
-        conn->buffer_size
-    );
-    if(tmp_err > 0) {
-        L(
-            chirp,
-            "Read %d bytes. ch_chirp_t:%p, ch_connection_t:%p",
-            tmp_err,
-            (void*) chirp,
-            (void*) conn
+    // Handshake done, normal operation. Read until the BIO is drained.
+    for(;;) {
+        tmp_err = SSL_read(
+            conn->ssl,
+            conn->buffer_rtls,
+            conn->buffer_size
         );
-        ch_rd_read(conn, conn->buffer_rtls, tmp_err);
-    } else {
-        if(tmp_err < 0) {
-#           ifndef NDEBUG
-                ERR_print_errors_fp(stderr);
-#           endif
-            E(
-                chirp,
-                "SSL operation fatal error. ch_chirp_t:%p, "
-                "ch_connection_t:%p",
-                (void*) chirp,
-                (void*) conn
-            );
-        } else {
+        if(tmp_err > 0) {
             L(
                 chirp,
-                "SSL operation failed. ch_chirp_t:%p, ch_connection_t:%p",
+                "Read %d bytes. ch_chirp_t:%p, ch_connection_t:%p",
+                tmp_err,
                 (void*) chirp,
                 (void*) conn
             );
+            if(!_ch_pr_read_plain(conn, conn->buffer_rtls, tmp_err))
+                return;
+            continue;
+        }
+        switch(SSL_get_error(conn->ssl, tmp_err)) {
+            case SSL_ERROR_WANT_READ:
+                return;
+            case SSL_ERROR_ZERO_RETURN:
+                L(
+                    chirp,
+                    "SSL connection closed by remote. ch_chirp_t:%p, "
+                    "ch_connection_t:%p",
+                    (void*) chirp,
+                    (void*) conn
+                );
+                ch_cn_shutdown(conn, CH_SHUTDOWN_EOF);
+                return;
+            default:
+#               ifndef NDEBUG
+                    ERR_print_errors_fp(stderr);
+#               endif
+                E(
+                    chirp,
+                    "SSL operation fatal error. ch_chirp_t:%p, "
+                    "ch_connection_t:%p",
+                    (void*) chirp,
+                    (void*) conn
+                );
+                ch_cn_shutdown(conn, CH_SHUTDOWN_TLS_ERROR);
+                return;
         }
-        ch_cn_shutdown(conn);
-        return;
     }
 }
+
 // .. c:function::
 static
 void
@@ -366,8 +364,11 @@ _ch_pr_read_data_cb(
 #   ifndef NDEBUG
         conn->flags &= ~CH_CN_BUF_UV_USED;
 #   endif
+    /* libuv may call us with nread == 0, which is neither an error nor EOF. */
+    if(nread == 0 || conn->flags & CH_CN_SHUTTING_DOWN)
+        return;
     if(nread == UV_EOF) {
-        ch_cn_shutdown(conn);
+        ch_cn_shutdown(conn, CH_SHUTDOWN_EOF);
         return;
     }
     if(nread < 0) {
@@ -379,9 +380,10 @@ _ch_pr_read_data_cb(
             (void*) chirp,
             (void*) conn
         );
-        ch_cn_shutdown(conn);
+        ch_cn_shutdown(conn, CH_SHUTDOWN_IO_ERROR);
         return;
     }
+    CH_STATS_ADD(conn, bytes_received, nread);
     L(
         chirp,
         "%d available bytes. ch_chirp_t:%p, ch_connection_t:%p",
@@ -389,35 +391,213 @@ _ch_pr_read_data_cb(
         (void*) chirp,
         (void*) conn
     );
-    if(conn->flags & CH_CN_ENCRYPTED) {
-        size_t bytes_decrypted = 0;
-        size_t snread = (size_t) nread;
-        do {
-            int tmp_err;
-            tmp_err = BIO_write(
-                conn->bio_app,
-                buf->base + bytes_decrypted,
-                nread - bytes_decrypted
+    if(conn->flags & CH_CN_ENCRYPTED)
+        _ch_pr_read_encrypted(conn, buf->base, nread);
+    else
+        _ch_pr_read_plain(conn, buf->base, nread);
+}
+
+// .. c:function::
+static
+void
+_ch_pr_read_encrypted(ch_connection_t* conn, ch_buf* buf, size_t len)
+//    :noindex:
+//
+//    see: :c:func:`_ch_pr_read_encrypted`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t* chirp = conn->chirp;
+    size_t bytes_decrypted = 0;
+    do {
+        int tmp_err;
+        tmp_err = BIO_write(
+            conn->bio_app,
+            buf + bytes_decrypted,
+            len - bytes_decrypted
+        );
+        if(tmp_err < 1) {
+            E(
+                chirp,
+                "SSL error writing to BIO, shutting down connection. "
+                "ch_connection_t:%p ch_chirp_t:%p",
+                (void*) conn,
+                (void*) chirp
             );
-            if(tmp_err < 1) {
-                E(
-                    chirp,
-                    "SSL error writing to BIO, shutting down connection. "
-                    "ch_connection_t:%p ch_chirp_t:%p",
-                    (void*) conn,
-                    (void*) chirp
-                );
-                ch_cn_shutdown(conn);
-                return;
-            }
-            bytes_decrypted += tmp_err;
-            if(conn->flags & CH_CN_TLS_HANDSHAKE)
-                _ch_pr_do_handshake(conn);
-            else
+            ch_cn_shutdown(conn, CH_SHUTDOWN_TLS_ERROR);
+            return;
+        }
+        bytes_decrypted += tmp_err;
+        if(conn->flags & CH_CN_TLS_HANDSHAKE) {
+            _ch_pr_do_handshake(conn);
+            /* The remote may have sent data right after its last
+             * handshake message.
+             */
+            if(!(conn->flags & (
+                    CH_CN_TLS_HANDSHAKE | CH_CN_SHUTTING_DOWN
+            )))
                 _ch_pr_read(conn);
-        } while(bytes_decrypted < snread);
+        } else
+            _ch_pr_read(conn);
+        if(conn->flags & CH_CN_SHUTTING_DOWN)
+            return;
+        if(conn->flags & CH_CN_READ_STOPPED) {
+            // Encrypted data SSL hasn't got yet
+            conn->read_tls_rest     = buf + bytes_decrypted;
+            conn->read_tls_rest_len = len - bytes_decrypted;
+            return;
+        }
+    } while(bytes_decrypted < len);
+}
+
+// .. c:function::
+static
+ch_inline
+int
+_ch_pr_read_plain(ch_connection_t* conn, ch_buf* buf, size_t len)
+//    :noindex:
+//
+//    see: :c:func:`_ch_pr_read_plain`
+//
+// .. code-block:: cpp
+//
+{
+    size_t handled = ch_rd_read(conn, buf, len);
+    if(conn->flags & CH_CN_SHUTTING_DOWN)
+        return 0;
+    if(conn->reader.state != CH_RD_HANDLER)
+        return 1;
+    L(
+        conn->chirp,
+        "No handler buffer left, stop reading. ch_chirp_t:%p, "
+        "ch_connection_t:%p",
+        (void*) conn->chirp,
+        (void*) conn
+    );
+    uv_read_stop((uv_stream_t*) &conn->client);
+    conn->flags         |= CH_CN_READ_STOPPED;
+    conn->read_rest      = buf + handled;
+    conn->read_rest_len  = len - handled;
+    return 0;
+}
+
+// .. c:function::
+void
+ch_pr_conn_start(ch_connection_t* conn, int accepted)
+//    :noindex:
+//
+//    see: :c:func:`ch_pr_conn_start`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t* chirp = conn->chirp;
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    uv_tcp_nodelay(&conn->client, 1);
+    int tmp_err = uv_read_start(
+        (uv_stream_t*) &conn->client,
+        ch_cn_read_alloc_cb,
+        _ch_pr_read_data_cb
+    );
+    if(tmp_err != CH_SUCCESS) {
+        E(
+            chirp,
+            "Could not start reading: %d. ch_chirp_t:%p, "
+            "ch_connection_t:%p",
+            tmp_err,
+            (void*) chirp,
+            (void*) conn
+        );
+        ch_cn_shutdown(conn, CH_SHUTDOWN_IO_ERROR);
+        return;
+    }
+    if(conn->flags & CH_CN_ENCRYPTED) {
+        conn->flags |= CH_CN_TLS_HANDSHAKE;
+        if(accepted)
+            SSL_set_accept_state(conn->ssl);
+        else {
+            SSL_set_connect_state(conn->ssl);
+            _ch_pr_do_handshake(conn);
+        }
     } else
-        ch_rd_read(conn, buf->base, nread);
+        ch_rd_read(conn, NULL, 0); // Start reader
+}
+
+// .. c:function::
+void
+ch_pr_resume_read(ch_connection_t* conn)
+//    :noindex:
+//
+//    see: :c:func:`ch_pr_resume_read`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t* chirp = conn->chirp;
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    if(
+            !(conn->flags & CH_CN_READ_STOPPED) ||
+            conn->flags & CH_CN_SHUTTING_DOWN
+    )
+        return;
+    L(
+        chirp,
+        "Handler buffer released, resume reading. ch_chirp_t:%p, "
+        "ch_connection_t:%p",
+        (void*) chirp,
+        (void*) conn
+    );
+    conn->flags &= ~CH_CN_READ_STOPPED;
+    // The reader waits for a handler, so it has to run even without data
+    if(!_ch_pr_read_plain(conn, conn->read_rest, conn->read_rest_len))
+        return;
+    if(conn->flags & CH_CN_ENCRYPTED) {
+        _ch_pr_read(conn);
+        if(conn->flags & (CH_CN_READ_STOPPED | CH_CN_SHUTTING_DOWN))
+            return;
+        if(conn->read_tls_rest_len > 0) {
+            size_t len = conn->read_tls_rest_len;
+            conn->read_tls_rest_len = 0;
+            _ch_pr_read_encrypted(conn, conn->read_tls_rest, len);
+            if(conn->flags & (CH_CN_READ_STOPPED | CH_CN_SHUTTING_DOWN))
+                return;
+        }
+    }
+    int tmp_err = uv_read_start(
+        (uv_stream_t*) &conn->client,
+        ch_cn_read_alloc_cb,
+        _ch_pr_read_data_cb
+    );
+    if(tmp_err != CH_SUCCESS) {
+        E(
+            chirp,
+            "Could not resume reading: %d. ch_chirp_t:%p, "
+            "ch_connection_t:%p",
+            tmp_err,
+            (void*) chirp,
+            (void*) conn
+        );
+        ch_cn_shutdown(conn, CH_SHUTDOWN_IO_ERROR);
+    }
+}
+
+// .. c:function::
+void
+ch_pr_resume_accept(ch_protocol_t* protocol)
+//    :noindex:
+//
+//    see: :c:func:`ch_pr_resume_accept`
+//
+// .. code-block:: cpp
+//
+{
+    uint8_t deferred = protocol->deferred;
+    protocol->deferred = 0;
+    if(deferred & CH_PR_DEFERRED_V4)
+        _ch_pr_new_connection_cb((uv_stream_t*) &protocol->serverv4, 0);
+    if(deferred & CH_PR_DEFERRED_V6)
+        _ch_pr_new_connection_cb((uv_stream_t*) &protocol->serverv6, 0);
 }
 
 // .. c:function::
@@ -431,6 +611,7 @@ ch_pr_start(ch_protocol_t* protocol)
 //
 {
     int tmp_err;
+    uint64_t horizon;
     ch_text_address_t tmp_addr;
     ch_chirp_t* chirp = protocol->chirp;
     A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
@@ -528,8 +709,9 @@ ch_pr_start(ch_protocol_t* protocol)
         );
         return CH_EADDRINUSE; // NOCOV errors happend for IPV4
     }
-    protocol->receipts = NULL;
-    protocol->late_receipts = NULL;
+    horizon = (uint64_t) (config->REUSE_TIME * 1000);
+    ch_rc_init(&protocol->receipts, horizon, CH_DD_RECEIPTS);
+    ch_dd_init(&protocol->dedup, horizon);
     protocol->connections = NULL;
     return CH_SUCCESS;
 }
@@ -550,7 +732,7 @@ ch_pr_stop(ch_protocol_t* protocol)
     uv_close((uv_handle_t*) &protocol->serverv4, ch_chirp_close_cb);
     uv_close((uv_handle_t*) &protocol->serverv6, ch_chirp_close_cb);
     chirp->_->closing_tasks += 2;
-    _ch_pr_free_receipts(protocol->receipts);
-    _ch_pr_free_receipts(protocol->late_receipts);
+    ch_rc_free(&protocol->receipts);
+    ch_dd_free(&protocol->dedup);
     return CH_SUCCESS;
 }
@@ -16,43 +16,12 @@
 //
 #include "libchirp/chirp.h"
 #include "connection.h"
-#include "sglib.h"
+#include "dedup.h"
+#include "receipt.h"
 
 // Declarations
 // ============
 
-// .. c:type:: ch_receipt_t
-//
-//    Receipt set implemented as red-black tree.
-//
-//    .. c:member:: unsigned char receipt[16]
-//
-//       Identity of the receipt, represented as 16 byte long byte string.
-//
-//    .. c:member:: char color_field
-//
-//       The color of the current (protocol-) node. This may either be red or
-//       black, as receipts are built as a red-black tree.
-//
-//    .. c:member:: ch_receipt_s* left
-//
-//       (Struct-) Pointer to the left child of the current receipt (node)
-//       in the red-black tree.
-//
-//    .. c:member:: ch_receipt_s* right
-//
-//       (Struct-) Pointer to the right child of the current receipt (node)
-//       in the red-black tree.
-//
-// .. code-block:: cpp
-//
-typedef struct ch_receipt_s {
-    unsigned char        receipt[16];
-    char                 color_field;
-    struct ch_receipt_s* left;
-    struct ch_receipt_s* right;
-} ch_receipt_t;
-
 // .. c:type:: ch_protocol_t
 //
 //    Protocol object.
@@ -83,30 +52,22 @@ typedef struct ch_receipt_s {
 //       network race condition. The then current connections will be replaced
 //       and saved as old connections for garbage collection.
 //
-//    .. c:member:: ch_receipt_t* receipts
-//
-//       Pointer to a set of receipts.
+//    .. c:member:: ch_receipts_t receipts
 //
-//       A receipt gets added whenever the reader receives a message, that
-//       requires an ACK. In that case, if a connections has a receipt set,
-//       that receipt is removed from the set of (currently valid) receipts and
-//       the serial number (identifier) of the the current message is added as
-//       a new receipt.
+//       Serials of messages received, remembered for
+//       :c:member:`ch_config_t.REUSE_TIME`. Late receipts, of reads that
+//       were cancelled, don't need a set of their own: they expire with
+//       their generation, see :c:type:`ch_receipts_t`.
 //
-//       A receipt is attached to a connection, whereas a protocol may have
-//       multiple connections.
+//    .. c:member:: ch_dedup_t dedup
 //
-//    .. c:member:: ch_receipt_t* late_receipts
+//       Filters of the serials received per peer, see :c:type:`ch_dedup_t`.
 //
-//       Pointer to a set of late receipts.
+//    .. c:member:: uint8_t deferred
 //
-//       A late receipt gets added when a read on a certain connection was
-//       cancelled. This might happen on events like timeouts, incomplete
-//       reads, resets of the connection, broken pipes, extra data or an
-//       exception when unpacking data.
-//       A late receipt acts as a pending task (a todo-item): Remove the
-//       receipt with the same (message-) identifier after N seconds, if this
-//       specific receipt is still (or again) in the queue of receipts.
+//       Servers (:c:macro:`CH_PR_DEFERRED_V4`, :c:macro:`CH_PR_DEFERRED_V6`)
+//       with a connection not accepted, because chirp sheds load. See
+//       :c:func:`ch_pr_resume_accept`.
 //
 //    .. c:member:: ch_chirp_t* chirp
 //
@@ -121,35 +82,54 @@ typedef struct ch_protocol_s {
     uv_tcp_t            serverv6;
     ch_connection_t*    connections;
     ch_connection_t*    old_connections;
-    ch_receipt_t*       receipts;
-    ch_receipt_t*       late_receipts;
+    ch_receipts_t       receipts;
+    ch_dedup_t          dedup;
+    uint8_t             deferred;
     ch_chirp_t*         chirp;
 } ch_protocol_t;
 
-// Sglib Prototypes
-// ----------------
-
-// .. c:macro:: CH_RECEIPT_CMP
+// .. c:macro:: CH_PR_DEFERRED_V4
 //
-//    Compares two receipts memorywise as byte strings, assuming that both byte
-//    strings are 16 bytes long.
+//    The IPv4 server has a deferred connection.
 //
-//    :param x: First red-black tree node to get receipt (byte string) from.
-//    :param y: Second red-black tree node to get receipt (byte string) from.
+// .. c:macro:: CH_PR_DEFERRED_V6
+//
+//    The IPv6 server has a deferred connection.
 //
 // .. code-block:: cpp
 //
-#define CH_RECEIPT_CMP(x,y) \
-    memcmp(x->receipt, y->receipt, 16)
+#define CH_PR_DEFERRED_V4 (1 << 0)
+#define CH_PR_DEFERRED_V6 (1 << 1)
 
+// .. c:function::
+void
+ch_pr_conn_start(ch_connection_t* conn, int accepted);
+//
+//    Start reading on a connected connection and begin the TLS handshake,
+//    or the chirp handshake if the connection isn't encrypted.
+//
+//    :param ch_connection_t* conn: The connection.
+//    :param int accepted: 1 if the connection was accepted, 0 if we
+//                         connected to the remote.
+
+// .. c:function::
+void
+ch_pr_resume_accept(ch_protocol_t* protocol);
+//
+//    Accept the connections deferred while chirp was shedding load.
+//
+//    :param ch_protocol_t* protocol: Protocol with deferred connections.
 
-SGLIB_DEFINE_RBTREE_PROTOTYPES( // NOCOV
-    ch_receipt_t,
-    left,
-    right,
-    color_field,
-    CH_RECEIPT_CMP
-)
+// .. c:function::
+void
+ch_pr_resume_read(ch_connection_t* conn);
+//
+//    Resume reading on a connection stopped by flow control, since a handler
+//    buffer has been released. The data kept while reading was stopped is
+//    read first. If the reader runs out of handler buffers again, reading
+//    stays stopped.
+//
+//    :param ch_connection_t* conn: The connection.
 
 // .. c:function::
 ch_error_t
@@ -529,7 +529,7 @@ ch_qc_tgen_char(void)
 // .. c:function::
 static
 ch_inline
-uint8_t
+double
 ch_qc_tgen_double(void)
 //
 //    Generate float of type double.
@@ -13,7 +13,11 @@
 //
 #include "chirp.h"
 #include "connection.h"
+#include "histogram.h"
+#include "probes.h"
+#include "protocol.h"
 #include "reader.h"
+#include "stats.h"
 #include "util.h"
 
 // Declarations
@@ -22,22 +26,33 @@
 // .. c:function::
 static
 ch_inline
-void
-_ch_rd_handshake(
-        ch_connection_t* conn,
-        ch_reader_t* reader,
-        ch_buf* buf,
-        size_t read
-);
+int
+_ch_rd_handle_msg(ch_connection_t* conn, ch_reader_t* reader);
 //
-//    Handle a handshake on the given connection.
+//    The current message has been received completely. Pass it to the
+//    receive callback or release it, if there is no callback.
 //
-//    Ensures, that the byte count which shall be read is at least the same as
-//    the handshike size.
+//    :param ch_connection_t* conn: Pointer to a connection instance.
+//    :param ch_readert* reader:    Pointer to a reader instance.
 //
-//    The given buffer gets copied into the handshake structure of the reader.
-//    Then the port, the maximum time until a timeout happens and the remote
-//    identity are applied to the given connection coming from the readers
+//    :return: CH_SUCCESS or CH_PROTOCOL_ERROR if the connection has been
+//             shut down meanwhile
+//    :rtype:  int
+
+// .. c:function::
+static
+ch_inline
+int
+_ch_rd_handshake(ch_connection_t* conn, ch_reader_t* reader);
+//
+//    Handle the remote handshake on the given connection, it has been read
+//    completely into :c:member:`ch_reader_t.remote_hs`.
+//
+//    The connection is shut down if the remote handshake has another
+//    version, see :c:macro:`CH_RD_HS_VERSION`.
+//
+//    The port, the maximum time until a timeout happens and the remote
+//    identity are applied to the given connection coming from the remote
 //    handshake.
 //
 //    It is then ensured, that the address of the peer connected to the TCP
@@ -52,37 +67,66 @@ _ch_rd_handshake(
 //    (of the protocol), holding only such old connections.
 //
 //    Finally, the given connection is added to the protocols pool of
-//    connections.
+//    connections and messages can be sent over it.
 //
 //    :param ch_connection_t* conn: Pointer to a connection instance.
-//    :param ch_readert* reader:    Pointer to a reader instance. Its handshake
-//                                  data structure is the target of this
-//                                  handshake
-//    :param ch_buf* buf:           Buffer containing bytes read, acts as data
-//                                  source
-//    :param size_t read:           Count of bytes read
+//    :param ch_readert* reader:    Pointer to a reader instance.
+//
+//    :return: CH_SUCCESS or CH_PROTOCOL_ERROR if the connection has been
+//             shut down
+//    :rtype:  int
 
 // .. c:function::
 static
 ch_inline
 int
-_ch_rd_read_buffer(
+_ch_rd_read_frame(
         ch_connection_t* conn,
         ch_reader_t*     reader,
         ch_buf*          source_buf,
         size_t           read,
-        size_t*          bytes_handled,
-        ch_rd_state_t    state
+        size_t*          bytes_handled
 );
 //
-//    Reads ``read`` bytes from the given buffer ``source_buf`` over the given
-//    connection with resepect to the current state.
+//    Copies the bytes of a compact frame from the given buffer into
+//    :c:member:`ch_reader_t.frame`, but no byte of the payload, and decodes
+//    it into :c:member:`ch_reader_t.msg` once it is complete. See
+//    :c:func:`ch_wi_size`.
 //
+//    :param ch_connection_t* conn: Pointer to a connection instance.
+//    :param ch_readert* reader:    Pointer to a reader instance.
+//    :param ch_buf* buf:           Buffer containing ``read`` bytes to be
+//                                  read, acting as data source.
+//    :param size_t read:           Number of bytes to read.
+//    :param size_t* bytes_handled: Incremented by the bytes copied.
 //
-//    .. todo:: Implement this function.
+//    :return:                      The state of the reading.
+//                                  0: The frame is complete.
+//                                  1: More bytes are needed.
+//                                  -1: The frame is invalid, the
+//                                  connection has been shut down.
+//    :rtype:                       int
+
+// .. c:function::
+static
+ch_inline
+int
+_ch_rd_read_buffer(
+        ch_connection_t* conn,
+        ch_reader_t*     reader,
+        ch_buf*          source_buf,
+        size_t           read,
+        size_t*          bytes_handled,
+        ch_rd_state_t    state
+);
 //
-//    .. warning:: This function is not yet implemented and will always return
-//                 1.
+//    Copies up to ``read`` bytes from the given buffer ``source_buf`` into
+//    the remote handshake, the wire message or the header, actor or data of
+//    the current message, depending on the state.
+//    :c:member:`ch_reader_t.bytes_read` counts the bytes already copied, so
+//    the field can arrive in any number of reads. The data of a streamed
+//    message is passed to :c:type:`ch_recv_stream_cb_t` instead, the header,
+//    actor and data of a duplicate are skipped.
 //
 //    :param ch_connection_t* conn: Pointer to a connection instance.
 //    :param ch_readert* reader:    Pointer to a reader instance.
@@ -98,23 +142,80 @@ _ch_rd_read_buffer(
 //                                  machine).
 //
 //    :return:                      The state of the reading.
-//                                  0: The reading was not successful.
-//                                  1: The reading was successful.
+//                                  0: The field is complete.
+//                                  1: More bytes are needed.
 //    :rtype:                       int
 
+// .. c:function::
+static
+ch_inline
+int
+_ch_rd_start_msg(ch_connection_t* conn, ch_reader_t* reader);
+//
+//    Acquire a handler buffer for the message in :c:member:`ch_reader_t.msg`
+//    and set up its header, actor and data buffers. Fields that don't fit into
+//    the preallocated buffers are allocated. Data is not buffered if the
+//    message is streamed, see :c:func:`ch_chirp_set_recv_stream_cb`. A
+//    duplicate (see :c:type:`ch_dedup_t`) gets no buffers, the handler
+//    buffer only holds it until it is acknowledged.
+//
+//    If no handler buffer is left, the reader waits in CH_RD_HANDLER with flow
+//    control, otherwise the connection is shut down.
+//
+//    :param ch_connection_t* conn: Pointer to a connection instance.
+//    :param ch_readert* reader:    Pointer to a reader instance.
+//
+//    :return: CH_SUCCESS, CH_ENOMEM if the reader waits for a handler buffer
+//             or the connection has been shut down
+//    :rtype:  int
+
 // Definitions
 // ===========
 
 // .. c:function::
 static
 ch_inline
-void
-_ch_rd_handshake(
-        ch_connection_t* conn,
-        ch_reader_t* reader,
-        ch_buf* buf,
-        size_t read
-)
+int
+_ch_rd_handle_msg(ch_connection_t* conn, ch_reader_t* reader)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rd_handle_msg`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t* chirp = conn->chirp;
+    ch_chirp_int_t* ichirp = chirp->_;
+    ch_message_t* msg = &reader->handler->msg;
+    reader->handler = NULL;
+    reader->state   = CH_RD_WAIT;
+    ch_hg_stage(
+        &ichirp->histograms[CH_HG_RECEIVE],
+        reader->stamp
+    );
+    if(reader->duplicate) {
+        reader->duplicate = 0;
+        CH_STATS_ADD(conn, duplicates, 1);
+        L(
+            chirp,
+            "Duplicate message dropped. ch_connection_t:%p",
+            (void*) conn
+        );
+        ch_chirp_release_message(msg);
+    } else if(ichirp->recv_cb != NULL)
+        ichirp->recv_cb(chirp, msg);
+    else
+        ch_chirp_release_message(msg);
+    if(conn->flags & CH_CN_SHUTTING_DOWN)
+        return CH_PROTOCOL_ERROR;
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+static
+ch_inline
+int
+_ch_rd_handshake(ch_connection_t* conn, ch_reader_t* reader)
 //    :noindex:
 //
 //    see: :c:func:`_ch_rd_handshake`
@@ -122,36 +223,48 @@ _ch_rd_handshake(
 // .. code-block:: cpp
 //
 {
+    ch_rd_handshake_t* hs = &reader->remote_hs;
     struct sockaddr_storage addr;
-    int addr_len;
+    int addr_len = sizeof(addr);
     ch_connection_t* old_conn;
     ch_chirp_t* chirp = conn->chirp;
     A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
     ch_chirp_int_t* ichirp = chirp->_;
     ch_protocol_t* protocol = &ichirp->protocol;
-    if(read < sizeof(ch_rd_handshake_t)) {
+    if(ntohs(hs->version) != CH_RD_HS_VERSION) {
         E(
             chirp,
-            "Illegal handshake size -> shutdown. ch_chirp_t:%p, "
+            "Handshake version %d not supported, expected %d. "
             "ch_connection_t:%p",
-            (void*) chirp,
+            (int) ntohs(hs->version),
+            CH_RD_HS_VERSION,
             (void*) conn
         );
-        ch_cn_shutdown(conn);
-        return;
+        ch_cn_shutdown(conn, CH_SHUTDOWN_PROTOCOL_ERROR);
+        return CH_PROTOCOL_ERROR;
     }
-    memcpy(&reader->hs, buf, sizeof(ch_rd_handshake_t));
-    conn->port = ntohs(reader->hs.port);
-    conn->max_timeout = ntohs(
-        reader->hs.max_timeout + (
-            (ichirp->config.RETRIES + 2) * ichirp->config.TIMEOUT
-        )
+    /* Connections created by the writer are in the connections already,
+     * keyed by the address we connected to. We have to remove it, before we
+     * change the key.
+     */
+    old_conn = sglib_ch_connection_t_find_member(
+        protocol->connections,
+        conn
+    );
+    if(old_conn == conn)
+        sglib_ch_connection_t_delete(&protocol->connections, conn);
+    conn->port = ntohs(hs->port);
+    if(ichirp->config.COMPACT_WIRE && ntohs(hs->flags) & CH_RD_HS_COMPACT)
+        conn->flags |= CH_CN_COMPACT;
+    conn->max_timeout = ntohs(hs->max_timeout) + (
+        (ichirp->config.RETRIES + 2) * ichirp->config.TIMEOUT
     );
     memcpy(
         conn->remote_identity,
-        reader->hs.identity,
+        hs->identity,
         sizeof(conn->remote_identity)
     );
+    ch_wr_set_credits(conn, ntohs(hs->credits));
     if(uv_tcp_getpeername(
                 &conn->client,
                 (struct sockaddr*) &addr,
@@ -164,8 +277,8 @@ _ch_rd_handshake(
             (void*) chirp,
             (void*) conn
         );
-        ch_cn_shutdown(conn);
-        return;
+        ch_cn_shutdown(conn, CH_SHUTDOWN_PROTOCOL_ERROR);
+        return CH_PROTOCOL_ERROR;
     };
     if(addr.ss_family == AF_INET6) {
         struct sockaddr_in6* saddr = (struct sockaddr_in6*) &addr;
@@ -216,6 +329,9 @@ _ch_rd_handshake(
         &protocol->connections,
         conn
     );
+    conn->flags |= CH_CN_CONNECTED;
+    // Stop the connect timeout, the writer starts the send timeout
+    uv_timer_stop(&conn->writer.send_timeout);
 #   ifndef NDEBUG
     {
         ch_text_address_t addr;
@@ -244,10 +360,344 @@ _ch_rd_handshake(
         );
     }
 #   endif
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+static
+ch_inline
+int
+_ch_rd_read_frame(
+        ch_connection_t* conn,
+        ch_reader_t* reader,
+        ch_buf* source_buf,
+        size_t read,
+        size_t *bytes_handled
+)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rd_read_frame`
+//
+// .. code-block:: cpp
+//
+{
+    size_t to_copy;
+    size_t handled = 0;
+    ch_chirp_t* chirp = conn->chirp;
+    size_t size = ch_wi_size(reader->frame, reader->bytes_read);
+    while(reader->bytes_read < size) {
+        if(handled == read) {
+            *bytes_handled += handled;
+            return 1;
+        }
+        to_copy = size - reader->bytes_read;
+        if(to_copy > read - handled)
+            to_copy = read - handled;
+        memcpy(
+            reader->frame + reader->bytes_read,
+            source_buf + handled,
+            to_copy
+        );
+        reader->bytes_read += to_copy;
+        handled            += to_copy;
+        size = ch_wi_size(reader->frame, reader->bytes_read);
+    }
+    *bytes_handled += handled;
+    if(ch_wi_decode(
+            &reader->identities,
+            reader->frame,
+            reader->bytes_read,
+            &reader->msg
+    ) != CH_SUCCESS) {
+        E(
+            chirp,
+            "Invalid compact frame -> shutdown. ch_chirp_t:%p, "
+            "ch_connection_t:%p",
+            (void*) chirp,
+            (void*) conn
+        );
+        ch_cn_shutdown(conn, CH_SHUTDOWN_PROTOCOL_ERROR);
+        return -1;
+    }
+    return 0;
+}
+
+// .. c:function::
+static
+ch_inline
+int
+_ch_rd_read_buffer(
+        ch_connection_t* conn,
+        ch_reader_t* reader,
+        ch_buf* source_buf,
+        size_t read,
+        size_t *bytes_handled,
+        ch_rd_state_t state
+
+)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rd_read_buffer`
+//
+// .. code-block:: cpp
+//
+{
+    ch_buf* dest;
+    size_t expected;
+    size_t to_copy;
+    ch_message_t* msg = NULL;
+    ch_chirp_t* chirp = conn->chirp;
+    if(reader->handler != NULL)
+        msg = &reader->handler->msg;
+    switch(state) {
+        case CH_RD_HANDSHAKE:
+            dest     = (ch_buf*) &reader->remote_hs;
+            expected = sizeof(ch_rd_handshake_t);
+            break;
+        case CH_RD_WAIT:
+            dest     = (ch_buf*) &reader->msg;
+            expected = sizeof(ch_msg_message_t);
+            break;
+        case CH_RD_HEADER:
+            dest     = msg->header;
+            expected = msg->header_len;
+            break;
+        case CH_RD_ACTOR:
+            dest     = (ch_buf*) msg->actor;
+            expected = msg->actor_len;
+            break;
+        case CH_RD_DATA:
+            dest     = msg->data;
+            expected = msg->data_len;
+            break;
+        default:
+            A(0, "Not a buffer state");
+            return 1;
+    }
+    to_copy = expected - reader->bytes_read;
+    if(to_copy > read)
+        to_copy = read;
+    if(dest == NULL) {
+        /* The payload of a duplicate is skipped, data is streamed */
+        if(!reader->duplicate) {
+            A(msg->streamed, "Only streamed data has no buffer");
+            chirp->_->recv_stream_cb(
+                chirp,
+                msg,
+                source_buf,
+                to_copy,
+                reader->bytes_read
+            );
+        }
+    } else
+        memcpy(dest + reader->bytes_read, source_buf, to_copy);
+    reader->bytes_read += to_copy;
+    *bytes_handled     += to_copy;
+    return reader->bytes_read < expected;
+}
+
+// .. c:function::
+static
+ch_inline
+int
+_ch_rd_start_msg(ch_connection_t* conn, ch_reader_t* reader)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rd_start_msg`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t* chirp = conn->chirp;
+    ch_chirp_int_t* ichirp = chirp->_;
+    ch_msg_message_t* net_msg = &reader->msg;
+    ch_bf_handler_t* handler = ch_bf_acquire(reader->pool);
+    if(handler == NULL) {
+        if(ichirp->config.FLOW_CONTROL) {
+            reader->state = CH_RD_HANDLER;
+            return CH_ENOMEM;
+        }
+        E(
+            chirp,
+            "No handler buffer left -> shutdown. ch_chirp_t:%p, "
+            "ch_connection_t:%p",
+            (void*) chirp,
+            (void*) conn
+        );
+        ch_cn_shutdown(conn, CH_SHUTDOWN_PROTOCOL_ERROR);
+        return CH_ENOMEM;
+    }
+    reader->handler = handler;
+    ch_message_t* msg = &handler->msg;
+    memset(msg, 0, sizeof(ch_message_t));
+    memcpy(msg->identity, net_msg->identity, sizeof(msg->identity));
+    memcpy(msg->serial, net_msg->serial, sizeof(msg->serial));
+    msg->message_type = net_msg->message_type;
+    msg->header_len   = net_msg->header_len;
+    msg->actor_len    = net_msg->actor_len;
+    msg->data_len     = net_msg->data_len;
+    msg->ip_protocol  = conn->ip_protocol;
+    msg->port         = conn->port;
+    msg->_handler     = handler;
+    memcpy(msg->address, conn->address, sizeof(msg->address));
+    reader->duplicate = ch_dd_seen(
+        &ichirp->protocol.dedup,
+        &ichirp->protocol.receipts,
+        conn->remote_identity,
+        msg->serial,
+        uv_now(ichirp->loop)
+    );
+    /* Nothing is allocated or streamed for a duplicate, it is only acked */
+    if(reader->duplicate)
+        return CH_SUCCESS;
+    if(msg->header_len > CH_BF_PREALLOC_HEADER) {
+        msg->header      = ch_alloc(msg->header_len);
+        msg->free_header = msg->header != NULL;
+    } else
+        msg->header = handler->header;
+    if(msg->actor_len > CH_BF_PREALLOC_ACTOR) {
+        msg->actor      = ch_alloc(msg->actor_len);
+        msg->free_actor = msg->actor != NULL;
+    } else
+        msg->actor = handler->actor;
+    if(
+            ichirp->recv_stream_cb != NULL &&
+            msg->data_len > 0 &&
+            msg->data_len >= ichirp->stream_min_data_len
+    ) {
+        msg->data     = NULL;
+        msg->streamed = 1;
+    } else if(msg->data_len > CH_BF_PREALLOC_DATA) {
+        msg->data      = ch_alloc(msg->data_len);
+        msg->free_data = msg->data != NULL;
+    } else
+        msg->data = handler->data;
+    if(!(msg->header && msg->actor && (msg->data || msg->streamed))) {
+        E(
+            chirp,
+            "Could not allocate memory for message -> shutdown. "
+            "ch_chirp_t:%p, ch_connection_t:%p",
+            (void*) chirp,
+            (void*) conn
+        );
+        ch_cn_shutdown(conn, CH_SHUTDOWN_PROTOCOL_ERROR);
+        return CH_ENOMEM;
+    }
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+void
+ch_chirp_release_message(ch_message_t* msg)
+//    :noindex:
+//
+//    see: :c:func:`ch_chirp_release_message`
+//
+// .. code-block:: cpp
+//
+{
+    ch_bf_handler_t* handler = msg->_handler;
+    ch_connection_t* conn = handler->pool->conn;
+    if(
+            msg->message_type & CH_MSG_REQ_ACK &&
+            conn != NULL &&
+            !(conn->flags & CH_CN_SHUTTING_DOWN)
+    )
+        ch_wr_send_ack(conn, msg);
+    else
+        ch_rd_free_msg(msg);
+}
+
+// .. c:function::
+void
+ch_chirp_set_recv_cb(ch_chirp_t* chirp, ch_recv_cb_t recv_cb)
+//    :noindex:
+//
+//    see: :c:func:`ch_chirp_set_recv_cb`
+//
+// .. code-block:: cpp
+//
+{
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    chirp->_->recv_cb = recv_cb;
+}
+
+// .. c:function::
+void
+ch_chirp_set_recv_stream_cb(
+        ch_chirp_t* chirp,
+        ch_recv_stream_cb_t stream_cb,
+        uint32_t min_data_len
+)
+//    :noindex:
+//
+//    see: :c:func:`ch_chirp_set_recv_stream_cb`
+//
+// .. code-block:: cpp
+//
+{
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    chirp->_->recv_stream_cb      = stream_cb;
+    chirp->_->stream_min_data_len = min_data_len;
 }
 
 // .. c:function::
 void
+ch_rd_free(ch_reader_t* reader)
+//    :noindex:
+//
+//    see: :c:func:`ch_rd_free`
+//
+// .. code-block:: cpp
+//
+{
+    ch_message_t* msg;
+    ch_chirp_int_t* ichirp;
+    if(reader->handler != NULL) {
+        msg = &reader->handler->msg;
+        /* It was recorded by the duplicate suppression when it started */
+        if(!reader->duplicate && reader->pool->conn != NULL) {
+            ichirp = reader->pool->conn->chirp->_;
+            ch_rc_remove(
+                &ichirp->protocol.receipts,
+                msg->serial,
+                uv_now(ichirp->loop)
+            );
+        }
+        ch_rd_free_msg(msg);
+        reader->handler = NULL;
+    }
+    ch_bf_free(reader->pool);
+}
+
+// .. c:function::
+void
+ch_rd_free_msg(ch_message_t* msg)
+//    :noindex:
+//
+//    see: :c:func:`ch_rd_free_msg`
+//
+// .. code-block:: cpp
+//
+{
+    ch_bf_handler_t* handler = msg->_handler;
+    ch_connection_t* conn = handler->pool->conn;
+    if(msg->free_header)
+        ch_free(msg->header);
+    if(msg->free_actor)
+        ch_free(msg->actor);
+    if(msg->free_data)
+        ch_free(msg->data);
+    msg->free_header = 0;
+    msg->free_actor  = 0;
+    msg->free_data   = 0;
+    ch_bf_release(handler->pool, handler);
+    if(conn != NULL && conn->flags & CH_CN_READ_STOPPED)
+        ch_pr_resume_read(conn);
+}
+
+// .. c:function::
+size_t
 ch_rd_read(ch_connection_t* conn, void* buffer, size_t read)
 //    :noindex:
 //
@@ -256,6 +706,7 @@ ch_rd_read(ch_connection_t* conn, void* buffer, size_t read)
 // .. code-block:: cpp
 //
 {
+    int tmp_ret;
     ch_msg_message_t* msg;
     ch_buf* buf = buffer; // Don't do pointer arithmetics on void*
 
@@ -269,7 +720,11 @@ ch_rd_read(ch_connection_t* conn, void* buffer, size_t read)
     A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
     ch_chirp_int_t* ichirp = chirp->_;
     ch_reader_t* reader = &conn->reader;
+    ch_rd_state_t old_state;
+    /* Any data is a heartbeat for the watcher. */
+    conn->last_activity = uv_now(ichirp->loop);
     do {
+        old_state = reader->state;
         switch(reader->state) {
             case CH_RD_START:
                 reader->hs.port = htons(ichirp->public_port);
@@ -277,51 +732,80 @@ ch_rd_read(ch_connection_t* conn, void* buffer, size_t read)
                     (ichirp->config.RETRIES + 2) * ichirp->config.TIMEOUT
                 );
                 memcpy(reader->hs.identity, ichirp->identity, 16);
-                ch_cn_write(
-                    conn,
-                    &reader->hs,
-                    sizeof(ch_rd_handshake_t),
-                    NULL
+                reader->hs.version = htons(CH_RD_HS_VERSION);
+                reader->hs.credits = htons(
+                    reader->pool->max_buffers - reader->pool->used_buffers
+                );
+                reader->hs.flags = htons(
+                    ichirp->config.COMPACT_WIRE ? CH_RD_HS_COMPACT : 0
                 );
                 reader->state = CH_RD_HANDSHAKE;
+                conn->writer.flags |= CH_WR_HANDSHAKE;
+                ch_wr_process_queues(conn);
                 break;
             case CH_RD_HANDSHAKE:
-                /* We expect that complete handshake arrives at once,
-                 * check in _ch_rd_handshake
-                 */
-                _ch_rd_handshake(
+                if(_ch_rd_read_buffer(
                     conn,
                     reader,
                     buf + bytes_handled,
-                    read - bytes_handled
-                );
-                bytes_handled += sizeof(ch_rd_handshake_t);
+                    read - bytes_handled,
+                    &bytes_handled,
+                    CH_RD_HANDSHAKE
+                )) break;
+                reader->bytes_read = 0; // Reset partial buffer reads
+                if(_ch_rd_handshake(conn, reader) != CH_SUCCESS)
+                    return bytes_handled;
                 reader->state = CH_RD_WAIT;
+                ch_wr_process_queues(conn);
                 break;
             case CH_RD_WAIT:
-                // We expect that complete message header arrives at once
-                if(read + bytes_handled < sizeof(ch_msg_message_t)) {
-                    E(
-                        chirp,
-                        "Illegal message header size -> shutdown. "
-                        "ch_chirp_t:%p, ch_connection_t:%p",
-                        (void*) chirp,
-                        (void*) conn
+                if(reader->bytes_read == 0)
+                    reader->stamp = uv_hrtime();
+                msg = &reader->msg;
+                if(conn->flags & CH_CN_COMPACT) {
+                    tmp_ret = _ch_rd_read_frame(
+                        conn,
+                        reader,
+                        buf + bytes_handled,
+                        read - bytes_handled,
+                        &bytes_handled
                     );
-                    ch_cn_shutdown(conn);
-                    return;
+                    if(tmp_ret < 0)
+                        return bytes_handled;
+                    if(tmp_ret > 0)
+                        break;
+                    reader->bytes_read = 0; // Reset partial buffer reads
+                } else {
+                    if(_ch_rd_read_buffer(
+                        conn,
+                        reader,
+                        buf + bytes_handled,
+                        read - bytes_handled,
+                        &bytes_handled,
+                        CH_RD_WAIT
+                    )) break;
+                    reader->bytes_read = 0; // Reset partial buffer reads
+                    msg->header_len = ntohs(msg->header_len);
+                    msg->actor_len  = ntohs(msg->actor_len);
+                    msg->data_len   = ntohl(msg->data_len);
+                }
+                if(msg->message_type & CH_MSG_ACK) {
+                    ch_wr_ack_received(conn, msg->serial);
+                    break;
                 }
+                CH_STATS_ADD(conn, messages_received, 1);
+                // Pings and pongs have no payload
+                if(msg->message_type & CH_MSG_PING) {
+                    ch_wr_ping(conn, CH_MSG_PONG);
+                    break;
+                }
+                if(msg->message_type & CH_MSG_PONG)
+                    break;
+                // Fall through
+            case CH_RD_HANDLER:
                 msg = &reader->msg;
-                memcpy(
-                    msg,
-                    buf + bytes_handled,
-                    sizeof(ch_msg_message_t)
-                );
-                msg->header_len    = ntohs(msg->header_len);
-                msg->actor_len     = ntohs(msg->actor_len);
-                msg->data_len      = ntohl(msg->data_len);
-                bytes_handled     += sizeof(ch_msg_message_t);
-                reader->bytes_read = 0; // Reset partial buffer reads
+                if(_ch_rd_start_msg(conn, reader) != CH_SUCCESS)
+                    return bytes_handled;
                 // Direct jump to next read state
                 if(msg->header_len > 0)
                     reader->state = CH_RD_HEADER;
@@ -329,10 +813,8 @@ ch_rd_read(ch_connection_t* conn, void* buffer, size_t read)
                     reader->state = CH_RD_ACTOR;
                 else if(msg->data_len > 0)
                     reader->state = CH_RD_DATA;
-                else {
-                    reader->state = CH_RD_WAIT;
-                    //TODO ack
-                }
+                else if(_ch_rd_handle_msg(conn, reader) != CH_SUCCESS)
+                    return bytes_handled;
                 break;
             case CH_RD_HEADER:
                 msg = &reader->msg;
@@ -350,10 +832,8 @@ ch_rd_read(ch_connection_t* conn, void* buffer, size_t read)
                     reader->state = CH_RD_ACTOR;
                 else if(msg->data_len > 0)
                     reader->state = CH_RD_DATA;
-                else {
-                    reader->state = CH_RD_WAIT;
-                    //TODO ack
-                }
+                else if(_ch_rd_handle_msg(conn, reader) != CH_SUCCESS)
+                    return bytes_handled;
                 break;
             case CH_RD_ACTOR:
                 msg = &reader->msg;
@@ -363,64 +843,34 @@ ch_rd_read(ch_connection_t* conn, void* buffer, size_t read)
                     buf + bytes_handled,
                     read - bytes_handled,
                     &bytes_handled,
-                    CH_RD_HEADER
+                    CH_RD_ACTOR
                 )) break;
                 reader->bytes_read = 0; // Reset partial buffer reads
                 // Direct jump to next read state
                 if(msg->data_len > 0)
                     reader->state = CH_RD_DATA;
-                else {
-                    reader->state = CH_RD_WAIT;
-                    //TODO ack
-                }
+                else if(_ch_rd_handle_msg(conn, reader) != CH_SUCCESS)
+                    return bytes_handled;
                 break;
             case CH_RD_DATA:
-                msg = &reader->msg;
                 if(_ch_rd_read_buffer(
                     conn,
                     reader,
                     buf + bytes_handled,
                     read - bytes_handled,
                     &bytes_handled,
-                    CH_RD_HEADER
+                    CH_RD_DATA
                 )) break;
                 reader->bytes_read = 0; // Reset partial buffer reads
-                reader->state = CH_RD_WAIT;
-                //TODO ack
+                if(_ch_rd_handle_msg(conn, reader) != CH_SUCCESS)
+                    return bytes_handled;
+                break;
             default:
                 A(0, "Unknown reader state");
                 break;
         }
+        if(reader->state != old_state)
+            CH_PROBE3(rd_state, conn, old_state, reader->state);
     } while(bytes_handled < read);
-}
-
-// .. c:function::
-static
-ch_inline
-int
-_ch_rd_read_buffer(
-        ch_connection_t* conn,
-        ch_reader_t* reader,
-        ch_buf* source_buf,
-        size_t read,
-        size_t *bytes_handled,
-        ch_rd_state_t state
-
-)
-//    :noindex:
-//
-//    TODO: Implement the function
-//
-//    see: :c:func:`_ch_rd_read_buffer`
-//
-// .. code-block:: cpp
-//
-{
-    (void)(conn);
-    (void)(reader);
-    (void)(source_buf);
-    (void)(read);
-    (void)(bytes_handled);
-    (void)(state);
-    return 1;
+    return bytes_handled;
 }
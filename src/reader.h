@@ -17,6 +17,7 @@
 #include "common.h"
 #include "message.h"
 #include "buffer.h"
+#include "wire.h"
 
 // Declarations
 // ============
@@ -48,6 +49,11 @@ struct ch_connection_s;
 //
 //       Read data.
 //
+//    .. c:member:: CH_RD_HANDLER
+//
+//       The wire message is complete, but all handler buffers are used.
+//       Waits for a handler buffer, reading is stopped (flow control).
+//
 // .. code-block:: cpp
 //
 typedef enum {
@@ -56,9 +62,35 @@ typedef enum {
     CH_RD_WAIT      = 2,
     CH_RD_HEADER    = 3,
     CH_RD_ACTOR     = 4,
-    CH_RD_DATA      = 5
+    CH_RD_DATA      = 5,
+    CH_RD_HANDLER   = 6
 } ch_rd_state_t;
 
+// .. c:type:: ch_rd_hs_flags_t
+//
+//    Features announced in the handshake.
+//
+//    .. c:member:: CH_RD_HS_COMPACT
+//
+//       The node reads compact frames, see :c:type:`ch_wi_table_t`.
+//
+// .. code-block:: cpp
+//
+typedef enum {
+    CH_RD_HS_COMPACT = 1 << 0,
+} ch_rd_hs_flags_t;
+
+// .. c:macro:: CH_RD_HS_VERSION
+//
+//    Version of the handshake. The handshake of nodes without flow control
+//    and compact frames had no version and was 20 bytes long, these nodes
+//    cannot talk to this version. Nodes check the version of the remote
+//    handshake and close the connection if it differs.
+//
+// .. code-block:: cpp
+//
+#define CH_RD_HS_VERSION 2
+
 // .. c:type:: ch_rd_handshake_t
 //
 //    Handshake data structure.
@@ -80,12 +112,29 @@ typedef enum {
 //       a successful handshake. It is used by the connection for getting the
 //       remote address.
 //
+//    .. c:member:: uint16_t version
+//
+//       Version of the handshake, see :c:macro:`CH_RD_HS_VERSION`.
+//
+//    .. c:member:: uint16_t credits
+//
+//       Count of messages the remote may send before it has to wait for an
+//       ack: the free handler buffers of the connection. Every ack returns a
+//       credit, see :c:member:`ch_writer_t.credits`.
+//
+//    .. c:member:: uint16_t flags
+//
+//       Features of the node, see :c:type:`ch_rd_hs_flags_t`.
+//
 // .. code-block:: cpp
 //
 typedef struct ch_rd_handshake_s {
     uint16_t      port;
     uint16_t      max_timeout;
     unsigned char identity[16];
+    uint16_t      version;
+    uint16_t      credits;
+    uint16_t      flags;
 } ch_rd_handshake_t;
 
 // .. c:type:: ch_reader_t
@@ -101,13 +150,32 @@ typedef struct ch_rd_handshake_s {
 //       Handshake data structure to send over the network, which is used as
 //       data source.
 //
+//    .. c:member:: ch_rd_handshake_t remote_hs
+//
+//       Handshake of the remote, accumulated until it is complete.
+//
 //    .. c:member:: ch_msg_message_t msg
 //
-//       Wire protocol message in network order (network endianness).
+//       Wire protocol message, accumulated in network order (network
+//       endianness) until it is complete, then converted to host order.
 //
-//    .. c:member:: ch_buffer_pool_t pool
+//    .. c:member:: uint8_t frame[CH_WI_MAX]
+//
+//       Compact frame, accumulated until it is complete, see
+//       :c:func:`ch_wi_size`.
+//
+//    .. c:member:: ch_wi_table_t identities
+//
+//       Identities received in compact frames.
+//
+//    .. c:member:: ch_bf_handler_t* handler
+//
+//       Handler buffer the current message is read into.
+//
+//    .. c:member:: ch_buffer_pool_t* pool
 //
 //       Data structure containing preallocated buffers for the chirp handlers.
+//       It is allocated, since received messages can outlive the connection.
 //
 //    .. c:member:: size_t bytes_read
 //
@@ -116,46 +184,75 @@ typedef struct ch_rd_handshake_s {
 //       :c:member:`ch_rd_read.read` bytes to read but not enough bytes are
 //       being delivered over the connection :c:member:`ch_rd_read.conn`.
 //
+//    .. c:member:: uint64_t stamp
+//
+//       Time (uv_hrtime) the first byte of the current message arrived, see
+//       :c:member:`ch_hg_stage_t.CH_HG_RECEIVE`.
+//
+//    .. c:member:: int duplicate
+//
+//       The current message is a duplicate, its header, actor and data are
+//       skipped, see :c:type:`ch_dedup_t`.
+//
 // .. code-block:: cpp
 //
 typedef struct ch_reader_s {
     ch_rd_state_t     state;
     ch_rd_handshake_t hs;
+    ch_rd_handshake_t remote_hs;
     ch_msg_message_t  msg;
-    ch_buffer_pool_t  pool;
+    uint8_t           frame[CH_WI_MAX];
+    ch_wi_table_t     identities;
+    ch_bf_handler_t*  handler;
+    ch_buffer_pool_t* pool;
     size_t            bytes_read;
+    uint64_t          stamp;
+    int               duplicate;
 } ch_reader_t;
 
 // .. c:function::
 void
+ch_rd_free(ch_reader_t* reader);
+//
+//    Free the (data-) buffer pool of the given reader instance. A message
+//    that has not been received completely is dropped and removed from the
+//    receipts, so it is delivered when the sender retries it.
+//
+//    :param ch_reader_t* reader: The reader instance whose buffer
+//                                pool shall be freed.
+
+// .. c:function::
+void
+ch_rd_free_msg(ch_message_t* msg);
+//
+//    Free the buffers allocated for a received message and release its
+//    handler buffer. Resumes reading, if the connection waited for a handler
+//    buffer.
+//
+//    :param ch_message_t* msg: The message received.
+
+// .. c:function::
+size_t
 ch_rd_read(struct ch_connection_s* conn, void* buf, size_t read);
 //
 //    Implements the wire protocol reader part.
 //
+//    If :c:member:`ch_config_t.FLOW_CONTROL` is on and all handler buffers
+//    are used, the reader stops in :c:member:`ch_rd_state_t.CH_RD_HANDLER`
+//    and returns the bytes handled so far. The caller keeps the rest and
+//    calls the reader again, when a handler buffer has been released.
+//
 //    :param ch_connection_t* conn: Connection the data was read from.
 //    :param void* buf:             The buffer containing ``read`` bytes read.
 //    :param size_t read:           The number of bytes read.
+//
+//    :return: The bytes handled, less than ``read`` if the reader waits for
+//             a handler buffer or the connection has been shut down.
+//    :rtype:  size_t
 
 // Definitions
 // ===========
 
-// .. c:function::
-static
-ch_inline
-void
-ch_rd_free(ch_reader_t* reader)
-//
-//    Free the (data-) buffer pool of the given reader instance.
-//
-//    :param ch_reader_t* reader: The reader instance whose buffer
-//                                pool shall be freed.
-//
-// .. code-block:: cpp
-//
-{
-    ch_bf_free(&reader->pool);
-}
-
 // .. c:function::
 static
 ch_inline
@@ -171,8 +268,22 @@ ch_rd_init(ch_reader_t* reader, uint8_t max_buffers)
 // .. code-block:: cpp
 //
 {
-    reader->state = CH_RD_START;
-    return ch_bf_init(&reader->pool, max_buffers);
+    ch_error_t tmp_err;
+    reader->state      = CH_RD_START;
+    reader->handler    = NULL;
+    reader->bytes_read = 0;
+    reader->duplicate  = 0;
+    memset(&reader->identities, 0, sizeof(reader->identities));
+    reader->pool    = ch_alloc(sizeof(ch_buffer_pool_t));
+    if(!reader->pool) {
+        return CH_ENOMEM;
+    }
+    tmp_err = ch_bf_init(reader->pool, max_buffers);
+    if(tmp_err != CH_SUCCESS) {
+        ch_free(reader->pool);
+        reader->pool = NULL;
+    }
+    return tmp_err;
 }
 
 #endif //ch_reader_h
@@ -0,0 +1,415 @@
+// ============
+// Reader etest
+// ============
+//
+// Fragmentation sweep of the reader: quickcheck generates messages (see
+// :c:func:`ch_test_gen_message`), they are serialized to a wire stream and
+// fed to :c:func:`ch_rd_read` in chunks of random size. The property holds
+// if the reader returns every message unchanged and in order. The sweep runs
+// again with streaming (see :c:func:`ch_chirp_set_recv_stream_cb`) and with
+// compact frames. The last sweep checks the duplicate suppression (see
+// :c:type:`ch_dedup_t`): the stream breaks before its last message, then it
+// is sent again and only the last message is delivered, the third time
+// every message is a duplicate and skipped. The throughput of the reader is
+// printed at the end.
+//
+// The reader starts in CH_RD_WAIT on a fake connection, since the handshake
+// needs a socket.
+//
+// .. code-block:: cpp
+//
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "libchirp.h"
+#include "chirp.h"
+#include "connection.h"
+#include "message_test.h"
+#include "quickcheck.h"
+#include "reader.h"
+
+// Test functions
+// ==============
+//
+// Not documented on purpose.
+//
+// .. code-block:: cpp
+
+#define CH_TEST_MESSAGES 3
+#define CH_TEST_STREAM_MIN 4096
+
+typedef struct ch_test_reader_s {
+    ch_chirp_t       chirp;
+    ch_chirp_int_t   ichirp;
+    uv_loop_t        loop;
+    ch_connection_t  conn;
+    ch_message_t**   expected;
+    int              received;
+    int              errors;
+    uint32_t         streamed;
+    int              compact;
+    int              duplicate;
+    uint64_t         bytes;
+    uint64_t         ns;
+} ch_test_reader_t;
+
+static ch_test_reader_t _ch_test_reader;
+
+static
+void
+_ch_test_log_cb(char msg[], char error)
+{
+    if(error)
+        fprintf(stderr, "%s\n", msg);
+}
+
+static
+int
+_ch_test_field_eq(void* a, void* b, size_t len)
+{
+    if(len == 0)
+        return 1;
+    return memcmp(a, b, len) == 0;
+}
+
+static
+void
+_ch_test_stream_cb(
+        ch_chirp_t* chirp,
+        ch_message_t* msg,
+        const ch_buf* data,
+        uint32_t len,
+        uint32_t offset
+)
+{
+    (void)(chirp);
+    ch_test_reader_t* test = &_ch_test_reader;
+    ch_message_t* expected = test->expected[test->received];
+    if(
+            test->duplicate ||
+            !msg->streamed ||
+            offset != test->streamed ||
+            offset + len > expected->data_len ||
+            memcmp(data, expected->data + offset, len) != 0
+    )
+        test->errors += 1;
+    test->streamed += len;
+}
+
+static
+void
+_ch_test_recv_cb(ch_chirp_t* chirp, ch_message_t* msg)
+{
+    (void)(chirp);
+    ch_test_reader_t* test = &_ch_test_reader;
+    if(test->duplicate || test->received >= CH_TEST_MESSAGES) {
+        test->errors += 1;
+        ch_rd_free_msg(msg);
+        return;
+    }
+    ch_message_t* expected = test->expected[test->received];
+    int streamed = (
+        test->ichirp.recv_stream_cb != NULL &&
+        expected->data_len >= CH_TEST_STREAM_MIN
+    );
+    if(
+            msg->streamed != streamed ||
+            (streamed && test->streamed != msg->data_len) ||
+            msg->header_len != expected->header_len ||
+            msg->actor_len != expected->actor_len ||
+            msg->data_len != expected->data_len ||
+            memcmp(msg->identity, expected->identity, 16) != 0 ||
+            !_ch_test_field_eq(
+                msg->header,
+                expected->header,
+                msg->header_len
+            ) ||
+            !_ch_test_field_eq(msg->actor, expected->actor, msg->actor_len) ||
+            (
+                !streamed &&
+                !_ch_test_field_eq(msg->data, expected->data, msg->data_len)
+            )
+    )
+        test->errors += 1;
+    test->received += 1;
+    test->streamed  = 0;
+    // Not ch_chirp_release_message: there is no writer to send acks
+    ch_rd_free_msg(msg);
+}
+
+static
+void
+_ch_test_reset(void)
+{
+    ch_test_reader_t* test = &_ch_test_reader;
+    ch_connection_t* conn = &test->conn;
+    memset(conn, 0, sizeof(ch_connection_t));
+    conn->chirp = &test->chirp;
+    conn->flags = CH_CN_CONNECTED;
+    if(test->compact)
+        conn->flags |= CH_CN_COMPACT;
+    A(
+        ch_rd_init(&conn->reader, test->ichirp.config.MAX_HANDLERS) ==
+            CH_SUCCESS,
+        "Could not initialize reader"
+    );
+    conn->reader.state       = CH_RD_WAIT;
+    conn->reader.pool->stats = &conn->stats;
+    conn->reader.pool->total = &test->ichirp.stats;
+    conn->reader.pool->conn  = conn;
+    test->received = 0;
+    test->streamed = 0;
+}
+
+static
+size_t
+_ch_test_serialize(ch_message_t** msgs, ch_buf** stream)
+{
+    int i;
+    size_t size = 0;
+    size_t pos = 0;
+    ch_msg_message_t net_msg;
+    ch_wi_table_t identities;
+    ch_qc_mem_track_t* track;
+    for(i = 0; i < CH_TEST_MESSAGES; i++) {
+        size += sizeof(ch_msg_message_t) + CH_WI_MAX;
+        size += msgs[i]->header_len + msgs[i]->actor_len + msgs[i]->data_len;
+    }
+    track    = ch_qc_track_alloc(size);
+    *stream  = track->data;
+    memset(&identities, 0, sizeof(identities));
+    for(i = 0; i < CH_TEST_MESSAGES; i++) {
+        ch_message_t* msg = msgs[i];
+        if(_ch_test_reader.compact) {
+            pos += ch_wi_encode(
+                &identities,
+                msg,
+                msg->message_type,
+                (uint8_t*) *stream + pos
+            );
+        } else {
+            memset(&net_msg, 0, sizeof(net_msg));
+            memcpy(net_msg.identity, msg->identity, 16);
+            memcpy(net_msg.serial, msg->serial, 16);
+            net_msg.message_type = msg->message_type;
+            net_msg.header_len   = htons(msg->header_len);
+            net_msg.actor_len    = htons(msg->actor_len);
+            net_msg.data_len     = htonl(msg->data_len);
+            memcpy(*stream + pos, &net_msg, sizeof(net_msg));
+            pos += sizeof(net_msg);
+        }
+        memcpy(*stream + pos, msg->header, msg->header_len);
+        pos += msg->header_len;
+        memcpy(*stream + pos, msg->actor, msg->actor_len);
+        pos += msg->actor_len;
+        memcpy(*stream + pos, msg->data, msg->data_len);
+        pos += msg->data_len;
+    }
+    return pos;
+}
+
+static
+size_t
+_ch_test_chunk(size_t pos, size_t size)
+{
+    /* Mostly small chunks, sometimes up to 64KiB */
+    size_t chunk = 1 + rand() % (1 << (rand() % 17));
+    if(chunk > size - pos)
+        chunk = size - pos;
+    return chunk;
+}
+
+static
+size_t
+_ch_test_read(ch_buf* stream, size_t size)
+{
+    size_t pos = 0;
+    ch_test_reader_t* test = &_ch_test_reader;
+    _ch_test_reset();
+    while(pos < size) {
+        size_t chunk = _ch_test_chunk(pos, size);
+        uint64_t start = uv_hrtime();
+        ch_rd_read(&test->conn, stream + pos, chunk);
+        test->ns += uv_hrtime() - start;
+        pos += chunk;
+        if(test->conn.flags & CH_CN_SHUTTING_DOWN)
+            break;
+    }
+    test->bytes += pos;
+    ch_rd_free(&test->conn.reader);
+    return pos;
+}
+
+static
+bool
+_ch_test_fragmented_read(ch_buf* data)
+{
+    int i;
+    size_t size;
+    ch_buf* stream;
+    ch_message_t* msgs[CH_TEST_MESSAGES];
+    ch_test_reader_t* test = &_ch_test_reader;
+    for(i = 0; i < CH_TEST_MESSAGES; i++)
+        msgs[i] = ch_qc_args(ch_message_t*, i, ch_message_t*);
+    if(test->compact) {
+        /* New identities, the last one is sent as index. */
+        for(i = 0; i < CH_TEST_MESSAGES - 1; i++)
+            ch_random_ints_as_bytes(msgs[i]->identity, 16);
+        memcpy(msgs[i]->identity, msgs[0]->identity, 16);
+    }
+    size = _ch_test_serialize(msgs, &stream);
+    test->expected = msgs;
+    test->errors   = 0;
+    return (
+        _ch_test_read(stream, size) == size &&
+        test->errors == 0 &&
+        test->received == CH_TEST_MESSAGES
+    );
+}
+
+static
+bool
+_ch_test_duplicate_read(ch_buf* data)
+{
+    int i;
+    size_t size;
+    ch_buf* stream;
+    uint64_t duplicates = _ch_test_reader.ichirp.stats.duplicates;
+    ch_message_t* msgs[CH_TEST_MESSAGES];
+    ch_test_reader_t* test = &_ch_test_reader;
+    for(i = 0; i < CH_TEST_MESSAGES; i++) {
+        msgs[i] = ch_qc_args(ch_message_t*, i, ch_message_t*);
+        ch_random_ints_as_bytes(msgs[i]->serial, 16);
+    }
+    size = _ch_test_serialize(msgs, &stream);
+    test->expected = msgs;
+    test->errors   = 0;
+    /* The connection breaks before the last message is complete */
+    _ch_test_read(stream, size - 1);
+    if(test->received != CH_TEST_MESSAGES - 1)
+        return 0;
+    /* Only the last message is delivered when the stream is sent again */
+    test->expected = msgs + CH_TEST_MESSAGES - 1;
+    _ch_test_read(stream, size);
+    if(test->received != 1)
+        return 0;
+    /* All of them are duplicates now */
+    test->duplicate = 1;
+    _ch_test_read(stream, size);
+    test->duplicate = 0;
+    return (
+        test->errors == 0 &&
+        test->received == 0 &&
+        test->ichirp.stats.duplicates - duplicates ==
+            2 * CH_TEST_MESSAGES - 1
+    );
+}
+
+static
+void
+_ch_test_print_message(ch_buf* data)
+{
+    ch_message_t* msg = *(ch_message_t**) data;
+    printf(
+        "header_len: %d, actor_len: %d, data_len: %u",
+        msg->header_len,
+        msg->actor_len,
+        msg->data_len
+    );
+}
+
+// Runner
+// ======
+
+// .. c:function::
+int
+main(
+    int argc,
+    char *argv[]
+)
+//    :noindex:
+//
+//    Test the reader with fragmented streams.
+//
+// .. code-block:: cpp
+//
+{
+    (void)(argc); // I hate incomplete main signatures
+    (void)(argv); // I hate incomplete main signatures
+    int ret = 0;
+    ch_test_reader_t* test = &_ch_test_reader;
+    ch_libchirp_init();
+    ch_qc_init();
+    memset(test, 0, sizeof(*test));
+    ch_loop_init(&test->loop);
+    ch_chirp_config_init(&test->ichirp.config);
+    test->chirp._init    = CH_CHIRP_MAGIC;
+    test->chirp._        = &test->ichirp;
+    test->chirp._log     = _ch_test_log_cb;
+    test->ichirp.loop    = &test->loop;
+    test->ichirp.recv_cb = _ch_test_recv_cb;
+    ch_qc_gen gs[] = {
+        ch_test_gen_message,
+        ch_test_gen_message,
+        ch_test_gen_message
+    };
+    ch_qc_print ps[] = {
+        _ch_test_print_message,
+        _ch_test_print_message,
+        _ch_test_print_message
+    };
+    printf("Testing fragmented reads: ");
+    ret |= !ch_qc_for_all(
+        _ch_test_fragmented_read,
+        CH_TEST_MESSAGES,
+        gs,
+        ps,
+        ch_message_t*
+    );
+    ch_chirp_set_recv_stream_cb(
+        &test->chirp,
+        _ch_test_stream_cb,
+        CH_TEST_STREAM_MIN
+    );
+    printf("Testing fragmented streamed reads: ");
+    ret |= !ch_qc_for_all(
+        _ch_test_fragmented_read,
+        CH_TEST_MESSAGES,
+        gs,
+        ps,
+        ch_message_t*
+    );
+    test->compact = 1;
+    printf("Testing fragmented compact reads: ");
+    ret |= !ch_qc_for_all(
+        _ch_test_fragmented_read,
+        CH_TEST_MESSAGES,
+        gs,
+        ps,
+        ch_message_t*
+    );
+    test->compact = 0;
+    ch_rc_init(&test->ichirp.protocol.receipts, 60000, CH_DD_RECEIPTS);
+    ch_dd_init(&test->ichirp.protocol.dedup, 60000);
+    printf("Testing duplicate reads: ");
+    ret |= !ch_qc_for_all(
+        _ch_test_duplicate_read,
+        CH_TEST_MESSAGES,
+        gs,
+        ps,
+        ch_message_t*
+    );
+    ch_rc_free(&test->ichirp.protocol.receipts);
+    ch_dd_free(&test->ichirp.protocol.dedup);
+    printf(
+        "Reader: %.1f MB in %.3f s, %.1f MB/s\n",
+        test->bytes / 1e6,
+        test->ns / 1e9,
+        test->ns > 0 ? test->bytes * 1e3 / test->ns : 0
+    );
+    ch_loop_close(&test->loop);
+    ch_libchirp_cleanup();
+    return ret;
+}
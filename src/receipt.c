@@ -0,0 +1,335 @@
+// =======
+// Receipt
+// =======
+//
+// Receipt set, see :c:type:`ch_receipts_t`.
+//
+// .. code-block:: cpp
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "receipt.h"
+#include "util.h"
+
+// Declarations
+// ============
+
+// .. c:function::
+static
+ch_error_t
+_ch_rc_grow(ch_rc_bucket_t* bucket);
+//
+//    Allocate the slab of a generation or double it, keeping its serials.
+//
+//    :param ch_rc_bucket_t* bucket: The generation.
+//
+//    :return: A chirp error. see: :c:type:`ch_error_t`
+//    :rtype:  ch_error_t
+
+// .. c:function::
+static
+ch_inline
+uint32_t
+_ch_rc_hash(const uint8_t* serial);
+//
+//    Hash of a serial. Serials are random, but mixing both halves keeps the
+//    hash good if part of the serial is predictable.
+//
+//    :param const uint8_t* serial: The serial (16 bytes).
+//
+//    :return: the hash
+//    :rtype:  uint32_t
+
+// .. c:function::
+static
+ch_inline
+ch_rc_slot_t*
+_ch_rc_probe(ch_rc_bucket_t* bucket, const uint8_t* serial, uint32_t hash);
+//
+//    Find the slot of a serial in a generation, or the free slot it would be
+//    stored in. The slab has to be allocated.
+//
+//    :param ch_rc_bucket_t* bucket: The generation.
+//    :param const uint8_t* serial:  The serial (16 bytes).
+//    :param uint32_t hash:          Hash of the serial.
+//
+//    :return: the slot
+//    :rtype:  ch_rc_slot_t*
+
+// .. c:function::
+static
+ch_rc_slot_t*
+_ch_rc_find(ch_receipts_t* receipts, const uint8_t* serial, uint64_t now);
+//
+//    Find the slot of a serial that has not expired.
+//
+//    :param ch_receipts_t* receipts: The receipt set.
+//    :param const uint8_t* serial:   The serial (16 bytes).
+//    :param uint64_t now:            Current time in ms.
+//
+//    :return: the slot or NULL
+//    :rtype:  ch_rc_slot_t*
+
+// .. c:function::
+static
+void
+_ch_rc_rotate(ch_receipts_t* receipts, uint64_t now);
+//
+//    Start the generations that are due. The oldest generation is dropped
+//    for every generation started.
+//
+//    :param ch_receipts_t* receipts: The receipt set.
+//    :param uint64_t now:            Current time in ms.
+
+// Definitions
+// ===========
+
+// .. c:function::
+static
+ch_error_t
+_ch_rc_grow(ch_rc_bucket_t* bucket)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rc_grow`
+//
+// .. code-block:: cpp
+//
+{
+    uint32_t i;
+    uint32_t size;
+    uint32_t old_size = 0;
+    uint32_t old_epoch = bucket->epoch;
+    ch_rc_slot_t* old = bucket->slots;
+    ch_rc_slot_t* slots;
+    if(old != NULL)
+        old_size = bucket->mask + 1;
+    size = old_size == 0 ? CH_RC_MIN_SLOTS : old_size * 2;
+    slots = ch_alloc(sizeof(ch_rc_slot_t) * size);
+    if(!slots)
+        return CH_ENOMEM;
+    memset(slots, 0, sizeof(ch_rc_slot_t) * size);
+    bucket->slots = slots;
+    bucket->mask  = size - 1;
+    bucket->epoch = 1;
+    for(i = 0; i < old_size; i++) {
+        if(old[i].epoch == old_epoch) {
+            ch_rc_slot_t* slot = _ch_rc_probe(
+                bucket,
+                old[i].serial,
+                _ch_rc_hash(old[i].serial)
+            );
+            memcpy(slot->serial, old[i].serial, 16);
+            slot->epoch = 1;
+        }
+    }
+    if(old != NULL)
+        ch_free(old);
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+static
+ch_rc_slot_t*
+_ch_rc_find(ch_receipts_t* receipts, const uint8_t* serial, uint64_t now)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rc_find`
+//
+// .. code-block:: cpp
+//
+{
+    int i;
+    uint32_t hash;
+    ch_rc_slot_t* slot;
+    ch_rc_bucket_t* bucket;
+    if(receipts->rotate_at == 0)
+        return NULL;
+    if(now >= receipts->rotate_at)
+        _ch_rc_rotate(receipts, now);
+    hash = _ch_rc_hash(serial);
+    for(i = 0; i < CH_RC_BUCKETS; i++) {
+        bucket = &receipts->buckets[
+            (receipts->current + CH_RC_BUCKETS - i) % CH_RC_BUCKETS
+        ];
+        if(bucket->count == 0)
+            continue;
+        slot = _ch_rc_probe(bucket, serial, hash);
+        if(slot->epoch == bucket->epoch)
+            return slot;
+    }
+    return NULL;
+}
+
+// .. c:function::
+static
+ch_inline
+uint32_t
+_ch_rc_hash(const uint8_t* serial)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rc_hash`
+//
+// .. code-block:: cpp
+//
+{
+    uint64_t low;
+    uint64_t high;
+    memcpy(&low, serial, 8);
+    memcpy(&high, serial + 8, 8);
+    return (uint32_t) (((low ^ high) * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+// .. c:function::
+static
+ch_inline
+ch_rc_slot_t*
+_ch_rc_probe(ch_rc_bucket_t* bucket, const uint8_t* serial, uint32_t hash)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rc_probe`
+//
+// .. code-block:: cpp
+//
+{
+    ch_rc_slot_t* slot;
+    uint32_t i = hash & bucket->mask;
+    /* The load is at most 1/2, so there is always a free slot. */
+    for(;;) {
+        slot = &bucket->slots[i];
+        if(
+                slot->epoch != bucket->epoch ||
+                memcmp(slot->serial, serial, 16) == 0
+        )
+            return slot;
+        i = (i + 1) & bucket->mask;
+    }
+}
+
+// .. c:function::
+static
+void
+_ch_rc_rotate(ch_receipts_t* receipts, uint64_t now)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rc_rotate`
+//
+// .. code-block:: cpp
+//
+{
+    int i;
+    ch_rc_bucket_t* bucket;
+    for(i = 0; i < CH_RC_BUCKETS && now >= receipts->rotate_at; i++) {
+        receipts->current = (receipts->current + 1) % CH_RC_BUCKETS;
+        bucket = &receipts->buckets[receipts->current];
+        bucket->count  = 0;
+        bucket->epoch += 1;
+        if(bucket->epoch == 0) {
+            if(bucket->slots != NULL) {
+                memset(
+                    bucket->slots,
+                    0,
+                    sizeof(ch_rc_slot_t) * (bucket->mask + 1)
+                );
+            }
+            bucket->epoch = 1;
+        }
+        receipts->rotate_at += receipts->interval;
+    }
+    /* Idle for longer than the horizon: all generations are empty now. */
+    if(now >= receipts->rotate_at)
+        receipts->rotate_at = now + receipts->interval;
+}
+
+// .. c:function::
+ch_error_t
+ch_rc_add(ch_receipts_t* receipts, const uint8_t* serial, uint64_t now)
+//    :noindex:
+//
+//    see: :c:func:`ch_rc_add`
+//
+// .. code-block:: cpp
+//
+{
+    ch_rc_slot_t* slot;
+    ch_rc_bucket_t* bucket;
+    uint32_t hash = _ch_rc_hash(serial);
+    if(receipts->rotate_at == 0)
+        receipts->rotate_at = now + receipts->interval;
+    else if(now >= receipts->rotate_at)
+        _ch_rc_rotate(receipts, now);
+    bucket = &receipts->buckets[receipts->current];
+    /* Already added: a full generation must not end because of it. */
+    if(bucket->count > 0) {
+        slot = _ch_rc_probe(bucket, serial, hash);
+        if(slot->epoch == bucket->epoch)
+            return CH_SUCCESS;
+    }
+    if(receipts->limit > 0 && bucket->count >= receipts->limit) {
+        _ch_rc_rotate(receipts, receipts->rotate_at);
+        bucket = &receipts->buckets[receipts->current];
+    }
+    if(
+            bucket->slots == NULL ||
+            (bucket->count + 1) * 2 > bucket->mask + 1
+    ) {
+        if(_ch_rc_grow(bucket) != CH_SUCCESS)
+            return CH_ENOMEM;
+    }
+    slot = _ch_rc_probe(bucket, serial, hash);
+    if(slot->epoch != bucket->epoch) {
+        memcpy(slot->serial, serial, 16);
+        slot->epoch    = bucket->epoch;
+        bucket->count += 1;
+    }
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+int
+ch_rc_contains(ch_receipts_t* receipts, const uint8_t* serial, uint64_t now)
+//    :noindex:
+//
+//    see: :c:func:`ch_rc_contains`
+//
+// .. code-block:: cpp
+//
+{
+    return _ch_rc_find(receipts, serial, now) != NULL;
+}
+
+// .. c:function::
+void
+ch_rc_remove(ch_receipts_t* receipts, const uint8_t* serial, uint64_t now)
+//    :noindex:
+//
+//    see: :c:func:`ch_rc_remove`
+//
+// .. code-block:: cpp
+//
+{
+    ch_rc_slot_t* slot = _ch_rc_find(receipts, serial, now);
+    if(slot != NULL)
+        memset(slot->serial, 0, sizeof(slot->serial));
+}
+
+// .. c:function::
+void
+ch_rc_free(ch_receipts_t* receipts)
+//    :noindex:
+//
+//    see: :c:func:`ch_rc_free`
+//
+// .. code-block:: cpp
+//
+{
+    int i;
+    for(i = 0; i < CH_RC_BUCKETS; i++) {
+        if(receipts->buckets[i].slots != NULL)
+            ch_free(receipts->buckets[i].slots);
+        receipts->buckets[i].slots = NULL;
+        receipts->buckets[i].count = 0;
+    }
+}
@@ -0,0 +1,205 @@
+// ==============
+// Receipt header
+// ==============
+//
+// Set of message serials (receipts) with time-bucketed expiry. The horizon
+// is split into :c:macro:`CH_RC_BUCKETS` generations. Every generation is an
+// open-addressing hash table (linear probing) kept in one slab of slots,
+// serials are added to the current generation. When a generation expires,
+// its slab is reused for the next one: the epoch of the bucket is
+// incremented, which empties all its slots at once. So serials expire
+// without being deleted one by one, and the slab is only allocated when a
+// generation grows beyond all previous ones. Lookups don't allocate.
+//
+// A serial is remembered for at least the horizon and at most
+// buckets / (buckets - 1) of it. With a limit, a generation that is full
+// ends early, which bounds the memory but shortens the horizon when serials
+// arrive faster.
+//
+// .. code-block:: cpp
+//
+#ifndef ch_receipt_h
+#define ch_receipt_h
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "common.h"
+
+// Declarations
+// ============
+
+// .. c:macro:: CH_RC_BUCKETS
+//
+//    Generations of the set.
+//
+// .. c:macro:: CH_RC_MIN_SLOTS
+//
+//    Initial slots of a generation, must be a power of two.
+//
+// .. code-block:: cpp
+//
+#define CH_RC_BUCKETS 4
+#define CH_RC_MIN_SLOTS 256
+
+// .. c:type:: ch_rc_slot_t
+//
+//    A slot of a generation.
+//
+//    .. c:member:: uint8_t serial[16]
+//
+//       The serial.
+//
+//    .. c:member:: uint32_t epoch
+//
+//       The slot is used if its epoch is the epoch of the bucket.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_rc_slot_s {
+    uint8_t  serial[16];
+    uint32_t epoch;
+} ch_rc_slot_t;
+
+// .. c:type:: ch_rc_bucket_t
+//
+//    A generation: hash table of the serials added in one interval.
+//
+//    .. c:member:: ch_rc_slot_t* slots
+//
+//       The slab of slots, NULL until the first serial is added.
+//
+//    .. c:member:: uint32_t mask
+//
+//       Count of slots minus one.
+//
+//    .. c:member:: uint32_t count
+//
+//       Count of serials in the generation.
+//
+//    .. c:member:: uint32_t epoch
+//
+//       Epoch of the generation, see :c:member:`ch_rc_slot_t.epoch`.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_rc_bucket_s {
+    ch_rc_slot_t* slots;
+    uint32_t      mask;
+    uint32_t      count;
+    uint32_t      epoch;
+} ch_rc_bucket_t;
+
+// .. c:type:: ch_receipts_t
+//
+//    Receipt set.
+//
+//    .. c:member:: ch_rc_bucket_t buckets[CH_RC_BUCKETS]
+//
+//       The generations, used as ring.
+//
+//    .. c:member:: int current
+//
+//       Index of the generation serials are added to.
+//
+//    .. c:member:: uint64_t interval
+//
+//       Lifetime of a generation (ms).
+//
+//    .. c:member:: uint64_t rotate_at
+//
+//       Time (ms) the current generation ends. 0 until the first serial is
+//       added.
+//
+//    .. c:member:: uint32_t limit
+//
+//       Maximum count of serials in a generation, 0 for no limit.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_receipts_s {
+    ch_rc_bucket_t buckets[CH_RC_BUCKETS];
+    int            current;
+    uint64_t       interval;
+    uint64_t       rotate_at;
+    uint32_t       limit;
+} ch_receipts_t;
+
+// .. c:function::
+ch_error_t
+ch_rc_add(ch_receipts_t* receipts, const uint8_t* serial, uint64_t now);
+//
+//    Add a serial to the current generation. Does nothing if it already is
+//    in the current generation.
+//
+//    :param ch_receipts_t* receipts: The receipt set.
+//    :param const uint8_t* serial:   The serial (16 bytes).
+//    :param uint64_t now:            Current time in ms (loop time).
+//
+//    :return: A chirp error. see: :c:type:`ch_error_t`
+//    :rtype:  ch_error_t
+
+// .. c:function::
+int
+ch_rc_contains(ch_receipts_t* receipts, const uint8_t* serial, uint64_t now);
+//
+//    Check if the serial was added and has not expired.
+//
+//    :param ch_receipts_t* receipts: The receipt set.
+//    :param const uint8_t* serial:   The serial (16 bytes).
+//    :param uint64_t now:            Current time in ms (loop time).
+//
+//    :return: 1 if the serial is in the set, 0 otherwise.
+//    :rtype:  int
+
+// .. c:function::
+void
+ch_rc_remove(ch_receipts_t* receipts, const uint8_t* serial, uint64_t now);
+//
+//    Remove a serial. Its slot stays used, so the probing of other serials
+//    still passes it, only the serial is cleared.
+//
+//    :param ch_receipts_t* receipts: The receipt set.
+//    :param const uint8_t* serial:   The serial (16 bytes).
+//    :param uint64_t now:            Current time in ms (loop time).
+
+// .. c:function::
+void
+ch_rc_free(ch_receipts_t* receipts);
+//
+//    Free the slabs of the receipt set.
+//
+//    :param ch_receipts_t* receipts: The receipt set.
+
+// Definitions
+// ===========
+
+// .. c:function::
+static
+ch_inline
+void
+ch_rc_init(ch_receipts_t* receipts, uint64_t horizon, uint32_t limit)
+//
+//    Initialize the receipt set, nothing is allocated.
+//
+//    :param ch_receipts_t* receipts: The receipt set.
+//    :param uint64_t horizon:        Time (ms) serials are remembered.
+//    :param uint32_t limit:          Maximum count of serials in a
+//                                    generation, 0 for no limit.
+//
+// .. code-block:: cpp
+//
+{
+    int i;
+    memset(receipts, 0, sizeof(ch_receipts_t));
+    receipts->limit    = limit;
+    receipts->interval = horizon / (CH_RC_BUCKETS - 1);
+    if(receipts->interval == 0)
+        receipts->interval = 1;
+    for(i = 0; i < CH_RC_BUCKETS; i++)
+        receipts->buckets[i].epoch = 1;
+}
+
+#endif //ch_receipt_h
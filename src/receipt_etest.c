@@ -0,0 +1,194 @@
+// =============
+// Receipt etest
+// =============
+//
+// Behavior of the receipt set (see :c:type:`ch_receipts_t`): serials are
+// remembered for at least the horizon and forgotten after buckets /
+// (buckets - 1) of it, a full generation ends early when there is a limit
+// and generations grow beyond :c:macro:`CH_RC_MIN_SLOTS`.
+//
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "libchirp.h"
+#include "receipt.h"
+
+// Test functions
+// ==============
+//
+// Not documented on purpose.
+//
+// .. code-block:: cpp
+
+#define CH_RC_TEST_HORIZON 300
+#define CH_RC_TEST_LIMIT 4
+#define CH_RC_TEST_MANY 1000
+
+static
+void
+_ch_rc_test_serial(uint8_t* serial, uint32_t i)
+{
+    memset(serial, 0, 16);
+    memcpy(serial, &i, sizeof(i));
+}
+
+static
+int
+_ch_rc_test_check(
+        ch_receipts_t* receipts,
+        uint32_t i,
+        uint64_t now,
+        int expected,
+        const char* what
+)
+{
+    uint8_t serial[16];
+    _ch_rc_test_serial(serial, i);
+    if(ch_rc_contains(receipts, serial, now) != expected) {
+        fprintf(
+            stderr,
+            "%s: serial %u at %u ms: expected %d\n",
+            what,
+            (unsigned) i,
+            (unsigned) now,
+            expected
+        );
+        return 1;
+    }
+    return 0;
+}
+
+static
+int
+_ch_rc_test_expiry(void)
+{
+    int errors = 0;
+    uint8_t serial[16];
+    ch_receipts_t receipts;
+    ch_rc_init(&receipts, CH_RC_TEST_HORIZON, 0);
+    errors += _ch_rc_test_check(&receipts, 1, 0, 0, "Empty set");
+    _ch_rc_test_serial(serial, 1);
+    if(ch_rc_add(&receipts, serial, 0) != CH_SUCCESS)
+        errors += 1;
+    _ch_rc_test_serial(serial, 2);
+    if(ch_rc_add(&receipts, serial, 150) != CH_SUCCESS)
+        errors += 1;
+    errors += _ch_rc_test_check(&receipts, 1, 0, 1, "Expiry");
+    errors += _ch_rc_test_check(&receipts, 3, 0, 0, "Expiry");
+    /* At least the horizon */
+    errors += _ch_rc_test_check(
+        &receipts, 1, CH_RC_TEST_HORIZON, 1, "Expiry"
+    );
+    errors += _ch_rc_test_check(
+        &receipts, 1, CH_RC_TEST_HORIZON * 4 / 3 - 1, 1, "Expiry"
+    );
+    /* At most buckets / (buckets - 1) of the horizon */
+    errors += _ch_rc_test_check(
+        &receipts, 1, CH_RC_TEST_HORIZON * 4 / 3, 0, "Expiry"
+    );
+    errors += _ch_rc_test_check(
+        &receipts, 2, CH_RC_TEST_HORIZON * 4 / 3, 1, "Expiry"
+    );
+    /* Idle for longer than the horizon */
+    errors += _ch_rc_test_check(
+        &receipts, 2, CH_RC_TEST_HORIZON * 10, 0, "Idle"
+    );
+    _ch_rc_test_serial(serial, 1);
+    if(ch_rc_add(&receipts, serial, CH_RC_TEST_HORIZON * 10) != CH_SUCCESS)
+        errors += 1;
+    errors += _ch_rc_test_check(
+        &receipts, 1, CH_RC_TEST_HORIZON * 11, 1, "Idle"
+    );
+    ch_rc_free(&receipts);
+    return errors;
+}
+
+static
+int
+_ch_rc_test_limit(void)
+{
+    int i;
+    int errors = 0;
+    uint32_t s;
+    uint32_t total = CH_RC_TEST_LIMIT * CH_RC_BUCKETS;
+    uint8_t serial[16];
+    ch_receipts_t receipts;
+    ch_rc_init(&receipts, CH_RC_TEST_HORIZON, CH_RC_TEST_LIMIT);
+    for(s = 0; s <= total; s++) {
+        _ch_rc_test_serial(serial, s);
+        if(ch_rc_add(&receipts, serial, 0) != CH_SUCCESS)
+            errors += 1;
+        /* Adding it again does not count */
+        if(ch_rc_add(&receipts, serial, 0) != CH_SUCCESS)
+            errors += 1;
+    }
+    for(i = 0; i < CH_RC_BUCKETS; i++) {
+        if(receipts.buckets[i].count > CH_RC_TEST_LIMIT) {
+            fprintf(
+                stderr,
+                "Limit: generation %d has %u serials\n",
+                i,
+                (unsigned) receipts.buckets[i].count
+            );
+            errors += 1;
+        }
+    }
+    /* The first generation was reused for the last serial */
+    for(s = 0; s < CH_RC_TEST_LIMIT; s++)
+        errors += _ch_rc_test_check(&receipts, s, 0, 0, "Limit");
+    for(s = CH_RC_TEST_LIMIT; s <= total; s++)
+        errors += _ch_rc_test_check(&receipts, s, 0, 1, "Limit");
+    ch_rc_free(&receipts);
+    return errors;
+}
+
+static
+int
+_ch_rc_test_grow(void)
+{
+    int errors = 0;
+    uint32_t s;
+    uint8_t serial[16];
+    ch_receipts_t receipts;
+    ch_rc_init(&receipts, CH_RC_TEST_HORIZON, 0);
+    for(s = 0; s < CH_RC_TEST_MANY; s++) {
+        _ch_rc_test_serial(serial, s);
+        if(ch_rc_add(&receipts, serial, 0) != CH_SUCCESS)
+            errors += 1;
+    }
+    if(receipts.buckets[receipts.current].count != CH_RC_TEST_MANY) {
+        fprintf(stderr, "Grow: serials lost\n");
+        errors += 1;
+    }
+    for(s = 0; s < CH_RC_TEST_MANY; s++)
+        errors += _ch_rc_test_check(&receipts, s, 0, 1, "Grow");
+    errors += _ch_rc_test_check(&receipts, CH_RC_TEST_MANY, 0, 0, "Grow");
+    ch_rc_free(&receipts);
+    return errors;
+}
+
+// Runner
+// ======
+
+// .. c:function::
+int
+main(void)
+//    :noindex:
+//
+//    Run the test.
+//
+// .. code-block:: cpp
+//
+{
+    int errors = 0;
+    ch_libchirp_init();
+    errors += _ch_rc_test_expiry();
+    errors += _ch_rc_test_limit();
+    errors += _ch_rc_test_grow();
+    ch_libchirp_cleanup();
+    if(errors == 0)
+        printf("OK\n");
+    return errors > 0;
+}
@@ -0,0 +1,431 @@
+// =====
+// Retry
+// =====
+//
+// Retries and circuit breakers, see :c:type:`ch_retry_t`.
+//
+// .. code-block:: cpp
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "retry.h"
+#include "chirp.h"
+#include "util.h"
+#include "writer.h"
+
+// Sglib Prototypes
+// ================
+
+// .. code-block:: cpp
+//
+SGLIB_DEFINE_RBTREE_FUNCTIONS( // NOCOV
+    ch_ry_peer_t,
+    left,
+    right,
+    color_field,
+    CH_RY_PEER_CMP
+)
+
+// Declarations
+// ============
+
+// .. c:function::
+static
+ch_inline
+uint64_t
+_ch_ry_backoff(uint8_t attempt, uint64_t max);
+//
+//    Exponential backoff with equal jitter: the delay doubles with every
+//    attempt, half of it is random, so retries of many messages spread out.
+//
+//    :param uint8_t attempt: The retry, starting at 1.
+//    :param uint64_t max:    Upper bound of the delay in ms.
+//
+//    :return: the delay in ms
+//    :rtype:  uint64_t
+
+// .. c:function::
+static
+ch_inline
+ch_ry_peer_t*
+_ch_ry_find(
+        ch_retry_t* retry,
+        uint8_t ip_protocol,
+        uint8_t* address,
+        int32_t port
+);
+//
+//    Find the breaker of a peer.
+//
+//    :param ch_retry_t* retry:   The retry engine.
+//    :param uint8_t ip_protocol: IP protocol of the address.
+//    :param uint8_t* address:    IPv4/6 address of the peer.
+//    :param int32_t port:        The public port of the peer.
+//
+//    :return: the breaker or NULL
+//    :rtype:  ch_ry_peer_t*
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_ry_add(ch_retry_t* retry, ch_message_t* msg);
+//
+//    Put a message into the slot of its due tick.
+//
+//    :param ch_retry_t* retry: The retry engine.
+//    :param ch_message_t* msg: The message, its due time is set.
+
+// .. c:function::
+static
+void
+_ch_ry_timer_cb(uv_timer_t* handle);
+//
+//    Advance the wheel to the current tick and send the messages whose
+//    retry is due.
+//
+//    :param uv_timer_t* handle: The timer of the retry engine, contains chirp
+//                               (as data).
+
+// Definitions
+// ===========
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_ry_add(ch_retry_t* retry, ch_message_t* msg)
+//    :noindex:
+//
+//    see: :c:func:`_ch_ry_add`
+//
+// .. code-block:: cpp
+//
+{
+    uint64_t due = (msg->_stamp + CH_RY_TICK - 1) / CH_RY_TICK;
+    ch_message_t** slot;
+    if(due <= retry->tick)
+        due = retry->tick + 1;
+    slot = &retry->wheel[due & (CH_RY_SLOTS - 1)];
+    msg->_next = *slot;
+    *slot      = msg;
+}
+
+// .. c:function::
+static
+ch_inline
+uint64_t
+_ch_ry_backoff(uint8_t attempt, uint64_t max)
+//    :noindex:
+//
+//    see: :c:func:`_ch_ry_backoff`
+//
+// .. code-block:: cpp
+//
+{
+    uint64_t delay = CH_RY_BACKOFF_BASE;
+    if(attempt > 16)
+        attempt = 16;
+    delay <<= attempt - 1;
+    if(delay > max)
+        delay = max;
+    return delay / 2 + ch_random_u32() % (delay / 2 + 1);
+}
+
+// .. c:function::
+static
+ch_inline
+ch_ry_peer_t*
+_ch_ry_find(
+        ch_retry_t* retry,
+        uint8_t ip_protocol,
+        uint8_t* address,
+        int32_t port
+)
+//    :noindex:
+//
+//    see: :c:func:`_ch_ry_find`
+//
+// .. code-block:: cpp
+//
+{
+    ch_ry_peer_t search_peer;
+    search_peer.ip_protocol = ip_protocol;
+    search_peer.port        = port;
+    memcpy(
+        search_peer.address,
+        address,
+        ip_protocol == CH_IPV6 ? 16 : 4
+    );
+    return sglib_ch_ry_peer_t_find_member(retry->peers, &search_peer);
+}
+
+// .. c:function::
+static
+void
+_ch_ry_timer_cb(uv_timer_t* handle)
+//    :noindex:
+//
+//    see: :c:func:`_ch_ry_timer_cb`
+//
+// .. code-block:: cpp
+//
+{
+    ch_message_t* msg;
+    ch_message_t* slot;
+    CH_GET_CHIRP(handle);
+    ch_chirp_int_t* ichirp = chirp->_;
+    ch_retry_t* retry = &ichirp->retry;
+    uint64_t now = uv_now(ichirp->loop);
+    uint64_t target = now / CH_RY_TICK;
+    uint64_t tick = retry->tick;
+    /* After a round every slot was visited, so a stalled loop doesn't cause
+     * more work than one round.
+     */
+    uint64_t last = target - tick > CH_RY_SLOTS ? tick + CH_RY_SLOTS : target;
+    retry->tick = target;
+    while(tick < last && retry->count > 0) {
+        tick += 1;
+        slot = retry->wheel[tick & (CH_RY_SLOTS - 1)];
+        retry->wheel[tick & (CH_RY_SLOTS - 1)] = NULL;
+        while(slot != NULL) {
+            msg  = slot;
+            slot = msg->_next;
+            if(msg->_stamp > now) {
+                /* Due in a later round */
+                _ch_ry_add(retry, msg);
+                continue;
+            }
+            retry->count -= 1;
+            /* A send failing at once is queued again, it is due after now. */
+            ch_wr_enqueue(chirp, msg);
+        }
+    }
+    if(retry->count == 0)
+        uv_timer_stop(&retry->timer);
+}
+
+// .. c:function::
+void
+ch_ry_failed(ch_chirp_t* chirp, ch_message_t* msg, int status, float load)
+//    :noindex:
+//
+//    see: :c:func:`ch_ry_failed`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_int_t* ichirp = chirp->_;
+    ch_retry_t* retry = &ichirp->retry;
+    uint64_t now = uv_now(ichirp->loop);
+    if(
+            ichirp->flags & CH_CHIRP_CLOSING ||
+            msg->_retries >= ichirp->config.RETRIES ||
+            msg->message_type & (CH_MSG_PING | CH_MSG_PONG)
+    ) {
+        /* Messages failed by closing are sent again on the next start. */
+        if(!(ichirp->flags & CH_CHIRP_CLOSING))
+            ch_sp_done(&ichirp->spool, msg);
+        msg->_send_cb(chirp, msg, status, load);
+        return;
+    }
+    if(retry->count == 0) {
+        int tmp_err;
+        /* The wheel is empty, so we can jump to the current tick. */
+        retry->tick = now / CH_RY_TICK;
+        tmp_err = uv_timer_start(
+            &retry->timer,
+            _ch_ry_timer_cb,
+            CH_RY_TICK,
+            CH_RY_TICK
+        );
+        if(tmp_err != CH_SUCCESS) {
+            E(
+                chirp,
+                "Starting retry timer failed: %d. ch_chirp_t:%p",
+                tmp_err,
+                (void*) chirp
+            );
+            ch_sp_done(&ichirp->spool, msg);
+            msg->_send_cb(chirp, msg, status, load);
+            return;
+        }
+    }
+    msg->_retries += 1;
+    msg->_stamp = now + _ch_ry_backoff(
+        msg->_retries,
+        (uint64_t) (ichirp->config.TIMEOUT * 1000)
+    );
+    L(
+        chirp,
+        "Retry %d of message in %d ms. ch_chirp_t:%p, ch_message_t:%p",
+        msg->_retries,
+        (int) (msg->_stamp - now),
+        (void*) chirp,
+        (void*) msg
+    );
+    _ch_ry_add(retry, msg);
+    retry->count += 1;
+}
+
+// .. c:function::
+int
+ch_ry_is_open(ch_chirp_t* chirp, ch_message_t* msg)
+//    :noindex:
+//
+//    see: :c:func:`ch_ry_is_open`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_int_t* ichirp = chirp->_;
+    ch_ry_peer_t* peer = _ch_ry_find(
+        &ichirp->retry,
+        msg->ip_protocol,
+        msg->address,
+        msg->port
+    );
+    return peer != NULL && uv_now(ichirp->loop) < peer->open_until;
+}
+
+// .. c:function::
+void
+ch_ry_peer_failed(ch_chirp_t* chirp, ch_connection_t* conn)
+//    :noindex:
+//
+//    see: :c:func:`ch_ry_peer_failed`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_int_t* ichirp = chirp->_;
+    ch_retry_t* retry = &ichirp->retry;
+    ch_ry_peer_t* peer;
+    uint8_t shift;
+    if(ichirp->flags & CH_CHIRP_CLOSING)
+        return;
+    peer = _ch_ry_find(retry, conn->ip_protocol, conn->address, conn->port);
+    if(peer == NULL) {
+        peer = ch_alloc(sizeof(ch_ry_peer_t));
+        if(!peer) {
+            E(
+                chirp,
+                "Could not allocate memory for breaker. ch_chirp_t:%p",
+                (void*) chirp
+            );
+            return;
+        }
+        memset(peer, 0, sizeof(ch_ry_peer_t));
+        peer->ip_protocol = conn->ip_protocol;
+        peer->port        = conn->port;
+        memcpy(peer->address, conn->address, sizeof(peer->address));
+        sglib_ch_ry_peer_t_add(&retry->peers, peer);
+    }
+    if(peer->failures < UINT8_MAX)
+        peer->failures += 1;
+    if(peer->failures < CH_RY_FAILURES)
+        return;
+    shift = peer->failures - CH_RY_FAILURES;
+    if(shift > CH_RY_MAX_SHIFT)
+        shift = CH_RY_MAX_SHIFT;
+    peer->open_until = uv_now(ichirp->loop) + (
+        (uint64_t) (ichirp->config.TIMEOUT * 1000) << shift
+    );
+    L(
+        chirp,
+        "Peer failed %d times, breaker open. ch_chirp_t:%p, "
+        "ch_connection_t:%p",
+        peer->failures,
+        (void*) chirp,
+        (void*) conn
+    );
+}
+
+// .. c:function::
+void
+ch_ry_peer_ok(ch_chirp_t* chirp, ch_connection_t* conn)
+//    :noindex:
+//
+//    see: :c:func:`ch_ry_peer_ok`
+//
+// .. code-block:: cpp
+//
+{
+    ch_retry_t* retry = &chirp->_->retry;
+    ch_ry_peer_t* peer = _ch_ry_find(
+        retry,
+        conn->ip_protocol,
+        conn->address,
+        conn->port
+    );
+    if(peer != NULL) {
+        sglib_ch_ry_peer_t_delete(&retry->peers, peer);
+        ch_free(peer);
+    }
+}
+
+// .. c:function::
+ch_error_t
+ch_ry_start(ch_retry_t* retry)
+//    :noindex:
+//
+//    see: :c:func:`ch_ry_start`
+//
+// .. code-block:: cpp
+//
+{
+    int tmp_err;
+    ch_chirp_t* chirp = retry->chirp;
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    tmp_err = uv_timer_init(chirp->_->loop, &retry->timer);
+    if(tmp_err != CH_SUCCESS) {
+        E(
+            chirp,
+            "Initializing retry timer failed: %d. ch_chirp_t:%p",
+            tmp_err,
+            (void*) chirp
+        );
+        return CH_UV_ERROR;
+    }
+    retry->timer.data = chirp;
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+void
+ch_ry_stop(ch_retry_t* retry)
+//    :noindex:
+//
+//    see: :c:func:`ch_ry_stop`
+//
+// .. code-block:: cpp
+//
+{
+    int i;
+    ch_message_t* msg;
+    ch_ry_peer_t* peer;
+    struct sglib_ch_ry_peer_t_iterator it;
+    ch_chirp_t* chirp = retry->chirp;
+    uv_timer_stop(&retry->timer);
+    uv_close((uv_handle_t*) &retry->timer, ch_chirp_close_cb);
+    chirp->_->closing_tasks += 1;
+    for(i = 0; i < CH_RY_SLOTS; i++) {
+        while(retry->wheel[i] != NULL) {
+            msg = retry->wheel[i];
+            retry->wheel[i] = msg->_next;
+            msg->_send_cb(chirp, msg, CH_UNINIT, 0);
+        }
+    }
+    retry->count = 0;
+    for(
+            peer = sglib_ch_ry_peer_t_it_init_postorder(&it, retry->peers);
+            peer != NULL;
+            peer = sglib_ch_ry_peer_t_it_next(&it)
+    ) {
+        ch_free(peer);
+    }
+    retry->peers = NULL;
+}
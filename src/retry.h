@@ -0,0 +1,303 @@
+// ============
+// Retry header
+// ============
+//
+// Retries of failed sends. A message whose connection was shut down is
+// requeued up to :c:member:`ch_config_t.RETRIES` times, after an exponential
+// backoff with jitter. The original message is requeued, nothing is copied,
+// and it keeps its serial. All pending retries share one timer per chirp
+// instance and are kept in a hashed timing wheel of :c:macro:`CH_RY_SLOTS`
+// slots of :c:macro:`CH_RY_TICK` ms. A retry goes into the slot of its due
+// tick, so queueing it is O(1), also when a connection with a big queue is
+// aborted. Retries due more than a round of the wheel later stay in their
+// slot until the round they are due in.
+//
+// A circuit breaker per peer counts the connections that could not connect
+// or timed out. After :c:macro:`CH_RY_FAILURES` consecutive failures the
+// breaker opens: sends to the peer fail at once with
+// :c:member:`ch_error_t.CH_CANNOT_CONNECT`, instead of every send waiting
+// for the timeout. After a cool-down the next send tries again, an
+// acknowledged message closes the breaker.
+//
+// .. code-block:: cpp
+//
+#ifndef ch_retry_h
+#define ch_retry_h
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "common.h"
+#include "libchirp/chirp.h"
+#include "libchirp/message.h"
+#include "sglib.h"
+
+// Declarations
+// ============
+
+struct ch_connection_s;
+
+// .. c:macro:: CH_RY_BACKOFF_BASE
+//
+//    Backoff (ms) of the first retry, it doubles with every retry up to
+//    :c:member:`ch_config_t.TIMEOUT`.
+//
+// .. c:macro:: CH_RY_FAILURES
+//
+//    Consecutive connection failures of a peer that open its breaker.
+//
+// .. c:macro:: CH_RY_MAX_SHIFT
+//
+//    The cool-down of an open breaker is :c:member:`ch_config_t.TIMEOUT`,
+//    doubled for every further failure up to this many times.
+//
+// .. c:macro:: CH_RY_TICK
+//
+//    Resolution (ms) of the retry wheel.
+//
+// .. c:macro:: CH_RY_SLOTS
+//
+//    Slots of the retry wheel, a round takes 2.56 seconds.
+//
+// .. code-block:: cpp
+//
+#define CH_RY_BACKOFF_BASE 50
+#define CH_RY_FAILURES 3
+#define CH_RY_MAX_SHIFT 4
+#define CH_RY_TICK 10
+#define CH_RY_SLOTS 256
+
+// .. c:type:: ch_ry_peer_t
+//
+//    Circuit breaker of a peer, implemented as red-black tree. Only peers
+//    that failed since their last acknowledged message have one.
+//
+//    .. c:member:: uint8_t ip_protocol
+//
+//       What IP protocol (IPv4 or IPv6) the peer uses.
+//
+//    .. c:member:: uint8_t[16] address
+//
+//       IPv4/6 address of the peer.
+//
+//    .. c:member:: int32_t port
+//
+//       The public port of the peer.
+//
+//    .. c:member:: uint8_t failures
+//
+//       Consecutive connection failures.
+//
+//    .. c:member:: uint64_t open_until
+//
+//       Loop time (ms) until the breaker is open.
+//
+//    .. c:member:: char color_field
+//
+//       The color of the current node. This may either be red or black.
+//
+//    .. c:member:: struct ch_ry_peer_s* left
+//
+//       Left child in the red-black tree.
+//
+//    .. c:member:: struct ch_ry_peer_s* right
+//
+//       Right child in the red-black tree.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_ry_peer_s {
+    uint8_t              ip_protocol;
+    uint8_t              address[16];
+    int32_t              port;
+    uint8_t              failures;
+    uint64_t             open_until;
+    char                 color_field;
+    struct ch_ry_peer_s* left;
+    struct ch_ry_peer_s* right;
+} ch_ry_peer_t;
+
+// .. c:type:: ch_retry_t
+//
+//    Retry object.
+//
+//    .. c:member:: uv_timer_t timer
+//
+//       The shared timer advancing the wheel. It only runs while retries
+//       are pending.
+//
+//    .. c:member:: ch_message_t* wheel[CH_RY_SLOTS]
+//
+//       Messages waiting for their retry, linked by
+//       :c:member:`ch_message_t._next`. The due time (loop time in ms) is
+//       stored in :c:member:`ch_message_t._stamp`.
+//
+//    .. c:member:: uint64_t tick
+//
+//       The last tick processed.
+//
+//    .. c:member:: uint32_t count
+//
+//       Count of pending retries.
+//
+//    .. c:member:: ch_ry_peer_t* peers
+//
+//       The breakers of the failed peers.
+//
+//    .. c:member:: ch_chirp_t* chirp
+//
+//       Pointer to the chirp object. See: :c:type:`ch_chirp_t`.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_retry_s {
+    uv_timer_t    timer;
+    ch_message_t* wheel[CH_RY_SLOTS];
+    uint64_t      tick;
+    uint32_t      count;
+    ch_ry_peer_t* peers;
+    ch_chirp_t*   chirp;
+} ch_retry_t;
+
+// .. c:function::
+void
+ch_ry_failed(ch_chirp_t* chirp, ch_message_t* msg, int status, float load);
+//
+//    A send failed. Queue the message for a retry, or call its send callback
+//    if it has no retries left, chirp is closing or it is a ping.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    :param ch_message_t* msg: The message that failed.
+//    :param int status:        Status passed to the send callback.
+//    :param float load:        Load passed to the send callback.
+
+// .. c:function::
+int
+ch_ry_is_open(ch_chirp_t* chirp, ch_message_t* msg);
+//
+//    Check if the breaker of the recipient of the message is open.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    :param ch_message_t* msg: The message to send.
+//
+//    :return: 1 if sends to the peer have to fail, 0 otherwise.
+//    :rtype:  int
+
+// .. c:function::
+void
+ch_ry_peer_failed(ch_chirp_t* chirp, struct ch_connection_s* conn);
+//
+//    The connection to a peer could not connect or timed out. Count the
+//    failure and open the breaker of the peer after
+//    :c:macro:`CH_RY_FAILURES` consecutive failures.
+//
+//    :param ch_chirp_t* chirp:     Pointer to a chirp object.
+//    :param ch_connection_t* conn: The connection that failed.
+
+// .. c:function::
+void
+ch_ry_peer_ok(ch_chirp_t* chirp, struct ch_connection_s* conn);
+//
+//    A message to the peer was acknowledged: close its breaker.
+//
+//    :param ch_chirp_t* chirp:     Pointer to a chirp object.
+//    :param ch_connection_t* conn: The connection of the peer.
+
+// .. c:function::
+ch_error_t
+ch_ry_start(ch_retry_t* retry);
+//
+//    Start the retry engine.
+//
+//    :param ch_retry_t* retry: Retry engine which shall be started.
+//
+//    :return: A chirp error. see: :c:type:`ch_error_t`
+//    :rtype:  ch_error_t
+
+// .. c:function::
+void
+ch_ry_stop(ch_retry_t* retry);
+//
+//    Stop the retry engine. The send callbacks of pending retries are called
+//    with :c:member:`ch_error_t.CH_UNINIT`.
+//
+//    :param ch_retry_t* retry: Retry engine which shall be stopped.
+
+// .. c:macro:: CH_RY_PEER_CMP
+//
+//    Compare peers.
+//
+// .. code-block:: cpp
+//
+#define CH_RY_PEER_CMP(x,y) ch_ry_peer_cmp(x, y)
+
+// .. code-block:: cpp
+//
+SGLIB_DEFINE_RBTREE_PROTOTYPES( // NOCOV
+    ch_ry_peer_t,
+    left,
+    right,
+    color_field,
+    CH_RY_PEER_CMP
+)
+
+// Definitions
+// ===========
+
+// .. c:function::
+static
+ch_inline
+void
+ch_ry_init(ch_chirp_t* chirp, ch_retry_t* retry)
+//
+//    Initialize the retry structure.
+//
+//    :param ch_chirp_t* chirp: Chirp instance.
+//    :param ch_retry_t* retry: Retry engine to initialize.
+//
+// .. code-block:: cpp
+//
+{
+    memset(retry, 0, sizeof(ch_retry_t));
+    retry->chirp = chirp;
+}
+
+// .. c:function::
+static
+ch_inline
+int
+ch_ry_peer_cmp(ch_ry_peer_t* x, ch_ry_peer_t* y)
+//
+//    Compare operator for peers.
+//
+//    :param ch_ry_peer_t* x: First peer instance to compare
+//    :param ch_ry_peer_t* y: Second peer instance to compare
+//
+//    :return: the comparision between
+//                 - the IP protocols, if they are not the same, or
+//                 - the addresses, if they are not the same, or
+//                 - the ports
+//    :rtype: int
+//
+// .. code-block:: cpp
+//
+{
+    if(x->ip_protocol != y->ip_protocol) {
+        return x->ip_protocol - y->ip_protocol;
+    } else {
+        int tmp_cmp = memcmp(
+            x->address,
+            y->address,
+            x->ip_protocol == CH_IPV6 ? 16 : 4
+        );
+        if(tmp_cmp != 0) {
+            return tmp_cmp;
+        } else {
+            return x->port - y->port;
+        }
+    }
+}
+
+#endif //ch_retry_h
@@ -0,0 +1,359 @@
+// ===========
+// Retry etest
+// ===========
+//
+// Behavior of the retries and the circuit breaker (see :c:type:`ch_retry_t`):
+// a message to a peer that doesn't listen is retried after the backoff until
+// it has no retries left, pings and messages without retries left fail at
+// once. The connection failures open the breaker, while it is open sends
+// fail at once. After the cool-down a queue of messages gets through to the
+// peer again and is retried, an acknowledged message closes the breaker.
+//
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "libchirp.h"
+#include "fixture_test.h"
+#include "retry.h"
+
+// Test functions
+// ==============
+//
+// Not documented on purpose.
+//
+// .. code-block:: cpp
+
+#define CH_RY_TEST_SEND_PORT 59737
+#define CH_RY_TEST_RECV_PORT 59738
+#define CH_RY_TEST_RETRIES 2
+#define CH_RY_TEST_QUEUE 64
+#define CH_RY_TEST_MSGS (CH_RY_TEST_QUEUE + 4)
+#define CH_RY_TEST_TIMEOUT 10000
+/* Slack for connecting and the loop */
+#define CH_RY_TEST_LATE 300
+
+typedef enum {
+    CH_RY_TEST_RETRY,
+    CH_RY_TEST_OPEN,
+    CH_RY_TEST_QUEUED,
+    CH_RY_TEST_REOPENED,
+    CH_RY_TEST_ACKED,
+    CH_RY_TEST_CLOSING,
+} ch_ry_test_state_t;
+
+typedef struct ch_ry_test_s {
+    ch_chirp_t         sender;
+    ch_chirp_t         receiver;
+    ch_config_t        send_config;
+    ch_config_t        recv_config;
+    uv_loop_t          loop;
+    uv_timer_t         timer;
+    ch_message_t       msgs[CH_RY_TEST_MSGS];
+    uint64_t           start;
+    uint64_t           open_until;
+    int                failed;
+    int                receiving;
+    int                errors;
+    ch_ry_test_state_t state;
+} ch_ry_test_t;
+
+static ch_ry_test_t _ch_ry_test;
+
+static
+void
+_ch_ry_test_sender_done_cb(uv_async_t* handle)
+{
+    uv_close((uv_handle_t*) handle, ch_test_close_cb);
+    uv_close((uv_handle_t*) &_ch_ry_test.timer, ch_test_close_cb);
+}
+
+static
+void
+_ch_ry_test_receiver_done_cb(uv_async_t* handle)
+{
+    uv_close((uv_handle_t*) handle, ch_test_close_cb);
+}
+
+static
+void
+_ch_ry_test_close(ch_ry_test_t* test)
+{
+    test->state = CH_RY_TEST_CLOSING;
+    uv_timer_stop(&test->timer);
+    if(test->receiving)
+        ch_chirp_close_ts(&test->receiver);
+    ch_chirp_close_ts(&test->sender);
+}
+
+static
+uint64_t
+_ch_ry_test_elapsed(ch_ry_test_t* test)
+{
+    return uv_now(&test->loop) - test->start;
+}
+
+static
+uint64_t
+_ch_ry_test_open_until(ch_ry_test_t* test)
+{
+    ch_retry_t* retry = &test->sender._->retry;
+    if(retry->peers == NULL)
+        return 0;
+    return retry->peers->open_until;
+}
+
+static
+void
+_ch_ry_test_send_cb(
+        ch_chirp_t* chirp,
+        ch_message_t* msg,
+        int status,
+        float load
+)
+{
+    (void)(chirp);
+    (void)(load);
+    ch_ry_test_t* test = &_ch_ry_test;
+    uint64_t elapsed = _ch_ry_test_elapsed(test);
+    switch(test->state) {
+    case CH_RY_TEST_RETRY:
+        test->errors += ch_test_expect(status, CH_CANNOT_CONNECT, "Retry");
+        test->errors += ch_test_expect(
+            msg->_retries,
+            CH_RY_TEST_RETRIES,
+            "Retries"
+        );
+        /* Equal jitter: at least half of 50 ms and 100 ms */
+        if(elapsed < 75 || elapsed > 150 + CH_RY_TEST_LATE) {
+            fprintf(
+                stderr,
+                "Retries done after %u ms\n",
+                (unsigned) elapsed
+            );
+            test->errors += 1;
+        }
+        test->errors += ch_test_expect(
+            ch_ry_is_open(chirp, msg),
+            1,
+            "Breaker open"
+        );
+        test->open_until = _ch_ry_test_open_until(test);
+        test->state      = CH_RY_TEST_OPEN;
+        break;
+    case CH_RY_TEST_OPEN:
+        test->failed += 1;
+        test->errors += ch_test_expect(status, CH_CANNOT_CONNECT, "Open");
+        test->errors += ch_test_expect(
+            msg->_retries,
+            msg == &test->msgs[3] ? CH_RY_TEST_RETRIES : 0,
+            "Open retries"
+        );
+        break;
+    case CH_RY_TEST_QUEUED:
+    case CH_RY_TEST_REOPENED:
+        /* The queue was retried once, then the breaker was open again */
+        test->failed += 1;
+        test->errors += ch_test_expect(status, CH_CANNOT_CONNECT, "Queued");
+        test->errors += ch_test_expect(msg->_retries, 1, "Queued retries");
+        if(test->failed == CH_RY_TEST_QUEUE)
+            test->state = CH_RY_TEST_REOPENED;
+        break;
+    case CH_RY_TEST_ACKED:
+        test->errors += ch_test_expect(status, CH_SUCCESS, "Acked");
+        test->errors += ch_test_expect(
+            test->sender._->retry.peers == NULL,
+            1,
+            "Breaker closed"
+        );
+        _ch_ry_test_close(test);
+        break;
+    default:
+        break;
+    }
+}
+
+static
+void
+_ch_ry_test_recv_cb(ch_chirp_t* chirp, ch_message_t* msg)
+{
+    (void)(chirp);
+    ch_chirp_release_message(msg);
+}
+
+static
+ch_message_t*
+_ch_ry_test_msg(ch_ry_test_t* test, int i, int port)
+{
+    ch_message_t* msg = &test->msgs[i];
+    ch_msg_init(msg);
+    ch_msg_set_address(msg, CH_IPV4, "127.0.0.1", port);
+    return msg;
+}
+
+static
+void
+_ch_ry_test_fail_at_once(ch_ry_test_t* test)
+{
+    int i;
+    ch_message_t* msg;
+    ch_chirp_send(
+        &test->sender,
+        _ch_ry_test_msg(test, 1, CH_RY_TEST_RECV_PORT),
+        _ch_ry_test_send_cb
+    );
+    /* Pings and messages without retries left are not retried */
+    for(i = 2; i < 4; i++) {
+        msg = _ch_ry_test_msg(test, i, CH_RY_TEST_SEND_PORT);
+        msg->_send_cb = _ch_ry_test_send_cb;
+        if(i == 2)
+            msg->message_type = CH_MSG_PING;
+        else
+            msg->_retries = CH_RY_TEST_RETRIES;
+        ch_ry_failed(&test->sender, msg, CH_CANNOT_CONNECT, 0);
+    }
+    test->errors += ch_test_expect(test->failed, 3, "Failed at once");
+    test->errors += ch_test_expect(
+        test->sender._->retry.count,
+        0,
+        "Pending retries"
+    );
+}
+
+static
+void
+_ch_ry_test_timer_cb(uv_timer_t* handle)
+{
+    int i;
+    ch_ry_test_t* test = handle->data;
+    uint64_t now = uv_now(&test->loop);
+    if(now - test->start > CH_RY_TEST_TIMEOUT) {
+        fprintf(stderr, "Timeout in state %d\n", test->state);
+        test->errors += 1;
+        _ch_ry_test_close(test);
+        return;
+    }
+    switch(test->state) {
+    case CH_RY_TEST_OPEN:
+        if(test->failed == 0) {
+            _ch_ry_test_fail_at_once(test);
+        } else if(now >= test->open_until) {
+            /* Half-open: the queue is sent and fails on the connection */
+            test->failed = 0;
+            test->state  = CH_RY_TEST_QUEUED;
+            for(i = 4; i < CH_RY_TEST_MSGS; i++) {
+                ch_chirp_send(
+                    &test->sender,
+                    _ch_ry_test_msg(test, i, CH_RY_TEST_RECV_PORT),
+                    _ch_ry_test_send_cb
+                );
+            }
+        }
+        break;
+    case CH_RY_TEST_REOPENED:
+        if(!test->receiving) {
+            test->open_until = _ch_ry_test_open_until(test);
+            test->errors += ch_test_expect(
+                test->open_until > now,
+                1,
+                "Breaker open again"
+            );
+            if(ch_chirp_init(
+                    &test->receiver,
+                    &test->recv_config,
+                    &test->loop,
+                    _ch_ry_test_receiver_done_cb,
+                    ch_test_log_cb
+            ) != CH_SUCCESS) {
+                fprintf(stderr, "ch_chirp_init error\n");
+                test->errors += 1;
+                _ch_ry_test_close(test);
+                return;
+            }
+            ch_chirp_set_recv_cb(&test->receiver, _ch_ry_test_recv_cb);
+            test->receiving = 1;
+        } else if(now >= test->open_until) {
+            test->state = CH_RY_TEST_ACKED;
+            ch_chirp_send(
+                &test->sender,
+                _ch_ry_test_msg(test, 0, CH_RY_TEST_RECV_PORT),
+                _ch_ry_test_send_cb
+            );
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static
+void
+_ch_ry_test_config(ch_config_t* config, int port)
+{
+    ch_chirp_config_init(config);
+    config->PORT               = port;
+    config->RETRIES            = CH_RY_TEST_RETRIES;
+    config->TIMEOUT            = 0.5;
+    config->CLOSE_ON_SIGINT    = 0;
+    config->DISABLE_ENCRYPTION = 1;
+    config->CERT_CHAIN_PEM     = "./cert.pem";
+    config->DH_PARAMS_PEM      = "./dh.pem";
+}
+
+// Runner
+// ======
+
+// .. c:function::
+int
+main(void)
+//    :noindex:
+//
+//    Run the test.
+//
+// .. code-block:: cpp
+//
+{
+    ch_ry_test_t* test = &_ch_ry_test;
+    ch_libchirp_init();
+    memset(test, 0, sizeof(*test));
+    ch_loop_init(&test->loop);
+    test->timer.data = test;
+    uv_timer_init(&test->loop, &test->timer);
+    _ch_ry_test_config(&test->send_config, CH_RY_TEST_SEND_PORT);
+    _ch_ry_test_config(&test->recv_config, CH_RY_TEST_RECV_PORT);
+    if(ch_chirp_init(
+            &test->sender,
+            &test->send_config,
+            &test->loop,
+            _ch_ry_test_sender_done_cb,
+            ch_test_log_cb
+    ) != CH_SUCCESS) {
+        fprintf(stderr, "ch_chirp_init error\n");
+        uv_close((uv_handle_t*) &test->timer, ch_test_close_cb);
+        ch_run(&test->loop);
+        ch_loop_close(&test->loop);
+        ch_libchirp_cleanup();
+        return 1;
+    }
+    uv_update_time(&test->loop);
+    test->start = uv_now(&test->loop);
+    uv_timer_start(&test->timer, _ch_ry_test_timer_cb, 10, 10);
+    /* Nobody listens on the port of the receiver yet */
+    ch_chirp_send(
+        &test->sender,
+        _ch_ry_test_msg(test, 0, CH_RY_TEST_RECV_PORT),
+        _ch_ry_test_send_cb
+    );
+    ch_run(&test->loop);
+    ch_loop_close(&test->loop);
+    ch_libchirp_cleanup();
+    test->errors += ch_test_expect(
+        test->state,
+        CH_RY_TEST_CLOSING,
+        "Final state"
+    );
+    if(test->errors == 0)
+        printf("OK\n");
+    return test->errors > 0;
+}
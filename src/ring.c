@@ -0,0 +1,596 @@
+// ====
+// Ring
+// ====
+//
+// Consistent-hash ring. See :c:type:`ch_ring_t`.
+//
+// .. code-block:: cpp
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "ring.h"
+#include "chirp.h"
+#include "util.h"
+
+// System includes
+// ===============
+//
+// .. code-block:: cpp
+//
+#include <stdlib.h>
+
+// Declarations
+// ============
+
+// .. c:function::
+static
+ch_error_t
+_ch_rg_build(
+        ch_ring_int_t* iring,
+        const ch_rg_node_t* nodes,
+        uint32_t node_count
+);
+//
+//    Build a snapshot from the given nodes, publish it and retire the
+//    current one. Must be called while holding :c:member:`ch_ring_int_t.lock`.
+//
+//    :param ch_ring_int_t* iring: Ring internals
+//    :param ch_rg_node_t* nodes: The nodes, sorted by
+//                                :c:func:`_ch_rg_node_cmp`.
+//    :param uint32_t node_count: Count of the nodes.
+//
+//    :return: A chirp error. see: :c:type:`ch_error_t`
+//    :rtype:  ch_error_t
+
+// .. c:function::
+static
+ch_inline
+int
+_ch_rg_node_cmp(const ch_rg_node_t* x, const ch_rg_node_t* y);
+//
+//    Compare operator for nodes.
+//
+//    :param ch_rg_node_t* x: First node instance to compare
+//    :param ch_rg_node_t* y: Second node instance to compare
+//
+//    :return: the comparision between
+//                 - the IP protocols, if they are not the same, or
+//                 - the addresses, if they are not the same, or
+//                 - the ports
+//    :rtype: int
+
+// .. c:function::
+static
+int
+_ch_rg_point_cmp(const void* x, const void* y);
+//
+//    Compare operator for virtual nodes, used with qsort. Equal hashes are
+//    ordered by node, so the ring doesn't depend on the order of the changes.
+//
+//    :param void* x: First virtual node to compare
+//    :param void* y: Second virtual node to compare
+//
+//    :return: the comparision between the hashes or the nodes.
+//    :rtype: int
+
+// .. c:function::
+static
+void
+_ch_rg_reclaim(ch_ring_int_t* iring);
+//
+//    Free the retired snapshots if no lookup is running. Must be called
+//    while holding :c:member:`ch_ring_int_t.lock`.
+//
+//    :param ch_ring_int_t* iring: Ring internals
+
+// .. c:function::
+static
+ch_inline
+ch_error_t
+_ch_rg_search_node(
+        ch_rg_node_t* node,
+        ch_ip_protocol_t ip_protocol,
+        const char* address,
+        int32_t port
+);
+//
+//    Initialize a node structure from a textual address.
+//
+//    :param ch_rg_node_t* node: Out: The node
+//    :param ch_ip_protocol_t ip_protocol: IP-protocol of the address
+//    :param char* address: Textual representation of IP
+//    :param int32_t port: Port of the node
+//
+//    :return: A chirp error. see: :c:type:`ch_error_t`
+//    :rtype:  ch_error_t
+
+// .. c:function::
+static
+ch_inline
+uint32_t
+_ch_rg_lower_bound(
+        const ch_rg_snapshot_t* snapshot,
+        const ch_rg_node_t* node
+);
+//
+//    Get the index of the first node that is not less than the given node.
+//
+//    :param ch_rg_snapshot_t* snapshot: The snapshot to search
+//    :param ch_rg_node_t* node: The node to search for
+//
+//    :return: the index, node_count if all nodes are less
+//    :rtype: uint32_t
+
+// Definitions
+// ===========
+
+// .. c:function::
+static
+ch_error_t
+_ch_rg_build(
+        ch_ring_int_t* iring,
+        const ch_rg_node_t* nodes,
+        uint32_t node_count
+)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rg_build`
+//
+// .. code-block:: cpp
+//
+{
+    uint32_t i;
+    uint32_t r;
+    uint8_t key[25];
+    uint32_t point_count = node_count * CH_RG_VNODES;
+    ch_rg_snapshot_t* old;
+    ch_rg_snapshot_t* snapshot = ch_alloc(
+        sizeof(ch_rg_snapshot_t) +
+        node_count * sizeof(ch_rg_node_t) +
+        point_count * sizeof(ch_rg_point_t)
+    );
+    if(!snapshot) {
+        E(
+            iring->chirp,
+            "Could not allocate memory for ring. ch_ring_int_t:%p",
+            (void*) iring
+        );
+        return CH_ENOMEM;
+    }
+    /* The points need 8 byte alignment: place them before the nodes. */
+    snapshot->points      = (ch_rg_point_t*) (snapshot + 1);
+    snapshot->point_count = point_count;
+    snapshot->nodes       = (ch_rg_node_t*) (snapshot->points + point_count);
+    snapshot->node_count  = node_count;
+    snapshot->retired     = NULL;
+    if(node_count > 0)
+        memcpy(snapshot->nodes, nodes, node_count * sizeof(ch_rg_node_t));
+    for(i = 0; i < node_count; i++) {
+        const ch_rg_node_t* node = &nodes[i];
+        key[0] = node->ip_protocol;
+        memcpy(key + 1, node->address, 16);
+        memcpy(key + 17, &node->port, 4);
+        for(r = 0; r < CH_RG_VNODES; r++) {
+            ch_rg_point_t* point = &snapshot->points[i * CH_RG_VNODES + r];
+            memcpy(key + 21, &r, 4);
+            point->hash = ch_hash64(key, sizeof(key), 0);
+            point->node = i;
+        }
+    }
+    qsort(
+        snapshot->points,
+        point_count,
+        sizeof(ch_rg_point_t),
+        _ch_rg_point_cmp
+    );
+    old = iring->snapshot;
+    ch_atomic_store_ptr((void**) &iring->snapshot, snapshot);
+    if(old != NULL) {
+        old->retired = iring->retired;
+        ch_atomic_store_ptr((void**) &iring->retired, old);
+        _ch_rg_reclaim(iring);
+    }
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+static
+ch_inline
+uint32_t
+_ch_rg_lower_bound(
+        const ch_rg_snapshot_t* snapshot,
+        const ch_rg_node_t* node
+)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rg_lower_bound`
+//
+// .. code-block:: cpp
+//
+{
+    uint32_t i;
+    for(i = 0; i < snapshot->node_count; i++) {
+        if(_ch_rg_node_cmp(&snapshot->nodes[i], node) >= 0)
+            break;
+    }
+    return i;
+}
+
+// .. c:function::
+static
+ch_inline
+int
+_ch_rg_node_cmp(const ch_rg_node_t* x, const ch_rg_node_t* y)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rg_node_cmp`
+//
+// .. code-block:: cpp
+//
+{
+    if(x->ip_protocol != y->ip_protocol) {
+        return x->ip_protocol - y->ip_protocol;
+    } else {
+        int tmp_cmp = memcmp(
+            x->address,
+            y->address,
+            x->ip_protocol == CH_IPV6 ? 16 : 4
+        );
+        if(tmp_cmp != 0) {
+            return tmp_cmp;
+        } else {
+            return x->port - y->port;
+        }
+    }
+}
+
+// .. c:function::
+static
+int
+_ch_rg_point_cmp(const void* x, const void* y)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rg_point_cmp`
+//
+// .. code-block:: cpp
+//
+{
+    const ch_rg_point_t* px = x;
+    const ch_rg_point_t* py = y;
+    if(px->hash != py->hash)
+        return px->hash < py->hash ? -1 : 1;
+    if(px->node != py->node)
+        return px->node < py->node ? -1 : 1;
+    return 0;
+}
+
+// .. c:function::
+static
+void
+_ch_rg_reclaim(ch_ring_int_t* iring)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rg_reclaim`
+//
+// .. code-block:: cpp
+//
+{
+    ch_rg_snapshot_t* snapshot = iring->retired;
+    /* Adding 0 orders this read after the snapshots were replaced, see
+     * ch_ring_int_t.readers.
+     */
+    if(snapshot == NULL || ch_atomic_add_u64(&iring->readers, 0) != 0)
+        return;
+    ch_atomic_store_ptr((void**) &iring->retired, NULL);
+    while(snapshot != NULL) {
+        ch_rg_snapshot_t* next = snapshot->retired;
+        ch_free(snapshot);
+        snapshot = next;
+    }
+}
+
+// .. c:function::
+static
+ch_inline
+ch_error_t
+_ch_rg_search_node(
+        ch_rg_node_t* node,
+        ch_ip_protocol_t ip_protocol,
+        const char* address,
+        int32_t port
+)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rg_search_node`
+//
+// .. code-block:: cpp
+//
+{
+    int af;
+    memset(node, 0, sizeof(ch_rg_node_t));
+    switch(ip_protocol) {
+        case CH_IPV4:
+            af = AF_INET;
+            break;
+        case CH_IPV6:
+            af = AF_INET6;
+            break;
+        default:
+            return CH_VALUE_ERROR;
+    }
+    if(uv_inet_pton(af, address, node->address)) {
+        return CH_VALUE_ERROR;
+    }
+    node->ip_protocol = ip_protocol;
+    node->port        = port;
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+ch_error_t
+ch_rg_add_node_ts(
+        ch_ring_t* ring,
+        ch_ip_protocol_t ip_protocol,
+        const char* address,
+        int32_t port
+)
+//    :noindex:
+//
+//    see: :c:func:`ch_rg_add_node_ts`
+//
+// .. code-block:: cpp
+//
+{
+    uint32_t i;
+    ch_rg_node_t node;
+    ch_rg_node_t* nodes;
+    ch_rg_snapshot_t* snapshot;
+    ch_error_t tmp_err = CH_SUCCESS;
+    ch_ring_int_t* iring = ring->_;
+    A(iring->chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    if(_ch_rg_search_node(&node, ip_protocol, address, port) != CH_SUCCESS)
+        return CH_VALUE_ERROR;
+    uv_mutex_lock(&iring->lock);
+    snapshot = iring->snapshot;
+    i = _ch_rg_lower_bound(snapshot, &node);
+    if(
+            i < snapshot->node_count &&
+            _ch_rg_node_cmp(&snapshot->nodes[i], &node) == 0
+    ) {
+        uv_mutex_unlock(&iring->lock);
+        return CH_SUCCESS;
+    }
+    nodes = ch_alloc((snapshot->node_count + 1) * sizeof(ch_rg_node_t));
+    if(!nodes) {
+        uv_mutex_unlock(&iring->lock);
+        E(
+            iring->chirp,
+            "Could not allocate memory for nodes. ch_ring_t:%p",
+            (void*) ring
+        );
+        return CH_ENOMEM;
+    }
+    memcpy(nodes, snapshot->nodes, i * sizeof(ch_rg_node_t));
+    nodes[i] = node;
+    memcpy(
+        nodes + i + 1,
+        snapshot->nodes + i,
+        (snapshot->node_count - i) * sizeof(ch_rg_node_t)
+    );
+    tmp_err = _ch_rg_build(iring, nodes, snapshot->node_count + 1);
+    uv_mutex_unlock(&iring->lock);
+    ch_free(nodes);
+    return tmp_err;
+}
+
+// .. c:function::
+void
+ch_rg_free(ch_ring_t* ring)
+//    :noindex:
+//
+//    see: :c:func:`ch_rg_free`
+//
+// .. code-block:: cpp
+//
+{
+    ch_rg_snapshot_t* snapshot;
+    ch_ring_int_t* iring = ring->_;
+    if(iring == NULL)
+        return;
+    snapshot = iring->retired;
+    while(snapshot != NULL) {
+        ch_rg_snapshot_t* next = snapshot->retired;
+        ch_free(snapshot);
+        snapshot = next;
+    }
+    ch_free(iring->snapshot);
+    uv_mutex_destroy(&iring->lock);
+    ch_free(iring);
+    ring->_ = NULL;
+}
+
+// .. c:function::
+ch_error_t
+ch_rg_init(ch_ring_t* ring, ch_chirp_t* chirp)
+//    :noindex:
+//
+//    see: :c:func:`ch_rg_init`
+//
+// .. code-block:: cpp
+//
+{
+    ch_error_t tmp_err;
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    ch_ring_int_t* iring = ch_alloc(sizeof(ch_ring_int_t));
+    if(!iring) {
+        E(
+            chirp,
+            "Could not allocate memory for ring. ch_ring_t:%p",
+            (void*) ring
+        );
+        return CH_ENOMEM;
+    }
+    memset(iring, 0, sizeof(ch_ring_int_t));
+    iring->chirp = chirp;
+    if(uv_mutex_init(&iring->lock) < 0) {
+        E(chirp, "Could not initialize lock. ch_ring_t:%p", (void*) ring);
+        ch_free(iring);
+        return CH_UV_ERROR;
+    }
+    /* Start with an empty snapshot, so readers never see NULL. */
+    tmp_err = _ch_rg_build(iring, NULL, 0);
+    if(tmp_err != CH_SUCCESS) {
+        uv_mutex_destroy(&iring->lock);
+        ch_free(iring);
+        return tmp_err;
+    }
+    ring->_ = iring;
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+ch_error_t
+ch_rg_remove_node_ts(
+        ch_ring_t* ring,
+        ch_ip_protocol_t ip_protocol,
+        const char* address,
+        int32_t port
+)
+//    :noindex:
+//
+//    see: :c:func:`ch_rg_remove_node_ts`
+//
+// .. code-block:: cpp
+//
+{
+    uint32_t i;
+    ch_rg_node_t node;
+    ch_rg_node_t* nodes;
+    ch_rg_snapshot_t* snapshot;
+    ch_error_t tmp_err = CH_SUCCESS;
+    ch_ring_int_t* iring = ring->_;
+    A(iring->chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    if(_ch_rg_search_node(&node, ip_protocol, address, port) != CH_SUCCESS)
+        return CH_VALUE_ERROR;
+    uv_mutex_lock(&iring->lock);
+    snapshot = iring->snapshot;
+    i = _ch_rg_lower_bound(snapshot, &node);
+    if(
+            i == snapshot->node_count ||
+            _ch_rg_node_cmp(&snapshot->nodes[i], &node) != 0
+    ) {
+        uv_mutex_unlock(&iring->lock);
+        return CH_VALUE_ERROR;
+    }
+    nodes = ch_alloc(snapshot->node_count * sizeof(ch_rg_node_t));
+    if(!nodes) {
+        uv_mutex_unlock(&iring->lock);
+        E(
+            iring->chirp,
+            "Could not allocate memory for nodes. ch_ring_t:%p",
+            (void*) ring
+        );
+        return CH_ENOMEM;
+    }
+    memcpy(nodes, snapshot->nodes, i * sizeof(ch_rg_node_t));
+    memcpy(
+        nodes + i,
+        snapshot->nodes + i + 1,
+        (snapshot->node_count - i - 1) * sizeof(ch_rg_node_t)
+    );
+    tmp_err = _ch_rg_build(iring, nodes, snapshot->node_count - 1);
+    uv_mutex_unlock(&iring->lock);
+    ch_free(nodes);
+    return tmp_err;
+}
+
+// .. c:function::
+ch_error_t
+ch_rg_route_ts(
+        ch_ring_t* ring,
+        ch_message_t* msg,
+        const ch_buf* key,
+        size_t key_len
+)
+//    :noindex:
+//
+//    see: :c:func:`ch_rg_route_ts`
+//
+// .. code-block:: cpp
+//
+{
+    uint32_t low  = 0;
+    uint32_t high;
+    const ch_rg_node_t* node;
+    ch_rg_snapshot_t* snapshot;
+    ch_error_t tmp_err = CH_SUCCESS;
+    ch_ring_int_t* iring = ring->_;
+    uint64_t hash = ch_hash64((const uint8_t*) key, key_len, 0);
+    ch_atomic_add_u64(&iring->readers, 1);
+    snapshot = ch_atomic_load_ptr((void**) &iring->snapshot);
+    if(snapshot->point_count == 0)
+        tmp_err = CH_VALUE_ERROR;
+    else {
+        /* Binary search the first virtual node at or after the hash. */
+        high = snapshot->point_count;
+        while(low < high) {
+            uint32_t mid = low + (high - low) / 2;
+            if(snapshot->points[mid].hash < hash)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+        if(low == snapshot->point_count)
+            low = 0;
+        node = &snapshot->nodes[snapshot->points[low].node];
+        msg->ip_protocol = node->ip_protocol;
+        msg->port        = node->port;
+        memcpy(msg->address, node->address, sizeof(msg->address));
+    }
+    /* The last lookup frees the snapshots replaced while it ran. If the lock
+     * is busy, the next change or lookup frees them.
+     */
+    if(
+            ch_atomic_add_u64(&iring->readers, (uint64_t) -1) == 0 &&
+            ch_atomic_load_ptr((void**) &iring->retired) != NULL &&
+            uv_mutex_trylock(&iring->lock) == 0
+    ) {
+        _ch_rg_reclaim(iring);
+        uv_mutex_unlock(&iring->lock);
+    }
+    return tmp_err;
+}
+
+// .. c:function::
+ch_error_t
+ch_rg_send(
+        ch_ring_t* ring,
+        ch_message_t* msg,
+        const ch_buf* key,
+        size_t key_len,
+        ch_send_cb_t send_cb
+)
+//    :noindex:
+//
+//    see: :c:func:`ch_rg_send`
+//
+// .. code-block:: cpp
+//
+{
+    ch_ring_int_t* iring = ring->_;
+    ch_error_t tmp_err = ch_rg_route_ts(ring, msg, key, key_len);
+    if(tmp_err != CH_SUCCESS) {
+        E(
+            iring->chirp,
+            "Ring is empty. ch_ring_t:%p, ch_message_t:%p",
+            (void*) ring,
+            (void*) msg
+        );
+        return tmp_err;
+    }
+    ch_chirp_send(iring->chirp, msg, send_cb);
+    return CH_SUCCESS;
+}
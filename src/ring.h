@@ -0,0 +1,145 @@
+// ===========
+// Ring header
+// ===========
+//
+// Internal data structures of the consistent-hash ring. A snapshot is never
+// modified after it has been published, changes build a new snapshot.
+//
+// .. code-block:: cpp
+//
+#ifndef ch_ring_h
+#define ch_ring_h
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "libchirp/ring.h"
+#include "common.h"
+
+// Declarations
+// ============
+
+// .. c:type:: ch_rg_node_t
+//
+//    A node on the ring.
+//
+//    .. c:member:: uint8_t ip_protocol
+//
+//       What IP protocol (IPv4 or IPv6) the node uses.
+//
+//    .. c:member:: uint8_t[16] address
+//
+//       IPv4/6 address of the node.
+//
+//    .. c:member:: int32_t port
+//
+//       The public port of the node.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_rg_node_s {
+    uint8_t ip_protocol;
+    uint8_t address[16];
+    int32_t port;
+} ch_rg_node_t;
+
+// .. c:type:: ch_rg_point_t
+//
+//    A virtual node: a position on the ring owned by a node.
+//
+//    .. c:member:: uint64_t hash
+//
+//       The position on the ring.
+//
+//    .. c:member:: uint32_t node
+//
+//       Index of the owning node in :c:member:`ch_rg_snapshot_t.nodes`.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_rg_point_s {
+    uint64_t hash;
+    uint32_t node;
+} ch_rg_point_t;
+
+// .. c:type:: ch_rg_snapshot_t
+//
+//    Immutable state of the ring. Allocated as one block: the nodes and the
+//    points follow the structure.
+//
+//    .. c:member:: ch_rg_node_t* nodes
+//
+//       The nodes on the ring.
+//
+//    .. c:member:: uint32_t node_count
+//
+//       Count of the nodes.
+//
+//    .. c:member:: ch_rg_point_t* points
+//
+//       The virtual nodes sorted by hash.
+//
+//    .. c:member:: uint32_t point_count
+//
+//       Count of the virtual nodes.
+//
+//    .. c:member:: struct ch_rg_snapshot_s* retired
+//
+//       Next snapshot in the list of retired snapshots. Readers may still use
+//       a retired snapshot, so it is freed once no lookup is running, see
+//       :c:member:`ch_ring_int_t.readers`.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_rg_snapshot_s {
+    ch_rg_node_t*            nodes;
+    uint32_t                 node_count;
+    ch_rg_point_t*           points;
+    uint32_t                 point_count;
+    struct ch_rg_snapshot_s* retired;
+} ch_rg_snapshot_t;
+
+// .. c:type:: ch_ring_int_t
+//
+//    Ring object.
+//
+//    .. c:member:: ch_chirp_t* chirp
+//
+//       Pointer to the chirp object used for sending.
+//
+//    .. c:member:: uv_mutex_t lock
+//
+//       Serializes writers (add and remove node).
+//
+//    .. c:member:: ch_rg_snapshot_t* snapshot
+//
+//       The current snapshot. Only accessed through
+//       :c:func:`ch_atomic_load_ptr` and :c:func:`ch_atomic_store_ptr`.
+//
+//    .. c:member:: ch_rg_snapshot_t* retired
+//
+//       List of snapshots that were replaced. Written with the lock held,
+//       lookups only check it for NULL.
+//
+//    .. c:member:: uint64_t readers
+//
+//       Count of running lookups (grace period). A lookup counts itself
+//       before it loads the snapshot. Once a snapshot is replaced and the
+//       count is seen at zero, no lookup can still use it: lookups starting
+//       later load the new snapshot. So the retired snapshots are freed when
+//       a change sees no lookup running or the last running lookup finishes.
+//       Only accessed through :c:func:`ch_atomic_add_u64`.
+//
+// .. code-block:: cpp
+//
+struct ch_ring_int_s {
+    ch_chirp_t*       chirp;
+    uv_mutex_t        lock;
+    ch_rg_snapshot_t* snapshot;
+    ch_rg_snapshot_t* retired;
+    uint64_t          readers;
+};
+
+#endif //ch_ring_h
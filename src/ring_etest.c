@@ -0,0 +1,236 @@
+// ==========
+// Ring etest
+// ==========
+//
+// Behavior of the ring (see :c:type:`ch_ring_t`): keys are bound to nodes
+// and spread over all of them, adding a node twice has no effect, removing a
+// node only moves its own keys and adding it again restores the binding.
+// Snapshots replaced while no lookup runs are freed at once.
+//
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "libchirp.h"
+#include "fixture_test.h"
+#include "ring.h"
+
+// Test functions
+// ==============
+//
+// Not documented on purpose.
+//
+// .. code-block:: cpp
+
+#define CH_RG_TEST_NODES 4
+#define CH_RG_TEST_KEYS 1000
+#define CH_RG_TEST_PORT 10000
+#define CH_RG_TEST_REMOVED 2
+
+typedef struct ch_rg_test_s {
+    ch_chirp_t     chirp;
+    ch_chirp_int_t ichirp;
+    ch_ring_t      ring;
+    int32_t        bound[CH_RG_TEST_KEYS];
+    int            errors;
+} ch_rg_test_t;
+
+static ch_rg_test_t _ch_rg_test;
+
+static
+int32_t
+_ch_rg_test_route(ch_rg_test_t* test, int key, ch_ip_protocol_t* proto)
+{
+    ch_message_t msg;
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "key-%d", key);
+    ch_msg_init(&msg);
+    if(ch_rg_route_ts(&test->ring, &msg, buf, len) != CH_SUCCESS) {
+        fprintf(stderr, "Routing key %d failed\n", key);
+        test->errors += 1;
+        return -1;
+    }
+    if(proto != NULL)
+        *proto = msg.ip_protocol;
+    return msg.port;
+}
+
+static
+void
+_ch_rg_test_membership(ch_rg_test_t* test)
+{
+    int i;
+    ch_message_t msg;
+    ch_ring_int_t* iring = test->ring._;
+    ch_msg_init(&msg);
+    test->errors += ch_test_expect(
+        ch_rg_route_ts(&test->ring, &msg, "key", 3),
+        CH_VALUE_ERROR,
+        "Empty ring"
+    );
+    for(i = 0; i < CH_RG_TEST_NODES; i++) {
+        test->errors += ch_test_expect(
+            ch_rg_add_node_ts(
+                &test->ring,
+                CH_IPV4,
+                "127.0.0.1",
+                CH_RG_TEST_PORT + i
+            ),
+            CH_SUCCESS,
+            "Add node"
+        );
+    }
+    test->errors += ch_test_expect(
+        ch_rg_add_node_ts(&test->ring, CH_IPV4, "127.0.0.1", CH_RG_TEST_PORT),
+        CH_SUCCESS,
+        "Add node twice"
+    );
+    test->errors += ch_test_expect(
+        iring->snapshot->node_count,
+        CH_RG_TEST_NODES,
+        "Nodes"
+    );
+    test->errors += ch_test_expect(
+        ch_rg_add_node_ts(&test->ring, CH_IPV4, "not an ip", 1),
+        CH_VALUE_ERROR,
+        "Invalid address"
+    );
+    test->errors += ch_test_expect(
+        ch_rg_remove_node_ts(&test->ring, CH_IPV4, "127.0.0.2", 1),
+        CH_VALUE_ERROR,
+        "Remove unknown node"
+    );
+    /* No lookup ran, so the replaced snapshots are gone */
+    if(iring->retired != NULL) {
+        fprintf(stderr, "Retired snapshots not freed\n");
+        test->errors += 1;
+    }
+}
+
+static
+void
+_ch_rg_test_lookup(ch_rg_test_t* test)
+{
+    int i;
+    int32_t port;
+    int keys[CH_RG_TEST_NODES] = {0};
+    for(i = 0; i < CH_RG_TEST_KEYS; i++) {
+        port = _ch_rg_test_route(test, i, NULL);
+        test->bound[i] = port;
+        if(
+                port < CH_RG_TEST_PORT ||
+                port >= CH_RG_TEST_PORT + CH_RG_TEST_NODES
+        ) {
+            fprintf(stderr, "Key %d routed to port %d\n", i, port);
+            test->errors += 1;
+            continue;
+        }
+        keys[port - CH_RG_TEST_PORT] += 1;
+        if(_ch_rg_test_route(test, i, NULL) != port) {
+            fprintf(stderr, "Key %d not bound\n", i);
+            test->errors += 1;
+        }
+    }
+    for(i = 0; i < CH_RG_TEST_NODES; i++) {
+        /* Virtual nodes spread the keys */
+        if(keys[i] < CH_RG_TEST_KEYS / CH_RG_TEST_NODES / 2) {
+            fprintf(stderr, "Node %d has only %d keys\n", i, keys[i]);
+            test->errors += 1;
+        }
+    }
+}
+
+static
+void
+_ch_rg_test_remove(ch_rg_test_t* test)
+{
+    int i;
+    int32_t port;
+    int32_t removed = CH_RG_TEST_PORT + CH_RG_TEST_REMOVED;
+    ch_ip_protocol_t proto;
+    test->errors += ch_test_expect(
+        ch_rg_remove_node_ts(&test->ring, CH_IPV4, "127.0.0.1", removed),
+        CH_SUCCESS,
+        "Remove node"
+    );
+    for(i = 0; i < CH_RG_TEST_KEYS; i++) {
+        port = _ch_rg_test_route(test, i, NULL);
+        if(port == removed || (
+                test->bound[i] != removed && port != test->bound[i]
+        )) {
+            fprintf(stderr, "Key %d moved to port %d\n", i, port);
+            test->errors += 1;
+        }
+    }
+    test->errors += ch_test_expect(
+        ch_rg_add_node_ts(&test->ring, CH_IPV4, "127.0.0.1", removed),
+        CH_SUCCESS,
+        "Add node again"
+    );
+    for(i = 0; i < CH_RG_TEST_KEYS; i++) {
+        if(_ch_rg_test_route(test, i, NULL) != test->bound[i]) {
+            fprintf(stderr, "Key %d not restored\n", i);
+            test->errors += 1;
+        }
+    }
+    /* Only an IPv6 node is left */
+    for(i = 0; i < CH_RG_TEST_NODES; i++) {
+        test->errors += ch_test_expect(
+            ch_rg_remove_node_ts(
+                &test->ring,
+                CH_IPV4,
+                "127.0.0.1",
+                CH_RG_TEST_PORT + i
+            ),
+            CH_SUCCESS,
+            "Remove node"
+        );
+    }
+    test->errors += ch_test_expect(
+        ch_rg_add_node_ts(&test->ring, CH_IPV6, "::1", CH_RG_TEST_PORT),
+        CH_SUCCESS,
+        "Add IPv6 node"
+    );
+    port = _ch_rg_test_route(test, 0, &proto);
+    if(port != CH_RG_TEST_PORT || proto != CH_IPV6) {
+        fprintf(stderr, "IPv6 node not found\n");
+        test->errors += 1;
+    }
+    if(test->ring._->retired != NULL) {
+        fprintf(stderr, "Retired snapshots not freed\n");
+        test->errors += 1;
+    }
+}
+
+// Runner
+// ======
+
+// .. c:function::
+int
+main(void)
+//    :noindex:
+//
+//    Run the test.
+//
+// .. code-block:: cpp
+//
+{
+    ch_rg_test_t* test = &_ch_rg_test;
+    ch_libchirp_init();
+    memset(test, 0, sizeof(*test));
+    ch_test_fake_chirp(&test->chirp, &test->ichirp);
+    if(ch_rg_init(&test->ring, &test->chirp) != CH_SUCCESS) {
+        fprintf(stderr, "ch_rg_init error\n");
+        ch_libchirp_cleanup();
+        return 1;
+    }
+    _ch_rg_test_membership(test);
+    _ch_rg_test_lookup(test);
+    _ch_rg_test_remove(test);
+    ch_rg_free(&test->ring);
+    ch_libchirp_cleanup();
+    if(test->errors == 0)
+        printf("OK\n");
+    return test->errors > 0;
+}
@@ -0,0 +1,570 @@
+// ======
+// Router
+// ======
+//
+// Power-of-two-choices router. See :c:type:`ch_router_t`.
+//
+// .. code-block:: cpp
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "router.h"
+#include "chirp.h"
+#include "util.h"
+
+// System includes
+// ===============
+//
+// .. code-block:: cpp
+//
+#include <math.h>
+
+// Sglib Prototypes
+// ================
+
+// .. code-block:: cpp
+//
+SGLIB_DEFINE_RBTREE_FUNCTIONS( // NOCOV
+    ch_rt_actor_t,
+    left,
+    right,
+    color_field,
+    CH_RT_ACTOR_CMP
+)
+
+// .. code-block:: cpp
+//
+SGLIB_DEFINE_RBTREE_FUNCTIONS( // NOCOV
+    ch_rt_node_t,
+    left,
+    right,
+    color_field,
+    CH_RT_NODE_CMP
+)
+
+// Declarations
+// ============
+
+// .. c:function::
+static
+ch_inline
+float
+_ch_rt_estimate(
+        ch_router_int_t* irouter,
+        ch_rt_node_t* node,
+        uint64_t now
+);
+//
+//    Update and return the load estimate of a node. If the peer reported a
+//    newer load on its connection, the report replaces the estimate.
+//    Otherwise the estimate is decayed by the time passed since its last
+//    update.
+//
+//    :param ch_router_int_t* irouter: Router internals
+//    :param ch_rt_node_t* node: The node to estimate
+//    :param uint64_t now: Current loop time in milliseconds
+//
+//    :return: the load estimate
+//    :rtype: float
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_rt_free_actor(ch_rt_actor_t* ractor);
+//
+//    Free an actor and its candidate array.
+//
+//    :param ch_rt_actor_t* ractor: The actor
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_rt_free_actors(ch_rt_actor_t* actors);
+//
+//    Free all actors in the actor dictionary.
+//
+//    :param ch_rt_actor_t* actors: Dictionary of actors
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_rt_free_nodes(ch_rt_node_t* nodes);
+//
+//    Free all nodes in the node dictionary.
+//
+//    :param ch_rt_node_t* nodes: Dictionary of nodes
+
+// .. c:function::
+static
+ch_inline
+ch_error_t
+_ch_rt_search_node(
+        ch_rt_node_t* node,
+        ch_ip_protocol_t ip_protocol,
+        const char* address,
+        int32_t port
+);
+//
+//    Initialize a node structure used to search the node dictionary.
+//
+//    :param ch_rt_node_t* node: Out: The search node
+//    :param ch_ip_protocol_t ip_protocol: IP-protocol of the address
+//    :param char* address: Textual representation of IP
+//    :param int32_t port: Port of the node
+//
+//    :return: A chirp error. see: :c:type:`ch_error_t`
+//    :rtype:  ch_error_t
+
+// Definitions
+// ===========
+
+// .. c:function::
+static
+ch_inline
+float
+_ch_rt_estimate(
+        ch_router_int_t* irouter,
+        ch_rt_node_t* node,
+        uint64_t now
+)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rt_estimate`
+//
+// .. code-block:: cpp
+//
+{
+    ch_connection_t search_conn;
+    ch_connection_t* conn;
+    ch_protocol_t* protocol = &irouter->chirp->_->protocol;
+    search_conn.ip_protocol = node->ip_protocol;
+    search_conn.port        = node->port;
+    memcpy(
+        search_conn.address,
+        node->address,
+        node->ip_protocol == CH_IPV6 ? 16 : 4
+    );
+    conn = sglib_ch_connection_t_find_member(
+        protocol->connections,
+        &search_conn
+    );
+    if(conn != NULL && conn->load_stamp > node->report_stamp) {
+        node->load         = conn->load;
+        node->stamp        = conn->load_stamp;
+        node->report_stamp = conn->load_stamp;
+    }
+    if(now > node->stamp) {
+        node->load *= exp2f(
+            -((float) (now - node->stamp)) / CH_RT_LOAD_HALF_LIFE
+        );
+        node->stamp = now;
+    }
+    return node->load;
+}
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_rt_free_actor(ch_rt_actor_t* ractor)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rt_free_actor`
+//
+// .. code-block:: cpp
+//
+{
+    ch_free(ractor->nodes);
+    ch_free(ractor->actor);
+    ch_free(ractor);
+}
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_rt_free_actors(ch_rt_actor_t* actors)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rt_free_actors`
+//
+// .. code-block:: cpp
+//
+{
+    ch_rt_actor_t* t;
+    struct sglib_ch_rt_actor_t_iterator it;
+    for(
+            t = sglib_ch_rt_actor_t_it_init_postorder(&it, actors);
+            t != NULL;
+            t = sglib_ch_rt_actor_t_it_next(&it)
+    ) {
+        _ch_rt_free_actor(t);
+    }
+}
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_rt_free_nodes(ch_rt_node_t* nodes)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rt_free_nodes`
+//
+// .. code-block:: cpp
+//
+{
+    ch_rt_node_t* t;
+    struct sglib_ch_rt_node_t_iterator it;
+    for(
+            t = sglib_ch_rt_node_t_it_init_postorder(&it, nodes);
+            t != NULL;
+            t = sglib_ch_rt_node_t_it_next(&it)
+    ) {
+        ch_free(t);
+    }
+}
+
+// .. c:function::
+static
+ch_inline
+ch_error_t
+_ch_rt_search_node(
+        ch_rt_node_t* node,
+        ch_ip_protocol_t ip_protocol,
+        const char* address,
+        int32_t port
+)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rt_search_node`
+//
+// .. code-block:: cpp
+//
+{
+    int af;
+    memset(node, 0, sizeof(ch_rt_node_t));
+    switch(ip_protocol) {
+        case CH_IPV4:
+            af = AF_INET;
+            break;
+        case CH_IPV6:
+            af = AF_INET6;
+            break;
+        default:
+            return CH_VALUE_ERROR;
+    }
+    if(uv_inet_pton(af, address, node->address)) {
+        return CH_VALUE_ERROR;
+    }
+    node->ip_protocol = ip_protocol;
+    node->port        = port;
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+ch_error_t
+ch_rt_add_node(
+        ch_router_t* router,
+        const char* actor,
+        ch_ip_protocol_t ip_protocol,
+        const char* address,
+        int32_t port
+)
+//    :noindex:
+//
+//    see: :c:func:`ch_rt_add_node`
+//
+// .. code-block:: cpp
+//
+{
+    uint32_t i;
+    ch_rt_node_t search_node;
+    ch_rt_node_t* node;
+    ch_rt_actor_t search_actor;
+    ch_rt_actor_t* ractor;
+    ch_rt_actor_t* new_actor = NULL;
+    ch_router_int_t* irouter = router->_;
+    ch_chirp_t* chirp = irouter->chirp;
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    size_t actor_len = strlen(actor);
+    V(
+        chirp,
+        actor_len <= UINT16_MAX,
+        "Actor too long. (%d)",
+        (int) actor_len
+    );
+    if(_ch_rt_search_node(
+            &search_node,
+            ip_protocol,
+            address,
+            port
+    ) != CH_SUCCESS) {
+        return CH_VALUE_ERROR;
+    }
+    search_actor.actor     = (char*) actor;
+    search_actor.actor_len = actor_len;
+    ractor = sglib_ch_rt_actor_t_find_member(irouter->actors, &search_actor);
+    if(ractor == NULL) {
+        ractor = ch_alloc(sizeof(ch_rt_actor_t));
+        if(!ractor) {
+            E(
+                chirp,
+                "Could not allocate memory for actor. ch_router_t:%p",
+                (void*) router
+            );
+            return CH_ENOMEM;
+        }
+        memset(ractor, 0, sizeof(ch_rt_actor_t));
+        ractor->actor = ch_alloc(actor_len + 1);
+        if(!ractor->actor) {
+            E(
+                chirp,
+                "Could not allocate memory for actor. ch_router_t:%p",
+                (void*) router
+            );
+            ch_free(ractor);
+            return CH_ENOMEM;
+        }
+        memcpy(ractor->actor, actor, actor_len + 1);
+        ractor->actor_len = actor_len;
+        /* The actor is only added with its first candidate, routing needs at
+         * least one.
+         */
+        new_actor = ractor;
+    }
+    node = sglib_ch_rt_node_t_find_member(irouter->nodes, &search_node);
+    if(node != NULL) {
+        for(i = 0; i < ractor->count; i++) {
+            if(ractor->nodes[i] == node)
+                return CH_SUCCESS;
+        }
+    }
+    if(ractor->count == ractor->size) {
+        uint32_t size = ractor->size ? ractor->size * 2 : 4;
+        ch_rt_node_t** nodes = ch_realloc(
+            ractor->nodes,
+            size * sizeof(ch_rt_node_t*)
+        );
+        if(!nodes) {
+            E(
+                chirp,
+                "Could not allocate memory for candidates. ch_router_t:%p",
+                (void*) router
+            );
+            if(new_actor != NULL)
+                _ch_rt_free_actor(new_actor);
+            return CH_ENOMEM;
+        }
+        ractor->nodes = nodes;
+        ractor->size  = size;
+    }
+    if(node == NULL) {
+        node = ch_alloc(sizeof(ch_rt_node_t));
+        if(!node) {
+            E(
+                chirp,
+                "Could not allocate memory for node. ch_router_t:%p",
+                (void*) router
+            );
+            if(new_actor != NULL)
+                _ch_rt_free_actor(new_actor);
+            return CH_ENOMEM;
+        }
+        *node = search_node;
+        node->stamp = uv_now(chirp->_->loop);
+        sglib_ch_rt_node_t_add(&irouter->nodes, node);
+    }
+    node->refs += 1;
+    ractor->nodes[ractor->count] = node;
+    ractor->count += 1;
+    if(new_actor != NULL)
+        sglib_ch_rt_actor_t_add(&irouter->actors, new_actor);
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+void
+ch_rt_free(ch_router_t* router)
+//    :noindex:
+//
+//    see: :c:func:`ch_rt_free`
+//
+// .. code-block:: cpp
+//
+{
+    ch_router_int_t* irouter = router->_;
+    if(irouter == NULL)
+        return;
+    _ch_rt_free_actors(irouter->actors);
+    _ch_rt_free_nodes(irouter->nodes);
+    ch_free(irouter);
+    router->_ = NULL;
+}
+
+// .. c:function::
+ch_error_t
+ch_rt_init(ch_router_t* router, ch_chirp_t* chirp)
+//    :noindex:
+//
+//    see: :c:func:`ch_rt_init`
+//
+// .. code-block:: cpp
+//
+{
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    ch_router_int_t* irouter = ch_alloc(sizeof(ch_router_int_t));
+    if(!irouter) {
+        E(
+            chirp,
+            "Could not allocate memory for router. ch_router_t:%p",
+            (void*) router
+        );
+        return CH_ENOMEM;
+    }
+    memset(irouter, 0, sizeof(ch_router_int_t));
+    irouter->chirp = chirp;
+    router->_      = irouter;
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+ch_error_t
+ch_rt_remove_node(
+        ch_router_t* router,
+        const char* actor,
+        ch_ip_protocol_t ip_protocol,
+        const char* address,
+        int32_t port
+)
+//    :noindex:
+//
+//    see: :c:func:`ch_rt_remove_node`
+//
+// .. code-block:: cpp
+//
+{
+    uint32_t i;
+    ch_rt_node_t search_node;
+    ch_rt_node_t* node;
+    ch_rt_actor_t search_actor;
+    ch_rt_actor_t* ractor;
+    ch_router_int_t* irouter = router->_;
+    ch_chirp_t* chirp = irouter->chirp;
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    if(_ch_rt_search_node(
+            &search_node,
+            ip_protocol,
+            address,
+            port
+    ) != CH_SUCCESS) {
+        return CH_VALUE_ERROR;
+    }
+    search_actor.actor     = (char*) actor;
+    search_actor.actor_len = strlen(actor);
+    ractor = sglib_ch_rt_actor_t_find_member(irouter->actors, &search_actor);
+    node = sglib_ch_rt_node_t_find_member(irouter->nodes, &search_node);
+    if(ractor == NULL || node == NULL)
+        return CH_VALUE_ERROR;
+    for(i = 0; i < ractor->count; i++) {
+        if(ractor->nodes[i] == node)
+            break;
+    }
+    if(i == ractor->count)
+        return CH_VALUE_ERROR;
+    /* The order of the candidates doesn't matter, move the last one into the
+     * gap.
+     */
+    ractor->count -= 1;
+    ractor->nodes[i] = ractor->nodes[ractor->count];
+    if(ractor->count == 0) {
+        sglib_ch_rt_actor_t_delete(&irouter->actors, ractor);
+        _ch_rt_free_actor(ractor);
+    }
+    node->refs -= 1;
+    if(node->refs == 0) {
+        sglib_ch_rt_node_t_delete(&irouter->nodes, node);
+        ch_free(node);
+    }
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+ch_error_t
+ch_rt_route(ch_router_t* router, ch_message_t* msg)
+//    :noindex:
+//
+//    see: :c:func:`ch_rt_route`
+//
+// .. code-block:: cpp
+//
+{
+    ch_rt_actor_t search_actor;
+    ch_rt_actor_t* ractor;
+    ch_rt_node_t* node;
+    ch_router_int_t* irouter = router->_;
+    ch_chirp_t* chirp = irouter->chirp;
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    ch_chirp_int_t* ichirp = chirp->_;
+    search_actor.actor     = msg->actor;
+    search_actor.actor_len = msg->actor_len;
+    ractor = sglib_ch_rt_actor_t_find_member(irouter->actors, &search_actor);
+    if(ractor == NULL || ractor->count == 0) {
+        E(
+            chirp,
+            "No candidates for actor. ch_router_t:%p, ch_message_t:%p",
+            (void*) router,
+            (void*) msg
+        );
+        return CH_VALUE_ERROR;
+    }
+    uint32_t first = ch_random_u32() % ractor->count;
+    node = ractor->nodes[first];
+    if(ractor->count > 1) {
+        uint64_t now = uv_now(ichirp->loop);
+        /* Sample the second candidate from the remaining ones, so we always
+         * get two different nodes.
+         */
+        uint32_t second = ch_random_u32() % (ractor->count - 1);
+        if(second >= first)
+            second += 1;
+        ch_rt_node_t* other = ractor->nodes[second];
+        if(
+                _ch_rt_estimate(irouter, other, now) <
+                _ch_rt_estimate(irouter, node, now)
+        ) {
+            node = other;
+        }
+    }
+    /* Until the peer reports again, we assume the message occupies one of its
+     * handlers. Otherwise we would send everything to the same node.
+     */
+    node->load += 1.0f / ichirp->config.MAX_HANDLERS;
+    msg->ip_protocol = node->ip_protocol;
+    msg->port        = node->port;
+    memcpy(msg->address, node->address, sizeof(msg->address));
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+ch_error_t
+ch_rt_send(ch_router_t* router, ch_message_t* msg, ch_send_cb_t send_cb)
+//    :noindex:
+//
+//    see: :c:func:`ch_rt_send`
+//
+// .. code-block:: cpp
+//
+{
+    ch_error_t tmp_err = ch_rt_route(router, msg);
+    if(tmp_err != CH_SUCCESS)
+        return tmp_err;
+    ch_chirp_send(router->_->chirp, msg, send_cb);
+    return CH_SUCCESS;
+}
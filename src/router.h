@@ -0,0 +1,254 @@
+// =============
+// Router header
+// =============
+//
+// Internal data structures of the router. The router keeps two dictionaries:
+// the nodes, which hold the load estimate, and the actors, which hold the
+// candidate nodes in an array, so sampling a candidate is O(1).
+//
+// .. code-block:: cpp
+//
+#ifndef ch_router_h
+#define ch_router_h
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "libchirp/router.h"
+#include "common.h"
+#include "sglib.h"
+
+// Declarations
+// ============
+
+// .. c:type:: ch_rt_node_t
+//
+//    Node dictionary implemented as red-black tree. A node is shared by all
+//    actors it provides.
+//
+//    .. c:member:: uint8_t ip_protocol
+//
+//       What IP protocol (IPv4 or IPv6) the node uses.
+//
+//    .. c:member:: uint8_t[16] address
+//
+//       IPv4/6 address of the node.
+//
+//    .. c:member:: int32_t port
+//
+//       The public port of the node.
+//
+//    .. c:member:: float load
+//
+//       The load estimate of the node. The last load reported by the peer plus
+//       1 / MAX_HANDLERS for every message dispatched since, decayed by
+//       :c:macro:`CH_RT_LOAD_HALF_LIFE`.
+//
+//    .. c:member:: uint64_t stamp
+//
+//       Loop time (ms) the load estimate was last updated.
+//
+//    .. c:member:: uint64_t report_stamp
+//
+//       Loop time (ms) of the last load report read from the connection. See
+//       :c:member:`ch_connection_t.load_stamp`.
+//
+//    .. c:member:: uint32_t refs
+//
+//       Count of actors referencing this node.
+//
+//    .. c:member:: char color_field
+//
+//       The color of the current node. This may either be red or black.
+//
+//    .. c:member:: struct ch_rt_node_s* left
+//
+//       Left child in the red-black tree.
+//
+//    .. c:member:: struct ch_rt_node_s* right
+//
+//       Right child in the red-black tree.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_rt_node_s {
+    uint8_t              ip_protocol;
+    uint8_t              address[16];
+    int32_t              port;
+    float                load;
+    uint64_t             stamp;
+    uint64_t             report_stamp;
+    uint32_t             refs;
+    char                 color_field;
+    struct ch_rt_node_s* left;
+    struct ch_rt_node_s* right;
+} ch_rt_node_t;
+
+// .. c:type:: ch_rt_actor_t
+//
+//    Actor dictionary implemented as red-black tree.
+//
+//    .. c:member:: char* actor
+//
+//       The actor, not null-terminated.
+//
+//    .. c:member:: uint16_t actor_len
+//
+//       Length of the actor.
+//
+//    .. c:member:: ch_rt_node_t** nodes
+//
+//       Array of the candidate nodes.
+//
+//    .. c:member:: uint32_t count
+//
+//       Count of the candidate nodes.
+//
+//    .. c:member:: uint32_t size
+//
+//       Allocated size of the nodes array.
+//
+//    .. c:member:: char color_field
+//
+//       The color of the current node. This may either be red or black.
+//
+//    .. c:member:: struct ch_rt_actor_s* left
+//
+//       Left child in the red-black tree.
+//
+//    .. c:member:: struct ch_rt_actor_s* right
+//
+//       Right child in the red-black tree.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_rt_actor_s {
+    char*                 actor;
+    uint16_t              actor_len;
+    ch_rt_node_t**        nodes;
+    uint32_t              count;
+    uint32_t              size;
+    char                  color_field;
+    struct ch_rt_actor_s* left;
+    struct ch_rt_actor_s* right;
+} ch_rt_actor_t;
+
+// .. c:type:: ch_router_int_t
+//
+//    Router object.
+//
+//    .. c:member:: ch_chirp_t* chirp
+//
+//       Pointer to the chirp object used for sending.
+//
+//    .. c:member:: ch_rt_actor_t* actors
+//
+//       Dictionary of the actors.
+//
+//    .. c:member:: ch_rt_node_t* nodes
+//
+//       Dictionary of the nodes.
+//
+// .. code-block:: cpp
+//
+struct ch_router_int_s {
+    ch_chirp_t*    chirp;
+    ch_rt_actor_t* actors;
+    ch_rt_node_t*  nodes;
+};
+
+// Sglib Prototypes
+// ----------------
+//
+// .. code-block:: cpp
+//
+#define CH_RT_ACTOR_CMP(x,y) ch_rt_actor_cmp(x, y)
+#define CH_RT_NODE_CMP(x,y) ch_rt_node_cmp(x, y)
+
+// .. code-block:: cpp
+//
+SGLIB_DEFINE_RBTREE_PROTOTYPES( // NOCOV
+    ch_rt_actor_t,
+    left,
+    right,
+    color_field,
+    CH_RT_ACTOR_CMP
+)
+
+// .. code-block:: cpp
+//
+SGLIB_DEFINE_RBTREE_PROTOTYPES( // NOCOV
+    ch_rt_node_t,
+    left,
+    right,
+    color_field,
+    CH_RT_NODE_CMP
+)
+
+// Definitions
+// ===========
+
+// .. c:function::
+static
+ch_inline
+int
+ch_rt_actor_cmp(ch_rt_actor_t* x, ch_rt_actor_t* y)
+//
+//    Compare operator for actors.
+//
+//    :param ch_rt_actor_t* x: First actor instance to compare
+//    :param ch_rt_actor_t* y: Second actor instance to compare
+//
+//    :return: the comparision between
+//                 - the lengths, if they are not the same, or
+//                 - the actors
+//    :rtype: int
+//
+// .. code-block:: cpp
+//
+{
+    if(x->actor_len != y->actor_len) {
+        return x->actor_len - y->actor_len;
+    }
+    return memcmp(x->actor, y->actor, x->actor_len);
+}
+
+// .. c:function::
+static
+ch_inline
+int
+ch_rt_node_cmp(ch_rt_node_t* x, ch_rt_node_t* y)
+//
+//    Compare operator for nodes.
+//
+//    :param ch_rt_node_t* x: First node instance to compare
+//    :param ch_rt_node_t* y: Second node instance to compare
+//
+//    :return: the comparision between
+//                 - the IP protocols, if they are not the same, or
+//                 - the addresses, if they are not the same, or
+//                 - the ports
+//    :rtype: int
+//
+// .. code-block:: cpp
+//
+{
+    if(x->ip_protocol != y->ip_protocol) {
+        return x->ip_protocol - y->ip_protocol;
+    } else {
+        int tmp_cmp = memcmp(
+            x->address,
+            y->address,
+            x->ip_protocol == CH_IPV6 ? 16 : 4
+        );
+        if(tmp_cmp != 0) {
+            return tmp_cmp;
+        } else {
+            return x->port - y->port;
+        }
+    }
+}
+
+#endif //ch_router_h
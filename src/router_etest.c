@@ -0,0 +1,383 @@
+// ============
+// Router etest
+// ============
+//
+// Behavior of the router (see :c:type:`ch_router_t`): the two candidates
+// sampled are always distinct and the one with the lower load wins, so the
+// most loaded node gets no messages. Stale load decays by half every
+// :c:macro:`CH_RT_LOAD_HALF_LIFE` ms. Nodes shared by actors are counted and
+// freed with their last actor, an actor is freed with its last candidate.
+//
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "libchirp.h"
+#include "fixture_test.h"
+#include "router.h"
+
+// System includes
+// ===============
+//
+// .. code-block:: cpp
+//
+#include <math.h>
+
+// Test functions
+// ==============
+//
+// Not documented on purpose.
+//
+// .. code-block:: cpp
+
+#define CH_RT_TEST_PORT 10000
+#define CH_RT_TEST_NODES 4
+#define CH_RT_TEST_ROUTES 1000
+
+typedef struct ch_rt_test_s {
+    ch_chirp_t     chirp;
+    ch_chirp_int_t ichirp;
+    uv_loop_t      loop;
+    ch_router_t    router;
+    int            errors;
+} ch_rt_test_t;
+
+static ch_rt_test_t _ch_rt_test;
+
+static
+ch_rt_node_t*
+_ch_rt_test_node(ch_rt_test_t* test, int i)
+{
+    ch_rt_node_t search_node;
+    memset(&search_node, 0, sizeof(search_node));
+    search_node.ip_protocol = CH_IPV4;
+    search_node.port        = CH_RT_TEST_PORT + i;
+    uv_inet_pton(AF_INET, "127.0.0.1", search_node.address);
+    return sglib_ch_rt_node_t_find_member(
+        test->router._->nodes,
+        &search_node
+    );
+}
+
+static
+ch_rt_actor_t*
+_ch_rt_test_actor(ch_rt_test_t* test, char* actor)
+{
+    ch_rt_actor_t search_actor;
+    search_actor.actor     = actor;
+    search_actor.actor_len = strlen(actor);
+    return sglib_ch_rt_actor_t_find_member(
+        test->router._->actors,
+        &search_actor
+    );
+}
+
+static
+int
+_ch_rt_test_add(ch_rt_test_t* test, char* actor, int i)
+{
+    return ch_rt_add_node(
+        &test->router,
+        actor,
+        CH_IPV4,
+        "127.0.0.1",
+        CH_RT_TEST_PORT + i
+    );
+}
+
+static
+int
+_ch_rt_test_remove(ch_rt_test_t* test, char* actor, int i)
+{
+    return ch_rt_remove_node(
+        &test->router,
+        actor,
+        CH_IPV4,
+        "127.0.0.1",
+        CH_RT_TEST_PORT + i
+    );
+}
+
+static
+int
+_ch_rt_test_route(ch_rt_test_t* test, char* actor)
+{
+    ch_message_t msg;
+    ch_msg_init(&msg);
+    msg.actor     = actor;
+    msg.actor_len = strlen(actor);
+    if(ch_rt_route(&test->router, &msg) != CH_SUCCESS)
+        return -1;
+    return msg.port - CH_RT_TEST_PORT;
+}
+
+static
+void
+_ch_rt_test_set_load(ch_rt_test_t* test, int i, float load)
+{
+    ch_rt_node_t* node = _ch_rt_test_node(test, i);
+    node->load  = load;
+    node->stamp = uv_now(&test->loop);
+}
+
+static
+void
+_ch_rt_test_add_remove(ch_rt_test_t* test)
+{
+    int i;
+    /* Logs an error */
+    test->errors += ch_test_expect(
+        _ch_rt_test_route(test, "a"),
+        -1,
+        "Route unknown actor"
+    );
+    for(i = 0; i < CH_RT_TEST_NODES; i++) {
+        test->errors += ch_test_expect(
+            _ch_rt_test_add(test, "a", i),
+            CH_SUCCESS,
+            "Add node"
+        );
+    }
+    test->errors += ch_test_expect(
+        _ch_rt_test_add(test, "a", 0),
+        CH_SUCCESS,
+        "Add node twice"
+    );
+    test->errors += ch_test_expect(
+        (int) _ch_rt_test_actor(test, "a")->count,
+        CH_RT_TEST_NODES,
+        "Candidates"
+    );
+    test->errors += ch_test_expect(
+        ch_rt_add_node(&test->router, "a", CH_IPV4, "not an ip", 1),
+        CH_VALUE_ERROR,
+        "Invalid address"
+    );
+    test->errors += ch_test_expect(
+        _ch_rt_test_remove(test, "b", 0),
+        CH_VALUE_ERROR,
+        "Remove unknown actor"
+    );
+    test->errors += ch_test_expect(
+        _ch_rt_test_remove(test, "a", CH_RT_TEST_NODES),
+        CH_VALUE_ERROR,
+        "Remove unknown node"
+    );
+    /* Node 0 is shared */
+    test->errors += ch_test_expect(
+        _ch_rt_test_add(test, "b", 0),
+        CH_SUCCESS,
+        "Add shared node"
+    );
+    test->errors += ch_test_expect(
+        (int) _ch_rt_test_node(test, 0)->refs,
+        2,
+        "Shared refs"
+    );
+    test->errors += ch_test_expect(
+        (int) _ch_rt_test_node(test, 1)->refs,
+        1,
+        "Refs"
+    );
+}
+
+static
+void
+_ch_rt_test_two_choices(ch_rt_test_t* test)
+{
+    int i;
+    int counts[CH_RT_TEST_NODES] = {0};
+    /* Two candidates: if the same one could be sampled twice, the loaded
+     * node would get a quarter of the messages.
+     */
+    test->errors += ch_test_expect(
+        _ch_rt_test_add(test, "c", 1),
+        CH_SUCCESS,
+        "Add node"
+    );
+    test->errors += ch_test_expect(
+        _ch_rt_test_add(test, "c", 2),
+        CH_SUCCESS,
+        "Add node"
+    );
+    _ch_rt_test_set_load(test, 1, 0);
+    _ch_rt_test_set_load(test, 2, 1000);
+    for(i = 0; i < CH_RT_TEST_ROUTES; i++)
+        counts[_ch_rt_test_route(test, "c")] += 1;
+    test->errors += ch_test_expect(
+        counts[1],
+        CH_RT_TEST_ROUTES,
+        "Lower load"
+    );
+    /* Skewed loads: the most loaded node never wins, the others share the
+     * messages as their estimates grow.
+     */
+    memset(counts, 0, sizeof(counts));
+    for(i = 0; i < CH_RT_TEST_NODES; i++)
+        _ch_rt_test_set_load(test, i, (float) i / 4);
+    _ch_rt_test_set_load(test, CH_RT_TEST_NODES - 1, 1000);
+    for(i = 0; i < CH_RT_TEST_ROUTES; i++)
+        counts[_ch_rt_test_route(test, "a")] += 1;
+    test->errors += ch_test_expect(
+        counts[CH_RT_TEST_NODES - 1],
+        0,
+        "Most loaded node"
+    );
+    for(i = 0; i < CH_RT_TEST_NODES - 1; i++) {
+        if(counts[i] < CH_RT_TEST_ROUTES / CH_RT_TEST_NODES) {
+            fprintf(stderr, "Node %d got only %d messages\n", i, counts[i]);
+            test->errors += 1;
+        }
+    }
+    /* The node with the lowest load gets the most */
+    if(counts[0] < counts[1] || counts[1] < counts[2]) {
+        fprintf(
+            stderr,
+            "Skewed loads: %d, %d, %d messages\n",
+            counts[0],
+            counts[1],
+            counts[2]
+        );
+        test->errors += 1;
+    }
+}
+
+static
+void
+_ch_rt_test_decay(ch_rt_test_t* test)
+{
+    uint64_t now = uv_now(&test->loop);
+    ch_rt_node_t* node = _ch_rt_test_node(test, 1);
+    float expected = 0.5f + 1.0f / test->ichirp.config.MAX_HANDLERS;
+    /* Node 1 has not been updated for a half-life */
+    node->load  = 1;
+    node->stamp = now - CH_RT_LOAD_HALF_LIFE;
+    _ch_rt_test_set_load(test, 2, 1000);
+    test->errors += ch_test_expect(
+        _ch_rt_test_route(test, "c"),
+        1,
+        "Route decayed node"
+    );
+    if(fabsf(node->load - expected) > 1e-4f || node->stamp != now) {
+        fprintf(
+            stderr,
+            "Decay: load %f, expected %f\n",
+            (double) node->load,
+            (double) expected
+        );
+        test->errors += 1;
+    }
+}
+
+static
+void
+_ch_rt_test_cleanup(ch_rt_test_t* test)
+{
+    int i;
+    test->errors += ch_test_expect(
+        _ch_rt_test_remove(test, "a", 0),
+        CH_SUCCESS,
+        "Remove shared node"
+    );
+    test->errors += ch_test_expect(
+        _ch_rt_test_node(test, 0) != NULL,
+        1,
+        "Shared node kept"
+    );
+    test->errors += ch_test_expect(
+        (int) _ch_rt_test_node(test, 0)->refs,
+        1,
+        "Shared refs"
+    );
+    test->errors += ch_test_expect(
+        _ch_rt_test_remove(test, "b", 0),
+        CH_SUCCESS,
+        "Remove last candidate"
+    );
+    test->errors += ch_test_expect(
+        _ch_rt_test_node(test, 0) == NULL,
+        1,
+        "Node freed"
+    );
+    test->errors += ch_test_expect(
+        _ch_rt_test_actor(test, "b") == NULL,
+        1,
+        "Actor freed"
+    );
+    for(i = 1; i < CH_RT_TEST_NODES; i++) {
+        test->errors += ch_test_expect(
+            _ch_rt_test_remove(test, "a", i),
+            CH_SUCCESS,
+            "Remove node"
+        );
+    }
+    /* Logs an error */
+    test->errors += ch_test_expect(
+        _ch_rt_test_route(test, "a"),
+        -1,
+        "Route removed actor"
+    );
+    for(i = 1; i < 3; i++) {
+        test->errors += ch_test_expect(
+            _ch_rt_test_remove(test, "c", i),
+            CH_SUCCESS,
+            "Remove node"
+        );
+    }
+    test->errors += ch_test_expect(
+        test->router._->actors == NULL && test->router._->nodes == NULL,
+        1,
+        "Router empty"
+    );
+    /* Adding again after the actor was freed */
+    test->errors += ch_test_expect(
+        _ch_rt_test_add(test, "a", 0),
+        CH_SUCCESS,
+        "Add node again"
+    );
+    test->errors += ch_test_expect(
+        _ch_rt_test_route(test, "a"),
+        0,
+        "Route single candidate"
+    );
+}
+
+// Runner
+// ======
+
+// .. c:function::
+int
+main(void)
+//    :noindex:
+//
+//    Run the test.
+//
+// .. code-block:: cpp
+//
+{
+    ch_rt_test_t* test = &_ch_rt_test;
+    ch_libchirp_init();
+    memset(test, 0, sizeof(*test));
+    ch_test_fake_chirp(&test->chirp, &test->ichirp);
+    ch_loop_init(&test->loop);
+    /* The estimates start at this time */
+    uv_update_time(&test->loop);
+    test->ichirp.loop = &test->loop;
+    if(ch_rt_init(&test->router, &test->chirp) != CH_SUCCESS) {
+        fprintf(stderr, "ch_rt_init error\n");
+        ch_loop_close(&test->loop);
+        ch_libchirp_cleanup();
+        return 1;
+    }
+    _ch_rt_test_add_remove(test);
+    _ch_rt_test_two_choices(test);
+    _ch_rt_test_decay(test);
+    _ch_rt_test_cleanup(test);
+    ch_rt_free(&test->router);
+    ch_loop_close(&test->loop);
+    ch_libchirp_cleanup();
+    if(test->errors == 0)
+        printf("OK\n");
+    return test->errors > 0;
+}
@@ -0,0 +1,389 @@
+// ========
+// Schedule
+// ========
+//
+// Timing wheel, see :c:type:`ch_scheduler_t`.
+//
+// .. code-block:: cpp
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "schedule.h"
+#include "chirp.h"
+
+// Declarations
+// ============
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_sc_add(ch_scheduler_t* scheduler, ch_schedule_t* entry);
+//
+//    Put an entry into the lowest level of the wheel covering its delay.
+//
+//    :param ch_scheduler_t* scheduler: Scheduler to add the entry to.
+//    :param ch_schedule_t* entry: The entry, _due must be set.
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_sc_cascade(ch_scheduler_t* scheduler, int level);
+//
+//    Move the entries of the current slot of **level** to lower levels.
+//
+//    :param ch_scheduler_t* scheduler: Scheduler to cascade.
+//    :param int level: The level to cascade.
+
+// .. c:function::
+static
+void
+_ch_sc_send_cb(ch_chirp_t* chirp, ch_schedule_t* entry);
+//
+//    Send the message of an entry scheduled by
+//    :c:func:`ch_chirp_schedule_send`.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    :param ch_schedule_t* entry: The entry that is due.
+
+// .. c:function::
+static
+void
+_ch_sc_timer_cb(uv_timer_t* handle);
+//
+//    Advance the wheel to the current loop time and call the callbacks of the
+//    due entries.
+//
+//    :param uv_timer_t* handle: The timer of the scheduler, contains chirp (as
+//                               data).
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_sc_unlink(ch_schedule_t* entry);
+//
+//    Remove an entry from its slot.
+//
+//    :param ch_schedule_t* entry: The entry to remove.
+
+// Definitions
+// ===========
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_sc_add(ch_scheduler_t* scheduler, ch_schedule_t* entry)
+//    :noindex:
+//
+//    see: :c:func:`_ch_sc_add`
+//
+// .. code-block:: cpp
+//
+{
+    int level = 0;
+    uint64_t due = entry->_due;
+    uint64_t delta = due - scheduler->tick;
+    uint64_t max = ((uint64_t) 1 << (CH_SC_BITS * CH_SC_LEVELS)) - 1;
+    ch_schedule_t** slot;
+    while(
+            level < CH_SC_LEVELS - 1 &&
+            delta >= ((uint64_t) 1 << (CH_SC_BITS * (level + 1)))
+    ) level += 1;
+    /* Delays beyond the wheel wait in the last slot of the top level and get
+     * cascaded again.
+     */
+    if(delta > max)
+        due = scheduler->tick + max;
+    slot = &scheduler->wheel[level][
+        (due >> (CH_SC_BITS * level)) & (CH_SC_SLOTS - 1)
+    ];
+    entry->_next  = *slot;
+    entry->_pprev = slot;
+    if(*slot != NULL)
+        (*slot)->_pprev = &entry->_next;
+    *slot = entry;
+}
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_sc_cascade(ch_scheduler_t* scheduler, int level)
+//    :noindex:
+//
+//    see: :c:func:`_ch_sc_cascade`
+//
+// .. code-block:: cpp
+//
+{
+    ch_schedule_t* entry;
+    ch_schedule_t** slot = &scheduler->wheel[level][
+        (scheduler->tick >> (CH_SC_BITS * level)) & (CH_SC_SLOTS - 1)
+    ];
+    while((entry = *slot) != NULL) {
+        _ch_sc_unlink(entry);
+        _ch_sc_add(scheduler, entry);
+    }
+}
+
+// .. c:function::
+static
+void
+_ch_sc_send_cb(ch_chirp_t* chirp, ch_schedule_t* entry)
+//    :noindex:
+//
+//    see: :c:func:`_ch_sc_send_cb`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_send(chirp, entry->_msg, entry->_send_cb);
+}
+
+// .. c:function::
+static
+void
+_ch_sc_timer_cb(uv_timer_t* handle)
+//    :noindex:
+//
+//    see: :c:func:`_ch_sc_timer_cb`
+//
+// .. code-block:: cpp
+//
+{
+    ch_schedule_t* entry;
+    CH_GET_CHIRP(handle);
+    ch_chirp_int_t* ichirp = chirp->_;
+    ch_scheduler_t* scheduler = &ichirp->scheduler;
+    uint64_t target = uv_now(ichirp->loop) / CH_SC_TICK;
+    while(scheduler->tick < target && scheduler->count > 0) {
+        int level = 1;
+        ch_schedule_t** slot;
+        scheduler->tick += 1;
+        /* Find the highest level that wraps around and cascade from the top,
+         * so entries cascaded from level n + 1 into the current slot of level
+         * n are cascaded again.
+         */
+        while(
+                level < CH_SC_LEVELS &&
+                (scheduler->tick & (
+                    ((uint64_t) 1 << (CH_SC_BITS * level)) - 1
+                )) == 0
+        ) level += 1;
+        for(level -= 1; level > 0; level--)
+            _ch_sc_cascade(scheduler, level);
+        slot = &scheduler->wheel[0][scheduler->tick & (CH_SC_SLOTS - 1)];
+        while((entry = *slot) != NULL) {
+            _ch_sc_unlink(entry);
+            scheduler->count -= 1;
+            entry->_cb(chirp, entry);
+        }
+    }
+    if(scheduler->count == 0) {
+        scheduler->tick = target;
+        uv_timer_stop(&scheduler->timer);
+    }
+}
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_sc_unlink(ch_schedule_t* entry)
+//    :noindex:
+//
+//    see: :c:func:`_ch_sc_unlink`
+//
+// .. code-block:: cpp
+//
+{
+    *entry->_pprev = entry->_next;
+    if(entry->_next != NULL)
+        entry->_next->_pprev = entry->_pprev;
+    entry->_next  = NULL;
+    entry->_pprev = NULL;
+}
+
+// .. c:function::
+ch_error_t
+ch_chirp_cancel(ch_chirp_t* chirp, ch_schedule_t* entry)
+//    :noindex:
+//
+//    see: :c:func:`ch_chirp_cancel`
+//
+// .. code-block:: cpp
+//
+{
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    if(entry->_pprev == NULL)
+        return CH_VALUE_ERROR;
+    _ch_sc_unlink(entry);
+    chirp->_->scheduler.count -= 1;
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+ch_error_t
+ch_chirp_schedule(
+        ch_chirp_t* chirp,
+        ch_schedule_t* entry,
+        uint64_t timeout,
+        ch_schedule_cb_t cb,
+        void* state
+)
+//    :noindex:
+//
+//    see: :c:func:`ch_chirp_schedule`
+//
+// .. code-block:: cpp
+//
+{
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    ch_chirp_int_t* ichirp = chirp->_;
+    ch_scheduler_t* scheduler = &ichirp->scheduler;
+    uint64_t now = uv_now(ichirp->loop) / CH_SC_TICK;
+    uint64_t due;
+    V(
+        chirp,
+        entry->_pprev == NULL,
+        "Entry is already pending. ch_schedule_t:%p",
+        (void*) entry
+    );
+    /* Entries added while closing would never fire. */
+    if(ichirp->flags & CH_CHIRP_CLOSING)
+        return CH_UNINIT;
+    if(scheduler->count == 0) {
+        int tmp_err;
+        /* The wheel is empty, so we can jump to the current tick. */
+        scheduler->tick = now;
+        tmp_err = uv_timer_start(
+            &scheduler->timer,
+            _ch_sc_timer_cb,
+            CH_SC_TICK,
+            CH_SC_TICK
+        );
+        if(tmp_err != CH_SUCCESS) {
+            E(
+                chirp,
+                "Starting scheduler timer failed: %d. ch_chirp_t:%p",
+                tmp_err,
+                (void*) chirp
+            );
+            return CH_UV_ERROR;
+        }
+    }
+    due = now + (timeout + CH_SC_TICK - 1) / CH_SC_TICK;
+    if(due <= scheduler->tick)
+        due = scheduler->tick + 1;
+    entry->state = state;
+    entry->_cb   = cb;
+    entry->_due  = due;
+    _ch_sc_add(scheduler, entry);
+    scheduler->count += 1;
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+ch_error_t
+ch_chirp_schedule_send(
+        ch_chirp_t* chirp,
+        ch_schedule_t* entry,
+        uint64_t timeout,
+        ch_message_t* msg,
+        ch_send_cb_t send_cb
+)
+//    :noindex:
+//
+//    see: :c:func:`ch_chirp_schedule_send`
+//
+// .. code-block:: cpp
+//
+{
+    ch_error_t tmp_err = ch_chirp_schedule(
+        chirp,
+        entry,
+        timeout,
+        _ch_sc_send_cb,
+        entry->state
+    );
+    if(tmp_err != CH_SUCCESS)
+        return tmp_err;
+    entry->_msg     = msg;
+    entry->_send_cb = send_cb;
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+void
+ch_schedule_init(ch_schedule_t* entry)
+//    :noindex:
+//
+//    see: :c:func:`ch_schedule_init`
+//
+// .. code-block:: cpp
+//
+{
+    memset(entry, 0, sizeof(ch_schedule_t));
+}
+
+// .. c:function::
+ch_error_t
+ch_sc_start(ch_scheduler_t* scheduler)
+//    :noindex:
+//
+//    see: :c:func:`ch_sc_start`
+//
+// .. code-block:: cpp
+//
+{
+    int tmp_err;
+    ch_chirp_t* chirp = scheduler->chirp;
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    tmp_err = uv_timer_init(chirp->_->loop, &scheduler->timer);
+    if(tmp_err != CH_SUCCESS) {
+        E(
+            chirp,
+            "Initializing scheduler timer failed: %d. ch_chirp_t:%p",
+            tmp_err,
+            (void*) chirp
+        );
+        return CH_UV_ERROR;
+    }
+    scheduler->timer.data = chirp;
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+void
+ch_sc_stop(ch_scheduler_t* scheduler)
+//    :noindex:
+//
+//    see: :c:func:`ch_sc_stop`
+//
+// .. code-block:: cpp
+//
+{
+    int level;
+    int i;
+    ch_schedule_t* entry;
+    ch_chirp_t* chirp = scheduler->chirp;
+    for(level = 0; level < CH_SC_LEVELS; level++) {
+        for(i = 0; i < CH_SC_SLOTS; i++) {
+            while((entry = scheduler->wheel[level][i]) != NULL) {
+                _ch_sc_unlink(entry);
+                scheduler->count -= 1;
+                if(entry->_cb == _ch_sc_send_cb)
+                    entry->_send_cb(chirp, entry->_msg, CH_UNINIT, 0);
+            }
+        }
+    }
+    uv_timer_stop(&scheduler->timer);
+    uv_close((uv_handle_t*) &scheduler->timer, ch_chirp_close_cb);
+    chirp->_->closing_tasks += 1;
+}
@@ -0,0 +1,126 @@
+// ===============
+// Schedule header
+// ===============
+//
+// Hierarchical timing wheel. The wheel has :c:macro:`CH_SC_LEVELS` levels of
+// :c:macro:`CH_SC_SLOTS` slots. A slot of level 0 spans one tick, a slot of
+// level n spans :code:`CH_SC_SLOTS^n` ticks. An entry is put into the lowest
+// level that covers its delay. Every time level n wraps around, the next slot
+// of level n + 1 is cascaded: its entries are put into lower levels.
+//
+// So every entry is moved at most :c:macro:`CH_SC_LEVELS` - 1 times, which
+// makes insert and fire O(1) amortized.
+//
+// .. code-block:: cpp
+//
+#ifndef ch_schedule_h
+#define ch_schedule_h
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "common.h"
+#include "libchirp/schedule.h"
+
+// Declarations
+// ============
+
+// .. c:macro:: CH_SC_BITS
+//
+//    Bits of the tick used by one level.
+//
+// .. c:macro:: CH_SC_SLOTS
+//
+//    Slots per level.
+//
+// .. c:macro:: CH_SC_LEVELS
+//
+//    Count of levels. With a tick of 10ms the wheel covers 497 days, longer
+//    delays are cascaded multiple times.
+//
+// .. code-block:: cpp
+//
+#define CH_SC_BITS 8
+#define CH_SC_SLOTS (1 << CH_SC_BITS)
+#define CH_SC_LEVELS 4
+
+// .. c:type:: ch_scheduler_t
+//
+//    Scheduler object.
+//
+//    .. c:member:: uv_timer_t timer
+//
+//       Timer advancing the wheel. It only runs while entries are pending.
+//
+//    .. c:member:: ch_schedule_t* wheel[CH_SC_LEVELS][CH_SC_SLOTS]
+//
+//       The slots of the wheel.
+//
+//    .. c:member:: uint64_t tick
+//
+//       The last tick processed.
+//
+//    .. c:member:: uint32_t count
+//
+//       Count of pending entries.
+//
+//    .. c:member:: ch_chirp_t* chirp
+//
+//       Pointer to the chirp object. See: :c:type:`ch_chirp_t`.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_scheduler_s {
+    uv_timer_t     timer;
+    ch_schedule_t* wheel[CH_SC_LEVELS][CH_SC_SLOTS];
+    uint64_t       tick;
+    uint32_t       count;
+    ch_chirp_t*    chirp;
+} ch_scheduler_t;
+
+// .. c:function::
+ch_error_t
+ch_sc_start(ch_scheduler_t* scheduler);
+//
+//    Start the scheduler.
+//
+//    :param ch_scheduler_t* scheduler: Scheduler which shall be started.
+//
+//    :return: A chirp error. see: :c:type:`ch_error_t`
+//    :rtype:  ch_error_t
+
+// .. c:function::
+void
+ch_sc_stop(ch_scheduler_t* scheduler);
+//
+//    Stop the scheduler. Pending entries are dropped and not pending anymore,
+//    their callbacks are not called. The send callbacks of messages
+//    scheduled by :c:func:`ch_chirp_schedule_send` are called with
+//    CH_UNINIT.
+//
+//    :param ch_scheduler_t* scheduler: Scheduler which shall be stopped.
+
+// Definitions
+// ===========
+
+// .. c:function::
+static
+ch_inline
+void
+ch_sc_init(ch_chirp_t* chirp, ch_scheduler_t* scheduler)
+//
+//    Initialize the scheduler structure.
+//
+//    :param ch_chirp_t* chirp: Chirp instance.
+//    :param ch_scheduler_t* scheduler: Scheduler to initialize.
+//
+// .. code-block:: cpp
+//
+{
+    memset(scheduler, 0, sizeof(ch_scheduler_t));
+    scheduler->chirp = chirp;
+}
+
+#endif //ch_schedule_h
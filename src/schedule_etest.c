@@ -0,0 +1,277 @@
+// ==============
+// Schedule etest
+// ==============
+//
+// Behavior of the timing wheel (see :c:type:`ch_scheduler_t`): entries fire
+// in order and not before their delay, an entry beyond the first level is
+// cascaded before it fires, cancelled entries don't fire and an entry can be
+// scheduled again from its callback. Closing chirp drops pending entries and
+// fails scheduled sends with CH_UNINIT.
+//
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "libchirp.h"
+#include "fixture_test.h"
+#include "schedule.h"
+
+// Test functions
+// ==============
+//
+// Not documented on purpose.
+//
+// .. code-block:: cpp
+
+#define CH_SC_TEST_PORT 59736
+#define CH_SC_TEST_ENTRIES 9
+#define CH_SC_TEST_FIRED 16
+#define CH_SC_TEST_LATE 500
+#define CH_SC_TEST_DAY (24 * 3600 * 1000)
+#define CH_SC_TEST_TIMEOUT 10000
+/* Beyond the first level of the wheel */
+#define CH_SC_TEST_CASCADE (CH_SC_SLOTS * CH_SC_TICK + 100)
+
+typedef struct ch_sc_test_s {
+    ch_chirp_t    chirp;
+    ch_config_t   config;
+    uv_loop_t     loop;
+    uv_timer_t    timer;
+    ch_schedule_t entries[CH_SC_TEST_ENTRIES];
+    uint64_t      delays[CH_SC_TEST_ENTRIES];
+    ch_message_t  msg;
+    uint64_t      start;
+    int           fired[CH_SC_TEST_FIRED];
+    int           fired_count;
+    int           send_status;
+    int           send_count;
+    int           errors;
+} ch_sc_test_t;
+
+static ch_sc_test_t _ch_sc_test;
+
+static
+void
+_ch_sc_test_done_cb(uv_async_t* handle)
+{
+    uv_close((uv_handle_t*) handle, ch_test_close_cb);
+    uv_close((uv_handle_t*) &_ch_sc_test.timer, ch_test_close_cb);
+}
+
+static
+void
+_ch_sc_test_send_cb(
+        ch_chirp_t* chirp,
+        ch_message_t* msg,
+        int status,
+        float load
+)
+{
+    (void)(chirp);
+    (void)(msg);
+    (void)(load);
+    ch_sc_test_t* test = &_ch_sc_test;
+    test->send_status = status;
+    test->send_count += 1;
+}
+
+static
+void
+_ch_sc_test_timer_cb(uv_timer_t* handle)
+{
+    ch_sc_test_t* test = &_ch_sc_test;
+    fprintf(stderr, "Timeout after %d entries fired\n", test->fired_count);
+    test->errors += 1;
+    uv_timer_stop(handle);
+    ch_chirp_close_ts(&test->chirp);
+}
+
+static
+void
+_ch_sc_test_cb(ch_chirp_t* chirp, ch_schedule_t* entry)
+{
+    ch_sc_test_t* test = &_ch_sc_test;
+    int i = (int) (entry - test->entries);
+    uint64_t elapsed = uv_now(&test->loop) - test->start;
+    if(test->fired_count < CH_SC_TEST_FIRED)
+        test->fired[test->fired_count] = i;
+    test->fired_count += 1;
+    if(
+            elapsed + CH_SC_TICK < test->delays[i] ||
+            elapsed > test->delays[i] + CH_SC_TEST_LATE
+    ) {
+        fprintf(
+            stderr,
+            "Entry %d fired after %u ms, expected %u ms\n",
+            i,
+            (unsigned) elapsed,
+            (unsigned) test->delays[i]
+        );
+        test->errors += 1;
+    }
+    if(ch_chirp_cancel(chirp, entry) != CH_VALUE_ERROR) {
+        fprintf(stderr, "Entry %d still pending\n", i);
+        test->errors += 1;
+    }
+    switch(i) {
+    case 3:
+        /* Schedule again from the callback */
+        if(test->delays[3] == 30) {
+            test->delays[3] = 80;
+            if(ch_chirp_schedule(
+                    chirp, entry, 50, _ch_sc_test_cb, NULL
+            ) != CH_SUCCESS)
+                test->errors += 1;
+        }
+        break;
+    case 4:
+        /* Cancel an entry scheduled beyond the first level */
+        if(ch_chirp_cancel(chirp, &test->entries[6]) != CH_SUCCESS) {
+            fprintf(stderr, "Cancel failed\n");
+            test->errors += 1;
+        }
+        break;
+    case 5:
+        uv_timer_stop(&test->timer);
+        ch_chirp_close_ts(chirp);
+        break;
+    default:
+        break;
+    }
+}
+
+static
+void
+_ch_sc_test_schedule(ch_sc_test_t* test, int i, uint64_t delay)
+{
+    test->delays[i] = delay;
+    if(ch_chirp_schedule(
+            &test->chirp,
+            &test->entries[i],
+            delay,
+            _ch_sc_test_cb,
+            test
+    ) != CH_SUCCESS) {
+        fprintf(stderr, "Scheduling entry %d failed\n", i);
+        test->errors += 1;
+    }
+}
+
+// Runner
+// ======
+
+// .. c:function::
+int
+main(void)
+//    :noindex:
+//
+//    Run the test.
+//
+// .. code-block:: cpp
+//
+{
+    int i;
+    int expected[] = {0, 3, 1, 3, 4, 5};
+    int expected_count = sizeof(expected) / sizeof(expected[0]);
+    ch_sc_test_t* test = &_ch_sc_test;
+    ch_libchirp_init();
+    memset(test, 0, sizeof(*test));
+    ch_loop_init(&test->loop);
+    uv_timer_init(&test->loop, &test->timer);
+    ch_chirp_config_init(&test->config);
+    test->config.PORT               = CH_SC_TEST_PORT;
+    test->config.CLOSE_ON_SIGINT    = 0;
+    test->config.DISABLE_ENCRYPTION = 1;
+    test->config.CERT_CHAIN_PEM     = "./cert.pem";
+    test->config.DH_PARAMS_PEM      = "./dh.pem";
+    if(ch_chirp_init(
+            &test->chirp,
+            &test->config,
+            &test->loop,
+            _ch_sc_test_done_cb,
+            ch_test_log_cb
+    ) != CH_SUCCESS) {
+        fprintf(stderr, "ch_chirp_init error\n");
+        uv_close((uv_handle_t*) &test->timer, ch_test_close_cb);
+        ch_run(&test->loop);
+        ch_loop_close(&test->loop);
+        ch_libchirp_cleanup();
+        return 1;
+    }
+    for(i = 0; i < CH_SC_TEST_ENTRIES; i++)
+        ch_schedule_init(&test->entries[i]);
+    test->start = uv_now(&test->loop);
+    _ch_sc_test_schedule(test, 1, 60);
+    _ch_sc_test_schedule(test, 0, 20);
+    _ch_sc_test_schedule(test, 3, 30);
+    _ch_sc_test_schedule(test, 4, 1000);
+    _ch_sc_test_schedule(test, 5, CH_SC_TEST_CASCADE + 100);
+    _ch_sc_test_schedule(test, 6, CH_SC_TEST_CASCADE);
+    _ch_sc_test_schedule(test, 2, 40);
+    _ch_sc_test_schedule(test, 7, CH_SC_TEST_DAY);
+    test->errors += ch_test_expect(
+        ch_chirp_cancel(&test->chirp, &test->entries[2]),
+        CH_SUCCESS,
+        "Cancel"
+    );
+    /* Logs an error */
+    test->errors += ch_test_expect(
+        ch_chirp_schedule(
+            &test->chirp,
+            &test->entries[1],
+            10,
+            _ch_sc_test_cb,
+            NULL
+        ),
+        CH_VALUE_ERROR,
+        "Schedule pending entry"
+    );
+    ch_msg_init(&test->msg);
+    ch_msg_set_address(
+        &test->msg,
+        CH_IPV4,
+        "127.0.0.1",
+        CH_SC_TEST_PORT
+    );
+    test->errors += ch_test_expect(
+        ch_chirp_schedule_send(
+            &test->chirp,
+            &test->entries[8],
+            CH_SC_TEST_DAY,
+            &test->msg,
+            _ch_sc_test_send_cb
+        ),
+        CH_SUCCESS,
+        "Schedule send"
+    );
+    uv_timer_start(
+        &test->timer,
+        _ch_sc_test_timer_cb,
+        CH_SC_TEST_TIMEOUT,
+        0
+    );
+    ch_run(&test->loop);
+    ch_loop_close(&test->loop);
+    ch_libchirp_cleanup();
+    test->errors += ch_test_expect(
+        test->fired_count,
+        expected_count,
+        "Entries fired"
+    );
+    for(i = 0; i < expected_count && i < test->fired_count; i++)
+        test->errors += ch_test_expect(
+            test->fired[i],
+            expected[i],
+            "Entry fired"
+        );
+    test->errors += ch_test_expect(test->send_count, 1, "Send callbacks");
+    test->errors += ch_test_expect(
+        test->send_status,
+        CH_UNINIT,
+        "Send status"
+    );
+    if(test->errors == 0)
+        printf("OK\n");
+    return test->errors > 0;
+}
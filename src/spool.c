@@ -0,0 +1,1331 @@
+// =====
+// Spool
+// =====
+//
+// Write-ahead spool of outbound messages, see :c:type:`ch_spool_t`.
+//
+// .. code-block:: cpp
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "spool.h"
+#include "chirp.h"
+#include "util.h"
+#include "writer.h"
+
+// Sglib Prototypes
+// ================
+
+// .. code-block:: cpp
+//
+SGLIB_DEFINE_RBTREE_FUNCTIONS( // NOCOV
+    ch_sp_replay_t,
+    left,
+    right,
+    color_field,
+    CH_SP_REPLAY_CMP
+)
+
+// Declarations
+// ============
+
+// .. c:function::
+static
+ch_inline
+char*
+_ch_sp_append(ch_spool_t* spool, size_t size);
+//
+//    Reserve space for a record in the buffer collecting records, the buffer
+//    grows if needed.
+//
+//    :param ch_spool_t* spool: The spool.
+//    :param size_t size:       Size of the record.
+//
+//    :return: pointer to the record or NULL if out of memory
+//    :rtype:  char*
+
+// .. c:function::
+static
+void
+_ch_sp_commit(ch_spool_t* spool);
+//
+//    Start a commit of the records collected, unless one is running. The
+//    messages waiting are assigned to the current segment, which is rotated
+//    first if it is full.
+//
+//    :param ch_spool_t* spool: The spool.
+
+// .. c:function::
+static
+void
+_ch_sp_committed(ch_spool_t* spool, int status);
+//
+//    The commit is written and synced: queue its messages on their
+//    connections and start the next commit. If the commit failed, the
+//    messages are not durable: their send callbacks are called with
+//    :c:member:`ch_error_t.CH_UV_ERROR` instead. If chirp is stopping, finish
+//    the spool instead.
+//
+//    :param ch_spool_t* spool: The spool.
+//    :param int status:        libuv status of the commit.
+
+// .. c:function::
+static
+void
+_ch_sp_finish(ch_spool_t* spool);
+//
+//    Write and sync the records collected, close the spool and call the send
+//    callbacks of the messages not queued yet with
+//    :c:member:`ch_error_t.CH_UNINIT`. The current segment is deleted if no
+//    message in the spool is pending.
+//
+//    :param ch_spool_t* spool: The spool.
+
+// .. c:function::
+static
+ch_error_t
+_ch_sp_load(ch_spool_t* spool, ch_message_t** head);
+//
+//    Read the segments found in :c:member:`ch_config_t.SPOOL_DIR`, oldest
+//    first.
+//
+//    :param ch_spool_t* spool:   The spool.
+//    :param ch_message_t** head: Out: messages without a done record, in the
+//                                order they were sent.
+//
+//    :return: A chirp error. see: :c:type:`ch_error_t`
+//    :rtype:  ch_error_t
+
+// .. c:function::
+static
+ch_error_t
+_ch_sp_load_segment(
+        ch_spool_t* spool,
+        uint64_t seq,
+        ch_sp_replay_t** tree,
+        ch_message_t** head,
+        ch_message_t** tail
+);
+//
+//    Read a segment file and parse its records, see :c:func:`_ch_sp_parse`.
+//
+//    :param ch_spool_t* spool:     The spool.
+//    :param uint64_t seq:          Sequence number of the segment.
+//    :param ch_sp_replay_t** tree: Messages read by serial.
+//    :param ch_message_t** head:   First message read.
+//    :param ch_message_t** tail:   Last message read.
+//
+//    :return: A chirp error. see: :c:type:`ch_error_t`
+//    :rtype:  ch_error_t
+
+// .. c:function::
+static
+ch_error_t
+_ch_sp_open(ch_spool_t* spool, uint64_t seq);
+//
+//    Create a new segment and make it current. The file of the previous
+//    segment is closed, segments that are done are deleted, see
+//    :c:func:`_ch_sp_reclaim`.
+//
+//    :param ch_spool_t* spool: The spool.
+//    :param uint64_t seq:      Sequence number of the new segment.
+//
+//    :return: A chirp error. see: :c:type:`ch_error_t`
+//    :rtype:  ch_error_t
+
+// .. c:function::
+static
+ch_error_t
+_ch_sp_parse(
+        ch_spool_t* spool,
+        char* buf,
+        size_t size,
+        ch_sp_replay_t** tree,
+        ch_message_t** head,
+        ch_message_t** tail
+);
+//
+//    Parse the records of a segment. Add records are appended to the
+//    messages read, done records mark them. Parsing stops at a truncated or
+//    corrupt record, which is the end of the last write before a crash.
+//
+//    :param ch_spool_t* spool:     The spool.
+//    :param char* buf:             Content of the segment.
+//    :param size_t size:           Size of the content.
+//    :param ch_sp_replay_t** tree: Messages read by serial.
+//    :param ch_message_t** head:   First message read.
+//    :param ch_message_t** tail:   Last message read.
+//
+//    :return: A chirp error. see: :c:type:`ch_error_t`
+//    :rtype:  ch_error_t
+
+// .. c:function::
+static
+ch_inline
+int
+_ch_sp_parse_name(const char* name, uint64_t* seq);
+//
+//    Parse the file name of a segment.
+//
+//    :param const char* name: File name.
+//    :param uint64_t* seq:    Out: sequence number of the segment.
+//
+//    :return: 1 if the file is a segment, 0 otherwise.
+//    :rtype:  int
+
+// .. c:function::
+static
+ch_inline
+int
+_ch_sp_path(ch_spool_t* spool, uint64_t seq, char* path, size_t size);
+//
+//    Get the path of a segment file.
+//
+//    :param ch_spool_t* spool: The spool.
+//    :param uint64_t seq:      Sequence number of the segment.
+//    :param char* path:        Out: the path.
+//    :param size_t size:       Size of path.
+//
+//    :return: 1 if the path fits, 0 otherwise.
+//    :rtype:  int
+
+// .. c:function::
+static
+void
+_ch_sp_reclaim(ch_spool_t* spool);
+//
+//    Delete the oldest segments as long as all their messages are done. A
+//    segment can hold done records of messages in older segments, so it is
+//    only deleted after them, otherwise those messages would be sent again
+//    after a restart. The current segment is never deleted.
+//
+//    :param ch_spool_t* spool: The spool.
+
+// .. c:function::
+static
+void
+_ch_sp_replay_cb(
+        ch_chirp_t* chirp,
+        ch_message_t* msg,
+        int status,
+        float load
+);
+//
+//    Send callback of messages sent again on start: log failures and free
+//    the message.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp instance.
+//    :param ch_message_t* msg: The message, see :c:type:`ch_sp_replay_t`.
+//    :param int status:        Status of the send.
+//    :param float load:        The load of the remote peer.
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_sp_schedule(ch_spool_t* spool);
+//
+//    Start a commit in the next loop iteration, if no commit is running.
+//    Otherwise the records go into the commit after the running one.
+//
+//    :param ch_spool_t* spool: The spool.
+
+// .. c:function::
+static
+int
+_ch_sp_seq_cmp(const void* x, const void* y);
+//
+//    Compare sequence numbers of segments, for qsort.
+//
+//    :param const void* x: First sequence number.
+//    :param const void* y: Second sequence number.
+//
+//    :return: the comparison of x and y
+//    :rtype:  int
+
+// .. c:function::
+static
+void
+_ch_sp_sync_cb(uv_fs_t* req);
+//
+//    The commit is synced.
+//
+//    :param uv_fs_t* req: The request of the spool, contains the spool (as
+//                         data).
+
+// .. c:function::
+static
+void
+_ch_sp_timer_cb(uv_timer_t* handle);
+//
+//    Start a commit.
+//
+//    :param uv_timer_t* handle: The timer of the spool, contains chirp (as
+//                               data).
+
+// .. c:function::
+static
+void
+_ch_sp_unlink(ch_spool_t* spool, uint64_t seq);
+//
+//    Delete the file of a segment.
+//
+//    :param ch_spool_t* spool: The spool.
+//    :param uint64_t seq:      Sequence number of the segment.
+
+// .. c:function::
+static
+void
+_ch_sp_unlink_replayed(ch_spool_t* spool);
+//
+//    Delete the segments of the last run, their messages are in the spool
+//    again.
+//
+//    :param ch_spool_t* spool: The spool.
+
+// .. c:function::
+static
+void
+_ch_sp_write_cb(uv_fs_t* req);
+//
+//    The records of the commit are written, sync them if the commit contains
+//    messages. Done records alone are not synced: if they are lost, the
+//    messages are sent again, which is allowed.
+//
+//    :param uv_fs_t* req: The request of the spool, contains the spool (as
+//                         data).
+
+// Definitions
+// ===========
+
+// .. c:function::
+static
+ch_inline
+char*
+_ch_sp_append(ch_spool_t* spool, size_t size)
+//    :noindex:
+//
+//    see: :c:func:`_ch_sp_append`
+//
+// .. code-block:: cpp
+//
+{
+    char* buf;
+    size_t cap = spool->caps[spool->cur];
+    if(spool->len + size > cap) {
+        while(spool->len + size > cap)
+            cap *= 2;
+        buf = ch_realloc(spool->bufs[spool->cur], cap);
+        if(!buf)
+            return NULL;
+        spool->bufs[spool->cur] = buf;
+        spool->caps[spool->cur] = cap;
+    }
+    buf = spool->bufs[spool->cur] + spool->len;
+    spool->len += size;
+    return buf;
+}
+
+// .. c:function::
+static
+void
+_ch_sp_commit(ch_spool_t* spool)
+//    :noindex:
+//
+//    see: :c:func:`_ch_sp_commit`
+//
+// .. code-block:: cpp
+//
+{
+    int tmp_err;
+    ch_message_t* msg;
+    ch_chirp_t* chirp = spool->chirp;
+    if(spool->flags & CH_SP_COMMITTING || spool->len == 0)
+        return;
+    if(spool->current->size >= spool->segment_size) {
+        tmp_err = _ch_sp_open(spool, spool->current->seq + 1);
+        if(tmp_err != CH_SUCCESS) {
+            /* The records are still durable in the current segment, the
+             * rotation is tried again on the next commit.
+             */
+            E(
+                chirp,
+                "Could not rotate spool segment %llx: %d. ch_chirp_t:%p",
+                (unsigned long long) spool->current->seq,
+                tmp_err,
+                (void*) chirp
+            );
+        }
+    }
+    for(msg = spool->wait_head; msg != NULL; msg = msg->_next) {
+        msg->_spool = spool->current;
+        spool->current->live += 1;
+    }
+    spool->commit_head = spool->wait_head;
+    spool->wait_head   = NULL;
+    spool->wait_tail   = NULL;
+    spool->commit_buf  = uv_buf_init(spool->bufs[spool->cur], spool->len);
+    spool->cur        ^= 1;
+    spool->len         = 0;
+    spool->flags      |= CH_SP_COMMITTING;
+    spool->req.data    = spool;
+    tmp_err = uv_fs_write(
+        chirp->_->loop,
+        &spool->req,
+        spool->file,
+        &spool->commit_buf,
+        1,
+        spool->current->size,
+        _ch_sp_write_cb
+    );
+    if(tmp_err < 0) {
+        E(
+            chirp,
+            "Could not write spool: %d. ch_chirp_t:%p",
+            tmp_err,
+            (void*) chirp
+        );
+        _ch_sp_committed(spool, tmp_err);
+    }
+}
+
+// .. c:function::
+static
+void
+_ch_sp_committed(ch_spool_t* spool, int status)
+//    :noindex:
+//
+//    see: :c:func:`_ch_sp_committed`
+//
+// .. code-block:: cpp
+//
+{
+    ch_message_t* msg;
+    ch_chirp_t* chirp = spool->chirp;
+    spool->flags &= ~CH_SP_COMMITTING;
+    if(status == 0)
+        _ch_sp_unlink_replayed(spool);
+    if(spool->flags & CH_SP_STOPPING) {
+        _ch_sp_finish(spool);
+        chirp->_->closing_tasks -= 1;
+        return;
+    }
+    while(spool->commit_head != NULL) {
+        msg = spool->commit_head;
+        spool->commit_head = msg->_next;
+        if(status < 0) {
+            ch_sp_trim(spool, msg);
+            msg->_send_cb(chirp, msg, CH_UV_ERROR, 0);
+        } else
+            ch_wr_enqueue(chirp, msg);
+    }
+    _ch_sp_commit(spool);
+}
+
+// .. c:function::
+static
+void
+_ch_sp_finish(ch_spool_t* spool)
+//    :noindex:
+//
+//    see: :c:func:`_ch_sp_finish`
+//
+// .. code-block:: cpp
+//
+{
+    int i;
+    int tmp_err;
+    uv_fs_t req;
+    uv_buf_t buf;
+    ch_message_t* msg;
+    ch_sp_segment_t* seg;
+    ch_chirp_t* chirp = spool->chirp;
+    uv_loop_t* loop = chirp->_->loop;
+    int pending = spool->commit_head != NULL || spool->wait_head != NULL;
+    if(spool->file != -1) {
+        if(spool->len > 0) {
+            buf = uv_buf_init(spool->bufs[spool->cur], spool->len);
+            tmp_err = uv_fs_write(
+                loop,
+                &req,
+                spool->file,
+                &buf,
+                1,
+                spool->current->size,
+                NULL
+            );
+            uv_fs_req_cleanup(&req);
+            if(tmp_err >= 0) {
+                tmp_err = uv_fs_fdatasync(loop, &req, spool->file, NULL);
+                uv_fs_req_cleanup(&req);
+            }
+            if(tmp_err < 0) {
+                E(
+                    chirp,
+                    "Could not write spool: %d. ch_chirp_t:%p",
+                    tmp_err,
+                    (void*) chirp
+                );
+            } else
+                _ch_sp_unlink_replayed(spool);
+        }
+        uv_fs_close(loop, &req, spool->file, NULL);
+        uv_fs_req_cleanup(&req);
+        spool->file = -1;
+        if(
+                spool->current->live == 0 &&
+                spool->segments == spool->current &&
+                !pending
+        )
+            _ch_sp_unlink(spool, spool->current->seq);
+    }
+    while(spool->commit_head != NULL) {
+        msg = spool->commit_head;
+        spool->commit_head = msg->_next;
+        msg->_send_cb(chirp, msg, CH_UNINIT, 0);
+    }
+    while(spool->wait_head != NULL) {
+        msg = spool->wait_head;
+        spool->wait_head = msg->_next;
+        msg->_send_cb(chirp, msg, CH_UNINIT, 0);
+    }
+    spool->wait_tail = NULL;
+    while(spool->segments != NULL) {
+        seg = spool->segments;
+        spool->segments = seg->next;
+        ch_free(seg);
+    }
+    spool->current = NULL;
+    for(i = 0; i < 2; i++) {
+        if(spool->bufs[i] != NULL)
+            ch_free(spool->bufs[i]);
+        spool->bufs[i] = NULL;
+    }
+    if(spool->replayed != NULL)
+        ch_free(spool->replayed);
+    spool->replayed = NULL;
+}
+
+// .. c:function::
+static
+ch_error_t
+_ch_sp_load(ch_spool_t* spool, ch_message_t** head)
+//    :noindex:
+//
+//    see: :c:func:`_ch_sp_load`
+//
+// .. code-block:: cpp
+//
+{
+    int tmp_err;
+    size_t i;
+    uint64_t seq;
+    uv_fs_t req;
+    uv_dirent_t ent;
+    ch_message_t* tail = NULL;
+    ch_sp_replay_t* tree = NULL;
+    ch_chirp_t* chirp = spool->chirp;
+    tmp_err = uv_fs_scandir(
+        chirp->_->loop,
+        &req,
+        chirp->_->config.SPOOL_DIR,
+        0,
+        NULL
+    );
+    if(tmp_err < 0) {
+        uv_fs_req_cleanup(&req);
+        E(
+            chirp,
+            "Could not read spool directory: %d. ch_chirp_t:%p",
+            tmp_err,
+            (void*) chirp
+        );
+        return CH_UV_ERROR;
+    }
+    spool->replayed = ch_alloc(sizeof(uint64_t) * (tmp_err + 1));
+    if(!spool->replayed) {
+        uv_fs_req_cleanup(&req);
+        E(
+            chirp,
+            "Could not allocate memory for spool. ch_chirp_t:%p",
+            (void*) chirp
+        );
+        return CH_ENOMEM;
+    }
+    while(uv_fs_scandir_next(&req, &ent) != UV_EOF) {
+        if(_ch_sp_parse_name(ent.name, &seq))
+            spool->replayed[spool->replayed_count++] = seq;
+    }
+    uv_fs_req_cleanup(&req);
+    qsort(
+        spool->replayed,
+        spool->replayed_count,
+        sizeof(uint64_t),
+        _ch_sp_seq_cmp
+    );
+    *head = NULL;
+    for(i = 0; i < spool->replayed_count; i++) {
+        tmp_err = _ch_sp_load_segment(
+            spool,
+            spool->replayed[i],
+            &tree,
+            head,
+            &tail
+        );
+        if(tmp_err != CH_SUCCESS) {
+            while(*head != NULL) {
+                ch_message_t* msg = *head;
+                *head = msg->_next;
+                ch_free(msg);
+            }
+            return tmp_err;
+        }
+    }
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+static
+ch_error_t
+_ch_sp_load_segment(
+        ch_spool_t* spool,
+        uint64_t seq,
+        ch_sp_replay_t** tree,
+        ch_message_t** head,
+        ch_message_t** tail
+)
+//    :noindex:
+//
+//    see: :c:func:`_ch_sp_load_segment`
+//
+// .. code-block:: cpp
+//
+{
+    int tmp_err;
+    uv_fs_t req;
+    uv_buf_t buf;
+    uv_file file;
+    char* data;
+    size_t size;
+    size_t pos = 0;
+    char path[PATH_MAX];
+    ch_chirp_t* chirp = spool->chirp;
+    uv_loop_t* loop = chirp->_->loop;
+    if(!_ch_sp_path(spool, seq, path, sizeof(path)))
+        return CH_VALUE_ERROR;
+    file = uv_fs_open(loop, &req, path, O_RDONLY, 0, NULL);
+    uv_fs_req_cleanup(&req);
+    if(file < 0) {
+        E(
+            chirp,
+            "Could not open spool segment %llx: %d. ch_chirp_t:%p",
+            (unsigned long long) seq,
+            file,
+            (void*) chirp
+        );
+        return CH_UV_ERROR;
+    }
+    tmp_err = uv_fs_fstat(loop, &req, file, NULL);
+    size    = req.statbuf.st_size;
+    uv_fs_req_cleanup(&req);
+    data = tmp_err < 0 ? NULL : ch_alloc(size + 1);
+    while(data != NULL && pos < size) {
+        buf = uv_buf_init(data + pos, size - pos);
+        tmp_err = uv_fs_read(loop, &req, file, &buf, 1, pos, NULL);
+        uv_fs_req_cleanup(&req);
+        if(tmp_err <= 0)
+            break;
+        pos += tmp_err;
+    }
+    uv_fs_close(loop, &req, file, NULL);
+    uv_fs_req_cleanup(&req);
+    if(data == NULL || pos < size) {
+        E(
+            chirp,
+            "Could not read spool segment %llx: %d. ch_chirp_t:%p",
+            (unsigned long long) seq,
+            tmp_err,
+            (void*) chirp
+        );
+        if(data == NULL)
+            return CH_ENOMEM;
+        ch_free(data);
+        return CH_UV_ERROR;
+    }
+    tmp_err = _ch_sp_parse(spool, data, size, tree, head, tail);
+    ch_free(data);
+    return tmp_err;
+}
+
+// .. c:function::
+static
+ch_error_t
+_ch_sp_open(ch_spool_t* spool, uint64_t seq)
+//    :noindex:
+//
+//    see: :c:func:`_ch_sp_open`
+//
+// .. code-block:: cpp
+//
+{
+    uv_fs_t req;
+    uv_file file;
+    char path[PATH_MAX];
+    ch_sp_segment_t* seg;
+    ch_sp_segment_t* old = spool->current;
+    ch_chirp_t* chirp = spool->chirp;
+    uv_loop_t* loop = chirp->_->loop;
+    if(!_ch_sp_path(spool, seq, path, sizeof(path)))
+        return CH_VALUE_ERROR;
+    seg = ch_alloc(sizeof(ch_sp_segment_t));
+    if(!seg) {
+        E(
+            chirp,
+            "Could not allocate memory for spool. ch_chirp_t:%p",
+            (void*) chirp
+        );
+        return CH_ENOMEM;
+    }
+    file = uv_fs_open(
+        loop,
+        &req,
+        path,
+        O_WRONLY | O_CREAT | O_TRUNC,
+        0600,
+        NULL
+    );
+    uv_fs_req_cleanup(&req);
+    if(file < 0) {
+        E(
+            chirp,
+            "Could not open spool segment %llx: %d. ch_chirp_t:%p",
+            (unsigned long long) seq,
+            file,
+            (void*) chirp
+        );
+        ch_free(seg);
+        return CH_UV_ERROR;
+    }
+    memset(seg, 0, sizeof(ch_sp_segment_t));
+    seg->seq = seq;
+    if(old == NULL)
+        spool->segments = seg;
+    else {
+        old->next = seg;
+        uv_fs_close(loop, &req, spool->file, NULL);
+        uv_fs_req_cleanup(&req);
+    }
+    spool->file    = file;
+    spool->current = seg;
+    if(old != NULL)
+        _ch_sp_reclaim(spool);
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+static
+ch_error_t
+_ch_sp_parse(
+        ch_spool_t* spool,
+        char* buf,
+        size_t size,
+        ch_sp_replay_t** tree,
+        ch_message_t** head,
+        ch_message_t** tail
+)
+//    :noindex:
+//
+//    see: :c:func:`_ch_sp_parse`
+//
+// .. code-block:: cpp
+//
+{
+    uint16_t tmp16;
+    uint32_t tmp32;
+    uint32_t len;
+    char* rec;
+    size_t pos = 0;
+    ch_sp_replay_t search;
+    ch_sp_replay_t* replay;
+    ch_message_t* msg;
+    ch_chirp_t* chirp = spool->chirp;
+    while(pos + CH_SP_DONE_SIZE <= size) {
+        rec = buf + pos;
+        memcpy(&tmp32, rec, 4);
+        len = ntohl(tmp32);
+        if(len < CH_SP_DONE_SIZE || len > size - pos)
+            break;
+        if(rec[4] == CH_SP_DONE && len == CH_SP_DONE_SIZE) {
+            memcpy(search.msg.serial, rec + 5, 16);
+            replay = sglib_ch_sp_replay_t_find_member(*tree, &search);
+            if(replay != NULL)
+                replay->done = 1;
+        } else if(rec[4] == CH_SP_ADD && len >= CH_SP_ADD_SIZE) {
+            memcpy(search.msg.serial, rec + 5, 16);
+            if(sglib_ch_sp_replay_t_find_member(*tree, &search) != NULL) {
+                pos += len;
+                continue;
+            }
+            replay = ch_alloc(sizeof(ch_sp_replay_t) + len - CH_SP_ADD_SIZE);
+            if(!replay) {
+                E(
+                    chirp,
+                    "Could not allocate memory for spool. ch_chirp_t:%p",
+                    (void*) chirp
+                );
+                return CH_ENOMEM;
+            }
+            memset(replay, 0, sizeof(ch_sp_replay_t));
+            msg = &replay->msg;
+            memcpy(msg->serial, rec + 5, 16);
+            memcpy(msg->identity, rec + 21, 16);
+            msg->message_type = rec[37];
+            msg->ip_protocol  = rec[38];
+            memcpy(msg->address, rec + 39, 16);
+            memcpy(&tmp32, rec + 55, 4);
+            msg->port = ntohl(tmp32);
+            memcpy(&tmp16, rec + 59, 2);
+            msg->header_len = ntohs(tmp16);
+            memcpy(&tmp16, rec + 61, 2);
+            msg->actor_len = ntohs(tmp16);
+            memcpy(&tmp32, rec + 63, 4);
+            msg->data_len = ntohl(tmp32);
+            if(
+                    (uint64_t) msg->header_len + msg->actor_len +
+                    msg->data_len != len - CH_SP_ADD_SIZE
+            ) {
+                ch_free(replay);
+                break;
+            }
+            memcpy(replay + 1, rec + CH_SP_ADD_SIZE, len - CH_SP_ADD_SIZE);
+            msg->header = (ch_buf*) (replay + 1);
+            msg->actor  = msg->header + msg->header_len;
+            msg->data   = msg->actor + msg->actor_len;
+            sglib_ch_sp_replay_t_add(tree, replay);
+            if(*tail == NULL)
+                *head = msg;
+            else
+                (*tail)->_next = msg;
+            *tail = msg;
+        } else
+            break;
+        pos += len;
+    }
+    if(pos < size) {
+        L(
+            chirp,
+            "Spool segment ends with %d invalid bytes. ch_chirp_t:%p",
+            (int) (size - pos),
+            (void*) chirp
+        );
+    }
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+static
+ch_inline
+int
+_ch_sp_parse_name(const char* name, uint64_t* seq)
+//    :noindex:
+//
+//    see: :c:func:`_ch_sp_parse_name`
+//
+// .. code-block:: cpp
+//
+{
+    char* end;
+    if(strlen(name) != 22 || strcmp(name + 16, ".spool") != 0)
+        return 0;
+    *seq = strtoull(name, &end, 16);
+    return end == name + 16;
+}
+
+// .. c:function::
+static
+ch_inline
+int
+_ch_sp_path(ch_spool_t* spool, uint64_t seq, char* path, size_t size)
+//    :noindex:
+//
+//    see: :c:func:`_ch_sp_path`
+//
+// .. code-block:: cpp
+//
+{
+    int len = snprintf(
+        path,
+        size,
+        "%s/%016llx.spool",
+        spool->chirp->_->config.SPOOL_DIR,
+        (unsigned long long) seq
+    );
+    return len > 0 && (size_t) len < size;
+}
+
+// .. c:function::
+static
+void
+_ch_sp_reclaim(ch_spool_t* spool)
+//    :noindex:
+//
+//    see: :c:func:`_ch_sp_reclaim`
+//
+// .. code-block:: cpp
+//
+{
+    ch_sp_segment_t* seg;
+    while(
+            spool->segments != spool->current &&
+            spool->segments->live == 0
+    ) {
+        seg = spool->segments;
+        spool->segments = seg->next;
+        _ch_sp_unlink(spool, seg->seq);
+        ch_free(seg);
+    }
+}
+
+// .. c:function::
+static
+void
+_ch_sp_replay_cb(
+        ch_chirp_t* chirp,
+        ch_message_t* msg,
+        int status,
+        float load
+)
+//    :noindex:
+//
+//    see: :c:func:`_ch_sp_replay_cb`
+//
+// .. code-block:: cpp
+//
+{
+    (void)(load);
+    if(status != CH_SUCCESS && status != CH_UNINIT) {
+        E(
+            chirp,
+            "Could not send spooled message: %d. ch_chirp_t:%p",
+            status,
+            (void*) chirp
+        );
+    }
+    ch_free(msg);
+}
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_sp_schedule(ch_spool_t* spool)
+//    :noindex:
+//
+//    see: :c:func:`_ch_sp_schedule`
+//
+// .. code-block:: cpp
+//
+{
+    int tmp_err;
+    ch_chirp_t* chirp = spool->chirp;
+    if(
+            spool->flags & CH_SP_COMMITTING ||
+            uv_is_active((uv_handle_t*) &spool->timer)
+    )
+        return;
+    tmp_err = uv_timer_start(&spool->timer, _ch_sp_timer_cb, 0, 0);
+    if(tmp_err != CH_SUCCESS) {
+        E(
+            chirp,
+            "Starting spool timer failed: %d. ch_chirp_t:%p",
+            tmp_err,
+            (void*) chirp
+        );
+    }
+}
+
+// .. c:function::
+static
+int
+_ch_sp_seq_cmp(const void* x, const void* y)
+//    :noindex:
+//
+//    see: :c:func:`_ch_sp_seq_cmp`
+//
+// .. code-block:: cpp
+//
+{
+    uint64_t a = *(const uint64_t*) x;
+    uint64_t b = *(const uint64_t*) y;
+    return (a > b) - (a < b);
+}
+
+// .. c:function::
+static
+void
+_ch_sp_sync_cb(uv_fs_t* req)
+//    :noindex:
+//
+//    see: :c:func:`_ch_sp_sync_cb`
+//
+// .. code-block:: cpp
+//
+{
+    ch_spool_t* spool = req->data;
+    ch_chirp_t* chirp = spool->chirp;
+    int status = req->result;
+    uv_fs_req_cleanup(req);
+    if(status < 0) {
+        E(
+            chirp,
+            "Could not sync spool: %d. ch_chirp_t:%p",
+            status,
+            (void*) chirp
+        );
+    }
+    _ch_sp_committed(spool, status);
+}
+
+// .. c:function::
+static
+void
+_ch_sp_timer_cb(uv_timer_t* handle)
+//    :noindex:
+//
+//    see: :c:func:`_ch_sp_timer_cb`
+//
+// .. code-block:: cpp
+//
+{
+    CH_GET_CHIRP(handle);
+    _ch_sp_commit(&chirp->_->spool);
+}
+
+// .. c:function::
+static
+void
+_ch_sp_unlink(ch_spool_t* spool, uint64_t seq)
+//    :noindex:
+//
+//    see: :c:func:`_ch_sp_unlink`
+//
+// .. code-block:: cpp
+//
+{
+    int tmp_err;
+    uv_fs_t req;
+    char path[PATH_MAX];
+    ch_chirp_t* chirp = spool->chirp;
+    if(!_ch_sp_path(spool, seq, path, sizeof(path)))
+        return;
+    tmp_err = uv_fs_unlink(chirp->_->loop, &req, path, NULL);
+    uv_fs_req_cleanup(&req);
+    if(tmp_err < 0) {
+        E(
+            chirp,
+            "Could not delete spool segment %llx: %d. ch_chirp_t:%p",
+            (unsigned long long) seq,
+            tmp_err,
+            (void*) chirp
+        );
+    }
+}
+
+// .. c:function::
+static
+void
+_ch_sp_unlink_replayed(ch_spool_t* spool)
+//    :noindex:
+//
+//    see: :c:func:`_ch_sp_unlink_replayed`
+//
+// .. code-block:: cpp
+//
+{
+    size_t i;
+    if(spool->replayed == NULL)
+        return;
+    for(i = 0; i < spool->replayed_count; i++)
+        _ch_sp_unlink(spool, spool->replayed[i]);
+    ch_free(spool->replayed);
+    spool->replayed       = NULL;
+    spool->replayed_count = 0;
+}
+
+// .. c:function::
+static
+void
+_ch_sp_write_cb(uv_fs_t* req)
+//    :noindex:
+//
+//    see: :c:func:`_ch_sp_write_cb`
+//
+// .. code-block:: cpp
+//
+{
+    int tmp_err;
+    ch_spool_t* spool = req->data;
+    ch_chirp_t* chirp = spool->chirp;
+    ssize_t result = req->result;
+    uv_fs_req_cleanup(req);
+    /* A partial write is overwritten by the next commit, a partial record
+     * would hide the records after it.
+     */
+    if(result < 0 || (size_t) result != spool->commit_buf.len) {
+        E(
+            chirp,
+            "Could not write spool: %d. ch_chirp_t:%p",
+            (int) result,
+            (void*) chirp
+        );
+        _ch_sp_committed(spool, result < 0 ? (int) result : UV_EIO);
+        return;
+    }
+    spool->current->size += result;
+    if(spool->commit_head == NULL) {
+        _ch_sp_committed(spool, 0);
+        return;
+    }
+    req->data = spool;
+    tmp_err = uv_fs_fdatasync(
+        chirp->_->loop,
+        req,
+        spool->file,
+        _ch_sp_sync_cb
+    );
+    if(tmp_err < 0) {
+        E(
+            chirp,
+            "Could not sync spool: %d. ch_chirp_t:%p",
+            tmp_err,
+            (void*) chirp
+        );
+        _ch_sp_committed(spool, tmp_err);
+    }
+}
+
+// .. c:function::
+void
+ch_sp_add(ch_spool_t* spool, ch_message_t* msg)
+//    :noindex:
+//
+//    see: :c:func:`ch_sp_add`
+//
+// .. code-block:: cpp
+//
+{
+    uint16_t tmp16;
+    uint32_t tmp32;
+    char* rec;
+    ch_chirp_t* chirp = spool->chirp;
+    size_t len = msg->header_len + msg->actor_len + msg->data_len;
+    msg->_spool = NULL;
+    rec = _ch_sp_append(spool, CH_SP_ADD_SIZE + len);
+    if(rec == NULL) {
+        E(
+            chirp,
+            "Could not allocate memory for spool. ch_chirp_t:%p",
+            (void*) chirp
+        );
+        ch_wr_enqueue(chirp, msg);
+        return;
+    }
+    tmp32 = htonl(CH_SP_ADD_SIZE + len);
+    memcpy(rec, &tmp32, 4);
+    rec[4] = CH_SP_ADD;
+    memcpy(rec + 5, msg->serial, 16);
+    memcpy(rec + 21, msg->identity, 16);
+    rec[37] = msg->message_type;
+    rec[38] = msg->ip_protocol;
+    memcpy(rec + 39, msg->address, 16);
+    tmp32 = htonl(msg->port);
+    memcpy(rec + 55, &tmp32, 4);
+    tmp16 = htons(msg->header_len);
+    memcpy(rec + 59, &tmp16, 2);
+    tmp16 = htons(msg->actor_len);
+    memcpy(rec + 61, &tmp16, 2);
+    tmp32 = htonl(msg->data_len);
+    memcpy(rec + 63, &tmp32, 4);
+    rec += CH_SP_ADD_SIZE;
+    if(msg->header_len > 0)
+        memcpy(rec, msg->header, msg->header_len);
+    rec += msg->header_len;
+    if(msg->actor_len > 0)
+        memcpy(rec, msg->actor, msg->actor_len);
+    rec += msg->actor_len;
+    if(msg->data_len > 0)
+        memcpy(rec, msg->data, msg->data_len);
+    msg->_next = NULL;
+    if(spool->wait_tail == NULL)
+        spool->wait_head = msg;
+    else
+        spool->wait_tail->_next = msg;
+    spool->wait_tail = msg;
+    _ch_sp_schedule(spool);
+}
+
+// .. c:function::
+ch_error_t
+ch_sp_start(ch_spool_t* spool)
+//    :noindex:
+//
+//    see: :c:func:`ch_sp_start`
+//
+// .. code-block:: cpp
+//
+{
+    int i;
+    int tmp_err;
+    uv_fs_t req;
+    uint64_t seq;
+    ch_message_t* msg;
+    ch_message_t* head;
+    ch_chirp_t* chirp = spool->chirp;
+    ch_chirp_int_t* ichirp = chirp->_;
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    tmp_err = uv_timer_init(ichirp->loop, &spool->timer);
+    if(tmp_err != CH_SUCCESS) {
+        E(
+            chirp,
+            "Initializing spool timer failed: %d. ch_chirp_t:%p",
+            tmp_err,
+            (void*) chirp
+        );
+        return CH_UV_ERROR;
+    }
+    spool->timer.data = chirp;
+    if(ichirp->config.SPOOL_DIR == NULL)
+        return CH_SUCCESS;
+    for(i = 0; i < 2; i++) {
+        spool->bufs[i] = ch_alloc(CH_SP_BUFFER_SIZE);
+        spool->caps[i] = CH_SP_BUFFER_SIZE;
+    }
+    tmp_err = uv_fs_mkdir(
+        ichirp->loop,
+        &req,
+        ichirp->config.SPOOL_DIR,
+        0700,
+        NULL
+    );
+    uv_fs_req_cleanup(&req);
+    if(tmp_err < 0 && tmp_err != UV_EEXIST) {
+        E(
+            chirp,
+            "Could not create spool directory: %d. ch_chirp_t:%p",
+            tmp_err,
+            (void*) chirp
+        );
+        tmp_err = CH_UV_ERROR;
+    } else if(spool->bufs[0] == NULL || spool->bufs[1] == NULL) {
+        E(
+            chirp,
+            "Could not allocate memory for spool. ch_chirp_t:%p",
+            (void*) chirp
+        );
+        tmp_err = CH_ENOMEM;
+    } else
+        tmp_err = _ch_sp_load(spool, &head);
+    if(tmp_err == CH_SUCCESS) {
+        seq = spool->replayed_count > 0 ?
+            spool->replayed[spool->replayed_count - 1] + 1 :
+            1;
+        tmp_err = _ch_sp_open(spool, seq);
+        if(tmp_err != CH_SUCCESS) {
+            while(head != NULL) {
+                msg  = head;
+                head = msg->_next;
+                ch_free(msg);
+            }
+        }
+    }
+    if(tmp_err != CH_SUCCESS) {
+        _ch_sp_finish(spool);
+        return tmp_err;
+    }
+    while(head != NULL) {
+        msg  = head;
+        head = msg->_next;
+        if(((ch_sp_replay_t*) msg)->done) {
+            ch_free(msg);
+            continue;
+        }
+        msg->_send_cb = _ch_sp_replay_cb;
+        msg->_retries = 0;
+        ch_sp_add(spool, msg);
+    }
+    /* Nothing to send again: the segments of the last run are obsolete. */
+    if(spool->wait_head == NULL)
+        _ch_sp_unlink_replayed(spool);
+    else
+        L(
+            chirp,
+            "Sending spooled messages again. ch_chirp_t:%p",
+            (void*) chirp
+        );
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+void
+ch_sp_stop(ch_spool_t* spool)
+//    :noindex:
+//
+//    see: :c:func:`ch_sp_stop`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t* chirp = spool->chirp;
+    uv_timer_stop(&spool->timer);
+    uv_close((uv_handle_t*) &spool->timer, ch_chirp_close_cb);
+    chirp->_->closing_tasks += 1;
+    if(spool->flags & CH_SP_COMMITTING) {
+        /* The thread pool is writing, the commit finishes the spool. */
+        spool->flags |= CH_SP_STOPPING;
+        chirp->_->closing_tasks += 1;
+        return;
+    }
+    _ch_sp_finish(spool);
+}
+
+// .. c:function::
+void
+ch_sp_trim(ch_spool_t* spool, ch_message_t* msg)
+//    :noindex:
+//
+//    see: :c:func:`ch_sp_trim`
+//
+// .. code-block:: cpp
+//
+{
+    uint32_t tmp32;
+    char* rec;
+    ch_sp_segment_t* seg = msg->_spool;
+    msg->_spool = NULL;
+    if(spool->file == -1)
+        return;
+    seg->live -= 1;
+    if(seg->live == 0 && seg == spool->segments && seg != spool->current) {
+        /* The segment of the message is deleted, no done record needed. */
+        _ch_sp_reclaim(spool);
+        return;
+    }
+    rec = _ch_sp_append(spool, CH_SP_DONE_SIZE);
+    if(rec == NULL) {
+        /* The message is sent again after a restart, which is allowed. */
+        E(
+            spool->chirp,
+            "Could not allocate memory for spool. ch_chirp_t:%p",
+            (void*) spool->chirp
+        );
+        return;
+    }
+    tmp32 = htonl(CH_SP_DONE_SIZE);
+    memcpy(rec, &tmp32, 4);
+    rec[4] = CH_SP_DONE;
+    memcpy(rec + 5, msg->serial, 16);
+    _ch_sp_schedule(spool);
+}
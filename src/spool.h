@@ -0,0 +1,377 @@
+// ============
+// Spool header
+// ============
+//
+// Write-ahead spool of outbound messages, enabled by
+// :c:member:`ch_config_t.SPOOL_DIR`. A message sent is appended to the spool
+// and only queued on its connection once the spool has been synced, so it
+// survives a restart until it is acknowledged. When the message is done, a
+// done record is appended. On start, messages without a done record are
+// sent again, with their original serial.
+//
+// The spool is a sequence of append-only segment files. Records are collected
+// in a buffer and written and synced on the libuv thread pool (group commit):
+// a commit starts in the next loop iteration, and messages sent while a
+// commit is running go into the next one, so one sync covers a batch. A
+// segment is deleted when all its messages are done and all older segments
+// are deleted, since it can hold the done records of their messages.
+//
+// Records (integers in network order)::
+//
+//    add:  len:4 type:1 serial:16 identity:16 message_type:1 ip_protocol:1
+//          address:16 port:4 header_len:2 actor_len:2 data_len:4
+//          header actor data
+//    done: len:4 type:1 serial:16
+//
+// .. code-block:: cpp
+//
+#ifndef ch_spool_h
+#define ch_spool_h
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "common.h"
+#include "libchirp/chirp.h"
+#include "libchirp/message.h"
+#include "sglib.h"
+
+// Declarations
+// ============
+
+// .. c:macro:: CH_SP_SEGMENT_SIZE
+//
+//    A new segment is started when the current one reaches this size.
+//
+// .. c:macro:: CH_SP_BUFFER_SIZE
+//
+//    Initial size of the record buffers, they grow as needed.
+//
+// .. c:macro:: CH_SP_ADD_SIZE
+//
+//    Size of an add record without header, actor and data.
+//
+// .. c:macro:: CH_SP_DONE_SIZE
+//
+//    Size of a done record.
+//
+// .. code-block:: cpp
+//
+#define CH_SP_SEGMENT_SIZE (64 * 1024 * 1024)
+#define CH_SP_BUFFER_SIZE (64 * 1024)
+#define CH_SP_ADD_SIZE 67
+#define CH_SP_DONE_SIZE 21
+
+// .. c:type:: ch_sp_record_type_t
+//
+//    Types of spool records.
+//
+//    .. c:member:: CH_SP_ADD
+//
+//       A message was sent.
+//
+//    .. c:member:: CH_SP_DONE
+//
+//       The message with the serial is done.
+//
+// .. code-block:: cpp
+//
+typedef enum {
+    CH_SP_ADD  = 1,
+    CH_SP_DONE = 2,
+} ch_sp_record_type_t;
+
+// .. c:type:: ch_sp_flags_t
+//
+//    Flags of the spool.
+//
+//    .. c:member:: CH_SP_COMMITTING
+//
+//       A commit is running on the thread pool.
+//
+//    .. c:member:: CH_SP_STOPPING
+//
+//       Chirp is closing, the running commit finishes the spool.
+//
+// .. code-block:: cpp
+//
+typedef enum {
+    CH_SP_COMMITTING = 1 << 0,
+    CH_SP_STOPPING   = 1 << 1,
+} ch_sp_flags_t;
+
+// .. c:type:: ch_sp_segment_t
+//
+//    A segment file of the spool.
+//
+//    .. c:member:: uint64_t seq
+//
+//       Sequence number of the segment, which is its file name.
+//
+//    .. c:member:: uint64_t size
+//
+//       Bytes committed to the segment.
+//
+//    .. c:member:: uint32_t live
+//
+//       Count of messages in the segment that are not done.
+//
+//    .. c:member:: struct ch_sp_segment_s* next
+//
+//       The next (newer) segment.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_sp_segment_s {
+    uint64_t                seq;
+    uint64_t                size;
+    uint32_t                live;
+    struct ch_sp_segment_s* next;
+} ch_sp_segment_t;
+
+// .. c:type:: ch_sp_replay_t
+//
+//    A message read from the spool on start, implemented as red-black tree
+//    keyed by the serial, so done records can remove it. Header, actor and
+//    data follow the structure.
+//
+//    .. c:member:: ch_message_t msg
+//
+//       The message, messages read are linked in order by
+//       :c:member:`ch_message_t._next`.
+//
+//    .. c:member:: char done
+//
+//       A done record of the message was read.
+//
+//    .. c:member:: char color_field
+//
+//       The color of the current node. This may either be red or black.
+//
+//    .. c:member:: struct ch_sp_replay_s* left
+//
+//       Left child in the red-black tree.
+//
+//    .. c:member:: struct ch_sp_replay_s* right
+//
+//       Right child in the red-black tree.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_sp_replay_s {
+    ch_message_t           msg;
+    char                   done;
+    char                   color_field;
+    struct ch_sp_replay_s* left;
+    struct ch_sp_replay_s* right;
+} ch_sp_replay_t;
+
+// .. c:type:: ch_spool_t
+//
+//    Spool object.
+//
+//    .. c:member:: uv_timer_t timer
+//
+//       Starts the commit in the next loop iteration.
+//
+//    .. c:member:: uv_fs_t req
+//
+//       Request of the running write or sync.
+//
+//    .. c:member:: uv_buf_t commit_buf
+//
+//       The records being written.
+//
+//    .. c:member:: uv_file file
+//
+//       File of the current segment, -1 if the spool is disabled.
+//
+//    .. c:member:: ch_sp_segment_t* segments
+//
+//       The segments, oldest first, the last one is current.
+//
+//    .. c:member:: ch_sp_segment_t* current
+//
+//       The segment records are written to.
+//
+//    .. c:member:: uint64_t segment_size
+//
+//       A new segment is started when the current one reaches this size,
+//       :c:macro:`CH_SP_SEGMENT_SIZE` by default.
+//
+//    .. c:member:: char* bufs[2]
+//
+//       The record buffers: one collects records while the other is being
+//       committed.
+//
+//    .. c:member:: size_t caps[2]
+//
+//       Sizes of the buffers.
+//
+//    .. c:member:: size_t len
+//
+//       Bytes collected in the buffer :c:member:`cur`.
+//
+//    .. c:member:: int cur
+//
+//       Index of the buffer collecting records.
+//
+//    .. c:member:: ch_message_t* wait_head
+//
+//       First message waiting for the next commit, linked by
+//       :c:member:`ch_message_t._next`.
+//
+//    .. c:member:: ch_message_t* wait_tail
+//
+//       Last message waiting for the next commit.
+//
+//    .. c:member:: ch_message_t* commit_head
+//
+//       Messages of the running commit, sent when it is synced.
+//
+//    .. c:member:: uint64_t* replayed
+//
+//       Sequence numbers of the segments found on start. They are deleted
+//       after the first commit, which contains their messages again.
+//
+//    .. c:member:: size_t replayed_count
+//
+//       Count of :c:member:`replayed`.
+//
+//    .. c:member:: uint8_t flags
+//
+//       See :c:type:`ch_sp_flags_t`.
+//
+//    .. c:member:: ch_chirp_t* chirp
+//
+//       Pointer to the chirp object. See: :c:type:`ch_chirp_t`.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_spool_s {
+    uv_timer_t       timer;
+    uv_fs_t          req;
+    uv_buf_t         commit_buf;
+    uv_file          file;
+    ch_sp_segment_t* segments;
+    ch_sp_segment_t* current;
+    uint64_t         segment_size;
+    char*            bufs[2];
+    size_t           caps[2];
+    size_t           len;
+    int              cur;
+    ch_message_t*    wait_head;
+    ch_message_t*    wait_tail;
+    ch_message_t*    commit_head;
+    uint64_t*        replayed;
+    size_t           replayed_count;
+    uint8_t          flags;
+    ch_chirp_t*      chirp;
+} ch_spool_t;
+
+// .. c:function::
+void
+ch_sp_add(ch_spool_t* spool, ch_message_t* msg);
+//
+//    Append the message to the spool. It is queued on its connection, see
+//    :c:func:`ch_wr_enqueue`, after the spool has been synced.
+//
+//    :param ch_spool_t* spool: The spool.
+//    :param ch_message_t* msg: The message to send.
+
+// .. c:function::
+ch_error_t
+ch_sp_start(ch_spool_t* spool);
+//
+//    Start the spool. If :c:member:`ch_config_t.SPOOL_DIR` is set, open the
+//    spool and send the messages of the last run that are not done.
+//
+//    :param ch_spool_t* spool: Spool which shall be started.
+//
+//    :return: A chirp error. see: :c:type:`ch_error_t`
+//    :rtype:  ch_error_t
+
+// .. c:function::
+void
+ch_sp_stop(ch_spool_t* spool);
+//
+//    Stop the spool: commit the records collected and close it. The send
+//    callbacks of the messages waiting for a commit are called with
+//    :c:member:`ch_error_t.CH_UNINIT`, they are sent on the next start.
+//
+//    :param ch_spool_t* spool: Spool which shall be stopped.
+
+// .. c:function::
+void
+ch_sp_trim(ch_spool_t* spool, ch_message_t* msg);
+//
+//    The message is done: append its done record, or delete its segment if
+//    it was the last message of the oldest segment that was not done.
+//
+//    :param ch_spool_t* spool: The spool.
+//    :param ch_message_t* msg: The message done.
+
+// .. c:macro:: CH_SP_REPLAY_CMP
+//
+//    Compare the serials of messages read from the spool.
+//
+// .. code-block:: cpp
+//
+#define CH_SP_REPLAY_CMP(x,y) memcmp(x->msg.serial, y->msg.serial, 16)
+
+// .. code-block:: cpp
+//
+SGLIB_DEFINE_RBTREE_PROTOTYPES( // NOCOV
+    ch_sp_replay_t,
+    left,
+    right,
+    color_field,
+    CH_SP_REPLAY_CMP
+)
+
+// Definitions
+// ===========
+
+// .. c:function::
+static
+ch_inline
+void
+ch_sp_init(ch_chirp_t* chirp, ch_spool_t* spool)
+//
+//    Initialize the spool structure.
+//
+//    :param ch_chirp_t* chirp: Chirp instance.
+//    :param ch_spool_t* spool: Spool to initialize.
+//
+// .. code-block:: cpp
+//
+{
+    memset(spool, 0, sizeof(ch_spool_t));
+    spool->file         = -1;
+    spool->segment_size = CH_SP_SEGMENT_SIZE;
+    spool->chirp        = chirp;
+}
+
+// .. c:function::
+static
+ch_inline
+void
+ch_sp_done(ch_spool_t* spool, ch_message_t* msg)
+//
+//    Trim the message from the spool, if it is spooled. Called when the send
+//    callback of a message is called, except when chirp is closing: those
+//    messages are sent again on the next start.
+//
+//    :param ch_spool_t* spool: The spool.
+//    :param ch_message_t* msg: The message done.
+//
+// .. code-block:: cpp
+//
+{
+    if(msg->_spool != NULL)
+        ch_sp_trim(spool, msg);
+}
+
+#endif //ch_spool_h
@@ -0,0 +1,339 @@
+// ===========
+// Spool etest
+// ===========
+//
+// Replays the write-ahead spool after a restart. A sender chirp with a spool
+// sends X, P and Y to a receiver chirp, which acknowledges X only. Segments
+// are rotated on every commit, so X, its done record and Y end up in
+// different segments. The sender is closed and started again: exactly P and
+// Y have to be sent again.
+//
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "libchirp.h"
+#include "fixture_test.h"
+#include "common.h"
+
+// System includes
+// ===============
+//
+// .. code-block:: cpp
+//
+#include <stdlib.h>
+#include <unistd.h>
+
+// Test functions
+// ==============
+//
+// Not documented on purpose.
+//
+// .. code-block:: cpp
+
+#define CH_SP_TEST_RECV_PORT 59734
+#define CH_SP_TEST_SEND_PORT 59735
+#define CH_SP_TEST_MAX_MSGS 8
+#define CH_SP_TEST_TIMEOUT 5000
+#define CH_SP_TEST_ID_SIZE 16
+
+typedef enum {
+    CH_SP_TEST_SENT    = 0,
+    CH_SP_TEST_ACKED   = 1,
+    CH_SP_TEST_SPOOLED = 2,
+    CH_SP_TEST_CLOSING = 3,
+} ch_sp_test_state_t;
+
+typedef struct ch_sp_test_s {
+    ch_chirp_t         sender;
+    ch_chirp_t         receiver;
+    ch_config_t        send_config;
+    ch_config_t        recv_config;
+    uv_loop_t          loop;
+    uv_timer_t         timer;
+    ch_message_t       msgs[3]; // X, P and Y
+    ch_message_t*      held[CH_SP_TEST_MAX_MSGS];
+    int                held_count;
+    uint8_t            received[CH_SP_TEST_MAX_MSGS][CH_SP_TEST_ID_SIZE];
+    int                received_count;
+    int                replay;
+    int                ticks;
+    int                errors;
+    ch_sp_test_state_t state;
+} ch_sp_test_t;
+
+static ch_sp_test_t _ch_sp_test;
+
+static
+void
+_ch_sp_test_receiver_done_cb(uv_async_t* handle)
+{
+    uv_close((uv_handle_t*) handle, ch_test_close_cb);
+    uv_close((uv_handle_t*) &_ch_sp_test.timer, ch_test_close_cb);
+}
+
+static
+void
+_ch_sp_test_sender_done_cb(uv_async_t* handle)
+{
+    int i;
+    ch_sp_test_t* test = &_ch_sp_test;
+    uv_close((uv_handle_t*) handle, ch_test_close_cb);
+    for(i = 0; i < test->held_count; i++)
+        ch_chirp_release_message(test->held[i]);
+    test->held_count = 0;
+    ch_chirp_close_ts(&test->receiver);
+}
+
+static
+void
+_ch_sp_test_send_cb(
+        ch_chirp_t* chirp,
+        ch_message_t* msg,
+        int status,
+        float load
+)
+{
+    (void)(chirp);
+    (void)(load);
+    ch_sp_test_t* test = &_ch_sp_test;
+    if(msg == &test->msgs[0]) {
+        if(status != CH_SUCCESS) {
+            fprintf(stderr, "Sending X failed: %d\n", status);
+            test->errors += 1;
+        }
+        test->state = CH_SP_TEST_ACKED;
+    } else if(status == CH_SUCCESS) {
+        fprintf(stderr, "Unacknowledged message succeeded\n");
+        test->errors += 1;
+    }
+}
+
+static
+void
+_ch_sp_test_recv_cb(ch_chirp_t* chirp, ch_message_t* msg)
+{
+    (void)(chirp);
+    ch_sp_test_t* test = &_ch_sp_test;
+    if(test->received_count < CH_SP_TEST_MAX_MSGS) {
+        memcpy(
+            test->received[test->received_count],
+            msg->serial,
+            CH_SP_TEST_ID_SIZE
+        );
+    }
+    test->received_count += 1;
+    if(
+            test->replay ||
+            (msg->data_len == 1 && msg->data[0] == 'X') ||
+            test->held_count == CH_SP_TEST_MAX_MSGS
+    )
+        ch_chirp_release_message(msg);
+    else
+        test->held[test->held_count++] = msg;
+}
+
+static
+int
+_ch_sp_test_idle(ch_chirp_t* chirp)
+{
+    ch_spool_t* spool = &chirp->_->spool;
+    return !(spool->flags & CH_SP_COMMITTING) && spool->len == 0;
+}
+
+static
+void
+_ch_sp_test_send(ch_sp_test_t* test, int i, ch_buf* data)
+{
+    ch_message_t* msg = &test->msgs[i];
+    ch_msg_init(msg);
+    ch_msg_set_address(msg, CH_IPV4, "127.0.0.1", CH_SP_TEST_RECV_PORT);
+    msg->data     = data;
+    msg->data_len = 1;
+    ch_chirp_send(&test->sender, msg, _ch_sp_test_send_cb);
+}
+
+static
+void
+_ch_sp_test_timer_cb(uv_timer_t* handle)
+{
+    ch_sp_test_t* test = handle->data;
+    test->ticks += 1;
+    if(test->ticks * 10 > CH_SP_TEST_TIMEOUT) {
+        fprintf(stderr, "Timeout in state %d\n", test->state);
+        test->errors += 1;
+        test->state = CH_SP_TEST_CLOSING;
+        uv_timer_stop(handle);
+        ch_chirp_close_ts(&test->sender);
+        return;
+    }
+    if(test->replay) {
+        /* Give duplicates some time to show up */
+        if(test->received_count >= 2 && test->state == CH_SP_TEST_SENT) {
+            test->state = CH_SP_TEST_SPOOLED;
+            test->ticks = CH_SP_TEST_TIMEOUT / 10 - 20;
+        } else if(test->ticks * 10 >= CH_SP_TEST_TIMEOUT - 10) {
+            test->state = CH_SP_TEST_CLOSING;
+            uv_timer_stop(handle);
+            ch_chirp_close_ts(&test->sender);
+        }
+        return;
+    }
+    switch(test->state) {
+    case CH_SP_TEST_ACKED:
+        /* The done record of X is synced, Y rotates the segment again */
+        if(_ch_sp_test_idle(&test->sender)) {
+            _ch_sp_test_send(test, 2, "Y");
+            test->state = CH_SP_TEST_SPOOLED;
+        }
+        break;
+    case CH_SP_TEST_SPOOLED:
+        if(_ch_sp_test_idle(&test->sender)) {
+            test->state = CH_SP_TEST_CLOSING;
+            uv_timer_stop(handle);
+            ch_chirp_close_ts(&test->sender);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static
+void
+_ch_sp_test_config(ch_config_t* config, int port, char* spool_dir)
+{
+    ch_chirp_config_init(config);
+    config->PORT               = port;
+    config->CLOSE_ON_SIGINT    = 0;
+    config->DISABLE_ENCRYPTION = 1;
+    config->CERT_CHAIN_PEM     = "./cert.pem";
+    config->DH_PARAMS_PEM      = "./dh.pem";
+    config->SPOOL_DIR          = spool_dir;
+}
+
+static
+int
+_ch_sp_test_run(ch_sp_test_t* test, char* spool_dir)
+{
+    ch_loop_init(&test->loop);
+    test->timer.data = test;
+    uv_timer_init(&test->loop, &test->timer);
+    _ch_sp_test_config(&test->recv_config, CH_SP_TEST_RECV_PORT, NULL);
+    _ch_sp_test_config(&test->send_config, CH_SP_TEST_SEND_PORT, spool_dir);
+    if(ch_chirp_init(
+            &test->receiver,
+            &test->recv_config,
+            &test->loop,
+            _ch_sp_test_receiver_done_cb,
+            ch_test_log_cb
+    ) != CH_SUCCESS) {
+        fprintf(stderr, "ch_chirp_init error\n");
+        uv_close((uv_handle_t*) &test->timer, ch_test_close_cb);
+        ch_run(&test->loop);
+        ch_loop_close(&test->loop);
+        return 1;
+    }
+    ch_chirp_set_recv_cb(&test->receiver, _ch_sp_test_recv_cb);
+    /* Replayed messages are sent on init, the receiver has to be ready */
+    if(ch_chirp_init(
+            &test->sender,
+            &test->send_config,
+            &test->loop,
+            _ch_sp_test_sender_done_cb,
+            ch_test_log_cb
+    ) != CH_SUCCESS) {
+        fprintf(stderr, "ch_chirp_init error\n");
+        ch_chirp_close_ts(&test->receiver);
+        ch_run(&test->loop);
+        ch_loop_close(&test->loop);
+        return 1;
+    }
+    test->sender._->spool.segment_size = 1;
+    uv_timer_start(&test->timer, _ch_sp_test_timer_cb, 10, 10);
+    if(!test->replay) {
+        _ch_sp_test_send(test, 0, "X");
+        _ch_sp_test_send(test, 1, "P");
+    }
+    ch_run(&test->loop);
+    ch_loop_close(&test->loop);
+    return 0;
+}
+
+static
+void
+_ch_sp_test_cleanup(char* spool_dir)
+{
+    uv_fs_t req;
+    uv_dirent_t ent;
+    char path[PATH_MAX];
+    if(uv_fs_scandir(NULL, &req, spool_dir, 0, NULL) >= 0) {
+        while(uv_fs_scandir_next(&req, &ent) != UV_EOF) {
+            snprintf(path, sizeof(path), "%s/%s", spool_dir, ent.name);
+            unlink(path);
+        }
+    }
+    uv_fs_req_cleanup(&req);
+    rmdir(spool_dir);
+}
+
+// Runner
+// ======
+
+// .. c:function::
+int
+main(void)
+//    :noindex:
+//
+//    Run the test.
+//
+// .. code-block:: cpp
+//
+{
+    int i;
+    int j;
+    int found;
+    int errors = 0;
+    uint8_t expected[2][CH_SP_TEST_ID_SIZE];
+    char spool_dir[] = "./spool_etest.XXXXXX";
+    ch_sp_test_t* test = &_ch_sp_test;
+    if(mkdtemp(spool_dir) == NULL) {
+        fprintf(stderr, "Could not create spool directory\n");
+        return 1;
+    }
+    ch_libchirp_init();
+    memset(test, 0, sizeof(*test));
+    errors += _ch_sp_test_run(test, spool_dir);
+    errors += test->errors;
+    memcpy(expected[0], test->msgs[1].serial, CH_SP_TEST_ID_SIZE);
+    memcpy(expected[1], test->msgs[2].serial, CH_SP_TEST_ID_SIZE);
+
+    memset(test, 0, sizeof(*test));
+    test->replay = 1;
+    errors += _ch_sp_test_run(test, spool_dir);
+    errors += test->errors;
+    if(ch_test_expect(test->received_count, 2, "Replayed messages")) {
+        errors += 1;
+    } else {
+        for(i = 0; i < 2; i++) {
+            found = 0;
+            for(j = 0; j < 2; j++) {
+                found += !memcmp(
+                    expected[i],
+                    test->received[j],
+                    CH_SP_TEST_ID_SIZE
+                );
+            }
+            if(found != 1) {
+                fprintf(stderr, "Message %d not replayed once\n", i);
+                errors += 1;
+            }
+        }
+    }
+    ch_libchirp_cleanup();
+    _ch_sp_test_cleanup(spool_dir);
+    if(errors == 0)
+        printf("OK\n");
+    return errors > 0;
+}
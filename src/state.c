@@ -0,0 +1,351 @@
+// ===========
+// Local state
+// ===========
+//
+// Lock-striped local state, see :c:type:`ch_state_t`.
+//
+// .. code-block:: cpp
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "state.h"
+#include "chirp.h"
+#include "util.h"
+
+// Sglib Prototypes
+// ================
+
+// .. code-block:: cpp
+//
+SGLIB_DEFINE_RBTREE_FUNCTIONS( // NOCOV
+    ch_st_entry_t,
+    _left,
+    _right,
+    _color_field,
+    CH_ST_ENTRY_CMP
+)
+
+// Declarations
+// ============
+
+// .. c:macro:: CH_ST_ALIGN
+//
+//    Alignment of the memory returned by :c:func:`ch_st_alloc`.
+//
+// .. c:macro:: CH_ST_HEADER
+//
+//    Size of the chunk header, rounded up to the alignment.
+//
+// .. code-block:: cpp
+//
+#define CH_ST_ALIGN 16
+#define CH_ST_HEADER \
+    ((sizeof(ch_st_chunk_t) + CH_ST_ALIGN - 1) & ~((size_t) CH_ST_ALIGN - 1))
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_st_free_entry(ch_st_entry_t* entry);
+//
+//    Free an entry and its arena.
+//
+//    :param ch_st_entry_t* entry: The entry to free.
+
+// .. c:function::
+static
+ch_inline
+uint64_t
+_ch_st_now(void);
+//
+//    Get a monotonic time in milliseconds. Unlike uv_now it can be used
+//    outside the loop thread.
+//
+//    :return: the time in milliseconds
+//    :rtype:  uint64_t
+
+// Definitions
+// ===========
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_st_free_entry(ch_st_entry_t* entry)
+//    :noindex:
+//
+//    see: :c:func:`_ch_st_free_entry`
+//
+// .. code-block:: cpp
+//
+{
+    ch_st_chunk_t* chunk = entry->_arena;
+    while(chunk != NULL) {
+        ch_st_chunk_t* next = chunk->next;
+        ch_free(chunk);
+        chunk = next;
+    }
+    ch_free(entry);
+}
+
+// .. c:function::
+static
+ch_inline
+uint64_t
+_ch_st_now(void)
+//    :noindex:
+//
+//    see: :c:func:`_ch_st_now`
+//
+// .. code-block:: cpp
+//
+{
+    return uv_hrtime() / 1000000;
+}
+
+// .. c:function::
+void*
+ch_st_alloc(ch_st_entry_t* entry, size_t size)
+//    :noindex:
+//
+//    see: :c:func:`ch_st_alloc`
+//
+// .. code-block:: cpp
+//
+{
+    void* buf;
+    ch_st_chunk_t* chunk = entry->_arena;
+    size = (size + CH_ST_ALIGN - 1) & ~((size_t) CH_ST_ALIGN - 1);
+    if(chunk == NULL || chunk->size - chunk->used < size) {
+        size_t chunk_size = CH_ST_CHUNK_SIZE;
+        if(size > chunk_size)
+            chunk_size = size;
+        chunk = ch_alloc(CH_ST_HEADER + chunk_size);
+        if(!chunk)
+            return NULL;
+        chunk->size   = chunk_size;
+        chunk->used   = 0;
+        chunk->next   = entry->_arena;
+        entry->_arena = chunk;
+    }
+    buf = ((char*) chunk) + CH_ST_HEADER + chunk->used;
+    chunk->used += size;
+    return buf;
+}
+
+// .. c:function::
+ch_error_t
+ch_st_expire_ts(ch_state_t* state, const ch_buf* key, size_t key_len)
+//    :noindex:
+//
+//    see: :c:func:`ch_st_expire_ts`
+//
+// .. code-block:: cpp
+//
+{
+    ch_st_entry_t search_entry;
+    ch_st_entry_t* entry;
+    ch_state_int_t* istate = state->_;
+    ch_st_stripe_t* stripe = &istate->stripes[
+        ch_hash64((const uint8_t*) key, key_len, 0) & istate->mask
+    ];
+    search_entry._key     = (ch_buf*) key;
+    search_entry._key_len = key_len;
+    uv_mutex_lock(&stripe->lock);
+    entry = sglib_ch_st_entry_t_find_member(stripe->entries, &search_entry);
+    if(entry != NULL)
+        sglib_ch_st_entry_t_delete(&stripe->entries, entry);
+    uv_mutex_unlock(&stripe->lock);
+    if(entry == NULL)
+        return CH_VALUE_ERROR;
+    _ch_st_free_entry(entry);
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+uint32_t
+ch_st_expire_idle_ts(ch_state_t* state, uint64_t idle)
+//    :noindex:
+//
+//    see: :c:func:`ch_st_expire_idle_ts`
+//
+// .. code-block:: cpp
+//
+{
+    uint32_t i;
+    uint32_t count = 0;
+    ch_state_int_t* istate = state->_;
+    uint64_t now = _ch_st_now();
+    for(i = 0; i <= istate->mask; i++) {
+        ch_st_entry_t* entry;
+        ch_st_entry_t* expired = NULL;
+        struct sglib_ch_st_entry_t_iterator it;
+        ch_st_stripe_t* stripe = &istate->stripes[i];
+        uv_mutex_lock(&stripe->lock);
+        /* We may not delete while iterating, so we collect first. */
+        for(
+                entry = sglib_ch_st_entry_t_it_init(&it, stripe->entries);
+                entry != NULL;
+                entry = sglib_ch_st_entry_t_it_next(&it)
+        ) {
+            if(now - entry->_stamp >= idle) {
+                entry->_expired = expired;
+                expired = entry;
+            }
+        }
+        for(entry = expired; entry != NULL; entry = entry->_expired)
+            sglib_ch_st_entry_t_delete(&stripe->entries, entry);
+        uv_mutex_unlock(&stripe->lock);
+        while(expired != NULL) {
+            entry = expired;
+            expired = entry->_expired;
+            _ch_st_free_entry(entry);
+            count += 1;
+        }
+    }
+    return count;
+}
+
+// .. c:function::
+void
+ch_st_free(ch_state_t* state)
+//    :noindex:
+//
+//    see: :c:func:`ch_st_free`
+//
+// .. code-block:: cpp
+//
+{
+    uint32_t i;
+    ch_state_int_t* istate = state->_;
+    if(istate == NULL)
+        return;
+    for(i = 0; i <= istate->mask; i++) {
+        ch_st_entry_t* entry;
+        struct sglib_ch_st_entry_t_iterator it;
+        ch_st_stripe_t* stripe = &istate->stripes[i];
+        for(
+                entry = sglib_ch_st_entry_t_it_init_postorder(
+                    &it,
+                    stripe->entries
+                );
+                entry != NULL;
+                entry = sglib_ch_st_entry_t_it_next(&it)
+        ) {
+            _ch_st_free_entry(entry);
+        }
+        uv_mutex_destroy(&stripe->lock);
+    }
+    ch_free(istate->stripes);
+    ch_free(istate);
+    state->_ = NULL;
+}
+
+// .. c:function::
+ch_error_t
+ch_st_init(ch_state_t* state, ch_chirp_t* chirp, uint32_t stripes)
+//    :noindex:
+//
+//    see: :c:func:`ch_st_init`
+//
+// .. code-block:: cpp
+//
+{
+    uint32_t i;
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    V(
+        chirp,
+        stripes > 0 && (stripes & (stripes - 1)) == 0,
+        "Stripes must be a power of two. (%u)",
+        stripes
+    );
+    ch_state_int_t* istate = ch_alloc(sizeof(ch_state_int_t));
+    if(!istate) {
+        E(
+            chirp,
+            "Could not allocate memory for state. ch_state_t:%p",
+            (void*) state
+        );
+        return CH_ENOMEM;
+    }
+    istate->chirp   = chirp;
+    istate->mask    = stripes - 1;
+    istate->stripes = ch_alloc(stripes * sizeof(ch_st_stripe_t));
+    if(!istate->stripes) {
+        E(
+            chirp,
+            "Could not allocate memory for stripes. ch_state_t:%p",
+            (void*) state
+        );
+        ch_free(istate);
+        return CH_ENOMEM;
+    }
+    for(i = 0; i < stripes; i++) {
+        istate->stripes[i].entries = NULL;
+        uv_mutex_init(&istate->stripes[i].lock);
+    }
+    state->_ = istate;
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+ch_st_entry_t*
+ch_st_lock_ts(ch_state_t* state, const ch_buf* key, size_t key_len)
+//    :noindex:
+//
+//    see: :c:func:`ch_st_lock_ts`
+//
+// .. code-block:: cpp
+//
+{
+    ch_st_entry_t search_entry;
+    ch_st_entry_t* entry;
+    ch_state_int_t* istate = state->_;
+    uint32_t index = ch_hash64(
+        (const uint8_t*) key,
+        key_len,
+        0
+    ) & istate->mask;
+    ch_st_stripe_t* stripe = &istate->stripes[index];
+    search_entry._key     = (ch_buf*) key;
+    search_entry._key_len = key_len;
+    uv_mutex_lock(&stripe->lock);
+    entry = sglib_ch_st_entry_t_find_member(stripe->entries, &search_entry);
+    if(entry == NULL) {
+        /* The key follows the entry. */
+        entry = ch_alloc(sizeof(ch_st_entry_t) + key_len);
+        if(!entry) {
+            uv_mutex_unlock(&stripe->lock);
+            E(
+                istate->chirp,
+                "Could not allocate memory for entry. ch_state_t:%p",
+                (void*) state
+            );
+            return NULL;
+        }
+        memset(entry, 0, sizeof(ch_st_entry_t));
+        entry->_key     = (ch_buf*) (entry + 1);
+        entry->_key_len = key_len;
+        entry->_stripe  = index;
+        memcpy(entry->_key, key, key_len);
+        sglib_ch_st_entry_t_add(&stripe->entries, entry);
+    }
+    entry->_stamp = _ch_st_now();
+    return entry;
+}
+
+// .. c:function::
+void
+ch_st_unlock_ts(ch_state_t* state, ch_st_entry_t* entry)
+//    :noindex:
+//
+//    see: :c:func:`ch_st_unlock_ts`
+//
+// .. code-block:: cpp
+//
+{
+    uv_mutex_unlock(&state->_->stripes[entry->_stripe].lock);
+}
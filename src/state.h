@@ -0,0 +1,137 @@
+// ==================
+// Local state header
+// ==================
+//
+// Internal data structures of the local state. Every stripe is a red-black
+// tree of entries protected by its own lock.
+//
+// .. code-block:: cpp
+//
+#ifndef ch_state_h
+#define ch_state_h
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "libchirp/state.h"
+#include "common.h"
+#include "sglib.h"
+
+// Declarations
+// ============
+
+// .. c:type:: ch_st_chunk_t
+//
+//    A chunk of the arena of an entry. The memory follows the structure.
+//
+//    .. c:member:: struct ch_st_chunk_s* next
+//
+//       The next (older) chunk.
+//
+//    .. c:member:: size_t size
+//
+//       Size of the memory of the chunk.
+//
+//    .. c:member:: size_t used
+//
+//       Bytes used of the memory of the chunk.
+//
+// .. code-block:: cpp
+//
+struct ch_st_chunk_s {
+    struct ch_st_chunk_s* next;
+    size_t                size;
+    size_t                used;
+};
+
+// .. c:type:: ch_st_stripe_t
+//
+//    A stripe of the local state.
+//
+//    .. c:member:: uv_mutex_t lock
+//
+//       Protects the entries of the stripe.
+//
+//    .. c:member:: ch_st_entry_t* entries
+//
+//       Dictionary of the entries.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_st_stripe_s {
+    uv_mutex_t     lock;
+    ch_st_entry_t* entries;
+} ch_st_stripe_t;
+
+// .. c:type:: ch_state_int_t
+//
+//    Local state object.
+//
+//    .. c:member:: ch_chirp_t* chirp
+//
+//       Pointer to the chirp object used for logging.
+//
+//    .. c:member:: ch_st_stripe_t* stripes
+//
+//       Array of the stripes.
+//
+//    .. c:member:: uint32_t mask
+//
+//       Count of stripes minus one.
+//
+// .. code-block:: cpp
+//
+struct ch_state_int_s {
+    ch_chirp_t*     chirp;
+    ch_st_stripe_t* stripes;
+    uint32_t        mask;
+};
+
+// Sglib Prototypes
+// ----------------
+//
+// .. code-block:: cpp
+//
+#define CH_ST_ENTRY_CMP(x,y) ch_st_entry_cmp(x, y)
+
+// .. code-block:: cpp
+//
+SGLIB_DEFINE_RBTREE_PROTOTYPES( // NOCOV
+    ch_st_entry_t,
+    _left,
+    _right,
+    _color_field,
+    CH_ST_ENTRY_CMP
+)
+
+// Definitions
+// ===========
+
+// .. c:function::
+static
+ch_inline
+int
+ch_st_entry_cmp(ch_st_entry_t* x, ch_st_entry_t* y)
+//
+//    Compare operator for entries.
+//
+//    :param ch_st_entry_t* x: First entry instance to compare
+//    :param ch_st_entry_t* y: Second entry instance to compare
+//
+//    :return: the comparision between
+//                 - the lengths, if they are not the same, or
+//                 - the keys
+//    :rtype: int
+//
+// .. code-block:: cpp
+//
+{
+    if(x->_key_len != y->_key_len) {
+        return x->_key_len < y->_key_len ? -1 : 1;
+    }
+    return memcmp(x->_key, y->_key, x->_key_len);
+}
+
+#endif //ch_state_h
@@ -0,0 +1,220 @@
+// ===========
+// State etest
+// ===========
+//
+// Behavior of the local state (see :c:type:`ch_state_t`): workers gather
+// into entries by key from several threads, entries keep their data until
+// they expire, arena memory doesn't overlap and expiring by key or by idle
+// time removes entries.
+//
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "libchirp.h"
+#include "fixture_test.h"
+#include "state.h"
+
+// Test functions
+// ==============
+//
+// Not documented on purpose.
+//
+// .. code-block:: cpp
+
+#define CH_ST_TEST_STRIPES 4
+#define CH_ST_TEST_KEYS 16
+#define CH_ST_TEST_THREADS 4
+#define CH_ST_TEST_ROUNDS 10000
+#define CH_ST_TEST_ALLOCS 100
+
+typedef struct ch_st_test_s {
+    ch_chirp_t     chirp;
+    ch_chirp_int_t ichirp;
+    ch_state_t     state;
+    int            errors;
+} ch_st_test_t;
+
+static ch_st_test_t _ch_st_test;
+
+static
+size_t
+_ch_st_test_key(char* buf, size_t size, int key)
+{
+    return (size_t) snprintf(buf, size, "batch-%d", key);
+}
+
+static
+void
+_ch_st_test_worker(void* arg)
+{
+    int i;
+    char key[32];
+    size_t key_len;
+    ch_st_entry_t* entry;
+    ch_st_test_t* test = arg;
+    for(i = 0; i < CH_ST_TEST_ROUNDS; i++) {
+        key_len = _ch_st_test_key(key, sizeof(key), i % CH_ST_TEST_KEYS);
+        entry = ch_st_lock_ts(&test->state, key, key_len);
+        if(entry == NULL)
+            continue;
+        if(entry->data == NULL) {
+            entry->data = ch_st_alloc(entry, sizeof(uint64_t));
+            *(uint64_t*) entry->data = 0;
+        }
+        *(uint64_t*) entry->data += 1;
+        ch_st_unlock_ts(&test->state, entry);
+    }
+}
+
+static
+void
+_ch_st_test_gather(ch_st_test_t* test)
+{
+    int i;
+    char key[32];
+    size_t key_len;
+    uint64_t count;
+    uv_thread_t threads[CH_ST_TEST_THREADS];
+    ch_st_entry_t* entry;
+    for(i = 0; i < CH_ST_TEST_THREADS; i++)
+        uv_thread_create(&threads[i], _ch_st_test_worker, test);
+    for(i = 0; i < CH_ST_TEST_THREADS; i++)
+        uv_thread_join(&threads[i]);
+    for(i = 0; i < CH_ST_TEST_KEYS; i++) {
+        key_len = _ch_st_test_key(key, sizeof(key), i);
+        entry = ch_st_lock_ts(&test->state, key, key_len);
+        count = entry->data != NULL ? *(uint64_t*) entry->data : 0;
+        ch_st_unlock_ts(&test->state, entry);
+        test->errors += ch_test_expect(
+            (int) count,
+            CH_ST_TEST_THREADS * CH_ST_TEST_ROUNDS / CH_ST_TEST_KEYS,
+            "Gather"
+        );
+    }
+}
+
+static
+void
+_ch_st_test_arena(ch_st_test_t* test)
+{
+    int i;
+    size_t j;
+    size_t size;
+    uint8_t* bufs[CH_ST_TEST_ALLOCS];
+    ch_st_entry_t* entry = ch_st_lock_ts(&test->state, "arena", 5);
+    for(i = 0; i < CH_ST_TEST_ALLOCS; i++) {
+        /* Small ones and some larger than a chunk */
+        size = i % 10 == 9 ? CH_ST_CHUNK_SIZE * 2 : (size_t) i + 1;
+        bufs[i] = ch_st_alloc(entry, size);
+        if(bufs[i] == NULL || ((uintptr_t) bufs[i]) % sizeof(void*) != 0) {
+            fprintf(stderr, "Arena: allocation %d failed\n", i);
+            test->errors += 1;
+            ch_st_unlock_ts(&test->state, entry);
+            return;
+        }
+        memset(bufs[i], i, size);
+    }
+    for(i = 0; i < CH_ST_TEST_ALLOCS; i++) {
+        size = i % 10 == 9 ? CH_ST_CHUNK_SIZE * 2 : (size_t) i + 1;
+        for(j = 0; j < size; j++) {
+            if(bufs[i][j] != (uint8_t) i) {
+                fprintf(stderr, "Arena: allocation %d overwritten\n", i);
+                test->errors += 1;
+                break;
+            }
+        }
+    }
+    ch_st_unlock_ts(&test->state, entry);
+}
+
+static
+void
+_ch_st_test_expire(ch_st_test_t* test)
+{
+    ch_st_entry_t* entry;
+    /* Keys are compared by length too */
+    entry = ch_st_lock_ts(&test->state, "a\0", 2);
+    entry->data = ch_st_alloc(entry, 1);
+    ch_st_unlock_ts(&test->state, entry);
+    entry = ch_st_lock_ts(&test->state, "a", 1);
+    test->errors += ch_test_expect(entry->data == NULL, 1, "Distinct keys");
+    entry->data = ch_st_alloc(entry, 1);
+    ch_st_unlock_ts(&test->state, entry);
+    test->errors += ch_test_expect(
+        ch_st_expire_ts(&test->state, "a", 1),
+        CH_SUCCESS,
+        "Expire"
+    );
+    test->errors += ch_test_expect(
+        ch_st_expire_ts(&test->state, "a", 1),
+        CH_VALUE_ERROR,
+        "Expire twice"
+    );
+    entry = ch_st_lock_ts(&test->state, "a", 1);
+    test->errors += ch_test_expect(entry->data == NULL, 1, "Expired data");
+    ch_st_unlock_ts(&test->state, entry);
+    entry = ch_st_lock_ts(&test->state, "a\0", 2);
+    test->errors += ch_test_expect(entry->data != NULL, 1, "Other data");
+    ch_st_unlock_ts(&test->state, entry);
+    test->errors += ch_test_expect(
+        ch_st_expire_idle_ts(&test->state, 3600 * 1000),
+        0,
+        "Expire active"
+    );
+    /* The gathered keys, the arena and both keys "a" */
+    test->errors += ch_test_expect(
+        ch_st_expire_idle_ts(&test->state, 0),
+        CH_ST_TEST_KEYS + 3,
+        "Expire idle"
+    );
+    test->errors += ch_test_expect(
+        ch_st_expire_idle_ts(&test->state, 0),
+        0,
+        "Expire idle again"
+    );
+}
+
+// Runner
+// ======
+
+// .. c:function::
+int
+main(void)
+//    :noindex:
+//
+//    Run the test.
+//
+// .. code-block:: cpp
+//
+{
+    ch_state_t bad;
+    ch_st_test_t* test = &_ch_st_test;
+    ch_libchirp_init();
+    memset(test, 0, sizeof(*test));
+    ch_test_fake_chirp(&test->chirp, &test->ichirp);
+    /* Logs an error */
+    test->errors += ch_test_expect(
+        ch_st_init(&bad, &test->chirp, 3),
+        CH_VALUE_ERROR,
+        "Stripes"
+    );
+    if(ch_st_init(
+            &test->state,
+            &test->chirp,
+            CH_ST_TEST_STRIPES
+    ) != CH_SUCCESS) {
+        fprintf(stderr, "ch_st_init error\n");
+        ch_libchirp_cleanup();
+        return 1;
+    }
+    _ch_st_test_gather(test);
+    _ch_st_test_arena(test);
+    _ch_st_test_expire(test);
+    ch_st_free(&test->state);
+    ch_libchirp_cleanup();
+    if(test->errors == 0)
+        printf("OK\n");
+    return test->errors > 0;
+}
@@ -0,0 +1,77 @@
+// ==========
+// Statistics
+// ==========
+//
+// Reporting of the counters, see :c:type:`ch_stats_t`.
+//
+// .. code-block:: cpp
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "stats.h"
+#include "chirp.h"
+
+// Definitions
+// ===========
+
+// .. c:function::
+void
+ch_chirp_get_stats(ch_chirp_t* chirp, ch_stats_t* stats)
+//    :noindex:
+//
+//    see: :c:func:`ch_chirp_get_stats`
+//
+// .. code-block:: cpp
+//
+{
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    *stats = chirp->_->stats;
+}
+
+// .. c:function::
+void
+ch_chirp_iter_conn_stats(
+        ch_chirp_t* chirp,
+        ch_conn_stats_cb_t cb,
+        void* arg
+)
+//    :noindex:
+//
+//    see: :c:func:`ch_chirp_iter_conn_stats`
+//
+// .. code-block:: cpp
+//
+{
+    ch_connection_t* conn;
+    ch_conn_stats_t conn_stats;
+    struct sglib_ch_connection_t_iterator it;
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    /* The callback may not shut down connections, so iterating is safe. */
+    for(
+            conn = sglib_ch_connection_t_it_init(
+                &it,
+                chirp->_->protocol.connections
+            );
+            conn != NULL;
+            conn = sglib_ch_connection_t_it_next(&it)
+    ) {
+        conn_stats.ip_protocol = conn->ip_protocol;
+        conn_stats.port        = conn->port;
+        conn_stats.credits     = conn->writer.credits;
+        conn_stats.stats       = conn->stats;
+        memcpy(
+            conn_stats.address,
+            conn->address,
+            sizeof(conn_stats.address)
+        );
+        memcpy(
+            conn_stats.identity,
+            conn->remote_identity,
+            sizeof(conn_stats.identity)
+        );
+        cb(chirp, &conn_stats, arg);
+    }
+}
@@ -0,0 +1,39 @@
+// =================
+// Statistics header
+// =================
+//
+// Counting for :c:type:`ch_stats_t`. Every counter exists twice: in the
+// connection and in the chirp instance, so the instance keeps the counts of
+// closed connections. Both are only written on the loop thread.
+//
+// .. code-block:: cpp
+//
+#ifndef ch_stats_h
+#define ch_stats_h
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "libchirp/stats.h"
+
+// Declarations
+// ============
+
+// .. c:macro:: CH_STATS_ADD
+//
+//    Add **value** to a counter of a connection and of its chirp instance.
+//
+//    :param conn: Pointer to a connection.
+//    :param member: The member of :c:type:`ch_stats_t`.
+//    :param value: The value to add, may be negative for the current counts.
+//
+// .. code-block:: cpp
+//
+#define CH_STATS_ADD(conn, member, value) do { \
+    (conn)->stats.member += (value); \
+    (conn)->chirp->_->stats.member += (value); \
+} while(0)
+
+#endif //ch_stats_h
@@ -0,0 +1,740 @@
+// =====
+// Trace
+// =====
+//
+// Per-thread binary event rings, see :c:macro:`T`.
+//
+// Every thread gets a single-producer single-consumer ring on its first
+// event. The recording thread only advances the head, the drainer only
+// advances the tail, so neither locks. The list of rings is protected by a
+// mutex, it is only taken when a thread records its first event, when a
+// thread exits and when draining.
+//
+// A ring belongs to its thread until the thread exits, a thread-exit hook
+// marks it and the next drain frees it. So a ring is never freed while its
+// thread may still record into it, not even by :c:func:`ch_tr_stop`.
+//
+// .. code-block:: cpp
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "trace.h"
+#include "util.h"
+
+// System includes
+// ===============
+//
+// .. code-block:: cpp
+//
+#include <stdarg.h>
+#ifndef _WIN32
+#   include <pthread.h>
+#endif
+
+// Declarations
+// ============
+
+// .. c:type:: ch_tr_event_t
+//
+//    A recorded event.
+//
+//    .. c:member:: ch_tr_site_t* site
+//
+//       The call site, identifies the event.
+//
+//    .. c:member:: ch_log_cb_t log_cb
+//
+//       The log callback of the chirp object that recorded the event.
+//
+//    .. c:member:: uint64_t stamp
+//
+//       Time of the event in nanoseconds (uv_hrtime).
+//
+//    .. c:member:: uint64_t args[CH_TR_MAX_ARGS]
+//
+//       The raw arguments. Strings are stored as offset into str.
+//
+//    .. c:member:: char error
+//
+//       1 if the event is an error.
+//
+//    .. c:member:: char str[CH_TR_STR_SIZE]
+//
+//       Copies of the string arguments.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_tr_event_s {
+    ch_tr_site_t* site;
+    ch_log_cb_t   log_cb;
+    uint64_t      stamp;
+    uint64_t      args[CH_TR_MAX_ARGS];
+    char          error;
+    char          str[CH_TR_STR_SIZE];
+} ch_tr_event_t;
+
+// .. c:type:: ch_tr_ring_t
+//
+//    The ring of one thread. Head and tail are on separate cache lines, so the
+//    recording thread and the drainer don't share a line.
+//
+//    .. c:member:: uint64_t head
+//
+//       Count of events recorded, written by the recording thread.
+//
+//    .. c:member:: uint64_t tail
+//
+//       Count of events drained, written by the drainer.
+//
+//    .. c:member:: uint64_t dropped
+//
+//       Count of events dropped because the ring was full.
+//
+//    .. c:member:: uint64_t reported
+//
+//       Count of dropped events already reported by the drainer.
+//
+//    .. c:member:: int exited
+//
+//       Set (with the lock held) when the thread of the ring exited. The
+//       ring is freed after it has been drained.
+//
+//    .. c:member:: struct ch_tr_ring_s* next
+//
+//       The next ring in the list of rings.
+//
+//    .. c:member:: ch_tr_event_t events[CH_TR_EVENTS]
+//
+//       The events.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_tr_ring_s {
+    uint64_t             head;
+    char                 _pad1[56];
+    uint64_t             tail;
+    char                 _pad2[56];
+    uint64_t             dropped;
+    uint64_t             reported;
+    int                  exited;
+    struct ch_tr_ring_s* next;
+    ch_tr_event_t        events[CH_TR_EVENTS];
+} ch_tr_ring_t;
+
+// .. c:var:: _ch_tr_cond
+//
+//    Wakes the drainer up when stopping.
+//
+// .. c:var:: _ch_tr_drainer
+//
+//    The drainer thread.
+//
+// .. c:var:: _ch_tr_key
+//
+//    Thread-specific key of the ring, its destructor is the thread-exit hook
+//    :c:func:`_ch_tr_release`.
+//
+// .. c:var:: _ch_tr_lock
+//
+//    Protects the list of rings and serializes draining. It lives as long as
+//    the process, since exiting threads take it at any time.
+//
+// .. c:var:: _ch_tr_once
+//
+//    Initializes the lock, the condition and the key once.
+//
+// .. c:var:: _ch_tr_ring
+//
+//    The ring of the current thread.
+//
+// .. c:var:: _ch_tr_rings
+//
+//    List of all rings.
+//
+// .. c:var:: _ch_tr_running
+//
+//    1 while the drainer is running.
+//
+// .. code-block:: cpp
+//
+static uv_cond_t _ch_tr_cond;
+static uv_thread_t _ch_tr_drainer;
+#ifdef _WIN32
+static DWORD _ch_tr_key;
+#else
+static pthread_key_t _ch_tr_key;
+#endif
+static uv_mutex_t _ch_tr_lock;
+static uv_once_t _ch_tr_once = UV_ONCE_INIT;
+static ch_thread_local ch_tr_ring_t* _ch_tr_ring = NULL;
+static ch_tr_ring_t* _ch_tr_rings = NULL;
+static uint64_t _ch_tr_running = 0;
+
+// .. c:function::
+static
+void
+_ch_tr_drain_locked(void);
+//
+//    Drain all rings and free the rings of exited threads. The lock must be
+//    held.
+
+// .. c:function::
+static
+void
+_ch_tr_drainer_cb(void* arg);
+//
+//    Main function of the drainer thread.
+//
+//    :param void* arg: Unused.
+
+// .. c:function::
+static
+void
+_ch_tr_format(ch_tr_event_t* event, char* buf, size_t size);
+//
+//    Format an event like :c:macro:`E` and :c:macro:`L` would, prefixed by
+//    its timestamp.
+//
+//    :param ch_tr_event_t* event: The event to format.
+//    :param char* buf: Buffer for the message.
+//    :param size_t size: Size of the buffer.
+
+// .. c:function::
+static
+void
+_ch_tr_init(void);
+//
+//    Initialize the lock, the condition and the thread-exit hook.
+
+// .. c:function::
+static
+void
+_ch_tr_parse(ch_tr_site_t* site);
+//
+//    Parse the types of the arguments from the format of a call site. Every
+//    site is parsed once, on its first event.
+//
+//    :param ch_tr_site_t* site: The call site.
+
+// .. c:function::
+static
+ch_inline
+const char*
+_ch_tr_spec(const char* pos, char* type);
+//
+//    Scan a conversion specification.
+//
+//    :param const char* pos: Position after the %.
+//    :param char* type: Out: Type of the argument, 0 if the specification
+//                       takes no argument.
+//
+//    :return: the position after the specification
+//    :rtype:  const char*
+
+// .. c:function::
+static
+ch_tr_ring_t*
+_ch_tr_register(void);
+//
+//    Allocate and register the ring of the current thread.
+//
+//    :return: the ring, NULL if allocation failed.
+//    :rtype:  ch_tr_ring_t*
+
+// .. c:function::
+static
+void
+#ifdef _WIN32
+WINAPI
+#endif
+_ch_tr_release(void* arg);
+//
+//    Thread-exit hook: hand the ring of the exiting thread to the drainer.
+//    If tracing is stopped, nothing is recorded anymore and the ring is
+//    freed at once.
+//
+//    :param void* arg: The ring of the thread.
+
+// Definitions
+// ===========
+
+// .. c:function::
+static
+void
+_ch_tr_drain_locked(void)
+//    :noindex:
+//
+//    see: :c:func:`_ch_tr_drain_locked`
+//
+// .. code-block:: cpp
+//
+{
+    char buf[1024];
+    ch_tr_ring_t* ring;
+    ch_tr_ring_t** pnext = &_ch_tr_rings;
+    while((ring = *pnext) != NULL) {
+        uint64_t dropped;
+        /* The thread published its last event before it exited. */
+        int exited = ring->exited;
+        uint64_t head = ch_atomic_load_u64(&ring->head);
+        uint64_t tail = ring->tail;
+        while(tail != head) {
+            ch_tr_event_t* event = &ring->events[tail & (CH_TR_EVENTS - 1)];
+            _ch_tr_format(event, buf, sizeof(buf));
+            if(event->log_cb != NULL) {
+                event->log_cb(buf, event->error);
+            } else {
+                fprintf(
+                    stderr,
+                    "%s%s\n",
+                    event->error ? "Error: " : "",
+                    buf
+                );
+            }
+            tail += 1;
+            /* Hand the slot back to the recording thread. */
+            ch_atomic_store_u64(&ring->tail, tail);
+        }
+        dropped = ch_atomic_load_u64(&ring->dropped);
+        if(dropped != ring->reported) {
+            fprintf(
+                stderr,
+                "Error: trace ring full, dropped %llu events\n",
+                (unsigned long long) (dropped - ring->reported)
+            );
+            ring->reported = dropped;
+        }
+        if(exited) {
+            *pnext = ring->next;
+            ch_free(ring);
+        } else
+            pnext = &ring->next;
+    }
+}
+
+// .. c:function::
+static
+void
+_ch_tr_drainer_cb(void* arg)
+//    :noindex:
+//
+//    see: :c:func:`_ch_tr_drainer_cb`
+//
+// .. code-block:: cpp
+//
+{
+    (void)(arg);
+    uv_mutex_lock(&_ch_tr_lock);
+    while(_ch_tr_running) {
+        uv_cond_timedwait(
+            &_ch_tr_cond,
+            &_ch_tr_lock,
+            (uint64_t) CH_TR_DRAIN_INTERVAL * 1000000
+        );
+        _ch_tr_drain_locked();
+    }
+    uv_mutex_unlock(&_ch_tr_lock);
+}
+
+// .. c:function::
+static
+void
+_ch_tr_format(ch_tr_event_t* event, char* buf, size_t size)
+//    :noindex:
+//
+//    see: :c:func:`_ch_tr_format`
+//
+// .. code-block:: cpp
+//
+{
+    ch_tr_site_t* site = event->site;
+    const char* pos = site->message;
+    int arg = 0;
+    int len = snprintf(
+        buf,
+        size,
+        "%llu.%06llu %s:%d ",
+        (unsigned long long) (event->stamp / 1000000000),
+        (unsigned long long) (event->stamp / 1000 % 1000000),
+        site->file,
+        site->line
+    );
+    while(*pos != 0 && len >= 0 && (size_t) len < size - 1) {
+        char spec[32];
+        char type;
+        const char* end;
+        uint64_t value;
+        if(*pos != '%') {
+            buf[len++] = *pos++;
+            continue;
+        }
+        end = _ch_tr_spec(pos + 1, &type);
+        if(type == 0 || arg >= site->nargs || end - pos >= 32) {
+            /* %%, arguments beyond CH_TR_MAX_ARGS or absurd specifications */
+            if(pos[1] == '%')
+                buf[len++] = '%';
+            else if(type != 0)
+                arg += 1;
+            pos = end;
+            continue;
+        }
+        memcpy(spec, pos, end - pos);
+        spec[end - pos] = 0;
+        pos = end;
+        value = event->args[arg++];
+        switch(type) {
+            case 'i':
+                len += snprintf(buf + len, size - len, spec, (int) value);
+                break;
+            case 'l':
+                len += snprintf(buf + len, size - len, spec, (long) value);
+                break;
+            case 'q':
+                len += snprintf(
+                    buf + len,
+                    size - len,
+                    spec,
+                    (long long) value
+                );
+                break;
+            case 'z':
+                len += snprintf(buf + len, size - len, spec, (size_t) value);
+                break;
+            case 'p':
+                len += snprintf(
+                    buf + len,
+                    size - len,
+                    spec,
+                    (void*) (uintptr_t) value
+                );
+                break;
+            case 'f': {
+                double dvalue;
+                memcpy(&dvalue, &value, sizeof(dvalue));
+                len += snprintf(buf + len, size - len, spec, dvalue);
+                break;
+            }
+            case 's':
+                len += snprintf(
+                    buf + len,
+                    size - len,
+                    spec,
+                    value < CH_TR_STR_SIZE ? event->str + value : "(null)"
+                );
+                break;
+        }
+    }
+    if(len < 0)
+        len = 0;
+    if((size_t) len >= size)
+        len = size - 1;
+    buf[len] = 0;
+}
+
+// .. c:function::
+static
+void
+_ch_tr_init(void)
+//    :noindex:
+//
+//    see: :c:func:`_ch_tr_init`
+//
+// .. code-block:: cpp
+//
+{
+    uv_mutex_init(&_ch_tr_lock);
+    uv_cond_init(&_ch_tr_cond);
+#ifdef _WIN32
+    _ch_tr_key = FlsAlloc(_ch_tr_release);
+#else
+    pthread_key_create(&_ch_tr_key, _ch_tr_release);
+#endif
+}
+
+// .. c:function::
+static
+void
+_ch_tr_parse(ch_tr_site_t* site)
+//    :noindex:
+//
+//    see: :c:func:`_ch_tr_parse`
+//
+// .. code-block:: cpp
+//
+{
+    const char* pos = site->message;
+    int8_t nargs = 0;
+    while(*pos != 0) {
+        char type;
+        if(*pos++ != '%')
+            continue;
+        pos = _ch_tr_spec(pos, &type);
+        if(type != 0 && nargs < CH_TR_MAX_ARGS)
+            site->types[nargs++] = type;
+    }
+    /* Sites are static and may be parsed by two threads at once, both write
+     * the same types. Publishing nargs last makes the types visible.
+     */
+#ifdef _MSC_VER
+    MemoryBarrier();
+    *(volatile int8_t*) &site->nargs = nargs;
+#else // _MSC_VER
+    __atomic_store_n(&site->nargs, nargs, __ATOMIC_RELEASE);
+#endif // _MSC_VER
+}
+
+// .. c:function::
+static
+ch_tr_ring_t*
+_ch_tr_register(void)
+//    :noindex:
+//
+//    see: :c:func:`_ch_tr_register`
+//
+// .. code-block:: cpp
+//
+{
+    ch_tr_ring_t* ring = ch_alloc(sizeof(ch_tr_ring_t));
+    if(!ring)
+        return NULL;
+    memset(ring, 0, sizeof(ch_tr_ring_t));
+    uv_mutex_lock(&_ch_tr_lock);
+    ring->next   = _ch_tr_rings;
+    _ch_tr_rings = ring;
+    uv_mutex_unlock(&_ch_tr_lock);
+#ifdef _WIN32
+    FlsSetValue(_ch_tr_key, ring);
+#else
+    pthread_setspecific(_ch_tr_key, ring);
+#endif
+    _ch_tr_ring = ring;
+    return ring;
+}
+
+// .. c:function::
+static
+void
+#ifdef _WIN32
+WINAPI
+#endif
+_ch_tr_release(void* arg)
+//    :noindex:
+//
+//    see: :c:func:`_ch_tr_release`
+//
+// .. code-block:: cpp
+//
+{
+    ch_tr_ring_t* ring = arg;
+    ch_tr_ring_t** pnext = &_ch_tr_rings;
+    uv_mutex_lock(&_ch_tr_lock);
+    if(ch_atomic_load_u64(&_ch_tr_running))
+        ring->exited = 1;
+    else {
+        while(*pnext != ring)
+            pnext = &(*pnext)->next;
+        *pnext = ring->next;
+        ch_free(ring);
+    }
+    uv_mutex_unlock(&_ch_tr_lock);
+}
+
+// .. c:function::
+static
+ch_inline
+const char*
+_ch_tr_spec(const char* pos, char* type)
+//    :noindex:
+//
+//    see: :c:func:`_ch_tr_spec`
+//
+// .. code-block:: cpp
+//
+{
+    int longs = 0;
+    int size_t_arg = 0;
+    *type = 0;
+    if(*pos == '%')
+        return pos + 1;
+    while(*pos != 0 && strchr("-+ #0123456789.", *pos) != NULL)
+        pos += 1;
+    while(*pos != 0 && strchr("hlzjt", *pos) != NULL) {
+        if(*pos == 'l')
+            longs += 1;
+        else if(*pos != 'h')
+            size_t_arg = 1;
+        pos += 1;
+    }
+    if(*pos == 0)
+        return pos;
+    if(strchr("diouxXc", *pos) != NULL) {
+        if(size_t_arg)
+            *type = 'z';
+        else if(longs > 1)
+            *type = 'q';
+        else if(longs == 1)
+            *type = 'l';
+        else
+            *type = 'i';
+    } else if(strchr("fFeEgGaA", *pos) != NULL) {
+        *type = 'f';
+    } else if(*pos == 'p') {
+        *type = 'p';
+    } else if(*pos == 's') {
+        *type = 's';
+    }
+    return pos + 1;
+}
+
+// .. c:function::
+void
+ch_tr_drain(void)
+//    :noindex:
+//
+//    see: :c:func:`ch_tr_drain`
+//
+// .. code-block:: cpp
+//
+{
+    uv_mutex_lock(&_ch_tr_lock);
+    _ch_tr_drain_locked();
+    uv_mutex_unlock(&_ch_tr_lock);
+}
+
+// .. c:function::
+void
+ch_tr_record(ch_tr_site_t* site, ch_log_cb_t log_cb, char error, ...)
+//    :noindex:
+//
+//    see: :c:func:`ch_tr_record`
+//
+// .. code-block:: cpp
+//
+{
+    int i;
+    int8_t nargs;
+    size_t str_used = 0;
+    va_list args;
+    ch_tr_event_t* event;
+    ch_tr_ring_t* ring = _ch_tr_ring;
+    uint64_t head;
+    /* Nobody drains while stopped, the ring of an exiting thread is freed at
+     * once then.
+     */
+    if(!ch_atomic_load_u64(&_ch_tr_running))
+        return;
+    if(ring == NULL) {
+        ring = _ch_tr_register();
+        if(ring == NULL)
+            return;
+    }
+    head = ring->head;
+    if(head - ch_atomic_load_u64(&ring->tail) >= CH_TR_EVENTS) {
+        ch_atomic_store_u64(&ring->dropped, ring->dropped + 1);
+        return;
+    }
+#ifdef _MSC_VER
+    nargs = *(volatile int8_t*) &site->nargs;
+    MemoryBarrier();
+#else // _MSC_VER
+    nargs = __atomic_load_n(&site->nargs, __ATOMIC_ACQUIRE);
+#endif // _MSC_VER
+    if(nargs < 0) {
+        _ch_tr_parse(site);
+        nargs = site->nargs;
+    }
+    event = &ring->events[head & (CH_TR_EVENTS - 1)];
+    event->site   = site;
+    event->log_cb = log_cb;
+    event->stamp  = uv_hrtime();
+    event->error  = error;
+    va_start(args, error);
+    for(i = 0; i < nargs; i++) {
+        switch(site->types[i]) {
+            case 'i':
+                event->args[i] = (uint64_t) va_arg(args, int);
+                break;
+            case 'l':
+                event->args[i] = (uint64_t) va_arg(args, long);
+                break;
+            case 'q':
+                event->args[i] = (uint64_t) va_arg(args, long long);
+                break;
+            case 'z':
+                event->args[i] = (uint64_t) va_arg(args, size_t);
+                break;
+            case 'p':
+                event->args[i] = (uintptr_t) va_arg(args, void*);
+                break;
+            case 'f': {
+                double value = va_arg(args, double);
+                memcpy(&event->args[i], &value, sizeof(value));
+                break;
+            }
+            case 's': {
+                const char* str = va_arg(args, const char*);
+                size_t len;
+                if(str == NULL || str_used >= CH_TR_STR_SIZE) {
+                    event->args[i] = CH_TR_STR_SIZE;
+                    break;
+                }
+                len = strlen(str);
+                if(len > CH_TR_STR_SIZE - str_used - 1)
+                    len = CH_TR_STR_SIZE - str_used - 1;
+                memcpy(event->str + str_used, str, len);
+                event->str[str_used + len] = 0;
+                event->args[i] = str_used;
+                str_used += len + 1;
+                break;
+            }
+        }
+    }
+    va_end(args);
+    /* Publish the event to the drainer. */
+    ch_atomic_store_u64(&ring->head, head + 1);
+}
+
+// .. c:function::
+void
+ch_tr_start(void)
+//    :noindex:
+//
+//    see: :c:func:`ch_tr_start`
+//
+// .. code-block:: cpp
+//
+{
+    uv_once(&_ch_tr_once, _ch_tr_init);
+    ch_atomic_store_u64(&_ch_tr_running, 1);
+    if(uv_thread_create(&_ch_tr_drainer, _ch_tr_drainer_cb, NULL) != 0) {
+        fprintf(stderr, "Error: could not start trace drainer\n");
+        ch_atomic_store_u64(&_ch_tr_running, 0);
+    }
+}
+
+// .. c:function::
+void
+ch_tr_stop(void)
+//    :noindex:
+//
+//    see: :c:func:`ch_tr_stop`
+//
+// .. code-block:: cpp
+//
+{
+    int running;
+    uv_mutex_lock(&_ch_tr_lock);
+    running = (int) _ch_tr_running;
+    ch_atomic_store_u64(&_ch_tr_running, 0);
+    uv_cond_signal(&_ch_tr_cond);
+    uv_mutex_unlock(&_ch_tr_lock);
+    if(running)
+        uv_thread_join(&_ch_tr_drainer);
+    uv_mutex_lock(&_ch_tr_lock);
+    /* Frees the rings of exited threads, the others are still in use. */
+    _ch_tr_drain_locked();
+    uv_mutex_unlock(&_ch_tr_lock);
+}
@@ -0,0 +1,140 @@
+// ============
+// Trace header
+// ============
+//
+// Binary event ring replacing formatted logging in hot paths. If
+// :c:macro:`CH_ENABLE_TRACE` is defined, :c:macro:`E` and :c:macro:`L` record
+// an event into a ring of the current thread instead of formatting the
+// message. An event holds the call site, a timestamp and the raw arguments,
+// recording it doesn't format, lock or call the log callback.
+//
+// A drainer thread formats the events and passes them to the log callback
+// the event was recorded with (or stderr). So the log callback must be
+// thread-safe when tracing is enabled. If the drainer can't keep up, events
+// are dropped and the count of dropped events is logged.
+//
+// .. code-block:: cpp
+//
+#ifndef ch_trace_h
+#define ch_trace_h
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "libchirp/common.h"
+#include "libchirp/callbacks.h"
+
+// Declarations
+// ============
+
+// .. c:macro:: CH_TR_MAX_ARGS
+//
+//    Maximal count of arguments recorded per event, further arguments are
+//    ignored.
+//
+// .. c:macro:: CH_TR_STR_SIZE
+//
+//    Space for the string arguments (%s) of an event, longer strings are
+//    truncated.
+//
+// .. code-block:: cpp
+//
+#define CH_TR_MAX_ARGS 6
+#define CH_TR_STR_SIZE 64
+
+// .. c:type:: ch_tr_site_t
+//
+//    A call site of :c:macro:`E` or :c:macro:`L`. Every call site has one
+//    static site, its address identifies the event.
+//
+//    .. c:member:: const char* message
+//
+//       The format of the message.
+//
+//    .. c:member:: const char* file
+//
+//       Source file of the call site.
+//
+//    .. c:member:: int line
+//
+//       Source line of the call site.
+//
+//    .. c:member:: int8_t nargs
+//
+//       Count of arguments, -1 until the format has been parsed.
+//
+//    .. c:member:: char types[CH_TR_MAX_ARGS]
+//
+//       Type of each argument, parsed from the format.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_tr_site_s {
+    const char* message;
+    const char* file;
+    int         line;
+    int8_t      nargs;
+    char        types[CH_TR_MAX_ARGS];
+} ch_tr_site_t;
+
+// .. c:macro:: CH_TR_SITE
+//
+//    Initializer of a :c:type:`ch_tr_site_t`.
+//
+//    :param message: The format of the message.
+//
+// .. code-block:: cpp
+//
+#define CH_TR_SITE(message) { message, __FILE__, __LINE__, -1, {0} }
+
+// .. c:macro:: T
+//
+//    Records an event into the trace ring of the current thread.
+//
+//    :param chirp: Pointer to a chirp object.
+//    :param error: 1 if the event is an error.
+//    :param message: The format of the message.
+//    :param ...: The arguments of the message (at least one).
+//
+// .. code-block:: cpp
+//
+#define T(chirp, error, message, ...) do { \
+    static ch_tr_site_t _ch_tr_site = CH_TR_SITE(message); \
+    ch_tr_record(&_ch_tr_site, chirp->_log, error, __VA_ARGS__); \
+} while(0)
+
+// .. c:function::
+void
+ch_tr_drain(void);
+//
+//    Format all recorded events and pass them to their log callbacks. Called
+//    by the drainer thread. Thread-safe.
+
+// .. c:function::
+void
+ch_tr_record(ch_tr_site_t* site, ch_log_cb_t log_cb, char error, ...);
+//
+//    Record an event into the ring of the current thread.
+//
+//    :param ch_tr_site_t* site: The call site.
+//    :param ch_log_cb_t log_cb: The log callback, can be NULL.
+//    :param char error: 1 if the event is an error.
+//    :param ...: The arguments of the message.
+
+// .. c:function::
+void
+ch_tr_start(void);
+//
+//    Start the drainer thread.
+
+// .. c:function::
+void
+ch_tr_stop(void);
+//
+//    Stop the drainer thread, drain the remaining events and free the rings
+//    of exited threads. Rings of running threads are kept and used again if
+//    tracing is started again, they are freed when their thread exits.
+
+#endif //ch_trace_h
@@ -13,12 +13,68 @@
 //
 #include "util.h"
 
+// System includes
+// ===============
+//
+// .. code-block:: cpp
+//
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#ifndef _WIN32
+#   include <pthread.h>
+#endif
+
 // Declarations
 // ============
 
 ch_free_cb_t _ch_free_cb = free;
 ch_alloc_cb_t _ch_alloc_cb = malloc;
 ch_realloc_cb_t _ch_realloc_cb = realloc;
+ch_thread_local ch_random_t _ch_random;
+
+// .. c:var:: _ch_random_once
+//
+//    Registers :c:func:`_ch_random_atfork_child` once.
+//
+// .. code-block:: cpp
+//
+static uv_once_t _ch_random_once = UV_ONCE_INIT;
+
+// .. c:function::
+static
+void
+_ch_random_atfork_child(void);
+//
+//    Drop the random bytes the child inherited, else parent and child would
+//    create the same serials.
+
+// .. c:function::
+static
+void
+_ch_random_bytes(uint8_t* bytes, size_t len);
+//
+//    Get random bytes from the CSPRNG. Chirp can't work without them, so it
+//    aborts if there are none.
+//
+//    :param uint8_t* bytes:  The buffer to fill the bytes into.
+//    :param size_t  len:     The length of the buffer.
+
+// .. c:function::
+static
+void
+_ch_random_keystream(ch_random_t* random);
+//
+//    Fill the random buffer of the thread with the next part of the
+//    keystream. Takes a new key first, if needed.
+//
+//    :param ch_random_t* random: Random buffer of the thread.
+
+// .. c:function::
+static
+void
+_ch_random_register(void);
+//
+//    Register :c:func:`_ch_random_atfork_child`.
 
 // Definitions
 // ===========
@@ -87,3 +143,146 @@ ch_set_alloc_funcs(
     _ch_realloc_cb = realloc;
     _ch_free_cb = free;
 }
+
+// .. c:function::
+static
+void
+_ch_random_atfork_child(void)
+//    :noindex:
+//
+//    see: :c:func:`_ch_random_atfork_child`
+//
+// .. code-block:: cpp
+//
+{
+    /* The thread calling fork is the only thread of the child. */
+    _ch_random.left   = 0;
+    _ch_random.blocks = 0;
+}
+
+// .. c:function::
+static
+void
+_ch_random_bytes(uint8_t* bytes, size_t len)
+//    :noindex:
+//
+//    see: :c:func:`_ch_random_bytes`
+//
+// .. code-block:: cpp
+//
+{
+    if(RAND_bytes(bytes, (int) len) != 1) {
+        fprintf(
+            stderr,
+            "%s:%d Fatal: no random bytes available\n",
+            __FILE__,
+            __LINE__
+        );
+        abort();
+    }
+}
+
+// .. c:function::
+static
+void
+_ch_random_keystream(ch_random_t* random)
+//    :noindex:
+//
+//    see: :c:func:`_ch_random_keystream`
+//
+// .. code-block:: cpp
+//
+{
+    int i;
+    int len;
+    uint64_t counter;
+    EVP_CIPHER_CTX* ctx;
+    if(random->blocks == 0 || random->blocks >= CH_RANDOM_REKEY) {
+        _ch_random_bytes(random->key, sizeof(random->key));
+        _ch_random_bytes(random->iv, 8);
+        random->blocks = 0;
+    }
+    counter = random->blocks;
+    for(i = 15; i >= 8; i--) {
+        random->iv[i] = counter & 0xFF;
+        counter >>= 8;
+    }
+    memset(random->bytes, 0, CH_RANDOM_SIZE);
+    ctx = EVP_CIPHER_CTX_new();
+    if(
+            ctx == NULL ||
+            EVP_EncryptInit_ex(
+                ctx,
+                EVP_aes_128_ctr(),
+                NULL,
+                random->key,
+                random->iv
+            ) != 1 ||
+            EVP_EncryptUpdate(
+                ctx,
+                random->bytes,
+                &len,
+                random->bytes,
+                CH_RANDOM_SIZE
+            ) != 1
+    ) {
+        fprintf(
+            stderr,
+            "%s:%d Fatal: cannot create random bytes\n",
+            __FILE__,
+            __LINE__
+        );
+        abort();
+    }
+    EVP_CIPHER_CTX_free(ctx);
+    random->blocks += CH_RANDOM_SIZE / 16;
+}
+
+// .. c:function::
+static
+void
+_ch_random_register(void)
+//    :noindex:
+//
+//    see: :c:func:`_ch_random_register`
+//
+// .. code-block:: cpp
+//
+{
+#ifndef _WIN32
+    pthread_atfork(NULL, NULL, _ch_random_atfork_child);
+#endif
+}
+
+// .. c:function::
+void
+ch_random_fill(uint8_t* bytes, size_t len)
+//    :noindex:
+//
+//    see: :c:func:`ch_random_fill`
+//
+// .. code-block:: cpp
+//
+{
+    ch_random_t* random = &_ch_random;
+    if(len > CH_RANDOM_SIZE) {
+        _ch_random_bytes(bytes, len);
+        return;
+    }
+    _ch_random_keystream(random);
+    memcpy(bytes, random->bytes, len);
+    random->left = CH_RANDOM_SIZE - len;
+}
+
+// .. c:function::
+void
+ch_random_init(void)
+//    :noindex:
+//
+//    see: :c:func:`ch_random_init`
+//
+// .. code-block:: cpp
+//
+{
+    uv_once(&_ch_random_once, _ch_random_register);
+}
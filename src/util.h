@@ -50,9 +50,212 @@ ch_realloc(
 //    :param void* buf:    The handle to resize.
 //    :param size_t size:  The new size of the memory in bytes.
 
+// .. c:macro:: CH_RANDOM_SIZE
+//
+//    Size of the random buffer of a thread, 256 serials.
+//
+// .. c:macro:: CH_RANDOM_REKEY
+//
+//    Blocks of the keystream after which a new key is taken, 0 means there
+//    is no key yet.
+//
+// .. code-block:: cpp
+//
+#define CH_RANDOM_SIZE 4096
+#define CH_RANDOM_REKEY (1 << 20)
+
+// .. c:type:: ch_random_t
+//
+//    Random buffer of a thread. It is filled with the AES-128-CTR keystream
+//    of a key taken from the CSPRNG of OpenSSL, which is seeded from the
+//    operating system. The keystream is a lot faster than the CSPRNG, the
+//    cost of filling the buffer is shared by many identities and serials,
+//    and threads don't contend.
+//
+//    .. c:member:: uint8_t bytes[CH_RANDOM_SIZE]
+//
+//       The random bytes, they are used from the front.
+//
+//    .. c:member:: size_t left
+//
+//       Count of bytes not used yet, at the end of the buffer.
+//
+//    .. c:member:: uint8_t key[16]
+//
+//       Key of the keystream.
+//
+//    .. c:member:: uint8_t iv[16]
+//
+//       Nonce (first half) and block counter of the keystream.
+//
+//    .. c:member:: uint64_t blocks
+//
+//       Blocks of the keystream used, a new key is taken after
+//       :c:macro:`CH_RANDOM_REKEY` blocks.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_random_s {
+    uint8_t  bytes[CH_RANDOM_SIZE];
+    size_t   left;
+    uint8_t  key[16];
+    uint8_t  iv[16];
+    uint64_t blocks;
+} ch_random_t;
+
+// .. c:var:: _ch_random
+//
+//    Random buffer of the current thread, see :c:type:`ch_random_t`.
+//
+// .. code-block:: cpp
+//
+extern ch_thread_local ch_random_t _ch_random;
+
+// .. c:function::
+void
+ch_random_fill(uint8_t* bytes, size_t len);
+//
+//    Refill the random buffer of the thread and fill in random bytes.
+//    Slow path of :c:func:`ch_random_ints_as_bytes`.
+//
+//    :param uint8_t* bytes:  The buffer to fill the bytes into.
+//    :param size_t  len:     The length of the buffer.
+
+// .. c:function::
+void
+ch_random_init(void);
+//
+//    Make sure a child process does not use the random bytes of its parent.
+//    Called by :c:func:`ch_libchirp_init`.
+
 // Definitions
 // ===========
 
+// .. c:function::
+static
+ch_inline
+void*
+ch_atomic_load_ptr(void** ptr)
+//
+//    Load a pointer published by :c:func:`ch_atomic_store_ptr`. Everything
+//    written before the pointer was stored is visible after loading it
+//    (acquire).
+//
+//    :param void** ptr: The location of the pointer.
+//
+//    :return: the pointer
+//    :rtype:  void*
+//
+// .. code-block:: cpp
+//
+{
+#ifdef _MSC_VER
+    void* tmp_ptr = *(void* volatile*) ptr;
+    MemoryBarrier();
+    return tmp_ptr;
+#else // _MSC_VER
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif // _MSC_VER
+}
+
+// .. c:function::
+static
+ch_inline
+uint64_t
+ch_atomic_load_u64(uint64_t* ptr)
+//
+//    Load a counter published by :c:func:`ch_atomic_store_u64` (acquire).
+//
+//    :param uint64_t* ptr: The location of the counter.
+//
+//    :return: the counter
+//    :rtype:  uint64_t
+//
+// .. code-block:: cpp
+//
+{
+#ifdef _MSC_VER
+    uint64_t tmp_val = *(volatile uint64_t*) ptr;
+    MemoryBarrier();
+    return tmp_val;
+#else // _MSC_VER
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif // _MSC_VER
+}
+
+// .. c:function::
+static
+ch_inline
+uint64_t
+ch_atomic_add_u64(uint64_t* ptr, uint64_t value)
+//
+//    Add to a counter shared by threads (full barrier). Adding 0 reads the
+//    counter in the same total order as the changes.
+//
+//    :param uint64_t* ptr: The location of the counter.
+//    :param uint64_t value: The value to add, wraps around like unsigned
+//                           arithmetic.
+//
+//    :return: the new value of the counter
+//    :rtype:  uint64_t
+//
+// .. code-block:: cpp
+//
+{
+#ifdef _MSC_VER
+    return (uint64_t) InterlockedExchangeAdd64(
+        (volatile LONG64*) ptr,
+        (LONG64) value
+    ) + value;
+#else // _MSC_VER
+    return __atomic_add_fetch(ptr, value, __ATOMIC_SEQ_CST);
+#endif // _MSC_VER
+}
+
+// .. c:function::
+static
+ch_inline
+void
+ch_atomic_store_ptr(void** ptr, void* value)
+//
+//    Publish a pointer to other threads (release).
+//
+//    :param void** ptr: The location of the pointer.
+//    :param void* value: The pointer to publish.
+//
+// .. code-block:: cpp
+//
+{
+#ifdef _MSC_VER
+    MemoryBarrier();
+    *(void* volatile*) ptr = value;
+#else // _MSC_VER
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+#endif // _MSC_VER
+}
+
+// .. c:function::
+static
+ch_inline
+void
+ch_atomic_store_u64(uint64_t* ptr, uint64_t value)
+//
+//    Publish a counter to other threads (release).
+//
+//    :param uint64_t* ptr: The location of the counter.
+//    :param uint64_t value: The value to publish.
+//
+// .. code-block:: cpp
+//
+{
+#ifdef _MSC_VER
+    MemoryBarrier();
+    *(volatile uint64_t*) ptr = value;
+#else // _MSC_VER
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+#endif // _MSC_VER
+}
+
 // .. c:function::
 static
 ch_inline
@@ -79,6 +282,40 @@ ch_bytes_to_hex(uint8_t* bytes, size_t bytes_size, char* str, size_t str_size)
     *str = 0;
 }
 
+// .. c:function::
+static
+ch_inline
+uint64_t
+ch_hash64(const uint8_t* bytes, size_t len, uint64_t seed)
+//
+//    Hash a buffer to 64 bits. FNV-1a followed by the finalizer of
+//    splitmix64, so that similar inputs (like consecutive replica indexes)
+//    are spread over the whole range. Not suitable against attackers.
+//
+//    :param uint8_t* bytes: The buffer to hash.
+//    :param size_t len:     The length of the buffer.
+//    :param uint64_t seed:  Seed mixed into the hash.
+//
+//    :return:               the hash
+//    :rtype:                uint64_t
+//
+// .. code-block:: cpp
+//
+{
+    size_t i;
+    uint64_t hash = 14695981039346656037ULL ^ seed;
+    for(i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return hash;
+}
+
 // .. c:function::
 static
 ch_inline
@@ -111,10 +348,9 @@ ch_inline
 void
 ch_random_ints_as_bytes(uint8_t* bytes, size_t len)
 //
-//    Fill in random ints efficiently.
-//    The parameter ``len`` MUST be multiple of four.
-//
-//    Thank you windows, for making this really complicated.
+//    Fill in random bytes efficiently, they are taken from the random buffer
+//    of the thread (see :c:type:`ch_random_t`). Used for identities and
+//    serials, so they are unpredictable and don't collide between nodes.
 //
 //    :param uint8_t* bytes:  The buffer to fill the bytes into.
 //    :param size_t  len:     The length of the buffer.
@@ -122,39 +358,33 @@ ch_random_ints_as_bytes(uint8_t* bytes, size_t len)
 // .. code-block:: cpp
 //
 {
-    size_t i;
-    int tmp_rand;
-    A(len % 4 == 0, "len must be multiple of four");
-#ifdef _WIN32
-#   if RAND_MAX < 16384 || INT_MAX < 16384 // 2**14
-#       error Seriously broken compiler or platform
-#   else // RAND_MAX < 16384 || INT_MAX < 16384
-        for(i = 0; i < len; i += 2) {
-            tmp_rand = rand();
-            memcpy(bytes + i, &tmp_rand, 2);
-        }
-#   endif // RAND_MAX < 16384 || INT_MAX < 16384
-#else // _WIN32
-#   if RAND_MAX < 1073741824 || INT_MAX < 1073741824 // 2**30
-#       ifdef CH_ACCEPT_STRANGE_PLATFORM
-            /* WTF, fallback platform */
-            (void)(tmp_rand);
-            for(i = 0; i < len; i++) {
-                bytes[i] = ((unsigned int) rand()) % 256;
-            }
-#       else // ACCEPT_STRANGE_PLATFORM
-            // cppcheck-suppress preprocessorErrorDirective
-#           error Unexpected RAND_MAX / INT_MAX, define \
-                CH_ACCEPT_STRANGE_PLATFORM
-#       endif // ACCEPT_STRANGE_PLATFORM
-#   else // RAND_MAX < 1073741824 || INT_MAX < 1073741824
-        /* Tested: this is 4 times faster*/
-        for(i = 0; i < len; i += 4) {
-            tmp_rand = rand();
-            memcpy(bytes + i, &tmp_rand, 4);
-        }
-#   endif // RAND_MAX < 1073741824 || INT_MAX < 1073741824
-#endif // _WIN32
+    ch_random_t* random = &_ch_random;
+    if(len > random->left) {
+        ch_random_fill(bytes, len);
+        return;
+    }
+    memcpy(bytes, random->bytes + CH_RANDOM_SIZE - random->left, len);
+    random->left -= len;
+}
+
+// .. c:function::
+static
+ch_inline
+uint32_t
+ch_random_u32(void)
+//
+//    Get a random integer, use it instead of rand(), which is not
+//    thread-safe.
+//
+//    :return: the random integer
+//    :rtype:  uint32_t
+//
+// .. code-block:: cpp
+//
+{
+    uint32_t value;
+    ch_random_ints_as_bytes((uint8_t*) &value, sizeof(value));
+    return value;
 }
 
 // .. c:function::
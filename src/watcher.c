@@ -0,0 +1,206 @@
+// =======
+// Watcher
+// =======
+//
+// Liveness detection, see :c:type:`ch_watcher_t`.
+//
+// .. code-block:: cpp
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "watcher.h"
+#include "chirp.h"
+
+// Declarations
+// ============
+
+// .. c:function::
+static
+ch_inline
+ch_connection_t*
+_ch_wa_check(ch_chirp_t* chirp, uint64_t now);
+//
+//    Check all connections: ping the ones that were idle for an interval.
+//    Stops at the first dead connection. Connections we stopped reading from
+//    (flow control) are skipped.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    :param uint64_t now: Current loop time in milliseconds.
+//
+//    :return: the first dead connection or NULL
+//    :rtype:  ch_connection_t*
+
+// .. c:function::
+static
+void
+_ch_wa_timer_cb(uv_timer_t* handle);
+//
+//    Called every :c:member:`ch_config_t.WATCH_INTERVAL`. Pings idle
+//    connections and shuts down connections of dead peers.
+//
+//    :param uv_timer_t* handle: The timer of the watcher, contains chirp (as
+//                               data).
+
+// Definitions
+// ===========
+
+// .. c:function::
+static
+ch_inline
+ch_connection_t*
+_ch_wa_check(ch_chirp_t* chirp, uint64_t now)
+//    :noindex:
+//
+//    see: :c:func:`_ch_wa_check`
+//
+// .. code-block:: cpp
+//
+{
+    ch_connection_t* conn;
+    struct sglib_ch_connection_t_iterator it;
+    ch_chirp_int_t* ichirp = chirp->_;
+    ch_config_t* config = &ichirp->config;
+    uint64_t interval = (uint64_t) (config->WATCH_INTERVAL * 1000);
+    for(
+            conn = sglib_ch_connection_t_it_init(
+                &it,
+                ichirp->protocol.connections
+            );
+            conn != NULL;
+            conn = sglib_ch_connection_t_it_next(&it)
+    ) {
+        uint64_t idle;
+        if(conn->flags & CH_CN_SHUTTING_DOWN)
+            continue;
+        /* We don't read, so we can't hear the peer. The interval starts
+         * again when reading resumes.
+         */
+        if(conn->flags & CH_CN_READ_STOPPED) {
+            conn->last_activity = now;
+            continue;
+        }
+        idle = now > conn->last_activity ? now - conn->last_activity : 0;
+        if(idle >= interval * config->WATCH_MISSES)
+            return conn;
+        if(idle >= interval)
+            ch_wr_ping(conn, CH_MSG_PING);
+    }
+    return NULL;
+}
+
+// .. c:function::
+static
+void
+_ch_wa_timer_cb(uv_timer_t* handle)
+//    :noindex:
+//
+//    see: :c:func:`_ch_wa_timer_cb`
+//
+// .. code-block:: cpp
+//
+{
+    ch_connection_t* conn;
+    CH_GET_CHIRP(handle);
+    ch_chirp_int_t* ichirp = chirp->_;
+    ch_watcher_t* watcher = &ichirp->watcher;
+    uint64_t now = uv_now(ichirp->loop);
+    /* Shutting down removes the connection from the tree, which invalidates
+     * the iterator, so we restart the check. Dead peers are rare.
+     */
+    while((conn = _ch_wa_check(chirp, now)) != NULL) {
+        uint8_t ip_protocol = conn->ip_protocol;
+        int32_t port = conn->port;
+        uint8_t address[16];
+        memcpy(address, conn->address, sizeof(address));
+        L(
+            chirp,
+            "Peer missed %d intervals, it is dead -> shutdown. "
+            "ch_chirp_t:%p, ch_connection_t:%p",
+            ichirp->config.WATCH_MISSES,
+            (void*) chirp,
+            (void*) conn
+        );
+        ch_cn_shutdown(conn, CH_SHUTDOWN_DEAD);
+        if(watcher->dead_cb != NULL)
+            watcher->dead_cb(chirp, ip_protocol, address, port);
+    }
+}
+
+// .. c:function::
+void
+ch_chirp_set_peer_dead_cb(ch_chirp_t* chirp, ch_peer_dead_cb_t dead_cb)
+//    :noindex:
+//
+//    see: :c:func:`ch_chirp_set_peer_dead_cb`
+//
+// .. code-block:: cpp
+//
+{
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    chirp->_->watcher.dead_cb = dead_cb;
+}
+
+// .. c:function::
+ch_error_t
+ch_wa_start(ch_watcher_t* watcher)
+//    :noindex:
+//
+//    see: :c:func:`ch_wa_start`
+//
+// .. code-block:: cpp
+//
+{
+    int tmp_err;
+    ch_chirp_t* chirp = watcher->chirp;
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    ch_chirp_int_t* ichirp = chirp->_;
+    uint64_t interval = (uint64_t) (ichirp->config.WATCH_INTERVAL * 1000);
+    tmp_err = uv_timer_init(ichirp->loop, &watcher->timer);
+    if(tmp_err != CH_SUCCESS) {
+        E(
+            chirp,
+            "Initializing watcher timer failed: %d. ch_chirp_t:%p",
+            tmp_err,
+            (void*) chirp
+        );
+        return CH_UV_ERROR;
+    }
+    watcher->timer.data = chirp;
+    if(interval == 0)
+        return CH_SUCCESS;
+    tmp_err = uv_timer_start(
+        &watcher->timer,
+        _ch_wa_timer_cb,
+        interval,
+        interval
+    );
+    if(tmp_err != CH_SUCCESS) {
+        E(
+            chirp,
+            "Starting watcher timer failed: %d. ch_chirp_t:%p",
+            tmp_err,
+            (void*) chirp
+        );
+        return CH_UV_ERROR;
+    }
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+void
+ch_wa_stop(ch_watcher_t* watcher)
+//    :noindex:
+//
+//    see: :c:func:`ch_wa_stop`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t* chirp = watcher->chirp;
+    uv_timer_stop(&watcher->timer);
+    uv_close((uv_handle_t*) &watcher->timer, ch_chirp_close_cb);
+    chirp->_->closing_tasks += 1;
+}
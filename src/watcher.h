@@ -0,0 +1,96 @@
+// ==============
+// Watcher header
+// ==============
+//
+// The watcher checks if peers are alive. Any data received from a peer
+// (messages, acks or pongs) counts as heartbeat, so busy peers cause no extra
+// traffic. A completed write is no heartbeat: it only means the kernel took
+// the data, not that the peer read it. Only connections that were idle for a
+// whole interval get a ping, it is queued behind pending messages.
+// If a peer is silent for :c:member:`ch_config_t.WATCH_MISSES` intervals it is
+// dead: its connection is shut down and the peer-dead callback is called.
+//
+// All connections are checked by one timer per chirp instance.
+//
+// .. code-block:: cpp
+//
+#ifndef ch_watcher_h
+#define ch_watcher_h
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "common.h"
+#include "libchirp/chirp.h"
+
+// Declarations
+// ============
+
+// .. c:type:: ch_watcher_t
+//
+//    Watcher object.
+//
+//    .. c:member:: uv_timer_t timer
+//
+//       The shared timer checking all connections.
+//
+//    .. c:member:: ch_peer_dead_cb_t dead_cb
+//
+//       Called when a peer is considered dead, can be NULL.
+//
+//    .. c:member:: ch_chirp_t* chirp
+//
+//       Pointer to the chirp object. See: :c:type:`ch_chirp_t`.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_watcher_s {
+    uv_timer_t        timer;
+    ch_peer_dead_cb_t dead_cb;
+    ch_chirp_t*       chirp;
+} ch_watcher_t;
+
+// .. c:function::
+ch_error_t
+ch_wa_start(ch_watcher_t* watcher);
+//
+//    Start the watcher. Does nothing if
+//    :c:member:`ch_config_t.WATCH_INTERVAL` is 0.
+//
+//    :param ch_watcher_t* watcher: Watcher which shall be started.
+//
+//    :return: A chirp error. see: :c:type:`ch_error_t`
+//    :rtype:  ch_error_t
+
+// .. c:function::
+void
+ch_wa_stop(ch_watcher_t* watcher);
+//
+//    Stop the watcher and close its timer.
+//
+//    :param ch_watcher_t* watcher: Watcher which shall be stopped.
+
+// Definitions
+// ===========
+
+// .. c:function::
+static
+ch_inline
+void
+ch_wa_init(ch_chirp_t* chirp, ch_watcher_t* watcher)
+//
+//    Initialize the watcher structure.
+//
+//    :param ch_chirp_t* chirp: Chirp instance.
+//    :param ch_watcher_t* watcher: Watcher to initialize.
+//
+// .. code-block:: cpp
+//
+{
+    memset(watcher, 0, sizeof(ch_watcher_t));
+    watcher->chirp = chirp;
+}
+
+#endif //ch_watcher_h
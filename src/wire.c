@@ -0,0 +1,265 @@
+// ====
+// Wire
+// ====
+//
+// Compact frame encoding, see :c:type:`ch_wi_table_t`.
+//
+// .. code-block:: cpp
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "wire.h"
+
+// Declarations
+// ============
+
+// .. c:function::
+static
+ch_inline
+int
+_ch_wi_has_payload(uint8_t message_type);
+//
+//    Check if frames of the type carry identity and lengths.
+//
+//    :param uint8_t message_type: Type of the frame.
+//
+//    :return: 0 for acks, pings and pongs, 1 otherwise
+//    :rtype:  int
+
+// .. c:function::
+static
+ch_inline
+size_t
+_ch_wi_put_varint(uint8_t* buf, uint32_t value);
+//
+//    Encode a varint.
+//
+//    :param uint8_t* buf:   Out: The varint, up to 5 bytes.
+//    :param uint32_t value: Value to encode.
+//
+//    :return: the length of the varint
+//    :rtype:  size_t
+
+// .. c:function::
+static
+ch_inline
+int
+_ch_wi_get_varint(
+        const uint8_t* buf,
+        size_t len,
+        size_t* pos,
+        uint32_t max,
+        uint32_t* value
+);
+//
+//    Decode a varint.
+//
+//    :param const uint8_t* buf: The frame.
+//    :param size_t len:         Length of the frame.
+//    :param size_t* pos:        In/out: Position of the varint.
+//    :param uint32_t max:       Maximum value allowed.
+//    :param uint32_t* value:    Out: The value.
+//
+//    :return: 0 on success, -1 if the varint is invalid
+//    :rtype:  int
+
+// Definitions
+// ===========
+
+// .. c:function::
+static
+ch_inline
+int
+_ch_wi_has_payload(uint8_t message_type)
+//    :noindex:
+//
+//    see: :c:func:`_ch_wi_has_payload`
+//
+// .. code-block:: cpp
+//
+{
+    return !(message_type & (CH_MSG_ACK | CH_MSG_PING | CH_MSG_PONG));
+}
+
+// .. c:function::
+static
+ch_inline
+size_t
+_ch_wi_put_varint(uint8_t* buf, uint32_t value)
+//    :noindex:
+//
+//    see: :c:func:`_ch_wi_put_varint`
+//
+// .. code-block:: cpp
+//
+{
+    size_t len = 0;
+    while(value >= 0x80) {
+        buf[len++] = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    buf[len++] = (uint8_t) value;
+    return len;
+}
+
+// .. c:function::
+static
+ch_inline
+int
+_ch_wi_get_varint(
+        const uint8_t* buf,
+        size_t len,
+        size_t* pos,
+        uint32_t max,
+        uint32_t* value
+)
+//    :noindex:
+//
+//    see: :c:func:`_ch_wi_get_varint`
+//
+// .. code-block:: cpp
+//
+{
+    int shift = 0;
+    uint64_t result = 0;
+    for(;;) {
+        if(*pos >= len || shift > 28)
+            return -1;
+        uint8_t byte = buf[*pos];
+        *pos += 1;
+        result |= (uint64_t) (byte & 0x7F) << shift;
+        if(!(byte & 0x80))
+            break;
+        shift += 7;
+    }
+    if(result > max)
+        return -1;
+    *value = (uint32_t) result;
+    return 0;
+}
+
+// .. c:function::
+ch_error_t
+ch_wi_decode(
+        ch_wi_table_t* table,
+        const uint8_t* frame,
+        size_t len,
+        ch_msg_message_t* msg
+)
+//    :noindex:
+//
+//    see: :c:func:`ch_wi_decode`
+//
+// .. code-block:: cpp
+//
+{
+    uint32_t header_len;
+    uint32_t actor_len;
+    uint32_t data_len;
+    uint8_t type;
+    size_t pos = 1 + 16;
+    if(len < CH_WI_MIN)
+        return CH_PROTOCOL_ERROR;
+    type = frame[0];
+    msg->message_type = type & ~CH_WI_REF;
+    memcpy(msg->serial, frame + 1, 16);
+    if(!_ch_wi_has_payload(type)) {
+        memset(msg->identity, 0, sizeof(msg->identity));
+        msg->header_len = 0;
+        msg->actor_len  = 0;
+        msg->data_len   = 0;
+        return len == pos ? CH_SUCCESS : CH_PROTOCOL_ERROR;
+    }
+    if(type & CH_WI_REF) {
+        if(pos >= len || frame[pos] >= CH_WI_IDENTITIES)
+            return CH_PROTOCOL_ERROR;
+        memcpy(msg->identity, table->identities[frame[pos]], 16);
+        pos += 1;
+    } else {
+        if(pos + 16 > len)
+            return CH_PROTOCOL_ERROR;
+        memcpy(msg->identity, frame + pos, 16);
+        memcpy(table->identities[table->next], frame + pos, 16);
+        table->next = (table->next + 1) % CH_WI_IDENTITIES;
+        pos += 16;
+    }
+    if(
+            _ch_wi_get_varint(frame, len, &pos, 0xFFFF, &header_len) ||
+            _ch_wi_get_varint(frame, len, &pos, 0xFFFF, &actor_len) ||
+            _ch_wi_get_varint(frame, len, &pos, 0xFFFFFFFF, &data_len) ||
+            pos != len
+    )
+        return CH_PROTOCOL_ERROR;
+    msg->header_len = (uint16_t) header_len;
+    msg->actor_len  = (uint16_t) actor_len;
+    msg->data_len   = data_len;
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+size_t
+ch_wi_encode(
+        ch_wi_table_t* table,
+        const ch_message_t* msg,
+        uint8_t message_type,
+        uint8_t* frame
+)
+//    :noindex:
+//
+//    see: :c:func:`ch_wi_encode`
+//
+// .. code-block:: cpp
+//
+{
+    uint8_t i;
+    size_t len = 1 + 16;
+    frame[0] = message_type;
+    memcpy(frame + 1, msg->serial, 16);
+    if(!_ch_wi_has_payload(message_type))
+        return len;
+    for(i = 0; i < CH_WI_IDENTITIES; i++) {
+        if(memcmp(table->identities[i], msg->identity, 16) == 0)
+            break;
+    }
+    if(i < CH_WI_IDENTITIES) {
+        frame[0]   |= CH_WI_REF;
+        frame[len++] = i;
+    } else {
+        memcpy(frame + len, msg->identity, 16);
+        memcpy(table->identities[table->next], msg->identity, 16);
+        table->next = (table->next + 1) % CH_WI_IDENTITIES;
+        len += 16;
+    }
+    len += _ch_wi_put_varint(frame + len, msg->header_len);
+    len += _ch_wi_put_varint(frame + len, msg->actor_len);
+    len += _ch_wi_put_varint(frame + len, msg->data_len);
+    return len;
+}
+
+// .. c:function::
+size_t
+ch_wi_size(const uint8_t* frame, size_t len)
+//    :noindex:
+//
+//    see: :c:func:`ch_wi_size`
+//
+// .. code-block:: cpp
+//
+{
+    int varints;
+    size_t size = CH_WI_MIN;
+    if(len == 0 || !_ch_wi_has_payload(frame[0]))
+        return size;
+    size += frame[0] & CH_WI_REF ? 1 : 16;
+    /* Every varint ends with a byte without the high bit. */
+    for(varints = 3; varints > 0 && size < len; size++) {
+        if(!(frame[size] & 0x80))
+            varints -= 1;
+    }
+    size += varints;
+    /* An invalid frame ends at the maximum, decoding fails then. */
+    return size < CH_WI_MAX ? size : CH_WI_MAX;
+}
@@ -0,0 +1,140 @@
+// ===========
+// Wire header
+// ===========
+//
+// Compact frame encoding, used on a connection if both nodes announce
+// :c:member:`ch_rd_hs_flags_t.CH_RD_HS_COMPACT` in the handshake (see
+// :c:member:`ch_config_t.COMPACT_WIRE`). The classic frame is
+// :c:type:`ch_msg_message_t` with fixed-width fields. A compact frame is::
+//
+//    type:1 serial:16 [identity:16 | index:1] header_len actor_len data_len
+//
+// The lengths are varints: 7 bits per byte, least significant first, the
+// high bit is set if another byte follows. Acks, pings and pongs only carry
+// type and serial, the remote needs nothing else.
+//
+// Each direction of a connection has a table of the last
+// :c:macro:`CH_WI_IDENTITIES` identities sent. If the identity of a message
+// is in the table, the sender sets :c:macro:`CH_WI_REF` in the type and
+// sends its index. Otherwise it sends the identity and both sides put it
+// into the next slot of their table. TCP keeps the frames in order, so the
+// tables stay the same.
+//
+// .. code-block:: cpp
+//
+#ifndef ch_wire_h
+#define ch_wire_h
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "common.h"
+#include "libchirp/message.h"
+
+// Declarations
+// ============
+
+// .. c:macro:: CH_WI_IDENTITIES
+//
+//    Size of the identity table of a direction.
+//
+// .. c:macro:: CH_WI_MIN
+//
+//    Size of the smallest compact frame: an ack.
+//
+// .. c:macro:: CH_WI_MAX
+//
+//    Maximum size of a compact frame.
+//
+// .. c:macro:: CH_WI_REF
+//
+//    Bit of the type: an index into the identity table follows instead of
+//    the identity. The message types (:c:type:`ch_msg_types_t`) use the
+//    lower bits.
+//
+// .. code-block:: cpp
+//
+#define CH_WI_IDENTITIES 16
+#define CH_WI_MIN 17
+#define CH_WI_MAX (1 + 16 + 16 + 3 + 3 + 5)
+#define CH_WI_REF (1 << 7)
+
+// .. c:type:: ch_wi_table_t
+//
+//    Identities recently sent in one direction of a connection.
+//
+//    .. c:member:: uint8_t identities[CH_WI_IDENTITIES][16]
+//
+//       The identities.
+//
+//    .. c:member:: uint8_t next
+//
+//       Slot the next identity not in the table is put into.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_wi_table_s {
+    uint8_t identities[CH_WI_IDENTITIES][16];
+    uint8_t next;
+} ch_wi_table_t;
+
+// .. c:function::
+ch_error_t
+ch_wi_decode(
+        ch_wi_table_t* table,
+        const uint8_t* frame,
+        size_t len,
+        ch_msg_message_t* msg
+);
+//
+//    Decode a complete compact frame, see :c:func:`ch_wi_size`.
+//
+//    :param ch_wi_table_t* table:  Identities received on the connection.
+//    :param const uint8_t* frame:  The frame.
+//    :param size_t len:            Length of the frame.
+//    :param ch_msg_message_t* msg: Out: The wire message in host order.
+//                                  Acks, pings and pongs have no identity.
+//
+//    :return: A chirp error, CH_PROTOCOL_ERROR if the frame is invalid.
+//             see: :c:type:`ch_error_t`
+//    :rtype:  ch_error_t
+
+// .. c:function::
+size_t
+ch_wi_encode(
+        ch_wi_table_t* table,
+        const ch_message_t* msg,
+        uint8_t message_type,
+        uint8_t* frame
+);
+//
+//    Encode the compact frame of a message.
+//
+//    :param ch_wi_table_t* table:    Identities sent on the connection.
+//    :param const ch_message_t* msg: The message.
+//    :param uint8_t message_type:    Type of the frame, the type of an ack
+//                                    differs from the message acknowledged.
+//    :param uint8_t* frame:          Out: :c:macro:`CH_WI_MAX` bytes.
+//
+//    :return: the length of the frame
+//    :rtype:  size_t
+
+// .. c:function::
+size_t
+ch_wi_size(const uint8_t* frame, size_t len);
+//
+//    Size of the compact frame starting with the given bytes. Bytes of the
+//    payload must not be read as part of the frame, so the frame is read
+//    until this size is reached: while varints are incomplete it returns a
+//    lower bound, which is more than ``len``. It is at most
+//    :c:macro:`CH_WI_MAX`.
+//
+//    :param const uint8_t* frame: The bytes of the frame read so far.
+//    :param size_t len:           Count of bytes read so far.
+//
+//    :return: the size, or a lower bound if it is more than ``len``
+//    :rtype:  size_t
+
+#endif //ch_wire_h
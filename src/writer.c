@@ -14,12 +14,33 @@
 //
 #include "writer.h"
 #include "chirp.h"
+#include "histogram.h"
+#include "probes.h"
 #include "protocol.h"
+#include "stats.h"
 #include "util.h"
 
+// System includes
+// ===============
+//
+// .. code-block:: cpp
+//
+#include <math.h>
+
 // Declarations
 // ============
 
+// .. c:function::
+static
+void
+_ch_wr_ack_cb(uv_write_t* req, int status);
+//
+//    Callback which is called after an ack was written. Releases the handler
+//    buffer of the acknowledged message and starts the next write.
+//
+//    :param uv_write_t* req:  Write request.
+//    :param int status:       Write status.
+
 // .. c:function::
 static
 ch_inline
@@ -32,11 +53,9 @@ _ch_wr_check_send_error(
 );
 //
 //    Check if the given status is erroneous (that is, there was an error
-//    during writing) and cleanup if necessary. Cleaning up means shutting down
-//    the given connection instance, stopping the timer for the send-timeout,
-//    unlocking the writer mutex and sending a protocol error
-//    :c:member:`ch_error_t.CH_PROTOCOL_ERROR` callback over the connections
-//    load.
+//    during writing) or if the connection is shutting down. In both cases the
+//    current write is over, :c:func:`ch_cn_write` shuts the connection down
+//    and the shutdown aborts the message, see :c:func:`ch_wr_abort`.
 //
 //    :param ch_chirp_t* chirp:      Pointer to a chirp instance.
 //    :param ch_writer_t* writer:    Pointer to a writer instance.
@@ -51,8 +70,99 @@ _ch_wr_check_send_error(
 // .. c:function::
 static
 ch_inline
+ch_connection_t*
+_ch_wr_connect(ch_chirp_t* chirp, ch_message_t* msg);
+//
+//    Create a connection to the recipient of the message and add it to the
+//    connections of the protocol, so following messages get queued on it.
+//    The send timeout of the writer covers connecting and the handshakes.
+//
+//    :param ch_chirp_t* chirp:  Pointer to a chirp instance.
+//    :param ch_message_t* msg:  Message to the node to connect to.
+//
+//    :return: the connection or NULL if connecting failed
+//    :rtype:  ch_connection_t*
+
+// .. c:function::
+static
 void
-_ch_wr_send(ch_connection_t* conn, ch_message_t* msg, ch_send_cb_t send_cb);
+_ch_wr_connect_cb(uv_connect_t* req, int status);
+//
+//    Called by libuv when the TCP connection has been established or has
+//    failed. Starts the TLS and chirp handshakes.
+//
+//    :param uv_connect_t* req: Connect request, holding the connection.
+//    :param int status:        Connect status.
+
+// .. c:function::
+static
+void
+_ch_wr_handshake_cb(uv_write_t* req, int status);
+//
+//    Callback which is called after the handshake of the reader was written.
+//
+//    :param uv_write_t* req:  Write request.
+//    :param int status:       Write status.
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_wr_msg_done(ch_connection_t* conn, ch_message_t* msg, int status);
+//
+//    The message is done: call its send callback. A failed message is
+//    passed to the retry engine instead, see :c:func:`ch_ry_failed`. The
+//    message must already be removed from the in-flight list.
+//
+//    :param ch_connection_t* conn:  Connection of the writer.
+//    :param ch_message_t* msg:      The current or an in-flight message.
+//    :param int status:             Status passed to the send callback.
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_wr_progress(ch_connection_t* conn);
+//
+//    The writer made progress: restart the send timeout if a message is
+//    being written or waits for its ack, stop it otherwise. With
+//    :c:member:`ch_config_t.FLOW_CONTROL` the credits in use are reported as
+//    load of the remote, see :c:member:`ch_connection_t.load`.
+//
+//    :param ch_connection_t* conn:  Connection of the writer.
+
+// .. c:function::
+static
+ch_inline
+int
+_ch_wr_req_ack(ch_chirp_int_t* ichirp, ch_message_t* msg);
+//
+//    Check if the message has to be acknowledged by the remote and therefore
+//    needs a credit. Pings and pongs are never acknowledged.
+//
+//    :param ch_chirp_int_t* ichirp: Internal chirp instance.
+//    :param ch_message_t* msg:      The message to send.
+//
+//    :return: 1 if the message requires an ack, 0 otherwise.
+//    :rtype:  int
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_wr_rtt_sample(ch_writer_t* writer, float rtt);
+//
+//    Update the round trip estimates of the writer with a sample, like TCP
+//    does (RFC 6298).
+//
+//    :param ch_writer_t* writer: Pointer to a writer instance.
+//    :param float rtt:           Round trip time (ms) of an acked message.
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_wr_send(ch_connection_t* conn, ch_message_t* msg);
 //
 //    Send the message after a connection has been established.
 //
@@ -60,8 +170,6 @@ _ch_wr_send(ch_connection_t* conn, ch_message_t* msg, ch_send_cb_t send_cb);
 //    :param ch_message_t msg:       The message to send. The memory of the
 //                                   message must stay valid until the callback
 //                                   is called.
-//    :param ch_send_cb_t send_cb:   The callback, that will be called after
-//                                   sending.
 
 // .. c:function::
 static
@@ -131,13 +239,9 @@ _ch_wr_send_finish(
     ch_connection_t* conn
 );
 //
-//    Sends a protocol error over the connections load when acknowledging of
-//    messages is disable. Does nothing if not.
-//
-//    If acknowledging is disabled (by configuration), the writers send-timeout
-//    timer is being stopped, the writers mutex is unlocked and a protocol
-//    error :c:member:`ch_error_t.CH_PROTOCOL_ERROR` callback over the
-//    connections load is being sent.
+//    The message has been written. If it doesn't require an ack (or the ack
+//    already arrived), the message is done. Otherwise it is moved to the
+//    in-flight list and the writer continues with the next write.
 //
 //    :param ch_chirp_t* chirp:      Pointer to a chirp instance.
 //    :param ch_writer_t* writer:    Pointer to a writer instance.
@@ -160,24 +264,75 @@ _ch_wr_send_msg_header_cb(uv_write_t* req, int status);
 //    :param uv_write_t* req:  Write request.
 //    :param int status:       Write status.
 
+// .. c:function::
+static
+void
+_ch_wr_ping_cb(ch_chirp_t* chirp, ch_message_t* msg, int status, float load);
+//
+//    Send callback of pings and pongs. Errors are handled by the watcher, so
+//    there is nothing to do.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp instance.
+//    :param ch_message_t* msg: The ping of the writer.
+//    :param int status: Status of the send.
+//    :param float load: The load of the remote peer.
+
 // .. c:function::
 static
 void
 _ch_wr_send_timeout_cb(uv_timer_t* handle);
 //
 //    Callback which is called after the writer reaches its timeout for
-//    sending. The timeout is set by the chirp configuration and is 5 seconds
-//    by default. When this callback is called, the connection is being shut
-//    down, the writers mutex is being unlocked and a timeout error
-//    :c:member:`ch_error_t.CH_TIMEOUT` is being sent over the connections
-//    load.
+//    connecting or sending. The connect timeout is set by the chirp
+//    configuration and is 5 seconds by default, the send timeout adapts to
+//    the round trip time, see :c:func:`_ch_wr_timeout`. When this callback
+//    is called, the connection is
+//    being shut down, which aborts the messages of the writer with a timeout
+//    error :c:member:`ch_error_t.CH_TIMEOUT`.
 //
 //    :param uv_timer_t* handle: Pointer to a timer handle to schedule
 //                               callback.
 
+// .. c:function::
+static
+ch_inline
+uint64_t
+_ch_wr_timeout(ch_connection_t* conn);
+//
+//    Timeout (ms) until the next progress of the writer: the ack of the
+//    first in-flight message or the write of the current message. See
+//    :c:member:`ch_writer_t.srtt`.
+//
+//    :param ch_connection_t* conn: Connection of the writer.
+//
+//    :return: the timeout in ms
+//    :rtype:  uint64_t
+
 // Definitions
 // ===========
 
+// .. c:function::
+static
+void
+_ch_wr_ack_cb(uv_write_t* req, int status)
+//    :noindex:
+//
+//    see: :c:func:`_ch_wr_ack_cb`
+//
+// .. code-block:: cpp
+//
+{
+    ch_connection_t* conn = req->data;
+    ch_chirp_t* chirp = conn->chirp;
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    ch_writer_t* writer = &conn->writer;
+    ch_message_t* msg = writer->ack;
+    writer->ack = NULL;
+    ch_rd_free_msg(msg);
+    if(_ch_wr_check_send_error(chirp, writer, conn, status)) return;
+    ch_wr_process_queues(conn);
+}
+
 // .. c:function::
 static
 ch_inline
@@ -195,6 +350,7 @@ _ch_wr_check_send_error(
 // .. code-block:: cpp
 //
 {
+    writer->flags &= ~CH_WR_WRITING;
     if(status != CH_SUCCESS) {
         L(
             chirp,
@@ -204,53 +360,251 @@ _ch_wr_check_send_error(
             (void*) chirp,
             (void*) conn
         );
-        ch_cn_shutdown(conn);
-        uv_timer_stop(&writer->send_timeout);
-        uv_mutex_unlock(&writer->lock);
-        writer->send_cb(CH_PROTOCOL_ERROR, conn->load);
         return CH_PROTOCOL_ERROR;
     }
+    if(conn->flags & CH_CN_SHUTTING_DOWN)
+        return CH_PROTOCOL_ERROR;
     return CH_SUCCESS;
 }
 
 // .. c:function::
 static
 ch_inline
-void
-_ch_wr_send(ch_connection_t* conn, ch_message_t* msg, ch_send_cb_t send_cb)
+ch_connection_t*
+_ch_wr_connect(ch_chirp_t* chirp, ch_message_t* msg)
 //    :noindex:
 //
-//    see: :c:func:`_ch_wr_send`
+//    see: :c:func:`_ch_wr_connect`
 //
 // .. code-block:: cpp
 //
 {
     int tmp_err;
+    struct sockaddr_storage addr;
+    ch_chirp_int_t* ichirp = chirp->_;
+    ch_connection_t* conn = (ch_connection_t*) ch_alloc(
+        sizeof(ch_connection_t)
+    );
+    if(!conn) {
+        E(
+            chirp,
+            "Could not allocate memory for connection. ch_chirp_t:%p",
+            (void*) chirp
+        );
+        return NULL;
+    }
+    if(ch_cn_init(
+            chirp,
+            conn,
+            ichirp->config.DISABLE_ENCRYPTION ? 0 : CH_CN_ENCRYPTED
+    ) != CH_SUCCESS) {
+        E(
+            chirp,
+            "Could not initialize connection. ch_chirp_t:%p",
+            (void*) chirp
+        );
+        ch_free(conn);
+        return NULL;
+    }
+    conn->ip_protocol = msg->ip_protocol;
+    conn->port        = msg->port;
+    memcpy(conn->address, msg->address, sizeof(conn->address));
+    memset(&addr, 0, sizeof(addr));
+    if(msg->ip_protocol == CH_IPV6) {
+        struct sockaddr_in6* saddr = (struct sockaddr_in6*) &addr;
+        saddr->sin6_family = AF_INET6;
+        saddr->sin6_port   = htons(msg->port);
+        memcpy(&saddr->sin6_addr, msg->address, sizeof(saddr->sin6_addr));
+    } else {
+        struct sockaddr_in* saddr = (struct sockaddr_in*) &addr;
+        saddr->sin_family = AF_INET;
+        saddr->sin_port   = htons(msg->port);
+        memcpy(&saddr->sin_addr, msg->address, sizeof(saddr->sin_addr));
+    }
+    uv_tcp_init(ichirp->loop, &conn->client);
+    conn->client.data      = conn;
+    conn->connect_req.data = conn;
+    tmp_err = uv_tcp_connect(
+        &conn->connect_req,
+        &conn->client,
+        (struct sockaddr*) &addr,
+        _ch_wr_connect_cb
+    );
+    if(tmp_err != CH_SUCCESS) {
+        E(
+            chirp,
+            "uv_tcp_connect returned error: %d. ch_chirp_t:%p, "
+            "ch_connection_t:%p",
+            tmp_err,
+            (void*) chirp,
+            (void*) conn
+        );
+        // Closes the handles, the writer has nothing to abort yet
+        ch_cn_shutdown(conn, CH_SHUTDOWN_IO_ERROR);
+        return NULL;
+    }
+    sglib_ch_connection_t_add(&ichirp->protocol.connections, conn);
+    tmp_err = uv_timer_start(
+        &conn->writer.send_timeout,
+        _ch_wr_send_timeout_cb,
+        ichirp->config.TIMEOUT * 1000,
+        0
+    );
+    if(tmp_err != CH_SUCCESS) {
+        E(
+            chirp,
+            "Starting connect timeout failed: %d. ch_connection_t:%p,"
+            " ch_chirp_t:%p",
+            tmp_err,
+            (void*) conn,
+            (void*) chirp
+        );
+    }
+    L(
+        chirp,
+        "Connecting to remote port %d. ch_chirp_t:%p, ch_connection_t:%p",
+        msg->port,
+        (void*) chirp,
+        (void*) conn
+    );
+    return conn;
+}
+
+// .. c:function::
+static
+void
+_ch_wr_connect_cb(uv_connect_t* req, int status)
+//    :noindex:
+//
+//    see: :c:func:`_ch_wr_connect_cb`
+//
+// .. code-block:: cpp
+//
+{
+    ch_connection_t* conn = req->data;
+    ch_chirp_t* chirp = conn->chirp;
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    if(status < 0) {
+        L(
+            chirp,
+            "Connect failed with uv status: %d. ch_chirp_t:%p, "
+            "ch_connection_t:%p",
+            status,
+            (void*) chirp,
+            (void*) conn
+        );
+        ch_cn_shutdown(conn, CH_SHUTDOWN_IO_ERROR);
+        return;
+    }
+    if(conn->flags & CH_CN_SHUTTING_DOWN)
+        return;
+    L(
+        chirp,
+        "Connected. ch_chirp_t:%p, ch_connection_t:%p",
+        (void*) chirp,
+        (void*) conn
+    );
+    ch_pr_conn_start(conn, 0);
+}
 
+// .. c:function::
+static
+void
+_ch_wr_handshake_cb(uv_write_t* req, int status)
+//    :noindex:
+//
+//    see: :c:func:`_ch_wr_handshake_cb`
+//
+// .. code-block:: cpp
+//
+{
+    ch_connection_t* conn = req->data;
     ch_chirp_t* chirp = conn->chirp;
     A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    if(_ch_wr_check_send_error(chirp, &conn->writer, conn, status)) return;
+    ch_wr_process_queues(conn);
+}
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_wr_msg_done(ch_connection_t* conn, ch_message_t* msg, int status)
+//    :noindex:
+//
+//    see: :c:func:`_ch_wr_msg_done`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t* chirp = conn->chirp;
+    ch_writer_t* writer = &conn->writer;
+    float load = ch_mo_load(&chirp->_->monitor, conn->load);
+    if(msg == writer->msg) {
+        writer->msg = NULL;
+        writer->flags &= ~CH_WR_ACKED;
+    }
+    if(msg == &writer->ping)
+        writer->flags &= ~CH_WR_PING;
+    CH_STATS_ADD(conn, sends_pending, -1);
+    if(status != CH_SUCCESS) {
+        ch_ry_failed(chirp, msg, status, load);
+        return;
+    }
+    if(chirp->_->retry.peers != NULL)
+        ch_ry_peer_ok(chirp, conn);
+    ch_sp_done(&chirp->_->spool, msg);
+    msg->_send_cb(chirp, msg, status, load);
+}
+
+// .. c:function::
+static
+void
+_ch_wr_ping_cb(ch_chirp_t* chirp, ch_message_t* msg, int status, float load)
+//    :noindex:
+//
+//    see: :c:func:`_ch_wr_ping_cb`
+//
+// .. code-block:: cpp
+//
+{
+    (void)(chirp);
+    (void)(msg);
+    (void)(status);
+    (void)(load);
+}
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_wr_progress(ch_connection_t* conn)
+//    :noindex:
+//
+//    see: :c:func:`_ch_wr_progress`
+//
+// .. code-block:: cpp
+//
+{
+    int tmp_err;
+
+    ch_chirp_t* chirp = conn->chirp;
     ch_chirp_int_t* ichirp = chirp->_;
     ch_writer_t* writer = &conn->writer;
-    /* We have to lock before starting the timeout. Otherwise the
-     * lock-wait-time would count towards the timeout.
-     */
-    uv_mutex_lock(&writer->lock);
-    /* Use the writers net message structure to write the actual message over
-     * the connection. The net message structure is of type
-     * :c:type:`ch_msg_message_t`, which is actually :c:macro:`CH_WIRE_MESSAGE`.
-     * The difference between ``msg`` and ``net_msg`` is, that ``msg`` is of
-     * type :c:type:`ch_message_t` and ``net_msg`` of type
-     * :c:macro:`CH_WIRE_MESSAGE`. That means ``net_msg`` is stripped down to
-     * essentially only the identity, the serial number, the message type and
-     * the lengths of the header, the actor and the data.
-     */
-    ch_msg_message_t* net_msg = &writer->net_msg;
-    writer->msg = msg;
-    writer->send_cb = send_cb;
+    if(conn->flags & CH_CN_SHUTTING_DOWN)
+        return;
+    if(ichirp->config.FLOW_CONTROL && writer->max_credits > 0) {
+        conn->load = 1.0f - (float) writer->credits / writer->max_credits;
+        conn->load_stamp = uv_now(ichirp->loop);
+    }
+    if(writer->msg == NULL && writer->wait_head == NULL) {
+        uv_timer_stop(&writer->send_timeout);
+        return;
+    }
     tmp_err = uv_timer_start(
         &writer->send_timeout,
         _ch_wr_send_timeout_cb,
-        ichirp->config.TIMEOUT * 1000,
+        _ch_wr_timeout(conn),
         0
     );
     if(tmp_err != CH_SUCCESS) {
@@ -263,6 +617,106 @@ _ch_wr_send(ch_connection_t* conn, ch_message_t* msg, ch_send_cb_t send_cb)
             (void*) chirp
         );
     }
+}
+
+// .. c:function::
+static
+ch_inline
+int
+_ch_wr_req_ack(ch_chirp_int_t* ichirp, ch_message_t* msg)
+//    :noindex:
+//
+//    see: :c:func:`_ch_wr_req_ack`
+//
+// .. code-block:: cpp
+//
+{
+    return (
+        ichirp->config.ACKNOWLEDGE &&
+        !(msg->message_type & (CH_MSG_PING | CH_MSG_PONG))
+    );
+}
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_wr_rtt_sample(ch_writer_t* writer, float rtt)
+//    :noindex:
+//
+//    see: :c:func:`_ch_wr_rtt_sample`
+//
+// .. code-block:: cpp
+//
+{
+    if(writer->srtt == 0) {
+        writer->srtt   = rtt;
+        writer->rttvar = rtt / 2;
+    } else {
+        writer->rttvar = 0.75f * writer->rttvar +
+            0.25f * fabsf(writer->srtt - rtt);
+        writer->srtt   = 0.875f * writer->srtt + 0.125f * rtt;
+    }
+}
+
+// .. c:function::
+static
+ch_inline
+void
+_ch_wr_send(ch_connection_t* conn, ch_message_t* msg)
+//    :noindex:
+//
+//    see: :c:func:`_ch_wr_send`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t* chirp = conn->chirp;
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    ch_chirp_int_t* ichirp = chirp->_;
+    ch_writer_t* writer = &conn->writer;
+    A(writer->msg == NULL, "Another message is being sent");
+    writer->stamp = ch_hg_stage(
+        &ichirp->histograms[CH_HG_QUEUE],
+        msg->_stamp
+    );
+    msg->_stamp = writer->stamp;
+    CH_PROBE2(wr_start, conn, msg);
+    CH_PROBE2(wr_stage, conn, CH_HG_QUEUE);
+    /* Use the writers net message structure to write the actual message over
+     * the connection. The net message structure is of type
+     * :c:type:`ch_msg_message_t`, which is actually :c:macro:`CH_WIRE_MESSAGE`.
+     * The difference between ``msg`` and ``net_msg`` is, that ``msg`` is of
+     * type :c:type:`ch_message_t` and ``net_msg`` of type
+     * :c:macro:`CH_WIRE_MESSAGE`. That means ``net_msg`` is stripped down to
+     * essentially only the identity, the serial number, the message type and
+     * the lengths of the header, the actor and the data.
+     */
+    ch_msg_message_t* net_msg = &writer->net_msg;
+    writer->msg    = msg;
+    writer->flags |= CH_WR_WRITING;
+    if(_ch_wr_req_ack(ichirp, msg)) {
+        A(writer->credits > 0, "No credit left");
+        msg->message_type |= CH_MSG_REQ_ACK;
+        writer->credits -= 1;
+    } else
+        msg->message_type &= ~CH_MSG_REQ_ACK;
+    CH_STATS_ADD(conn, sends_pending, 1);
+    _ch_wr_progress(conn);
+    if(conn->flags & CH_CN_COMPACT) {
+        ch_cn_write(
+            conn,
+            writer->frame,
+            ch_wi_encode(
+                &writer->identities,
+                msg,
+                msg->message_type,
+                writer->frame
+            ),
+            _ch_wr_send_msg_header_cb
+        );
+        return;
+    }
     memcpy(
         net_msg->serial,
         msg->serial,
@@ -273,9 +727,10 @@ _ch_wr_send(ch_connection_t* conn, ch_message_t* msg, ch_send_cb_t send_cb)
         msg->identity,
         sizeof(net_msg->identity)
     );
-    net_msg->header_len = htons(msg->header_len);
-    net_msg->actor_len  = htons(msg->actor_len);
-    net_msg->data_len   = htonl(msg->data_len);
+    net_msg->message_type = msg->message_type;
+    net_msg->header_len   = htons(msg->header_len);
+    net_msg->actor_len    = htons(msg->actor_len);
+    net_msg->data_len     = htonl(msg->data_len);
     ch_cn_write(
         conn,
         net_msg,
@@ -301,14 +756,20 @@ _ch_wr_send_actor_cb(uv_write_t* req, int status)
     ch_writer_t* writer = &conn->writer;
     ch_message_t* msg = writer->msg;
     if(_ch_wr_check_send_error(chirp, writer, conn, status)) return;
-    if(msg->data_len > 0)
+    writer->stamp = ch_hg_stage(
+        &chirp->_->histograms[CH_HG_ACTOR],
+        writer->stamp
+    );
+    CH_PROBE2(wr_stage, conn, CH_HG_ACTOR);
+    if(msg->data_len > 0) {
+        writer->flags |= CH_WR_WRITING;
         ch_cn_write(
             conn,
             msg->data,
             msg->data_len,
             _ch_wr_send_data_cb
         );
-    else
+    } else
         _ch_wr_send_finish(chirp, writer, conn);
 }
 
@@ -328,6 +789,11 @@ _ch_wr_send_data_cb(uv_write_t* req, int status)
     A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
     ch_writer_t* writer = &conn->writer;
     if(_ch_wr_check_send_error(chirp, writer, conn, status)) return;
+    writer->stamp = ch_hg_stage(
+        &chirp->_->histograms[CH_HG_DATA],
+        writer->stamp
+    );
+    CH_PROBE2(wr_stage, conn, CH_HG_DATA);
     _ch_wr_send_finish(chirp, writer, conn);
 }
 
@@ -347,12 +813,37 @@ _ch_wr_send_finish(
 // .. code-block:: cpp
 //
 {
-    ch_chirp_int_t* ichirp  = chirp->_;
-    if(ichirp->config.ACKNOWLEDGE == 0) {
-        uv_timer_stop(&writer->send_timeout);
-        uv_mutex_unlock(&writer->lock);
-        writer->send_cb(CH_PROTOCOL_ERROR, conn->load);
+    (void)(chirp);
+    ch_message_t* msg = writer->msg;
+    uint32_t size = msg->header_len + msg->actor_len + msg->data_len;
+    CH_STATS_ADD(conn, messages_sent, 1);
+    CH_PROBE2(wr_done, conn, msg);
+    if(size >= CH_WR_BW_MIN && writer->stamp > msg->_stamp) {
+        float bandwidth = size * 1e6f / (writer->stamp - msg->_stamp);
+        if(writer->bandwidth == 0)
+            writer->bandwidth = bandwidth;
+        else
+            writer->bandwidth = (
+                0.875f * writer->bandwidth + 0.125f * bandwidth
+            );
     }
+    if(
+            !(msg->message_type & CH_MSG_REQ_ACK) ||
+            writer->flags & CH_WR_ACKED
+    )
+        _ch_wr_msg_done(conn, msg, CH_SUCCESS);
+    else {
+        writer->msg = NULL;
+        msg->_stamp = writer->stamp;
+        msg->_next  = NULL;
+        if(writer->wait_tail == NULL)
+            writer->wait_head = msg;
+        else
+            writer->wait_tail->_next = msg;
+        writer->wait_tail = msg;
+    }
+    _ch_wr_progress(conn);
+    ch_wr_process_queues(conn);
 }
 
 // .. c:function::
@@ -372,6 +863,12 @@ _ch_wr_send_chirp_header_cb(uv_write_t* req, int status)
     ch_writer_t* writer = &conn->writer;
     ch_message_t* msg = writer->msg;
     if(_ch_wr_check_send_error(chirp, writer, conn, status)) return;
+    writer->stamp = ch_hg_stage(
+        &chirp->_->histograms[CH_HG_HEADER],
+        writer->stamp
+    );
+    CH_PROBE2(wr_stage, conn, CH_HG_HEADER);
+    writer->flags |= CH_WR_WRITING;
     if(msg->actor_len > 0)
         ch_cn_write(
             conn,
@@ -386,8 +883,10 @@ _ch_wr_send_chirp_header_cb(uv_write_t* req, int status)
             msg->data_len,
             _ch_wr_send_data_cb
         );
-    else
+    else {
+        writer->flags &= ~CH_WR_WRITING;
         _ch_wr_send_finish(chirp, writer, conn);
+    }
 }
 
 // .. c:function::
@@ -407,6 +906,12 @@ _ch_wr_send_msg_header_cb(uv_write_t* req, int status)
     ch_writer_t* writer = &conn->writer;
     ch_message_t* msg = writer->msg;
     if(_ch_wr_check_send_error(chirp, writer, conn, status)) return;
+    writer->stamp = ch_hg_stage(
+        &chirp->_->histograms[CH_HG_WIRE_HEADER],
+        writer->stamp
+    );
+    CH_PROBE2(wr_stage, conn, CH_HG_WIRE_HEADER);
+    writer->flags |= CH_WR_WRITING;
     if(msg->header_len > 0)
         ch_cn_write(
             conn,
@@ -428,8 +933,10 @@ _ch_wr_send_msg_header_cb(uv_write_t* req, int status)
             msg->data_len,
             _ch_wr_send_data_cb
         );
-    else
+    else {
+        writer->flags &= ~CH_WR_WRITING;
         _ch_wr_send_finish(chirp, writer, conn);
+    }
 }
 
 // .. c:function::
@@ -444,7 +951,6 @@ _ch_wr_send_timeout_cb(uv_timer_t* handle)
 //
 {
     ch_connection_t* conn = handle->data;
-    ch_writer_t* writer = &conn->writer;
     ch_chirp_t* chirp = conn->chirp;
     A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
     L(
@@ -453,10 +959,79 @@ _ch_wr_send_timeout_cb(uv_timer_t* handle)
         (void*) chirp,
         (void*) conn
     );
-    ch_cn_shutdown(conn);
-    uv_timer_stop(&writer->send_timeout);
-    uv_mutex_unlock(&writer->lock);
-    writer->send_cb(CH_TIMEOUT, conn->load);
+    CH_STATS_ADD(conn, send_timeouts, 1);
+    ch_cn_shutdown(conn, CH_SHUTDOWN_TIMEOUT);
+}
+
+// .. c:function::
+static
+ch_inline
+uint64_t
+_ch_wr_timeout(ch_connection_t* conn)
+//    :noindex:
+//
+//    see: :c:func:`_ch_wr_timeout`
+//
+// .. code-block:: cpp
+//
+{
+    ch_writer_t* writer = &conn->writer;
+    float max = conn->chirp->_->config.TIMEOUT * 1000;
+    ch_message_t* msg = writer->wait_head;
+    uint32_t size;
+    float timeout;
+    if(msg == NULL)
+        msg = writer->msg;
+    size = msg->header_len + msg->actor_len + msg->data_len;
+    if(writer->srtt == 0)
+        return max;
+    timeout = writer->srtt + 4 * writer->rttvar;
+    if(size >= CH_WR_BW_MIN) {
+        /* We can't guess the transfer time yet. */
+        if(writer->bandwidth == 0)
+            return max;
+        timeout += 2 * size / writer->bandwidth;
+    }
+    if(timeout < CH_WR_MIN_TIMEOUT)
+        timeout = CH_WR_MIN_TIMEOUT;
+    if(timeout > max)
+        timeout = max;
+    return timeout;
+}
+
+// .. c:function::
+int
+ch_chirp_get_credits(
+        ch_chirp_t* chirp,
+        ch_ip_protocol_t ip_protocol,
+        const uint8_t* address,
+        int32_t port
+)
+//    :noindex:
+//
+//    see: :c:func:`ch_chirp_get_credits`
+//
+// .. code-block:: cpp
+//
+{
+    ch_connection_t search_conn;
+    ch_connection_t* conn;
+
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    search_conn.ip_protocol = ip_protocol;
+    search_conn.port        = port;
+    memcpy(
+        search_conn.address,
+        address,
+        ip_protocol == CH_IPV6 ? 16 : 4
+    );
+    conn = sglib_ch_connection_t_find_member(
+        chirp->_->protocol.connections,
+        &search_conn
+    );
+    if(conn == NULL || !(conn->flags & CH_CN_CONNECTED))
+        return -1;
+    return conn->writer.credits;
 }
 
 //
@@ -469,13 +1044,154 @@ ch_chirp_send(ch_chirp_t* chirp, ch_message_t* msg, ch_send_cb_t send_cb)
 //
 // .. code-block:: cpp
 //
+{
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    ch_random_ints_as_bytes(msg->serial, sizeof(msg->serial));
+    msg->_send_cb = send_cb;
+    msg->_retries = 0;
+    msg->_spool   = NULL;
+    if(
+            chirp->_->spool.file != -1 &&
+            !(chirp->_->flags & CH_CHIRP_CLOSING)
+    )
+        ch_sp_add(&chirp->_->spool, msg);
+    else
+        ch_wr_enqueue(chirp, msg);
+}
+
+// .. c:function::
+void
+ch_wr_abort(ch_connection_t* conn, int status)
+//    :noindex:
+//
+//    see: :c:func:`ch_wr_abort`
+//
+// .. code-block:: cpp
+//
+{
+    ch_message_t* msg;
+    ch_chirp_t* chirp = conn->chirp;
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    ch_writer_t* writer = &conn->writer;
+    uv_timer_stop(&writer->send_timeout);
+    if(
+            (status == CH_CANNOT_CONNECT || status == CH_TIMEOUT) &&
+            (writer->msg || writer->wait_head || writer->queue_head)
+    )
+        ch_ry_peer_failed(chirp, conn);
+    while(writer->wait_head != NULL) {
+        msg = writer->wait_head;
+        writer->wait_head = msg->_next;
+        _ch_wr_msg_done(conn, msg, status);
+    }
+    writer->wait_tail = NULL;
+    if(writer->msg != NULL)
+        _ch_wr_msg_done(conn, writer->msg, status);
+    while(writer->queue_head != NULL) {
+        msg = writer->queue_head;
+        writer->queue_head = msg->_next;
+        ch_ry_failed(
+            chirp,
+            msg,
+            status,
+            ch_mo_load(&chirp->_->monitor, conn->load)
+        );
+    }
+    writer->queue_tail = NULL;
+    writer->flags     &= ~CH_WR_PING;
+    while(writer->ack_head != NULL) {
+        msg = writer->ack_head;
+        writer->ack_head = msg->_next;
+        ch_rd_free_msg(msg);
+    }
+    writer->ack_tail = NULL;
+}
+
+// .. c:function::
+void
+ch_wr_ack_received(ch_connection_t* conn, uint8_t serial[16])
+//    :noindex:
+//
+//    see: :c:func:`ch_wr_ack_received`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t* chirp = conn->chirp;
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    ch_writer_t* writer = &conn->writer;
+    ch_message_t* msg = writer->msg;
+    ch_message_t* prev = NULL;
+    uint64_t now;
+    if(
+            msg != NULL &&
+            msg->message_type & CH_MSG_REQ_ACK &&
+            memcmp(msg->serial, serial, sizeof(msg->serial)) == 0
+    ) {
+        /* The ack overtook the write callback of the message. */
+        writer->flags |= CH_WR_ACKED;
+        writer->credits += 1;
+        _ch_wr_progress(conn);
+        return;
+    }
+    /* Acks arrive in order, usually the first message matches. */
+    for(msg = writer->wait_head; msg != NULL; msg = msg->_next) {
+        if(memcmp(msg->serial, serial, sizeof(msg->serial)) == 0)
+            break;
+        prev = msg;
+    }
+    if(msg == NULL) {
+        L(
+            chirp,
+            "Unexpected ack. ch_chirp_t:%p, ch_connection_t:%p",
+            (void*) chirp,
+            (void*) conn
+        );
+        return;
+    }
+    if(prev == NULL)
+        writer->wait_head = msg->_next;
+    else
+        prev->_next = msg->_next;
+    if(writer->wait_tail == msg)
+        writer->wait_tail = prev;
+    now = ch_hg_stage(&chirp->_->histograms[CH_HG_ACK], msg->_stamp);
+    _ch_wr_rtt_sample(writer, (now - msg->_stamp) / 1e6f);
+    writer->credits += 1;
+    _ch_wr_msg_done(conn, msg, CH_SUCCESS);
+    _ch_wr_progress(conn);
+    ch_wr_process_queues(conn);
+}
+
+// .. c:function::
+void
+ch_wr_enqueue(ch_chirp_t* chirp, ch_message_t* msg)
+//    :noindex:
+//
+//    see: :c:func:`ch_wr_enqueue`
+//
+// .. code-block:: cpp
+//
 {
     ch_connection_t search_conn;
     ch_connection_t* conn;
 
-    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
     ch_chirp_int_t* ichirp  = chirp->_;
     ch_protocol_t* protocol = &ichirp->protocol;
+    if(ichirp->flags & CH_CHIRP_CLOSING) {
+        msg->_send_cb(chirp, msg, CH_UNINIT, 0);
+        return;
+    }
+    if(ichirp->monitor.overloaded) {
+        ch_sp_done(&ichirp->spool, msg);
+        msg->_send_cb(
+            chirp,
+            msg,
+            CH_OVERLOADED,
+            ch_mo_load(&ichirp->monitor, 0)
+        );
+        return;
+    }
     search_conn.ip_protocol = msg->ip_protocol;
     search_conn.port        = msg->port;
     memcpy(
@@ -487,11 +1203,57 @@ ch_chirp_send(ch_chirp_t* chirp, ch_message_t* msg, ch_send_cb_t send_cb)
         protocol->connections,
         &search_conn
     );
-    ch_random_ints_as_bytes(msg->serial, sizeof(msg->serial));
+    msg->_next  = NULL;
+    msg->_stamp = uv_hrtime();
     if(conn == NULL) {
-        // TODO connect
-    } else
-        _ch_wr_send(conn, msg, send_cb);
+        if(ichirp->retry.peers != NULL && ch_ry_is_open(chirp, msg)) {
+            ch_sp_done(&ichirp->spool, msg);
+            msg->_send_cb(chirp, msg, CH_CANNOT_CONNECT, 0);
+            return;
+        }
+        conn = _ch_wr_connect(chirp, msg);
+        if(conn == NULL) {
+            ch_ry_failed(chirp, msg, CH_CANNOT_CONNECT, 0);
+            return;
+        }
+    }
+    ch_writer_t* writer = &conn->writer;
+    if(writer->queue_tail == NULL)
+        writer->queue_head = msg;
+    else
+        writer->queue_tail->_next = msg;
+    writer->queue_tail = msg;
+    CH_PROBE2(wr_enqueue, conn, msg);
+    ch_wr_process_queues(conn);
+}
+
+// .. c:function::
+int
+ch_wr_ping(ch_connection_t* conn, uint8_t message_type)
+//    :noindex:
+//
+//    see: :c:func:`ch_wr_ping`
+//
+// .. code-block:: cpp
+//
+{
+    ch_writer_t* writer = &conn->writer;
+    ch_message_t* ping = &writer->ping;
+    if(writer->flags & CH_WR_PING || !(conn->flags & CH_CN_CONNECTED))
+        return 0;
+    memset(ping, 0, sizeof(ch_message_t));
+    ping->message_type = message_type;
+    ping->_send_cb     = _ch_wr_ping_cb;
+    ping->_stamp       = uv_hrtime();
+    writer->flags     |= CH_WR_PING;
+    if(writer->queue_tail == NULL)
+        writer->queue_head = ping;
+    else
+        writer->queue_tail->_next = ping;
+    writer->queue_tail = ping;
+    CH_PROBE2(wr_enqueue, conn, ping);
+    ch_wr_process_queues(conn);
+    return 1;
 }
 
 // .. c:function::
@@ -509,7 +1271,6 @@ ch_wr_init(ch_writer_t* writer, ch_connection_t* conn)
     ch_chirp_t* chirp = conn->chirp;
     A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
     ch_chirp_int_t* ichirp = chirp->_;
-    uv_mutex_init(&writer->lock);
     tmp_err = uv_timer_init(ichirp->loop, &writer->send_timeout);
     if(tmp_err != CH_SUCCESS) {
         E(
@@ -521,3 +1282,116 @@ ch_wr_init(ch_writer_t* writer, ch_connection_t* conn)
     }
     writer->send_timeout.data = conn;
 }
+
+// .. c:function::
+void
+ch_wr_process_queues(ch_connection_t* conn)
+//    :noindex:
+//
+//    see: :c:func:`ch_wr_process_queues`
+//
+// .. code-block:: cpp
+//
+{
+    ch_message_t* msg;
+    ch_writer_t* writer = &conn->writer;
+    if(
+            conn->flags & (CH_CN_SHUTTING_DOWN | CH_CN_TLS_HANDSHAKE) ||
+            writer->flags & CH_WR_WRITING
+    )
+        return;
+    if(writer->flags & CH_WR_HANDSHAKE) {
+        writer->flags &= ~CH_WR_HANDSHAKE;
+        writer->flags |= CH_WR_WRITING;
+        ch_cn_write(
+            conn,
+            &conn->reader.hs,
+            sizeof(ch_rd_handshake_t),
+            _ch_wr_handshake_cb
+        );
+        return;
+    }
+    if(!(conn->flags & CH_CN_CONNECTED))
+        return;
+    if(writer->ack_head != NULL) {
+        ch_msg_message_t* ack_msg = &writer->ack_msg;
+        msg = writer->ack_head;
+        writer->ack_head = msg->_next;
+        if(writer->ack_head == NULL)
+            writer->ack_tail = NULL;
+        writer->ack = msg;
+        writer->flags |= CH_WR_WRITING;
+        if(conn->flags & CH_CN_COMPACT) {
+            ch_cn_write(
+                conn,
+                writer->ack_frame,
+                ch_wi_encode(
+                    &writer->identities,
+                    msg,
+                    CH_MSG_ACK,
+                    writer->ack_frame
+                ),
+                _ch_wr_ack_cb
+            );
+            return;
+        }
+        memset(ack_msg, 0, sizeof(ch_msg_message_t));
+        memcpy(ack_msg->serial, msg->serial, sizeof(ack_msg->serial));
+        memcpy(ack_msg->identity, msg->identity, sizeof(ack_msg->identity));
+        ack_msg->message_type = CH_MSG_ACK;
+        ch_cn_write(
+            conn,
+            ack_msg,
+            sizeof(ch_msg_message_t),
+            _ch_wr_ack_cb
+        );
+        return;
+    }
+    if(writer->msg == NULL && writer->queue_head != NULL) {
+        msg = writer->queue_head;
+        /* Without credit the message stays queued until an ack arrives. */
+        if(writer->credits == 0 && _ch_wr_req_ack(conn->chirp->_, msg))
+            return;
+        writer->queue_head = msg->_next;
+        if(writer->queue_head == NULL)
+            writer->queue_tail = NULL;
+        _ch_wr_send(conn, msg);
+    }
+}
+
+// .. c:function::
+void
+ch_wr_send_ack(ch_connection_t* conn, ch_message_t* msg)
+//    :noindex:
+//
+//    see: :c:func:`ch_wr_send_ack`
+//
+// .. code-block:: cpp
+//
+{
+    ch_writer_t* writer = &conn->writer;
+    msg->_next = NULL;
+    if(writer->ack_tail == NULL)
+        writer->ack_head = msg;
+    else
+        writer->ack_tail->_next = msg;
+    writer->ack_tail = msg;
+    ch_wr_process_queues(conn);
+}
+
+// .. c:function::
+void
+ch_wr_set_credits(ch_connection_t* conn, uint16_t credits)
+//    :noindex:
+//
+//    see: :c:func:`ch_wr_set_credits`
+//
+// .. code-block:: cpp
+//
+{
+    ch_writer_t* writer = &conn->writer;
+    if(!conn->chirp->_->config.FLOW_CONTROL || credits == 0)
+        credits = 1;
+    writer->credits     = credits;
+    writer->max_credits = credits;
+}
@@ -18,6 +18,7 @@
 #include "common.h"
 #include "libchirp/callbacks.h"
 #include "libchirp/message.h"
+#include "wire.h"
 
 // Declarations
 // ============
@@ -30,31 +31,100 @@ struct ch_connection_s;
 // Direct declarations
 // -------------------
 
+// .. c:macro:: CH_WR_MIN_TIMEOUT
+//
+//    Lower bound (ms) of the adaptive send timeout, see
+//    :c:member:`ch_writer_t.srtt`.
+//
+// .. c:macro:: CH_WR_BW_MIN
+//
+//    Messages smaller than this (bytes) are written into the socket buffer
+//    at once, so they don't sample the throughput.
+//
+// .. code-block:: cpp
+//
+#define CH_WR_MIN_TIMEOUT 1000
+#define CH_WR_BW_MIN (64 * 1024)
+
+// .. c:type:: ch_wr_flags_t
+//
+//    Flags of the writer.
+//
+//    .. c:member:: CH_WR_WRITING
+//
+//       A write is running on the connection, the next one has to wait.
+//
+//    .. c:member:: CH_WR_HANDSHAKE
+//
+//       The chirp handshake of the reader has to be written.
+//
+//    .. c:member:: CH_WR_ACKED
+//
+//       The ack arrived before the write callback of the message.
+//
+//    .. c:member:: CH_WR_PING
+//
+//       :c:member:`ch_writer_t.ping` is queued or being written.
+//
+// .. code-block:: cpp
+//
+typedef enum {
+    CH_WR_WRITING   = 1 << 0,
+    CH_WR_HANDSHAKE = 1 << 1,
+    CH_WR_ACKED     = 1 << 2,
+    CH_WR_PING      = 1 << 3,
+} ch_wr_flags_t;
+
 // .. c:type:: ch_writer_t
 //
 //    The chirp protocol writer data strcture.
 //
-//    .. c:member:: ch_send_cb_t send_cb
-//
-//       Callback that will be called upon successful sending of a message.
+//    Messages to a node are queued on the writer of its connection. The
+//    writer writes one message at a time. Written messages wait for their
+//    ack in the in-flight list, while the writer continues with the next
+//    message as long as the remote has credits left. Acks of received
+//    messages are sent between the messages, so both sides can send at the
+//    same time.
 //
 //    .. c:member:: uv_timer_t send_timeout
 //
 //       Libuv timer handle for setting a timeout when trying to send a
-//       message. At the end of the defined timeout time, the timer triggers
-//       the :c:func:`_ch_wr_send_timeout_cb` callback.
+//       message or to connect. At the end of the defined timeout time, the
+//       timer triggers the :c:func:`_ch_wr_send_timeout_cb` callback.
+//
+//    .. c:member:: ch_message_t* msg
 //
-//    .. c:member:: uv_mutex_t lock
+//       The message being written, NULL if the writer is idle.
 //
-//       Mutex acting as lock. The mutex is locked when a writer is initialized
-//       or when a writer is trying to send a message. It is unlocked when
-//       sending is finished, when an error during sending happened or when
-//       sending runs into a timeout.
+//    .. c:member:: ch_message_t* queue_head
 //
-//    .. c:member:: ch_message_t* msg
+//       First message waiting to be sent, linked by
+//       :c:member:`ch_message_t._next`.
+//
+//    .. c:member:: ch_message_t* queue_tail
+//
+//       Last message waiting to be sent.
+//
+//    .. c:member:: ch_message_t* wait_head
+//
+//       First message written and waiting for its ack.
+//
+//    .. c:member:: ch_message_t* wait_tail
+//
+//       Last message written and waiting for its ack.
+//
+//    .. c:member:: ch_message_t* ack_head
+//
+//       First received message waiting for its ack to be sent.
+//
+//    .. c:member:: ch_message_t* ack_tail
 //
-//       Pointer to a message. The message is set when sending through
-//       :c:func:`_ch_wr_send` and being read again during the callbacks.
+//       Last received message waiting for its ack to be sent.
+//
+//    .. c:member:: ch_message_t* ack
+//
+//       Received message whose ack is being written. Its handler buffer is
+//       released after the write.
 //
 //    .. c:member:: ch_msg_message_t net_msg
 //
@@ -68,32 +138,144 @@ struct ch_connection_s;
 //       essentially only the identity, the serial number, the message type and
 //       the lengths of the header, the actor and the data.
 //
+//    .. c:member:: ch_msg_message_t ack_msg
+//
+//       The net message of the ack being written.
+//
+//    .. c:member:: uint8_t frame[CH_WI_MAX]
+//
+//       The compact frame of ``msg``, used instead of ``net_msg`` if the
+//       connection is compact, see :c:type:`ch_wi_table_t`.
+//
+//    .. c:member:: uint8_t ack_frame[CH_WI_MAX]
+//
+//       The compact frame of the ack being written.
+//
+//    .. c:member:: ch_wi_table_t identities
+//
+//       Identities sent in compact frames.
+//
+//    .. c:member:: ch_message_t ping
+//
+//       Message used to send pings and pongs of the watcher, see
+//       :c:func:`ch_wr_ping`.
+//
+//    .. c:member:: uint64_t stamp
+//
+//       Start (uv_hrtime) of the current stage of sending, see
+//       :c:type:`ch_hg_stage_t`. After the last write it is copied to
+//       :c:member:`ch_message_t._stamp`, the start of the acknowledge round
+//       trip.
+//
+//    .. c:member:: float srtt
+//
+//       Smoothed round trip time (ms) from the last write of a message to its
+//       ack, zero until the first ack. The send timeout is ``srtt + 4 *
+//       rttvar`` plus twice the transfer time of the message at
+//       ``bandwidth``, between :c:macro:`CH_WR_MIN_TIMEOUT` and
+//       :c:member:`ch_config_t.TIMEOUT`. Without estimates it is ``TIMEOUT``.
+//
+//    .. c:member:: float rttvar
+//
+//       Smoothed deviation (ms) of the round trip time.
+//
+//    .. c:member:: float bandwidth
+//
+//       Smoothed write throughput (bytes per ms) of messages of at least
+//       :c:macro:`CH_WR_BW_MIN` bytes, zero until the first sample.
+//
+//    .. c:member:: uint16_t credits
+//
+//       Count of messages requiring an ack the writer may still send before
+//       it has to wait for an ack. Initialized by the handshake of the
+//       remote, see :c:func:`ch_wr_set_credits`.
+//
+//    .. c:member:: uint16_t max_credits
+//
+//       The credits granted by the handshake.
+//
+//    .. c:member:: uint8_t flags
+//
+//       See :c:type:`ch_wr_flags_t`.
+//
 // .. code-block:: cpp
 //
 typedef struct ch_writer_s {
-    ch_send_cb_t     send_cb;
     uv_timer_t       send_timeout;
-    uv_mutex_t       lock;
     ch_message_t*    msg;
+    ch_message_t*    queue_head;
+    ch_message_t*    queue_tail;
+    ch_message_t*    wait_head;
+    ch_message_t*    wait_tail;
+    ch_message_t*    ack_head;
+    ch_message_t*    ack_tail;
+    ch_message_t*    ack;
     ch_msg_message_t net_msg;
+    ch_msg_message_t ack_msg;
+    uint8_t          frame[CH_WI_MAX];
+    uint8_t          ack_frame[CH_WI_MAX];
+    ch_wi_table_t    identities;
+    ch_message_t     ping;
+    uint64_t         stamp;
+    float            srtt;
+    float            rttvar;
+    float            bandwidth;
+    uint16_t         credits;
+    uint16_t         max_credits;
+    uint8_t          flags;
 } ch_writer_t;
 
 // .. c:function::
-static
-ch_inline
 void
-ch_wr_free(ch_writer_t* writer)
+ch_wr_abort(struct ch_connection_s* conn, int status);
 //
-//    Free the writer data structure. This means essentially destroying the
-//    muteck on the writers lock attribute :c:member:`ch_writer_t.lock`.
+//    Fail the current, the in-flight and the queued messages of a connection
+//    that is shut down, and drop the acks that can't be sent anymore. The
+//    connection must already be removed from the connections of the
+//    protocol, so the send callbacks can retry on a new connection.
 //
-//    :param ch_writer_t* writer: Pointer to writer (data-) structure.
+//    :param ch_connection_t* conn: Connection shut down.
+//    :param int status:            Status passed to the send callbacks.
+
+// .. c:function::
+void
+ch_wr_ack_received(struct ch_connection_s* conn, uint8_t serial[16]);
 //
-// .. code-block:: cpp
+//    The remote acknowledged the message with the given serial. The message
+//    is done and its credit is returned.
+//
+//    :param ch_connection_t* conn: Connection the ack was received on.
+//    :param uint8_t[16] serial:    Serial of the acknowledged message.
+
+// .. c:function::
+void
+ch_wr_enqueue(struct ch_chirp_s* chirp, ch_message_t* msg);
+//
+//    Queue the message on the connection to its recipient, connecting if
+//    needed. Fails the message if chirp is closing, overloaded or the breaker
+//    of the recipient is open, see :c:func:`ch_ry_is_open`. Used by
+//    :c:func:`ch_chirp_send` and for retries, so the serial and the send
+//    callback must be set.
 //
-{
-    uv_mutex_destroy(&writer->lock);
-}
+//    :param ch_chirp_t* chirp: Pointer to a chirp instance.
+//    :param ch_message_t* msg: The message to send.
+
+// .. c:function::
+int
+ch_wr_ping(struct ch_connection_s* conn, uint8_t message_type);
+//
+//    Queue a ping or pong behind the pending messages. A sender that gets
+//    no acks (:c:member:`ch_config_t.ACKNOWLEDGE` off) only hears from the
+//    peer through pongs, so pings must not wait for an idle writer. If a
+//    ping or pong is already queued, it serves as heartbeat for the peer and
+//    nothing is queued.
+//
+//    :param ch_connection_t* conn: Connection to send the ping over.
+//    :param uint8_t message_type:  :c:member:`ch_msg_types_t.CH_MSG_PING` or
+//                                  :c:member:`ch_msg_types_t.CH_MSG_PONG`.
+//
+//    :return: 1 if the ping was queued, 0 otherwise.
+//    :rtype:  int
 
 // .. c:function::
 void
@@ -101,11 +283,42 @@ ch_wr_init(ch_writer_t* writer, struct ch_connection_s* conn);
 //
 //    Initialize the writer data structure.
 //
-//    Initializes the writers mutex and the libuv timer for handling timeouts
-//    when sending. The connection gets set as data pointer for the sending
-//    timeout.
+//    Initializes the libuv timer for handling timeouts when sending. The
+//    connection gets set as data pointer for the sending timeout.
 //
 //    :param ch_chirp_t* chirp:      Pointer to a chirp instance.
 //    :param ch_connection_t* conn:  Pointer to a connection instance.
 
+// .. c:function::
+void
+ch_wr_process_queues(struct ch_connection_s* conn);
+//
+//    Start the next write if the connection is idle: the handshake first,
+//    then the acks and then the next message, if the remote has credits
+//    left.
+//
+//    :param ch_connection_t* conn: Connection to write to.
+
+// .. c:function::
+void
+ch_wr_send_ack(struct ch_connection_s* conn, ch_message_t* msg);
+//
+//    Queue the ack of a received message. The handler buffer of the message
+//    is released after the ack has been written.
+//
+//    :param ch_connection_t* conn: Connection the message was received on.
+//    :param ch_message_t* msg:     The message received.
+
+// .. c:function::
+void
+ch_wr_set_credits(struct ch_connection_s* conn, uint16_t credits);
+//
+//    Set the credits granted by the handshake of the remote. With
+//    :c:member:`ch_config_t.FLOW_CONTROL` the writer sends up to **credits**
+//    messages before waiting for an ack, otherwise (or if the remote granted
+//    none) it waits for the ack of every message.
+//
+//    :param ch_connection_t* conn: Connection the handshake was received on.
+//    :param uint16_t credits:      Credits granted by the remote.
+
 #endif //ch_writer_h